@@ -78,6 +78,39 @@ void ASIC_set_job_difficulty_mask(GlobalState * GLOBAL_STATE, uint8_t mask)
     }
 }
 
+uint8_t ASIC_get_job_packet_len(GlobalState * GLOBAL_STATE)
+{
+    switch (GLOBAL_STATE->DEVICE_CONFIG.family.asic.model) {
+        case BM1397:
+            return sizeof(job_packet) + JOB_PACKET_OVERHEAD;
+        case BM1366:
+            return sizeof(BM1366_job) + JOB_PACKET_OVERHEAD;
+        case BM1368:
+            return sizeof(BM1368_job) + JOB_PACKET_OVERHEAD;
+        case BM1370:
+            return sizeof(BM1370_job) + JOB_PACKET_OVERHEAD;
+    }
+    return 0;
+}
+
+void ASIC_serialize_job(GlobalState * GLOBAL_STATE, bm_job * job)
+{
+    switch (GLOBAL_STATE->DEVICE_CONFIG.family.asic.model) {
+        case BM1397:
+            BM1397_serialize_job(job);
+            break;
+        case BM1366:
+            BM1366_serialize_job(job);
+            break;
+        case BM1368:
+            BM1368_serialize_job(job);
+            break;
+        case BM1370:
+            BM1370_serialize_job(job);
+            break;
+    }
+}
+
 void ASIC_send_work(GlobalState * GLOBAL_STATE, void * next_job)
 {
     switch (GLOBAL_STATE->DEVICE_CONFIG.family.asic.model) {
@@ -159,3 +192,39 @@ double ASIC_get_asic_job_frequency_ms(GlobalState * GLOBAL_STATE)
     }
     return 500;
 }
+
+void ASIC_set_active_job(GlobalState * GLOBAL_STATE, uint8_t job_id, bm_job * job)
+{
+    // a result task still using the previous job holds its own reference
+    free_bm_job(atomic_exchange(&GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id], job));
+}
+
+bm_job * ASIC_get_active_job(GlobalState * GLOBAL_STATE, uint8_t job_id)
+{
+    if (job_id >= MAX_ACTIVE_JOBS) {
+        return NULL;
+    }
+
+    _Atomic(bm_job *) * slot = &GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id];
+    bm_job * job;
+    while (1) {
+        job = atomic_load(slot);
+        if (job == NULL) {
+            return NULL;
+        }
+        // the slot keeps its job referenced, so this only fails or finds a different job in the slot
+        // when the job was replaced in between, then the replacement is looked up instead
+        if (bm_job_try_ref(job)) {
+            if (atomic_load(slot) == job) {
+                break;
+            }
+            free_bm_job(job);
+        }
+    }
+
+    if (job->generation != atomic_load(&GLOBAL_STATE->sessions[job->session].work_generation)) {
+        free_bm_job(job);
+        return NULL;
+    }
+    return job;
+}
@@ -2,6 +2,7 @@
 
 #include "crc.h"
 #include "global_state.h"
+#include "asic.h"
 #include "serial.h"
 #include "utils.h"
 
@@ -70,6 +71,8 @@ static const char * TAG = "bm1366Module";
 
 static task_result result;
 
+static crc16_byte_change job_id_crc;
+
 /// @brief
 /// @param ftdi
 /// @param header
@@ -329,6 +332,8 @@ uint8_t BM1366_init(uint64_t frequency, uint16_t asic_count, uint16_t difficulty
 {
     ESP_LOGI(TAG, "Initializing BM1366");
 
+    crc16_byte_change_init(&job_id_crc, sizeof(BM1366_job) - 1);
+
     esp_rom_gpio_pad_select_gpio(GPIO_ASIC_RESET);
     gpio_set_direction(GPIO_ASIC_RESET, GPIO_MODE_OUTPUT);
 
@@ -388,38 +393,38 @@ void BM1366_set_job_difficulty_mask(int difficulty)
 
 static uint8_t id = 0;
 
+void BM1366_serialize_job(bm_job * job)
+{
+    uint8_t * packet = bm_job_packet(job);
+    BM1366_job * data = (BM1366_job *) (packet + JOB_PACKET_DATA_OFFSET);
+    data->job_id = 0;
+    data->num_midstates = 0x01;
+    memcpy(&data->starting_nonce, &job->starting_nonce, 4);
+    memcpy(&data->nbits, &job->target, 4);
+    memcpy(&data->ntime, &job->ntime, 4);
+    memcpy(data->merkle_root, job->merkle_root_be, 32);
+    memcpy(data->prev_block_hash, job->prev_block_hash_be, 32);
+    memcpy(&data->version, &job->version, 4);
+
+    job->packet_len = frame_job_packet(packet, TYPE_JOB | GROUP_SINGLE | CMD_WRITE, sizeof(BM1366_job));
+}
+
 void BM1366_send_work(void * pvParameters, bm_job * next_bm_job)
 {
 
     GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
 
-    BM1366_job job;
     id = (id + 8) % 128;
-    job.job_id = id;
-    job.num_midstates = 0x01;
-    memcpy(&job.starting_nonce, &next_bm_job->starting_nonce, 4);
-    memcpy(&job.nbits, &next_bm_job->target, 4);
-    memcpy(&job.ntime, &next_bm_job->ntime, 4);
-    memcpy(job.merkle_root, next_bm_job->merkle_root_be, 32);
-    memcpy(job.prev_block_hash, next_bm_job->prev_block_hash_be, 32);
-    memcpy(&job.version, &next_bm_job->version, 4);
-
-    if (GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job.job_id] != NULL) {
-        free_bm_job(GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job.job_id]);
-    }
-
-    GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job.job_id] = next_bm_job;
+    set_job_packet_id(bm_job_packet(next_bm_job), next_bm_job->packet_len, id, &job_id_crc);
 
-    pthread_mutex_lock(&GLOBAL_STATE->valid_jobs_lock);
-    GLOBAL_STATE->valid_jobs[job.job_id] = 1;
-    pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
+    ASIC_set_active_job(GLOBAL_STATE, id, next_bm_job);
 
     //debug sent jobs - this can get crazy if the interval is short
     #if BM1366_DEBUG_JOBS
-    ESP_LOGI(TAG, "Send Job: %02X", job.job_id);
+    ESP_LOGI(TAG, "Send Job: %02X", id);
     #endif
 
-    _send_BM1366((TYPE_JOB | GROUP_SINGLE | CMD_WRITE), (uint8_t *)&job, sizeof(BM1366_job), BM1366_DEBUG_WORK);
+    SERIAL_send(bm_job_packet(next_bm_job), next_bm_job->packet_len, BM1366_DEBUG_WORK);
 }
 
 task_result * BM1366_process_work(void * pvParameters)
@@ -438,12 +443,14 @@ task_result * BM1366_process_work(void * pvParameters)
 
     GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
 
-    if (GLOBAL_STATE->valid_jobs[job_id] == 0) {
+    bm_job * active_job = ASIC_get_active_job(GLOBAL_STATE, job_id);
+    if (active_job == NULL) {
         ESP_LOGW(TAG, "Invalid job found, 0x%02X", job_id);
         return NULL;
     }
 
-    uint32_t rolled_version = GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->version | version_bits;
+    uint32_t rolled_version = active_job->version | version_bits;
+    free_bm_job(active_job);
 
     result.job_id = job_id;
     result.nonce = asic_result.nonce;
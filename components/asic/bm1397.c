@@ -15,6 +15,7 @@
 #include "crc.h"
 #include "mining.h"
 #include "global_state.h"
+#include "asic.h"
 
 #define BM1397_CHIP_ID 0x1397
 #define BM1397_CHIP_ID_RESPONSE_LENGTH 9
@@ -67,6 +68,8 @@ static const char *TAG = "bm1397Module";
 static uint32_t prev_nonce = 0;
 static task_result result;
 
+static crc16_byte_change job_id_crc;
+
 /// @brief
 /// @param ftdi
 /// @param header
@@ -293,6 +296,8 @@ uint8_t BM1397_init(uint64_t frequency, uint16_t asic_count, uint16_t difficulty
 {
     ESP_LOGI(TAG, "Initializing BM1397");
 
+    crc16_byte_change_init(&job_id_crc, sizeof(job_packet) - 1);
+
     esp_rom_gpio_pad_select_gpio(GPIO_ASIC_RESET);
     gpio_set_direction(GPIO_ASIC_RESET, GPIO_MODE_OUTPUT);
 
@@ -353,47 +358,51 @@ void BM1397_set_job_difficulty_mask(int difficulty)
 
 static uint8_t id = 0;
 
+void BM1397_serialize_job(bm_job *job)
+{
+    uint8_t *packet = bm_job_packet(job);
+    job_packet *data = (job_packet *)(packet + JOB_PACKET_DATA_OFFSET);
+    data->job_id = 0;
+    data->num_midstates = job->num_midstates;
+    memcpy(&data->starting_nonce, &job->starting_nonce, 4);
+    memcpy(&data->nbits, &job->target, 4);
+    memcpy(&data->ntime, &job->ntime, 4);
+    memcpy(&data->merkle4, job->merkle_root + 28, 4);
+    memcpy(data->midstate, job->midstate, 32);
+
+    if (data->num_midstates == 4)
+    {
+        memcpy(data->midstate1, job->midstate1, 32);
+        memcpy(data->midstate2, job->midstate2, 32);
+        memcpy(data->midstate3, job->midstate3, 32);
+    }
+    else
+    {
+        memset(data->midstate1, 0, 32);
+        memset(data->midstate2, 0, 32);
+        memset(data->midstate3, 0, 32);
+    }
+
+    job->packet_len = frame_job_packet(packet, TYPE_JOB | GROUP_SINGLE | CMD_WRITE, sizeof(job_packet));
+}
+
 void BM1397_send_work(void *pvParameters, bm_job *next_bm_job)
 {
     GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
 
-    job_packet job;
     // max job number is 128
     // there is still some really weird logic with the job id bits for the asic to sort out
     // so we have it limited to 128 and it has to increment by 4
     id = (id + 4) % 128;
+    set_job_packet_id(bm_job_packet(next_bm_job), next_bm_job->packet_len, id, &job_id_crc);
 
-    job.job_id = id;
-    job.num_midstates = next_bm_job->num_midstates;
-    memcpy(&job.starting_nonce, &next_bm_job->starting_nonce, 4);
-    memcpy(&job.nbits, &next_bm_job->target, 4);
-    memcpy(&job.ntime, &next_bm_job->ntime, 4);
-    memcpy(&job.merkle4, next_bm_job->merkle_root + 28, 4);
-    memcpy(job.midstate, next_bm_job->midstate, 32);
-
-    if (job.num_midstates == 4)
-    {
-        memcpy(job.midstate1, next_bm_job->midstate1, 32);
-        memcpy(job.midstate2, next_bm_job->midstate2, 32);
-        memcpy(job.midstate3, next_bm_job->midstate3, 32);
-    }
-
-    if (GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job.job_id] != NULL)
-    {
-        free_bm_job(GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job.job_id]);
-    }
-
-    GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job.job_id] = next_bm_job;
-
-    pthread_mutex_lock(&GLOBAL_STATE->valid_jobs_lock);
-    GLOBAL_STATE->valid_jobs[job.job_id] = 1;
-    pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
+    ASIC_set_active_job(GLOBAL_STATE, id, next_bm_job);
 
     #if BM1397_DEBUG_JOBS
-    ESP_LOGI(TAG, "Send Job: %02X", job.job_id);
+    ESP_LOGI(TAG, "Send Job: %02X", id);
     #endif
 
-    _send_BM1397((TYPE_JOB | GROUP_SINGLE | CMD_WRITE), (uint8_t *)&job, sizeof(job_packet), BM1397_DEBUG_WORK);
+    SERIAL_send(bm_job_packet(next_bm_job), next_bm_job->packet_len, BM1397_DEBUG_WORK);
 }
 
 task_result *BM1397_process_work(void *pvParameters)
@@ -411,17 +420,19 @@ task_result *BM1397_process_work(void *pvParameters)
     uint8_t rx_midstate_index = asic_result.job_id & 0x03;
 
     GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
-    if (GLOBAL_STATE->valid_jobs[rx_job_id] == 0)
+    bm_job *active_job = ASIC_get_active_job(GLOBAL_STATE, rx_job_id);
+    if (active_job == NULL)
     {
         ESP_LOGW(TAG, "Invalid job nonce found, id=%d", rx_job_id);
         return NULL;
     }
 
-    uint32_t rolled_version = GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[rx_job_id]->version;
+    uint32_t rolled_version = active_job->version;
     for (int i = 0; i < rx_midstate_index; i++)
     {
-        rolled_version = increment_bitmask(rolled_version, GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[rx_job_id]->version_mask);
+        rolled_version = increment_bitmask(rolled_version, active_job->version_mask);
     }
+    free_bm_job(active_job);
 
     // ASIC may return the same nonce multiple times
     // or one that was already found
@@ -125,4 +125,29 @@ esp_err_t receive_work(uint8_t * buffer, int buffer_size)
     }
 
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+uint8_t frame_job_packet(uint8_t * packet, uint8_t header, uint8_t data_len)
+{
+    packet[0] = 0x55;
+    packet[1] = 0xAA;
+    packet[2] = header;
+    packet[3] = data_len + 4;
+
+    uint16_t crc = crc16_false(packet + 2, data_len + 2);
+    packet[4 + data_len] = (crc >> 8) & 0xFF;
+    packet[5 + data_len] = crc & 0xFF;
+
+    return data_len + JOB_PACKET_OVERHEAD;
+}
+
+void set_job_packet_id(uint8_t * packet, uint8_t packet_len, uint8_t job_id, const crc16_byte_change * id_change)
+{
+    uint8_t * crc_bytes = packet + packet_len - 2;
+    uint16_t crc = (crc_bytes[0] << 8) | crc_bytes[1];
+
+    crc = crc16_byte_change_apply(id_change, crc, packet[JOB_PACKET_DATA_OFFSET], job_id);
+    packet[JOB_PACKET_DATA_OFFSET] = job_id;
+    crc_bytes[0] = (crc >> 8) & 0xFF;
+    crc_bytes[1] = crc & 0xFF;
+}
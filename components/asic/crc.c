@@ -54,3 +54,28 @@ uint16_t crc16_false(uint8_t *data, uint16_t len)
     return crc;
 }
 
+// The crc is linear, changing a byte xors it with the crc (starting from 0) of the change followed
+// by as many zero bytes as come after it. That is worked out once per bit for a fixed position.
+void crc16_byte_change_init(crc16_byte_change *change, uint16_t bytes_after)
+{
+    for (int bit = 0; bit < 8; bit++) {
+        uint16_t crc = crc16_table[1 << bit];
+        for (uint16_t i = 0; i < bytes_after; i++) {
+            crc = crc16_table[crc >> 8] ^ (crc << 8);
+        }
+        change->bits[bit] = crc;
+    }
+}
+
+uint16_t crc16_byte_change_apply(const crc16_byte_change *change, uint16_t crc, uint8_t old_byte, uint8_t new_byte)
+{
+    uint8_t diff = old_byte ^ new_byte;
+
+    for (int bit = 0; diff != 0; bit++, diff >>= 1) {
+        if (diff & 1) {
+            crc ^= change->bits[bit];
+        }
+    }
+
+    return crc;
+}
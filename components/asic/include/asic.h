@@ -9,9 +9,23 @@ uint8_t ASIC_init(GlobalState * GLOBAL_STATE);
 task_result * ASIC_process_work(GlobalState * GLOBAL_STATE);
 int ASIC_set_max_baud(GlobalState * GLOBAL_STATE);
 void ASIC_set_job_difficulty_mask(GlobalState * GLOBAL_STATE, uint8_t mask);
+/// @brief Length of the framed job command, the storage bm_job_pool_init() reserves per job.
+uint8_t ASIC_get_job_packet_len(GlobalState * GLOBAL_STATE);
+/// @brief Builds the job command into bm_job_packet(job), done when the job is created to keep it off the ASIC task.
+/// The job has to come from the pool.
+void ASIC_serialize_job(GlobalState * GLOBAL_STATE, bm_job * job);
+/// @brief Sets the id of a job serialized by ASIC_serialize_job() and writes it to the UART.
 void ASIC_send_work(GlobalState * GLOBAL_STATE, void * next_job);
 void ASIC_set_version_mask(GlobalState * GLOBAL_STATE, uint32_t mask);
 bool ASIC_set_frequency(GlobalState * GLOBAL_STATE, float target_frequency);
 double ASIC_get_asic_job_frequency_ms(GlobalState * GLOBAL_STATE);
 
+/// @brief Puts a job into its slot, taking over the caller's reference, and releases the job it replaces.
+void ASIC_set_active_job(GlobalState * GLOBAL_STATE, uint8_t job_id, bm_job * job);
+
+/// @brief Looks up the job an ASIC result belongs to without locking.
+/// @return a referenced job, release it with free_bm_job(). NULL if the slot is empty or the job
+/// is from an older work generation
+bm_job * ASIC_get_active_job(GlobalState * GLOBAL_STATE, uint8_t job_id);
+
 #endif // ASIC_H
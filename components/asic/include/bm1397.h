@@ -25,6 +25,7 @@ typedef struct __attribute__((__packed__))
 } job_packet;
 
 uint8_t BM1397_init(uint64_t frequency, uint16_t asic_count, uint16_t difficulty);
+void BM1397_serialize_job(bm_job * job);
 void BM1397_send_work(void * GLOBAL_STATE, bm_job * next_bm_job);
 void BM1397_set_job_difficulty_mask(int);
 void BM1397_set_version_mask(uint32_t version_mask);
@@ -3,6 +3,11 @@
 
 #include <stdint.h>
 #include "esp_err.h"
+#include "crc.h"
+
+// Job commands go out as 0x55 0xAA, header, length, the job data starting with its id and a crc16
+#define JOB_PACKET_DATA_OFFSET 4
+#define JOB_PACKET_OVERHEAD 6
 
 typedef struct __attribute__((__packed__))
 {
@@ -17,4 +22,13 @@ int _largest_power_of_two(int num);
 int count_asic_chips(uint16_t asic_count, uint16_t chip_id, int chip_id_response_length);
 esp_err_t receive_work(uint8_t * buffer, int buffer_size);
 
+/// @brief Frames the job data already written at packet + JOB_PACKET_DATA_OFFSET.
+/// @return the length of the whole packet
+uint8_t frame_job_packet(uint8_t * packet, uint8_t header, uint8_t data_len);
+
+/// @brief Sets the id of a framed job packet, its crc is patched instead of computed over the packet again.
+/// The id is the only byte of a job packet that differs at dispatch, so each driver keeps a single id_change.
+/// @param id_change made with crc16_byte_change_init() for the bytes after the id
+void set_job_packet_id(uint8_t * packet, uint8_t packet_len, uint8_t job_id, const crc16_byte_change * id_change);
+
 #endif /* COMMON_H_ */
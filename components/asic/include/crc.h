@@ -38,9 +38,18 @@ static const uint16_t crc16_table[256] = {
 	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
 };
 
+// How the crc16_false of a message changes with the bits of one of its bytes
+typedef struct
+{
+    uint16_t bits[8];
+} crc16_byte_change;
+
 uint8_t crc5(uint8_t *data, uint8_t len);
 uint16_t crc16(uint8_t *data, uint16_t len);
 uint16_t crc16_false(uint8_t *data, uint16_t len);
 
+void crc16_byte_change_init(crc16_byte_change *change, uint16_t bytes_after);
+uint16_t crc16_byte_change_apply(const crc16_byte_change *change, uint16_t crc, uint8_t old_byte, uint8_t new_byte);
+
 
 #endif /* INC_CRC_H_ */
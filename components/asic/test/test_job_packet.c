@@ -0,0 +1,46 @@
+#include "unity.h"
+
+#include "common.h"
+#include "crc.h"
+
+#include <string.h>
+
+static void fill(uint8_t *data, uint8_t len, uint32_t seed)
+{
+    for (int i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+}
+
+TEST_CASE("Job packet ids are patched into the crc", "[asic]")
+{
+    // the data of the BM1366/BM1368/BM1370 and the BM1397 jobs
+    const uint8_t data_lens[] = {82, 146};
+
+    for (int l = 0; l < sizeof(data_lens); l++) {
+        uint8_t data_len = data_lens[l];
+        crc16_byte_change id_change;
+        crc16_byte_change_init(&id_change, data_len - 1);
+
+        uint8_t packet[152];
+        fill(packet + JOB_PACKET_DATA_OFFSET, data_len, l);
+        packet[JOB_PACKET_DATA_OFFSET] = 0;
+        uint8_t packet_len = frame_job_packet(packet, 0x21, data_len);
+        TEST_ASSERT_EQUAL_UINT8(data_len + JOB_PACKET_OVERHEAD, packet_len);
+        TEST_ASSERT_EQUAL_UINT8(0x55, packet[0]);
+        TEST_ASSERT_EQUAL_UINT8(0xAA, packet[1]);
+        TEST_ASSERT_EQUAL_UINT8(0x21, packet[2]);
+        TEST_ASSERT_EQUAL_UINT8(data_len + 4, packet[3]);
+
+        // ids are patched over each other, the packet is only framed once
+        for (int id = 0; id < 256; id++) {
+            set_job_packet_id(packet, packet_len, id, &id_change);
+            TEST_ASSERT_EQUAL_UINT8(id, packet[JOB_PACKET_DATA_OFFSET]);
+
+            uint16_t crc = crc16_false(packet + 2, data_len + 2);
+            TEST_ASSERT_EQUAL_UINT8(crc >> 8, packet[packet_len - 2]);
+            TEST_ASSERT_EQUAL_UINT8(crc & 0xFF, packet[packet_len - 1]);
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef LINE_BUFFER_H_
+#define LINE_BUFFER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-capacity framer for newline delimited streams (stratum JSON-RPC).
+// Received bytes are written straight into the buffer, only the newly received
+// bytes are scanned for '\n' and complete lines are handed out in place.
+typedef struct
+{
+    char * buffer;
+    size_t capacity;
+    // [head, tail) holds received but not yet consumed bytes
+    size_t head;
+    size_t tail;
+    // [head, scan) is known not to contain a '\n'
+    size_t scan;
+    // set while dropping the rest of a line that did not fit into the buffer
+    bool discarding;
+    // number of lines dropped because they exceeded the capacity
+    uint32_t overflows;
+} line_buffer;
+
+bool line_buffer_init(line_buffer * lb, size_t capacity);
+void line_buffer_free(line_buffer * lb);
+void line_buffer_reset(line_buffer * lb);
+
+/// @brief Returns where the next received bytes have to be written.
+/// @param available set to the number of bytes that can be written
+char * line_buffer_write_ptr(line_buffer * lb, size_t * available);
+
+/// @brief Marks len bytes written to line_buffer_write_ptr() as received.
+void line_buffer_commit(line_buffer * lb, size_t len);
+
+/// @brief Returns the next complete line without its line terminator, or NULL.
+/// The line is NUL terminated inside the buffer and stays valid until the next
+/// call to line_buffer_write_ptr() or line_buffer_reset(). Empty lines are skipped.
+/// @param len optional, set to the length of the line
+const char * line_buffer_next_line(line_buffer * lb, size_t * len);
+
+#endif /* LINE_BUFFER_H_ */
@@ -2,6 +2,10 @@
 #define MINING_H_
 
 #include "stratum_api.h"
+#include "mbedtls/sha256.h"
+
+#define MAX_JOB_ID_LEN 63
+#define MAX_EXTRANONCE_2_LEN 16 // bytes
 
 typedef struct
 {
@@ -21,22 +25,134 @@ typedef struct
     uint8_t midstate2[32];
     uint8_t midstate3[32];
     uint32_t pool_diff;
-    char *jobid;
-    char *extranonce2;
+    hash_target pool_target;
+    hash_target network_target;
+    uint32_t generation;
+    uint8_t session;
+    int64_t notify_received_us;
+    char jobid[MAX_JOB_ID_LEN + 1];
+    char extranonce2[MAX_EXTRANONCE_2_LEN * 2 + 1];
+    // length of the job command in bm_job_packet(), framed when the job is created so only its id is set when sending
+    uint8_t packet_len;
 } bm_job;
 
+typedef struct
+{
+    size_t capacity;
+    size_t in_use;
+    size_t high_water;
+    uint32_t exhausted; // allocations that failed because every job was in use
+} bm_job_pool_stats;
+
+// Per-notify state for building the merkle root of each extranonce_2. Everything in the coinbase before
+// extranonce_2 is constant, the sha256 state of its whole 64-byte blocks is kept so only the tail is hashed per job.
+typedef struct
+{
+    uint8_t *coinbase_tx;
+    size_t coinbase_tx_len;
+    size_t extranonce_2_offset;
+    size_t extranonce_2_len;
+    size_t prefix_len;
+    mbedtls_sha256_context prefix_ctx;
+} job_template;
+
+/// @brief Allocates storage for capacity jobs once, alloc_bm_job() never touches the heap afterwards.
+/// Each job gets packet_size bytes for its ASIC job command, sized for the ASIC so smaller commands don't pay
+/// for the longest one. Calling it again is only allowed while no job is in use.
+bool bm_job_pool_init(size_t capacity, size_t packet_size);
+
+/// @return a job from the pool, NULL if the pool is exhausted or not initialized
+bm_job *alloc_bm_job(void);
+
+/// @brief Drops a reference, the job goes back to the pool with the last one. NULL is ignored.
+/// alloc_bm_job() returns a job holding one reference.
 void free_bm_job(bm_job *job);
 
-char *construct_coinbase_tx(const char *coinbase_1, const char *coinbase_2,
-                            const char *extranonce, const char *extranonce_2);
+/// @brief Takes another reference unless the job is already back in the pool. Lock-free.
+/// Pool memory always holds jobs, so it is fine to pass a pointer that may have been freed meanwhile.
+bool bm_job_try_ref(bm_job *job);
+
+/// @return the packet_size bytes of job command storage of a pool job, NULL for a job outside the pool
+uint8_t *bm_job_packet(const bm_job *job);
+
+void bm_job_pool_get_stats(bm_job_pool_stats *stats);
+
+/// @brief Lays out coinbase_1 | extranonce | extranonce_2 | coinbase_2 with the extranonce_2 bytes zeroed.
+/// @return the malloc'ed transaction, NULL if out of memory
+uint8_t *construct_coinbase_tx(const mining_notify *notify, const uint8_t *extranonce, size_t extranonce_len,
+                               size_t extranonce_2_len, size_t *coinbase_tx_len);
+
+void calculate_merkle_root_hash(const uint8_t *coinbase_tx, size_t coinbase_tx_len, const uint8_t merkle_branches[][32],
+                                const int num_merkle_branches, uint8_t *merkle_root);
+
+bool job_template_init(job_template *tmpl, const mining_notify *notify, const uint8_t *extranonce, size_t extranonce_len,
+                       size_t extranonce_2_len);
+
+void job_template_free(job_template *tmpl);
+
+/// @brief Writes extranonce_2 into the template coinbase and calculates the merkle root for it.
+void job_template_merkle_root(job_template *tmpl, const mining_notify *notify, uint32_t extranonce_2, uint8_t *merkle_root);
+
+bm_job construct_bm_job(mining_notify *params, const uint8_t *merkle_root, const uint32_t version_mask);
+
+/// @brief Sets the pool difficulty of the notify's jobs and calculates their share and block targets once.
+void mining_notify_set_difficulty(mining_notify *notify, uint32_t difficulty);
+
+/// @brief The target a hash has to meet for difficulty, 0 accepts every hash.
+void hash_target_from_difficulty(uint32_t difficulty, hash_target *target);
+
+/// @brief The block target of the compact nbits encoding.
+void hash_target_from_nbits(uint32_t nbits, hash_target *target);
+
+/// @param hash little endian, as test_nonce_hash() returns it
+bool hash_meets_target(const uint8_t *hash, const hash_target *target);
+
+// Results of a job often come back for the same rolled version, so the sha256 state after the first
+// 64 header bytes is kept per header. The second block only differs in the nonce (word 3), the rounds
+// before it and the parts of the message schedule that do not depend on it are kept too.
+#define NONCE_MIDSTATE_CACHE_SIZE 16
+
+typedef struct
+{
+    bool valid;
+    uint8_t header[76]; // everything but the nonce
+    uint32_t midstate[8];
+    uint32_t rounds_state[8]; // after rounds 0-2 of the second block
+    uint32_t w[20];           // second block schedule without the nonce terms of w[18] and w[19]
+} nonce_midstate;
+
+// Owned by the one task that verifies the nonces, it takes no lock. Zero it before the first use.
+typedef struct
+{
+    nonce_midstate entries[NONCE_MIDSTATE_CACHE_SIZE];
+} nonce_midstate_cache;
+
+/// @brief Double sha256 of the header of job with nonce and rolled_version.
+/// @param cache the caller's midstate cache, NULL hashes the first block every time
+void test_nonce_hash(nonce_midstate_cache *cache, const bm_job *job, const uint32_t nonce, const uint32_t rolled_version,
+                     uint8_t *hash);
+
+typedef struct
+{
+    bm_job *job;
+    uint32_t nonce;
+    uint32_t rolled_version;
+    uint8_t hash[32];
+} nonce_check;
+
+// checks test_nonce_hashes() sorts together, a whole ASIC share batch
+#define NONCE_CHECKS_SORTED 16
 
-char *calculate_merkle_root_hash(const char *coinbase_tx, const uint8_t merkle_branches[][32], const int num_merkle_branches);
+/// @brief test_nonce_hash() for a burst of results. The checks are visited by job and rolled version so each
+/// midstate is looked up once, and hashed SHA256_LANES at a time. The array keeps its order.
+void test_nonce_hashes(nonce_midstate_cache *cache, nonce_check *checks, size_t count);
 
-bm_job construct_bm_job(mining_notify *params, const char *merkle_root, const uint32_t version_mask);
+double hash_difficulty(const uint8_t *hash);
 
+/// @brief The difficulty of the hash of test_nonce_hash(), without a midstate cache.
 double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version);
 
-char *extranonce_2_generate(uint32_t extranonce_2, uint32_t length);
+void extranonce_2_generate(uint32_t extranonce_2, uint32_t length, uint8_t *dest);
 
 uint32_t increment_bitmask(const uint32_t value, const uint32_t mask);
 
@@ -0,0 +1,48 @@
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#include <stdint.h>
+#include "soc/soc_caps.h"
+
+// The fixed length hashes mining repeats all the time. Hashes and midstates are the big endian bytes
+// of the sha256 state, as mbedtls_sha256() writes them.
+typedef struct
+{
+    const char *name;
+    // state after one 64-byte block, no padding
+    void (*midstate)(const uint8_t *block, uint8_t *midstate);
+    // sha256(sha256(data)) of a block header and of a merkle pair
+    void (*double_80)(const uint8_t *header, uint8_t *hash);
+    void (*double_64)(const uint8_t *pair, uint8_t *hash);
+} sha256_backend;
+
+// unrolled, the padding of the fixed lengths and the message schedule of the 64-byte padding block precomputed
+extern const sha256_backend sha256_software;
+
+#if SOC_SHA_SUPPORT_RESUME
+// the SHA peripheral, shared with mbedTLS
+extern const sha256_backend sha256_hardware;
+#endif
+
+// The backend selected with CONFIG_STRATUM_SHA256_HARDWARE
+void sha256_midstate(const uint8_t *block, uint8_t *midstate);
+void sha256_double_80(const uint8_t *header, uint8_t *hash);
+void sha256_double_64(const uint8_t *pair, uint8_t *hash);
+
+// Software kernel for callers that precompute parts of a block themselves, w holds the message schedule
+extern const uint32_t sha256_iv[8];
+void sha256_soft_expand(uint32_t *w, int from);
+// rounds [from, to) on the working variables v
+void sha256_soft_rounds(uint32_t *v, const uint32_t *w, int from, int to);
+// second hash of a double sha256, digest is the state of the first
+void sha256_soft_hash_digest(const uint32_t *digest, uint8_t *hash);
+
+// The same kernel on SHA256_LANES independent messages at once, [word][lane] so every step of the rounds
+// is one loop over the lanes. The messages keep the pipeline busy where a single one waits on its own results.
+#define SHA256_LANES 4
+void sha256_soft_expand_lanes(uint32_t w[64][SHA256_LANES], int from);
+// rounds [from, 64) on the working variables v
+void sha256_soft_rounds_lanes(uint32_t v[8][SHA256_LANES], const uint32_t w[64][SHA256_LANES], int from);
+void sha256_soft_hash_digest_lanes(const uint32_t digest[8][SHA256_LANES], uint8_t hash[SHA256_LANES][32]);
+
+#endif /* SHA256_H_ */
@@ -0,0 +1,74 @@
+#ifndef SHARE_TRACKER_H_
+#define SHARE_TRACKER_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "mining.h"
+
+// Shares waiting for the pool's response, indexed by send_uid. Must be a power of two.
+#define SHARE_TRACKER_SIZE 64
+
+// Round-trip histogram with four buckets per power of two from 256 us, the last one takes everything above ~12 s
+#define SHARE_LATENCY_BUCKETS 64
+
+typedef struct
+{
+    int send_uid; // 0 while the entry is free
+    int64_t submit_us;
+    char jobid[MAX_JOB_ID_LEN + 1];
+    double nonce_diff;
+    // time from receiving the job's mining.notify to submitting the share
+    int64_t job_age_us;
+} tracked_share;
+
+// In-flight mining.submit requests, so every response can be matched to its share and timed
+typedef struct
+{
+    tracked_share in_flight[SHARE_TRACKER_SIZE];
+    uint32_t latency_histogram[SHARE_LATENCY_BUCKETS];
+    uint32_t accepted;
+    uint32_t rejected;
+    // shares that never got a response, their entry was reused or the connection was lost
+    uint32_t lost;
+    pthread_mutex_t lock;
+} share_tracker;
+
+typedef struct
+{
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t lost;
+    uint32_t in_flight;
+    // upper bounds of the histogram buckets, 0 before the first response
+    int64_t latency_p50_us;
+    int64_t latency_p95_us;
+    int64_t latency_p99_us;
+} share_tracker_stats;
+
+void share_tracker_init(share_tracker * tracker);
+
+/// @brief Forgets the in-flight shares, they are counted as lost. Call when the connection is replaced.
+void share_tracker_reset(share_tracker * tracker);
+
+/// @brief Resets the counters and the histogram, e.g. when switching pools.
+void share_tracker_clear_stats(share_tracker * tracker);
+
+/// @brief Records a share before its mining.submit is sent.
+void share_tracker_submit(share_tracker * tracker, int send_uid, const char * jobid, double nonce_diff, int64_t job_age_us);
+
+/// @brief Forgets a share whose mining.submit could not be sent.
+void share_tracker_cancel(share_tracker * tracker, int send_uid);
+
+/// @brief Matches a response to its share and records the round trip.
+/// @param share optional, set to the tracked share
+/// @param latency_us optional, set to the round-trip time
+/// @return false if send_uid is not an in-flight share
+bool share_tracker_complete(share_tracker * tracker, int send_uid, bool accepted, tracked_share * share, int64_t * latency_us);
+
+/// @brief When the oldest in-flight share sent at or after since_us was submitted, 0 if there is none.
+int64_t share_tracker_oldest_since(share_tracker * tracker, int64_t since_us);
+
+void share_tracker_get_stats(share_tracker * tracker, share_tracker_stats * stats);
+
+#endif /* SHARE_TRACKER_H_ */
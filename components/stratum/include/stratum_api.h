@@ -2,6 +2,8 @@
 #define STRATUM_API_H
 
 #include "cJSON.h"
+#include "line_buffer.h"
+#include "stratum_tx.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -10,6 +12,9 @@
 #define COINBASE_SIZE 100
 #define COINBASE2_SIZE 128
 
+// Large enough for a mining.notify with a big coinbase and a full merkle branch list
+#define STRATUM_LINE_BUFFER_SIZE (16 * 1024)
+
 typedef enum
 {
     STRATUM_UNKNOWN,
@@ -20,31 +25,63 @@ typedef enum
     STRATUM_RESULT_SETUP,
     STRATUM_RESULT_VERSION_MASK,
     STRATUM_RESULT_SUBSCRIBE,
-    CLIENT_RECONNECT
+    CLIENT_RECONNECT,
+    MINING_SET_EXTRANONCE
 } stratum_method;
 
 static const int  STRATUM_ID_CONFIGURE    = 1;
 static const int  STRATUM_ID_SUBSCRIBE    = 2;
 
+#define STRATUM_MAX_SUBSCRIPTION_ID_LEN 64
+// bytes of extranonce1 a session keeps
+#define STRATUM_MAX_EXTRANONCE_LEN 32
+
+// 256-bit number a hash has to be at most, words[0] is the least significant word
+typedef struct
+{
+    uint32_t words[8];
+} hash_target;
+
+// job_id, coinbase_1, coinbase_2 and merkle_branches live in the same allocation as the struct,
+// release it with STRATUM_V1_free_mining_notify()
 typedef struct
 {
     char *job_id;
-    char *prev_block_hash;
-    char *coinbase_1;
-    char *coinbase_2;
+    // in block header byte order
+    uint8_t prev_block_hash[HASH_SIZE];
+    uint8_t *coinbase_1;
+    size_t coinbase_1_len;
+    uint8_t *coinbase_2;
+    size_t coinbase_2_len;
     uint8_t *merkle_branches;
     size_t n_merkle_branches;
     uint32_t version;
     uint32_t version_mask;
+    // Stratum V2 standard channels send the merkle root instead of the coinbase, the branches and
+    // coinbase halves are empty then and ntime is rolled instead of extranonce_2
+    bool header_only;
+    uint8_t merkle_root[HASH_SIZE];
     uint32_t target;
     uint32_t ntime;
     uint32_t difficulty;
+    // targets for difficulty and for the network nbits in target, see mining_notify_set_difficulty()
+    hash_target pool_target;
+    hash_target network_target;
+    // work generation the notify was received in, see GlobalState.work_generation
+    uint32_t generation;
+    // esp_timer time the notify was received, for the job age of shares
+    int64_t received_us;
+    // stratum session the notify was received on, shares for it are submitted there
+    uint8_t session;
 } mining_notify;
 
 typedef struct
 {
+    // subscribe result and mining.set_extranonce, owned by the receiver of the message
     char * extranonce_str;
     int extranonce_2_len;
+    // subscribe result, the pool's id of the mining.notify subscription for resuming it, empty if none
+    char subscription_id[STRATUM_MAX_SUBSCRIPTION_ID_LEN];
 
     int64_t message_id;
     // Indicates the type of request the message represents.
@@ -59,26 +96,36 @@ typedef struct
     uint32_t version_mask;
     // result
     bool response_success;
-    char * error_str;
+    char error_str[64];
 } StratumApiV1Message;
 
-void STRATUM_V1_initialize_buffer();
+/// @brief Blocks until a complete line has been received or the socket's receive timeout expires.
+/// @param buffer receive buffer of the connection, keeps the bytes received after the line
+/// @return the line, owned by the receive buffer and valid until the next call, or NULL on error.
+/// On a timeout errno is EAGAIN and the buffer keeps the partial line, the connection is still usable.
+const char *STRATUM_V1_receive_jsonrpc_line(line_buffer * buffer, int sockfd);
 
-char *STRATUM_V1_receive_jsonrpc_line(int sockfd);
+/// @param subscription_id asks the pool to resume this subscription, NULL or empty for a new one
+int STRATUM_V1_subscribe(stratum_tx * tx, int send_uid, const char * model, const char * subscription_id);
 
-int STRATUM_V1_subscribe(int socket, int send_uid, const char * model);
+/// @brief Asks the pool to announce extranonce changes with mining.set_extranonce instead of reconnecting.
+int STRATUM_V1_extranonce_subscribe(stratum_tx * tx, int send_uid);
 
 void STRATUM_V1_parse(StratumApiV1Message *message, const char *stratum_json);
 
 void STRATUM_V1_free_mining_notify(mining_notify *params);
 
-int STRATUM_V1_authenticate(int socket, int send_uid, const char *username, const char *pass);
+int STRATUM_V1_authenticate(stratum_tx * tx, int send_uid, const char *username, const char *pass);
+
+int STRATUM_V1_configure_version_rolling(stratum_tx * tx, int send_uid, uint32_t * version_mask);
 
-int STRATUM_V1_configure_version_rolling(int socket, int send_uid, uint32_t * version_mask);
+int STRATUM_V1_suggest_difficulty(stratum_tx * tx, int send_uid, uint32_t difficulty);
 
-int STRATUM_V1_suggest_difficulty(int socket, int send_uid, uint32_t difficulty);
+/// @brief Asks the pool for an answer to check the connection. Pools without mining.ping answer
+/// with an error, which shows just as well that the connection works.
+int STRATUM_V1_ping(stratum_tx * tx, int send_uid);
 
-int STRATUM_V1_submit_share(int socket, int send_uid, const char *username, const char *jobid,
+int STRATUM_V1_submit_share(stratum_tx * tx, int send_uid, const char *username, const char *jobid,
                             const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
                             const uint32_t version);
 
@@ -0,0 +1,82 @@
+#ifndef STRATUM_CAPTURE_H_
+#define STRATUM_CAPTURE_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STRATUM_CAPTURE_VERSION 1
+#define STRATUM_CAPTURE_HEADER_SIZE 16
+// header flag, the oldest lines were overwritten
+#define STRATUM_CAPTURE_FLAG_TRUNCATED 0x01
+// sessions per capture, the session is stored next to the direction in one byte
+#define STRATUM_CAPTURE_MAX_SESSIONS 128
+
+// Every line received from and sent to the pools, for replaying real pool traffic offline.
+// The newest lines are kept in a ring, older ones are overwritten.
+//
+// An exported capture is a 16-byte header: "SCAP", the version, flags, two reserved bytes and
+// the esp_timer time the first record is relative to as little endian int64. Records follow:
+//   varint  microseconds since the previous record
+//   uint8   session << 1 | 1 for a sent line, 0 for a received one
+//   varint  length of the line
+//   bytes   the line without its newline
+// Varints are unsigned LEB128.
+typedef struct
+{
+    uint8_t * ring;
+    size_t capacity;
+    bool psram;
+    // offset of the oldest record
+    size_t head;
+    size_t used;
+    // the time the oldest record's delta is relative to
+    int64_t base_us;
+    // of the newest record
+    int64_t last_us;
+    bool truncated;
+    uint32_t records;
+    // lines that didn't fit even in the empty ring
+    uint32_t dropped;
+    pthread_mutex_t lock;
+} stratum_capture;
+
+typedef struct
+{
+    int64_t timestamp_us;
+    uint8_t session;
+    bool sent;
+    // not terminated
+    const char * line;
+    size_t len;
+} stratum_capture_record;
+
+typedef struct
+{
+    const uint8_t * data;
+    size_t len;
+    size_t pos;
+    int64_t timestamp_us;
+    uint8_t flags;
+} stratum_capture_reader;
+
+/// @param use_psram puts the ring in PSRAM, where there is room for a capture of many blocks
+bool stratum_capture_init(stratum_capture * capture, size_t capacity, bool use_psram);
+void stratum_capture_free(stratum_capture * capture);
+
+/// @brief Appends a line, overwriting the oldest ones if the ring is full. A trailing newline is not stored.
+void stratum_capture_line(stratum_capture * capture, int64_t now_us, uint8_t session, bool sent, const char * line,
+                          size_t len);
+
+/// @brief Copies the capture in the export format.
+/// @return the malloc'ed capture, NULL if out of memory
+uint8_t * stratum_capture_export(stratum_capture * capture, size_t * len);
+
+/// @return false if data is not an exported capture
+bool stratum_capture_reader_init(stratum_capture_reader * reader, const uint8_t * data, size_t len);
+
+/// @return false at the end of the capture or if it is truncated
+bool stratum_capture_next(stratum_capture_reader * reader, stratum_capture_record * record);
+
+#endif /* STRATUM_CAPTURE_H_ */
@@ -0,0 +1,53 @@
+#ifndef STRATUM_CONNECT_H_
+#define STRATUM_CONNECT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lwip/sockets.h"
+
+#define STRATUM_DNS_CACHE_SIZE 8
+#define STRATUM_DNS_MAX_ADDRESSES 4
+#define STRATUM_DNS_MAX_HOST_LEN 128
+// lwIP's resolver doesn't report the record's TTL, pools rarely move
+#define STRATUM_DNS_TTL_MS (5 * 60 * 1000)
+// A lookup taking longer is abandoned, cached addresses are used if there are any
+#define STRATUM_DNS_TIMEOUT_MS 3000
+
+// Time an attempt gets before the next address is tried alongside it (RFC 8305)
+#define STRATUM_CONNECT_ATTEMPT_DELAY_MS 250
+
+// stratum_connect() results besides a socket
+#define STRATUM_CONNECT_ERR_DNS -1
+#define STRATUM_CONNECT_ERR_SOCKET -2
+#define STRATUM_CONNECT_ERR_CONNECT -3
+
+typedef struct
+{
+    struct sockaddr_storage addr;
+    socklen_t len;
+} stratum_address;
+
+/// @brief Resolves host to at most max_addresses addresses with the port set, in the order to try them.
+/// @return the number of addresses, 0 if the host doesn't resolve
+typedef int (*stratum_resolver)(const char * host, uint16_t port, stratum_address * addresses, int max_addresses);
+
+/// @brief Replaces the getaddrinfo based resolver, e.g. to simulate a slow DNS server. NULL restores it.
+void stratum_dns_set_resolver(stratum_resolver resolver);
+
+/// @brief Resolves host through the cache. An expired entry is used if the host doesn't resolve anymore
+/// or the lookup takes longer than STRATUM_DNS_TIMEOUT_MS.
+int stratum_dns_resolve(const char * host, uint16_t port, stratum_address * addresses, int max_addresses);
+
+/// @brief Drops the cached addresses of host, the next connect resolves it again.
+void stratum_dns_invalidate(const char * host);
+
+/// @brief Opens a TCP connection to host within timeout_ms. Every resolved address is tried, the next one
+/// whenever an attempt fails or hasn't completed after STRATUM_CONNECT_ATTEMPT_DELAY_MS, and the
+/// first one to connect wins. IPv6 and IPv4 addresses alternate. When every address refuses the
+/// connection, the host is resolved again next time; its addresses stay cached in case that fails.
+/// @param ip_str receives the address connected to, may be NULL
+/// @return a blocking socket, or one of the STRATUM_CONNECT_ERR_ codes with errno set
+int stratum_connect(const char * host, uint16_t port, uint32_t timeout_ms, char * ip_str, size_t ip_str_len);
+
+#endif /* STRATUM_CONNECT_H_ */
@@ -0,0 +1,53 @@
+#ifndef STRATUM_LIVENESS_H_
+#define STRATUM_LIVENESS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Silence before a probe even for pools that notify often, a few seconds without a job are normal
+#define STRATUM_LIVENESS_MIN_PROBE_MS 10000
+
+// Detects connections that died without being closed, a NAT mapping that timed out or a pool that
+// crashed without FIN, which TCP only notices once the receive timeout expires. A pool is expected to
+// send something at least about as often as it sent notifies so far. After twice that silence it gets
+// a probe, and a probe or share that gets no answer in half the dead timeout ends the connection.
+// A dead connection is noticed at most dead_timeout_ms after the pool went quiet.
+typedef struct
+{
+    uint32_t dead_timeout_ms;
+    int64_t last_rx_us;
+    int64_t last_notify_us;
+    // smoothed time between notifies, 0 until the second one
+    int64_t notify_interval_us;
+    // 0 while no probe is outstanding
+    int64_t probe_sent_us;
+    // id of the last probe, its answer isn't a response to anything else
+    int probe_uid;
+} stratum_liveness;
+
+typedef enum
+{
+    STRATUM_LIVENESS_OK,
+    // send a probe, the pool has been quiet for longer than usual
+    STRATUM_LIVENESS_PROBE,
+    // the pool didn't answer in time, close the connection
+    STRATUM_LIVENESS_DEAD,
+} stratum_liveness_action;
+
+void stratum_liveness_init(stratum_liveness * liveness, uint32_t dead_timeout_ms);
+
+/// @brief Starts over for a new connection, established at now_us.
+void stratum_liveness_reset(stratum_liveness * liveness, int64_t now_us);
+
+/// @brief Records a line from the pool, everything it sends shows the connection works.
+void stratum_liveness_received(stratum_liveness * liveness, int64_t now_us, bool notify);
+
+/// @brief Silence after which the pool gets a probe.
+int64_t stratum_liveness_probe_after_us(const stratum_liveness * liveness);
+
+/// @brief Decides what to do about the connection, to be called regularly while it's idle.
+/// @param oldest_request_us when the oldest request still waiting for its response was sent, e.g. a share, 0 if none
+/// @return STRATUM_LIVENESS_PROBE counts the probe as sent, the caller sends it with probe_uid set
+stratum_liveness_action stratum_liveness_check(stratum_liveness * liveness, int64_t now_us, int64_t oldest_request_us);
+
+#endif /* STRATUM_LIVENESS_H_ */
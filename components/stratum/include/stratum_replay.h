@@ -0,0 +1,61 @@
+#ifndef STRATUM_REPLAY_H_
+#define STRATUM_REPLAY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mining.h"
+
+// Sessions the replay keeps extranonce and difficulty for, the lines of further sessions are skipped
+#define STRATUM_REPLAY_MAX_SESSIONS 4
+
+// Frames the ASIC job command of every job as create_jobs_task does, ASIC_serialize_job() on the device
+typedef void (*stratum_replay_serialize_fn)(void * ctx, bm_job * job);
+
+// Stands in for the ASIC, gets every job the replay generates
+typedef void (*stratum_replay_asic_fn)(void * ctx, const bm_job * job);
+
+typedef struct
+{
+    // 1 replays with the original timing, 10 ten times faster, 0 as fast as possible
+    float speed;
+    // jobs generated after each notify, the queue create_jobs_task keeps filled for the ASIC
+    int jobs_per_notify;
+    // share of the jobs of each session, NULL weighs them equally
+    const int32_t * weights;
+    stratum_replay_serialize_fn serialize;
+    void * serialize_ctx;
+    stratum_replay_asic_fn asic;
+    void * asic_ctx;
+} stratum_replay_config;
+
+typedef struct
+{
+    uint32_t received;
+    uint32_t sent;
+    uint32_t notifies;
+    uint32_t clean_jobs;
+    uint32_t jobs;
+    // notifies no job could be built for
+    uint32_t failed;
+    // most notifies within one second of the capture, the storms around block changes
+    uint32_t notify_burst_max;
+    // in STRATUM_V1_parse
+    int64_t parse_us;
+    // building the coinbase, merkle roots and jobs, framing them and in the ASIC stand-in
+    int64_t jobs_us;
+    // from the start of parsing a notify to its first job reaching the ASIC
+    int64_t notify_to_job_max_us;
+    // time span of the capture and of its replay
+    int64_t capture_us;
+    int64_t elapsed_us;
+} stratum_replay_stats;
+
+/// @brief Replays the received lines of an exported capture through the Stratum V1 parser and stratum_work,
+/// the job generation create_jobs_task runs. Sent lines are only counted. The jobs come from the pool, one at
+/// a time, so bm_job_pool_init() has to be called first.
+/// @return false if capture is not a capture or out of memory
+bool stratum_replay_run(const uint8_t * capture, size_t len, const stratum_replay_config * config,
+                        stratum_replay_stats * stats);
+
+#endif /* STRATUM_REPLAY_H_ */
@@ -0,0 +1,66 @@
+#ifndef STRATUM_STANDBY_H_
+#define STRATUM_STANDBY_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "line_buffer.h"
+#include "stratum_api.h"
+#include "stratum_tx.h"
+
+// Authorized but idle connection to the fallback pool. It never submits shares, it only follows
+// the pool's notify, difficulty and version mask so that mining can continue on it right away
+// when the primary connection fails.
+typedef struct
+{
+    int socket; // -1 while disconnected
+    line_buffer buffer;
+    stratum_tx tx; // only used for the handshake
+    int send_uid;
+    char * extranonce_str;
+    int extranonce_2_len;
+    uint32_t difficulty;
+    uint32_t version_mask;
+    // most recent notify, already parsed
+    mining_notify * latest_notify;
+    pthread_mutex_t lock;
+} stratum_standby;
+
+// State of a standby connection handed over to the primary connection
+typedef struct
+{
+    int socket;
+    int send_uid;
+    char * extranonce_str;
+    int extranonce_2_len;
+    uint32_t difficulty;
+    uint32_t version_mask;
+    // owned by the caller, NULL if the pool never sent one
+    mining_notify * latest_notify;
+} stratum_standby_session;
+
+bool stratum_standby_init(stratum_standby * standby);
+void stratum_standby_free(stratum_standby * standby);
+
+/// @brief Connects and sends mining.configure, mining.subscribe, mining.authorize and mining.suggest_difficulty.
+/// Replaces an existing connection. Only the task that polls the standby may call it.
+/// @param tls stratum+ssl, the handshake is part of connecting
+bool stratum_standby_connect(stratum_standby * standby, const char * host, uint16_t port, bool tls, const char * user,
+                             const char * pass, const char * model, uint32_t difficulty, uint32_t connect_timeout_ms);
+
+/// @brief Waits up to timeout_ms for data and processes every complete message.
+/// @return false if the connection was lost or the pool asked to reconnect, the standby is closed then
+bool stratum_standby_poll(stratum_standby * standby, uint32_t timeout_ms);
+
+void stratum_standby_close(stratum_standby * standby);
+
+/// @brief True once the pool has answered mining.subscribe and sent a job.
+bool stratum_standby_ready(stratum_standby * standby);
+
+/// @brief Hands the connection over if it is ready and leaves the standby disconnected.
+/// The standby's receive buffer is exchanged with receive_buffer, so bytes the pool sent after the
+/// last complete message are read by the new owner.
+/// @return false if the standby is not ready
+bool stratum_standby_take(stratum_standby * standby, stratum_standby_session * session, line_buffer * receive_buffer);
+
+#endif /* STRATUM_STANDBY_H_ */
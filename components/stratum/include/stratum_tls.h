@@ -0,0 +1,60 @@
+#ifndef STRATUM_TLS_H_
+#define STRATUM_TLS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// connections that may use TLS at the same time: the sessions, the standby and the heartbeat
+#define STRATUM_TLS_MAX_CONNECTIONS 6
+// pools whose last TLS session is kept for resuming it
+#define STRATUM_TLS_SESSION_CACHE_SIZE 4
+// mbedTLS allocations at least this large go to PSRAM if there is some, that's the record buffers
+#define STRATUM_TLS_PSRAM_MIN_ALLOC 2048
+
+// TLS on a connected stratum socket. The connection is looked up by its socket number, so stratum_tx,
+// the line receiver and the standby keep passing plain sockets around and send and receive through
+// stratum_socket_send() and stratum_socket_recv() whether the connection is encrypted or not.
+
+typedef struct
+{
+    // first flight to finished
+    int64_t handshake_us;
+    // an abbreviated handshake with the session of the previous connection to the pool
+    bool resumed;
+    // heap the connection holds once established, internal and PSRAM
+    int32_t heap_internal;
+    int32_t heap_psram;
+} stratum_tls_handshake_stats;
+
+/// @brief Sets up the shared TLS configuration, once before the first stratum_tls_start().
+/// @param ca_pem trusted root certificates, NULL for the certificate bundle of the firmware
+/// @param use_psram place the record buffers of stratum connections in PSRAM, other mbedTLS users are unaffected
+bool stratum_tls_init(const char * ca_pem, bool use_psram);
+
+/// @brief Runs the TLS handshake on a connected blocking socket and attaches the connection to it.
+/// Offers the session of the last connection to host:port, a ticket or session id, so a reconnect
+/// takes an abbreviated handshake without certificate verification and key exchange.
+/// @param host the name the certificate has to be issued for
+/// @param stats optional
+bool stratum_tls_start(int sock, const char * host, uint16_t port, uint32_t timeout_ms, stratum_tls_handshake_stats * stats);
+
+/// @brief Drops the cached session of host:port, the next connection does a full handshake.
+void stratum_tls_forget_session(const char * host, uint16_t port);
+
+/// @brief Like send(), encrypted if the socket has a TLS connection.
+int stratum_socket_send(int sock, const void * data, size_t len);
+
+/// @brief Like recv() with flags 0 or MSG_DONTWAIT, decrypted if the socket has a TLS connection.
+/// A blocking call waits at most SO_RCVTIMEO for the next record.
+int stratum_socket_recv(int sock, void * data, size_t len, int flags);
+
+/// @brief Whether stratum_socket_recv() has data without the socket becoming readable,
+/// records already received and decrypted by TLS don't wake select().
+bool stratum_socket_pending(int sock);
+
+/// @brief Ends the TLS connection with close_notify, keeping its session for the next connection to the
+/// pool, then shuts down and closes the socket.
+void stratum_socket_close(int sock);
+
+#endif /* STRATUM_TLS_H_ */
@@ -0,0 +1,81 @@
+#ifndef STRATUM_TX_H_
+#define STRATUM_TX_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "stratum_capture.h"
+
+// Messages waiting for the writer, shares are submitted one at a time so this is plenty
+#define STRATUM_TX_MAX_PENDING 32
+
+// Outgoing stratum messages. Any task formats its message and enqueues it without touching the
+// socket, a single writer sends everything pending with as few send() calls as possible.
+typedef struct
+{
+    char * buffer;
+    size_t capacity;
+    // [head, tail) is enqueued but not yet sent, both run freely and wrap at capacity
+    size_t head;
+    size_t tail;
+    // end offset and enqueue time of every pending message, for the latency stats
+    struct
+    {
+        size_t end;
+        int64_t enqueued_us;
+    } pending[STRATUM_TX_MAX_PENDING];
+    uint32_t pending_head;
+    uint32_t pending_tail;
+    int socket;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    // held by the writer while it uses the socket, so the socket is never swapped under a send()
+    pthread_mutex_t send_lock;
+
+    // records every enqueued message if set
+    stratum_capture * capture;
+    uint8_t capture_session;
+
+    uint32_t messages;
+    uint32_t sends;
+    uint32_t dropped;
+    int64_t latency_total_us;
+    int64_t latency_max_us;
+} stratum_tx;
+
+typedef struct
+{
+    uint32_t messages;  // messages written to the socket
+    uint32_t sends;     // send() calls it took
+    uint32_t dropped;   // messages rejected because the queue was full
+    size_t queued;      // bytes waiting for the writer
+    int64_t latency_avg_us; // enqueue to send() returning
+    int64_t latency_max_us;
+} stratum_tx_stats;
+
+bool stratum_tx_init(stratum_tx * tx, size_t capacity);
+void stratum_tx_free(stratum_tx * tx);
+
+/// @brief Starts a new connection, anything still queued for the previous one is dropped.
+/// Waits for a send() in progress, pass -1 before closing the old socket.
+void stratum_tx_set_socket(stratum_tx * tx, int socket);
+
+/// @brief Records the messages of the connection in capture as sent by session, NULL stops.
+void stratum_tx_set_capture(stratum_tx * tx, stratum_capture * capture, uint8_t session);
+
+/// @brief Queues a complete message without blocking.
+/// @return len, or -1 with errno ENOTCONN without a socket or ENOBUFS when the queue is full
+int stratum_tx_enqueue(stratum_tx * tx, const char * msg, size_t len);
+
+/// @brief Blocks until there is something to send.
+void stratum_tx_wait(stratum_tx * tx);
+
+/// @brief Sends everything queued, including messages enqueued meanwhile. Writer only.
+/// @return false if the socket failed, the queue is dropped and the socket shut down so the
+/// reader sees the connection close
+bool stratum_tx_flush(stratum_tx * tx);
+
+void stratum_tx_get_stats(stratum_tx * tx, stratum_tx_stats * stats);
+
+#endif /* STRATUM_TX_H_ */
@@ -0,0 +1,38 @@
+#ifndef STRATUM_VARDIFF_H_
+#define STRATUM_VARDIFF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A new suggestion once the target moved this far from the last one, in percent
+#define STRATUM_VARDIFF_CHANGE_PERCENT 25
+// Time between suggestions on a connection, the measured hashrate settles over minutes anyway
+#define STRATUM_VARDIFF_MIN_INTERVAL_MS (2 * 60 * 1000)
+
+// Sizes the difficulty suggested to the pool so the hashrate finds a set number of shares per minute.
+// Difficulty D takes D * 2^32 hashes per share on average.
+typedef struct
+{
+    // 0 disables the controller, fallback_difficulty is suggested instead
+    float shares_per_minute;
+    // while the hashrate is unknown
+    uint32_t fallback_difficulty;
+    // last suggestion on the connection, 0 before the first one
+    uint32_t suggested;
+    int64_t suggested_us;
+} stratum_vardiff;
+
+void stratum_vardiff_init(stratum_vardiff * vardiff, float shares_per_minute, uint32_t fallback_difficulty);
+
+/// @brief Forgets the last suggestion, the next update suggests right away. For a new connection.
+void stratum_vardiff_reset(stratum_vardiff * vardiff);
+
+/// @brief The difficulty to suggest for hashrate_ghs, at least 1.
+uint32_t stratum_vardiff_difficulty(const stratum_vardiff * vardiff, double hashrate_ghs);
+
+/// @brief Whether the difficulty for hashrate_ghs differs enough from the last suggestion, and enough time
+/// has passed, to suggest it.
+/// @param difficulty receives the difficulty to suggest if so, it counts as suggested from now
+bool stratum_vardiff_update(stratum_vardiff * vardiff, double hashrate_ghs, int64_t now_us, uint32_t * difficulty);
+
+#endif /* STRATUM_VARDIFF_H_ */
@@ -0,0 +1,70 @@
+#ifndef STRATUM_WORK_H_
+#define STRATUM_WORK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mining.h"
+
+// Header-only jobs roll ntime by a second per job. Pools reject shares too far ahead of their clock,
+// so the roll stays within this much of the time elapsed since the notify arrived.
+#define STRATUM_WORK_MAX_NTIME_AHEAD_S 60
+
+// The current notify of a session and the coinbase built for it
+typedef struct
+{
+    mining_notify * notification; // NULL while the session has no work
+    job_template tmpl;            // unused for header-only work
+    // of the next job, the ntime offset instead for header-only work
+    uint32_t extranonce_2;
+    // the session's extranonce generation the template was built with
+    uint32_t extranonce_generation;
+    // smooth weighted round robin between the sessions
+    int32_t current_weight;
+} stratum_work;
+
+typedef struct
+{
+    uint8_t extranonce[STRATUM_MAX_EXTRANONCE_LEN];
+    size_t extranonce_len;
+    int extranonce_2_len;
+    // changes with every new extranonce of the session
+    uint32_t generation;
+} stratum_work_extranonce;
+
+// Reads the current extranonce of a session when a coinbase is built for it
+typedef void (*stratum_work_extranonce_fn)(void * ctx, uint8_t session, stratum_work_extranonce * extranonce);
+
+// What stratum_work_next() looks at of each session
+typedef struct
+{
+    // notifies of older work generations are stale
+    uint32_t work_generation;
+    uint32_t extranonce_generation;
+    int32_t weight;
+} stratum_work_session;
+
+/// @brief Makes notification the work of its session, the previous work is released. Header-only notifies
+/// come with their merkle root, for the others the coinbase is built with the session's extranonce.
+/// @return false if no job can be built from the notify, it stays with the caller then
+bool stratum_work_accept(stratum_work * work, mining_notify * notification, stratum_work_extranonce_fn read_extranonce,
+                         void * ctx);
+
+/// @brief Frees the notify and coinbase of the work, the session has no work afterwards.
+void stratum_work_release(stratum_work * work);
+
+/// @brief Picks the session for the next job so that each gets jobs in proportion to its weight, spread
+/// evenly instead of in runs. Sessions without current work are skipped, their share goes to the others.
+/// Stale work is released and work of an old extranonce rebuilt on the way.
+/// @param work one per session, indexed like sessions
+/// @param rebuilt set when a coinbase was rebuilt, jobs built with the old extranonce are useless
+/// @param ntime_limited set when a session was skipped only because of its ntime roll
+/// @return NULL if no session has work for another job
+stratum_work * stratum_work_next(stratum_work * work, const stratum_work_session * sessions, int count,
+                                 stratum_work_extranonce_fn read_extranonce, void * ctx, int64_t now_us, bool * rebuilt,
+                                 bool * ntime_limited);
+
+/// @brief Builds the next job of the work and moves on to the one after. The ASIC command is left to the caller.
+void stratum_work_next_job(stratum_work * work, uint32_t version_mask, bm_job * job);
+
+#endif /* STRATUM_WORK_H_ */
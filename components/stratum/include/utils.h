@@ -8,10 +8,11 @@
 
 size_t hex2bin(const char *restrict hex, uint8_t *restrict bin, size_t bin_len);
 size_t bin2hex(const uint8_t *restrict bin, size_t bin_len, char *restrict hex, size_t hex_len);
-uint8_t *double_sha256_bin(const uint8_t *data, const size_t data_len);
+void double_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest);
 void single_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest);
 void midstate_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest);
 void swap_endian_words(const char *hex_words, uint8_t *output);
+void flip32bytes(void *restrict dest_p, const void *restrict src_p);
 void reverse_bytes(uint8_t *data, size_t len);
 double le256todouble(const void *restrict target);
 void prettyHex(unsigned char *buf, int len);
@@ -0,0 +1,101 @@
+#include "line_buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+static const char * TAG = "line_buffer";
+
+bool line_buffer_init(line_buffer * lb, size_t capacity)
+{
+    memset(lb, 0, sizeof(line_buffer));
+    lb->buffer = malloc(capacity);
+    if (lb->buffer == NULL) {
+        return false;
+    }
+    lb->capacity = capacity;
+    return true;
+}
+
+void line_buffer_free(line_buffer * lb)
+{
+    free(lb->buffer);
+    memset(lb, 0, sizeof(line_buffer));
+}
+
+void line_buffer_reset(line_buffer * lb)
+{
+    lb->head = 0;
+    lb->tail = 0;
+    lb->scan = 0;
+    lb->discarding = false;
+}
+
+char * line_buffer_write_ptr(line_buffer * lb, size_t * available)
+{
+    if (lb->head == lb->tail) {
+        // nothing pending, start over at the front for free
+        lb->head = lb->tail = lb->scan = 0;
+    } else if (lb->head > 0 && lb->capacity - lb->tail < lb->capacity / 4) {
+        // only the partial line at the end is moved, never the whole buffer
+        size_t pending = lb->tail - lb->head;
+        memmove(lb->buffer, lb->buffer + lb->head, pending);
+        lb->scan -= lb->head;
+        lb->head = 0;
+        lb->tail = pending;
+    }
+
+    if (lb->tail == lb->capacity) {
+        // a single line fills the whole buffer, drop it up to the next '\n'
+        ESP_LOGW(TAG, "Line exceeds %u bytes, discarding", (unsigned) lb->capacity);
+        lb->overflows++;
+        lb->discarding = true;
+        lb->head = lb->tail = lb->scan = 0;
+    }
+
+    *available = lb->capacity - lb->tail;
+    return lb->buffer + lb->tail;
+}
+
+void line_buffer_commit(line_buffer * lb, size_t len)
+{
+    lb->tail += len;
+}
+
+const char * line_buffer_next_line(line_buffer * lb, size_t * len)
+{
+    while (lb->scan < lb->tail) {
+        char * newline = memchr(lb->buffer + lb->scan, '\n', lb->tail - lb->scan);
+        if (newline == NULL) {
+            lb->scan = lb->tail;
+            if (lb->discarding) {
+                lb->head = lb->tail;
+            }
+            return NULL;
+        }
+
+        size_t start = lb->head;
+        size_t line_len = newline - (lb->buffer + start);
+        lb->head = lb->scan = line_len + start + 1;
+
+        if (lb->discarding) {
+            lb->discarding = false;
+            continue;
+        }
+
+        *newline = '\0';
+        if (line_len > 0 && lb->buffer[start + line_len - 1] == '\r') {
+            lb->buffer[start + --line_len] = '\0';
+        }
+        if (line_len == 0) {
+            continue;
+        }
+
+        if (len != NULL) {
+            *len = line_len;
+        }
+        return lb->buffer + start;
+    }
+    return NULL;
+}
@@ -1,58 +1,276 @@
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <limits.h>
 #include "mining.h"
 #include "utils.h"
 #include "mbedtls/sha256.h"
+#include "sha256.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include "esp_log.h"
+
+static const char *TAG = "mining";
+
+// Jobs are handed out from a stack of free slots, the storage is allocated once at boot. The reference
+// counts and the ASIC job commands live next to the jobs so copying a bm_job around never touches them.
+static struct
+{
+    bm_job *jobs;
+    bm_job **free_slots;
+    _Atomic uint32_t *refs;
+    uint8_t *packets;
+    size_t packet_size;
+    size_t capacity;
+    size_t free_count;
+    size_t high_water;
+    uint32_t exhausted;
+    pthread_mutex_t lock;
+} job_pool = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+bool bm_job_pool_init(size_t capacity, size_t packet_size)
+{
+    pthread_mutex_lock(&job_pool.lock);
+
+    if (job_pool.free_count != job_pool.capacity) {
+        pthread_mutex_unlock(&job_pool.lock);
+        ESP_LOGE(TAG, "Job pool still has %u jobs in use", (unsigned)(job_pool.capacity - job_pool.free_count));
+        return false;
+    }
+
+    free(job_pool.jobs);
+    free(job_pool.free_slots);
+    free(job_pool.refs);
+    free(job_pool.packets);
+    job_pool.jobs = malloc(capacity * sizeof(bm_job));
+    job_pool.free_slots = malloc(capacity * sizeof(bm_job *));
+    job_pool.refs = calloc(capacity, sizeof(*job_pool.refs));
+    job_pool.packets = packet_size > 0 ? malloc(capacity * packet_size) : NULL;
+    if (job_pool.jobs == NULL || job_pool.free_slots == NULL || job_pool.refs == NULL ||
+        (packet_size > 0 && job_pool.packets == NULL)) {
+        free(job_pool.jobs);
+        free(job_pool.free_slots);
+        free(job_pool.refs);
+        free(job_pool.packets);
+        job_pool.jobs = NULL;
+        job_pool.free_slots = NULL;
+        job_pool.refs = NULL;
+        job_pool.packets = NULL;
+        capacity = 0;
+        packet_size = 0;
+    }
+
+    // hand out the lowest slots first
+    for (size_t i = 0; i < capacity; i++) {
+        job_pool.free_slots[i] = &job_pool.jobs[capacity - 1 - i];
+    }
+    job_pool.capacity = capacity;
+    job_pool.packet_size = packet_size;
+    job_pool.free_count = capacity;
+    job_pool.high_water = 0;
+    job_pool.exhausted = 0;
+
+    pthread_mutex_unlock(&job_pool.lock);
+
+    if (job_pool.jobs == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate job pool");
+        return false;
+    }
+    return true;
+}
+
+// The pool storage only changes while no job is in use, so this needs no lock
+static bool job_index(const bm_job *job, size_t *index)
+{
+    uintptr_t offset = (uintptr_t)job - (uintptr_t)job_pool.jobs;
+    *index = offset / sizeof(bm_job);
+    return (uintptr_t)job >= (uintptr_t)job_pool.jobs && *index < job_pool.capacity && offset % sizeof(bm_job) == 0;
+}
+
+static _Atomic uint32_t *job_refs(const bm_job *job)
+{
+    size_t index;
+    return job_index(job, &index) ? &job_pool.refs[index] : NULL;
+}
+
+uint8_t *bm_job_packet(const bm_job *job)
+{
+    size_t index;
+    if (job_pool.packets == NULL || !job_index(job, &index)) {
+        return NULL;
+    }
+    return &job_pool.packets[index * job_pool.packet_size];
+}
+
+bm_job *alloc_bm_job(void)
+{
+    bm_job *job = NULL;
+
+    pthread_mutex_lock(&job_pool.lock);
+    if (job_pool.free_count > 0) {
+        job = job_pool.free_slots[--job_pool.free_count];
+        atomic_store(job_refs(job), 1);
+        size_t in_use = job_pool.capacity - job_pool.free_count;
+        if (in_use > job_pool.high_water) {
+            job_pool.high_water = in_use;
+        }
+    } else {
+        job_pool.exhausted++;
+    }
+    pthread_mutex_unlock(&job_pool.lock);
+
+    return job;
+}
+
+bool bm_job_try_ref(bm_job *job)
+{
+    _Atomic uint32_t *refs = job_refs(job);
+    if (refs == NULL) {
+        return false;
+    }
+
+    uint32_t count = atomic_load(refs);
+    do {
+        // already back in the pool, the caller's pointer is stale
+        if (count == 0) {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak(refs, &count, count + 1));
+    return true;
+}
 
 void free_bm_job(bm_job *job)
 {
-    free(job->jobid);
-    free(job->extranonce2);
-    free(job);
+    if (job == NULL) {
+        return;
+    }
+
+    _Atomic uint32_t *refs = job_refs(job);
+    uint32_t count = refs == NULL ? 0 : atomic_load(refs);
+    do {
+        if (count == 0) {
+            ESP_LOGE(TAG, "Job %p is not an allocated pool job", job);
+            return;
+        }
+    } while (!atomic_compare_exchange_weak(refs, &count, count - 1));
+
+    // only the last reference touches the lock
+    if (count == 1) {
+        pthread_mutex_lock(&job_pool.lock);
+        job_pool.free_slots[job_pool.free_count++] = job;
+        pthread_mutex_unlock(&job_pool.lock);
+    }
+}
+
+void bm_job_pool_get_stats(bm_job_pool_stats *stats)
+{
+    pthread_mutex_lock(&job_pool.lock);
+    stats->capacity = job_pool.capacity;
+    stats->in_use = job_pool.capacity - job_pool.free_count;
+    stats->high_water = job_pool.high_water;
+    stats->exhausted = job_pool.exhausted;
+    pthread_mutex_unlock(&job_pool.lock);
 }
 
-char *construct_coinbase_tx(const char *coinbase_1, const char *coinbase_2,
-                            const char *extranonce, const char *extranonce_2)
+uint8_t *construct_coinbase_tx(const mining_notify *notify, const uint8_t *extranonce, size_t extranonce_len,
+                               size_t extranonce_2_len, size_t *coinbase_tx_len)
 {
-    int coinbase_tx_len = strlen(coinbase_1) + strlen(coinbase_2) + strlen(extranonce) + strlen(extranonce_2) + 1;
+    *coinbase_tx_len = notify->coinbase_1_len + extranonce_len + extranonce_2_len + notify->coinbase_2_len;
+
+    uint8_t *coinbase_tx = malloc(*coinbase_tx_len);
+    if (coinbase_tx == NULL)
+    {
+        return NULL;
+    }
 
-    char *coinbase_tx = malloc(coinbase_tx_len);
-    strcpy(coinbase_tx, coinbase_1);
-    strcat(coinbase_tx, extranonce);
-    strcat(coinbase_tx, extranonce_2);
-    strcat(coinbase_tx, coinbase_2);
-    coinbase_tx[coinbase_tx_len - 1] = '\0';
+    uint8_t *p = coinbase_tx;
+    memcpy(p, notify->coinbase_1, notify->coinbase_1_len);
+    p += notify->coinbase_1_len;
+    memcpy(p, extranonce, extranonce_len);
+    p += extranonce_len;
+    memset(p, 0, extranonce_2_len);
+    p += extranonce_2_len;
+    memcpy(p, notify->coinbase_2, notify->coinbase_2_len);
 
     return coinbase_tx;
 }
 
-char *calculate_merkle_root_hash(const char *coinbase_tx, const uint8_t merkle_branches[][32], const int num_merkle_branches)
+// both_merkles holds the coinbase hash in its first half, the root is left there
+static void hash_merkle_branches(uint8_t both_merkles[64], const uint8_t merkle_branches[][32], const int num_merkle_branches)
 {
-    size_t coinbase_tx_bin_len = strlen(coinbase_tx) / 2;
-    uint8_t *coinbase_tx_bin = malloc(coinbase_tx_bin_len);
-    hex2bin(coinbase_tx, coinbase_tx_bin, coinbase_tx_bin_len);
-
-    uint8_t both_merkles[64];
-    uint8_t *new_root = double_sha256_bin(coinbase_tx_bin, coinbase_tx_bin_len);
-    free(coinbase_tx_bin);
-    memcpy(both_merkles, new_root, 32);
-    free(new_root);
     for (int i = 0; i < num_merkle_branches; i++)
     {
         memcpy(both_merkles + 32, merkle_branches[i], 32);
-        uint8_t *new_root = double_sha256_bin(both_merkles, 64);
-        memcpy(both_merkles, new_root, 32);
-        free(new_root);
+        sha256_double_64(both_merkles, both_merkles);
     }
+}
+
+void calculate_merkle_root_hash(const uint8_t *coinbase_tx, size_t coinbase_tx_len, const uint8_t merkle_branches[][32],
+                                const int num_merkle_branches, uint8_t *merkle_root)
+{
+    uint8_t both_merkles[64];
+    double_sha256_bin(coinbase_tx, coinbase_tx_len, both_merkles);
+    hash_merkle_branches(both_merkles, merkle_branches, num_merkle_branches);
+
+    memcpy(merkle_root, both_merkles, 32);
+}
+
+bool job_template_init(job_template *tmpl, const mining_notify *notify, const uint8_t *extranonce, size_t extranonce_len,
+                       size_t extranonce_2_len)
+{
+    tmpl->coinbase_tx = construct_coinbase_tx(notify, extranonce, extranonce_len, extranonce_2_len, &tmpl->coinbase_tx_len);
+    if (tmpl->coinbase_tx == NULL)
+    {
+        return false;
+    }
+    tmpl->extranonce_2_offset = notify->coinbase_1_len + extranonce_len;
+    tmpl->extranonce_2_len = extranonce_2_len;
+
+    // only whole blocks can be kept in the sha256 state
+    tmpl->prefix_len = tmpl->extranonce_2_offset & ~(size_t)63;
+    mbedtls_sha256_init(&tmpl->prefix_ctx);
+    mbedtls_sha256_starts(&tmpl->prefix_ctx, 0);
+    mbedtls_sha256_update(&tmpl->prefix_ctx, tmpl->coinbase_tx, tmpl->prefix_len);
+
+    return true;
+}
+
+void job_template_free(job_template *tmpl)
+{
+    mbedtls_sha256_free(&tmpl->prefix_ctx);
+    free(tmpl->coinbase_tx);
+    tmpl->coinbase_tx = NULL;
+}
+
+void job_template_merkle_root(job_template *tmpl, const mining_notify *notify, uint32_t extranonce_2, uint8_t *merkle_root)
+{
+    extranonce_2_generate(extranonce_2, tmpl->extranonce_2_len, tmpl->coinbase_tx + tmpl->extranonce_2_offset);
+
+    uint8_t both_merkles[64];
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, &tmpl->prefix_ctx);
+    mbedtls_sha256_update(&ctx, tmpl->coinbase_tx + tmpl->prefix_len, tmpl->coinbase_tx_len - tmpl->prefix_len);
+    mbedtls_sha256_finish(&ctx, both_merkles);
+    mbedtls_sha256_free(&ctx);
+    mbedtls_sha256(both_merkles, 32, both_merkles, 0);
 
-    char *merkle_root_hash = malloc(65);
-    bin2hex(both_merkles, 32, merkle_root_hash, 65);
-    return merkle_root_hash;
+    hash_merkle_branches(both_merkles, (const uint8_t(*)[32])notify->merkle_branches, notify->n_merkle_branches);
+
+    memcpy(merkle_root, both_merkles, 32);
 }
 
-// take a mining_notify struct with ascii hex strings and convert it to a bm_job struct
-bm_job construct_bm_job(mining_notify *params, const char *merkle_root, const uint32_t version_mask)
+// the ASIC wants hashes with the order of the 32-bit words reversed
+static void reverse_words(const uint8_t *src, uint8_t *dest)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        memcpy(dest + i * 4, src + (7 - i) * 4, 4);
+    }
+}
+
+// take a mining_notify struct and convert it to a bm_job struct
+bm_job construct_bm_job(mining_notify *params, const uint8_t *merkle_root, const uint32_t version_mask)
 {
     bm_job new_job;
 
@@ -61,17 +279,17 @@ bm_job construct_bm_job(mining_notify *params, const char *merkle_root, const ui
     new_job.target = params->target;
     new_job.ntime = params->ntime;
     new_job.pool_diff = params->difficulty;
+    new_job.pool_target = params->pool_target;
+    new_job.network_target = params->network_target;
+    new_job.generation = params->generation;
+    new_job.session = params->session;
+    new_job.notify_received_us = params->received_us;
 
-    hex2bin(merkle_root, new_job.merkle_root, 32);
-
-    // hex2bin(merkle_root, new_job.merkle_root_be, 32);
-    swap_endian_words(merkle_root, new_job.merkle_root_be);
-    reverse_bytes(new_job.merkle_root_be, 32);
+    memcpy(new_job.merkle_root, merkle_root, 32);
+    reverse_words(new_job.merkle_root, new_job.merkle_root_be);
 
-    swap_endian_words(params->prev_block_hash, new_job.prev_block_hash);
-
-    hex2bin(params->prev_block_hash, new_job.prev_block_hash_be, 32);
-    reverse_bytes(new_job.prev_block_hash_be, 32);
+    memcpy(new_job.prev_block_hash, params->prev_block_hash, 32);
+    reverse_words(new_job.prev_block_hash, new_job.prev_block_hash_be);
 
     ////make the midstate hash
     uint8_t midstate_data[64];
@@ -110,17 +328,13 @@ bm_job construct_bm_job(mining_notify *params, const char *merkle_root, const ui
     return new_job;
 }
 
-char *extranonce_2_generate(uint32_t extranonce_2, uint32_t length)
+void extranonce_2_generate(uint32_t extranonce_2, uint32_t length, uint8_t *dest)
 {
-    char *extranonce_2_str = malloc(length * 2 + 1);
-    memset(extranonce_2_str, '0', length * 2);
-    extranonce_2_str[length * 2] = '\0';
-    bin2hex((uint8_t *)&extranonce_2, length, extranonce_2_str, length * 2 + 1);
-    if (length > 4)
+    // little endian, zero padded when the pool asks for more than 4 bytes
+    for (uint32_t i = 0; i < length; i++)
     {
-        extranonce_2_str[8] = '0';
+        dest[i] = i < 4 ? (extranonce_2 >> (i * 8)) & 0xff : 0;
     }
-    return extranonce_2_str;
 }
 
 ///////cgminer nonce testing
@@ -128,17 +342,50 @@ char *extranonce_2_generate(uint32_t extranonce_2, uint32_t length)
  */
 static const double truediffone = 26959535291011309493156476344723991336010898738574164086137773096960.0;
 
-/* testing a nonce and return the diff - 0 means invalid */
-double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version)
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define sigma0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define sigma1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static inline uint32_t load_be32(const uint8_t *p)
 {
-    double d64, s64, ds;
-    unsigned char header[80];
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void nonce_midstate_init(nonce_midstate *entry, const uint8_t *header)
+{
+    uint32_t w[64];
+    uint8_t midstate[32];
+    memcpy(entry->header, header, sizeof(entry->header));
+    sha256_midstate(header, midstate);
+    for (int i = 0; i < 8; i++)
+    {
+        entry->midstate[i] = load_be32(midstate + i * 4);
+    }
 
-    // // TODO: use the midstate hash instead of hashing the whole header
-    // uint32_t rolled_version = job->version;
-    // for (int i = 0; i < midstate_index; i++) {
-    //     rolled_version = increment_bitmask(rolled_version, job->version_mask);
-    // }
+    // merkle root tail, ntime and nbits, the nonce, then the padding of an 80 byte message
+    memset(w, 0, sizeof(w));
+    for (int i = 0; i < 3; i++)
+    {
+        w[i] = load_be32(header + 64 + i * 4);
+    }
+    w[4] = 0x80000000;
+    w[15] = 80 * 8;
+    w[16] = sigma1(w[14]) + w[9] + sigma0(w[1]) + w[0];
+    w[17] = sigma1(w[15]) + w[10] + sigma0(w[2]) + w[1];
+    w[18] = sigma1(w[16]) + w[11] + w[2];
+    w[19] = sigma1(w[17]) + w[12] + sigma0(w[4]);
+    memcpy(entry->w, w, sizeof(entry->w));
+
+    memcpy(entry->rounds_state, entry->midstate, sizeof(entry->midstate));
+    sha256_soft_rounds(entry->rounds_state, w, 0, 3);
+    entry->valid = true;
+}
+
+// the entry is only valid until the next lookup, without a cache it is built into scratch
+static const nonce_midstate *nonce_midstate_get(nonce_midstate_cache *cache, nonce_midstate *scratch,
+                                                const bm_job *job, uint32_t rolled_version)
+{
+    unsigned char header[76];
 
     // copy data from job to header
     memcpy(header, &rolled_version, 4);
@@ -146,20 +393,215 @@ double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t
     memcpy(header + 36, job->merkle_root, 32);
     memcpy(header + 68, &job->ntime, 4);
     memcpy(header + 72, &job->target, 4);
-    memcpy(header + 76, &nonce, 4);
 
-    unsigned char hash_buffer[32];
-    unsigned char hash_result[32];
+    if (cache == NULL)
+    {
+        nonce_midstate_init(scratch, header);
+        return scratch;
+    }
+
+    uint32_t index = (rolled_version ^ job->ntime ^ load_be32(job->merkle_root)) * 2654435761u >> 28;
+    nonce_midstate *entry = &cache->entries[index % NONCE_MIDSTATE_CACHE_SIZE];
+    if (!entry->valid || memcmp(entry->header, header, sizeof(header)) != 0)
+    {
+        nonce_midstate_init(entry, header);
+    }
+    return entry;
+}
+
+void test_nonce_hash(nonce_midstate_cache *cache, const bm_job *job, const uint32_t nonce, const uint32_t rolled_version,
+                     uint8_t *hash)
+{
+    uint32_t w[64];
+    uint32_t v[8];
+    uint32_t state[8];
+    nonce_midstate scratch;
+
+    const nonce_midstate *entry = nonce_midstate_get(cache, &scratch, job, rolled_version);
+    memcpy(w, entry->w, sizeof(entry->w));
+    memcpy(v, entry->rounds_state, sizeof(v));
+    memcpy(state, entry->midstate, sizeof(state));
+
+    // second block from round 3 on, the nonce is stored little endian in the header
+    w[3] = __builtin_bswap32(nonce);
+    w[18] += sigma0(w[3]);
+    w[19] += w[3];
+    sha256_soft_expand(w, 20);
+    sha256_soft_rounds(v, w, 3, 64);
+    for (int i = 0; i < 8; i++)
+    {
+        state[i] += v[i];
+    }
+    sha256_soft_hash_digest(state, hash);
+}
+
+// test_nonce_hash() of SHA256_LANES checks side by side
+static void test_nonce_hash_lanes(nonce_midstate_cache *cache, nonce_check *const *checks)
+{
+    uint32_t w[64][SHA256_LANES];
+    uint32_t v[8][SHA256_LANES];
+    uint32_t state[8][SHA256_LANES];
+    uint8_t hashes[SHA256_LANES][32];
+    nonce_midstate scratch;
+
+    const nonce_midstate *entry = NULL;
+    for (int l = 0; l < SHA256_LANES; l++)
+    {
+        if (l == 0 || checks[l]->job != checks[l - 1]->job || checks[l]->rolled_version != checks[l - 1]->rolled_version)
+        {
+            entry = nonce_midstate_get(cache, &scratch, checks[l]->job, checks[l]->rolled_version);
+        }
+        for (int i = 0; i < 20; i++)
+        {
+            w[i][l] = entry->w[i];
+        }
+        for (int i = 0; i < 8; i++)
+        {
+            v[i][l] = entry->rounds_state[i];
+            state[i][l] = entry->midstate[i];
+        }
+    }
+
+    for (int l = 0; l < SHA256_LANES; l++)
+    {
+        w[3][l] = __builtin_bswap32(checks[l]->nonce);
+        w[18][l] += sigma0(w[3][l]);
+        w[19][l] += w[3][l];
+    }
+    sha256_soft_expand_lanes(w, 20);
+    sha256_soft_rounds_lanes(v, w, 3);
+    for (int i = 0; i < 8; i++)
+    {
+        for (int l = 0; l < SHA256_LANES; l++)
+        {
+            state[i][l] += v[i][l];
+        }
+    }
+    sha256_soft_hash_digest_lanes(state, hashes);
+    for (int l = 0; l < SHA256_LANES; l++)
+    {
+        memcpy(checks[l]->hash, hashes[l], 32);
+    }
+}
+
+static int compare_nonce_checks(const void *a, const void *b)
+{
+    const nonce_check *x = *(nonce_check *const *)a, *y = *(nonce_check *const *)b;
+    if (x->job != y->job)
+    {
+        return (uintptr_t)x->job < (uintptr_t)y->job ? -1 : 1;
+    }
+    return x->rolled_version < y->rolled_version ? -1 : x->rolled_version > y->rolled_version;
+}
+
+void test_nonce_hashes(nonce_midstate_cache *cache, nonce_check *checks, size_t count)
+{
+    // the caller submits the checks in the order they came, only pointers to them are sorted
+    nonce_check *sorted[NONCE_CHECKS_SORTED];
+
+    for (size_t start = 0; start < count; start += NONCE_CHECKS_SORTED)
+    {
+        size_t batch = count - start < NONCE_CHECKS_SORTED ? count - start : NONCE_CHECKS_SORTED;
+        for (size_t i = 0; i < batch; i++)
+        {
+            sorted[i] = &checks[start + i];
+        }
+        qsort(sorted, batch, sizeof(sorted[0]), compare_nonce_checks);
+
+        size_t i = 0;
+        for (; i + SHA256_LANES <= batch; i += SHA256_LANES)
+        {
+            test_nonce_hash_lanes(cache, sorted + i);
+        }
+        for (; i < batch; i++)
+        {
+            test_nonce_hash(cache, sorted[i]->job, sorted[i]->nonce, sorted[i]->rolled_version, sorted[i]->hash);
+        }
+    }
+}
+
+double hash_difficulty(const uint8_t *hash)
+{
+    return truediffone / le256todouble(hash);
+}
+
+/* testing a nonce and return the diff - 0 means invalid */
+double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version)
+{
+    uint8_t hash[32];
+    test_nonce_hash(NULL, job, nonce, rolled_version, hash);
+    return hash_difficulty(hash);
+}
+
+void hash_target_from_difficulty(uint32_t difficulty, hash_target *target)
+{
+    if (difficulty == 0)
+    {
+        memset(target->words, 0xff, sizeof(target->words));
+        return;
+    }
+
+    // truediffone / difficulty, one 32-bit word at a time from the top
+    hash_target diffone = {.words = {[6] = 0xffff0000}};
+    uint64_t remainder = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        uint64_t dividend = remainder << 32 | diffone.words[i];
+        target->words[i] = dividend / difficulty;
+        remainder = dividend % difficulty;
+    }
+}
 
-    // double hash the header
-    mbedtls_sha256(header, 80, hash_buffer, 0);
-    mbedtls_sha256(hash_buffer, 32, hash_result, 0);
+void hash_target_from_nbits(uint32_t nbits, hash_target *target)
+{
+    uint32_t mantissa = nbits & 0x007fffff;
+    int shift = 8 * (int)((nbits >> 24) - 3);
 
-    d64 = truediffone;
-    s64 = le256todouble(hash_result);
-    ds = d64 / s64;
+    memset(target->words, 0, sizeof(target->words));
+    if (mantissa == 0)
+    {
+        return;
+    }
+    if (shift < 0)
+    {
+        target->words[0] = shift > -32 ? mantissa >> -shift : 0;
+        return;
+    }
+    if (shift >= 256 || (shift > 256 - 23 && mantissa >> (256 - shift) != 0))
+    {
+        // more than 256 bits, nothing is above it
+        memset(target->words, 0xff, sizeof(target->words));
+        return;
+    }
+    int word = shift / 32;
+    int bits = shift % 32;
+    target->words[word] = mantissa << bits;
+    if (bits > 0 && word < 7)
+    {
+        target->words[word + 1] = mantissa >> (32 - bits);
+    }
+}
 
-    return ds;
+bool hash_meets_target(const uint8_t *hash, const hash_target *target)
+{
+    // the top two words decide for almost every hash
+    for (int i = 7; i >= 0; i--)
+    {
+        uint32_t word = (uint32_t)hash[i * 4] | (uint32_t)hash[i * 4 + 1] << 8 | (uint32_t)hash[i * 4 + 2] << 16 |
+                        (uint32_t)hash[i * 4 + 3] << 24;
+        if (word != target->words[i])
+        {
+            return word < target->words[i];
+        }
+    }
+    return true;
+}
+
+void mining_notify_set_difficulty(mining_notify *notify, uint32_t difficulty)
+{
+    notify->difficulty = difficulty;
+    hash_target_from_difficulty(difficulty, &notify->pool_target);
+    hash_target_from_nbits(notify->target, &notify->network_target);
 }
 
 uint32_t increment_bitmask(const uint32_t value, const uint32_t mask)
@@ -0,0 +1,303 @@
+#include "sha256.h"
+
+#include <string.h>
+
+#include "sdkconfig.h"
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t sha256_iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                               0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// K + W of the block that pads a 64-byte message, the whole message schedule is constant
+static const uint32_t PAD_64_KW[64] = {
+    0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+    0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254, 0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+    0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7, 0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+    0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd, 0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+    0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537, 0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+    0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7, 0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+    0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c, 0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SIGMA0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define SIGMA1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define sigma0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define sigma1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+#define CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+// the variables rotate through the arguments instead of being moved every round
+#define ROUND(a, b, c, d, e, f, g, h, kw)                  \
+    do                                                     \
+    {                                                      \
+        uint32_t t1 = h + SIGMA1(e) + CH(e, f, g) + (kw);  \
+        d += t1;                                           \
+        h = t1 + SIGMA0(a) + MAJ(a, b, c);                 \
+    } while (0)
+
+#define ROUNDS_8(KW, i)                          \
+    ROUND(a, b, c, d, e, f, g, h, KW((i) + 0));  \
+    ROUND(h, a, b, c, d, e, f, g, KW((i) + 1));  \
+    ROUND(g, h, a, b, c, d, e, f, KW((i) + 2));  \
+    ROUND(f, g, h, a, b, c, d, e, KW((i) + 3));  \
+    ROUND(e, f, g, h, a, b, c, d, KW((i) + 4));  \
+    ROUND(d, e, f, g, h, a, b, c, KW((i) + 5));  \
+    ROUND(c, d, e, f, g, h, a, b, KW((i) + 6));  \
+    ROUND(b, c, d, e, f, g, h, a, KW((i) + 7))
+
+#define ROUNDS_64(KW)  \
+    ROUNDS_8(KW, 0);   \
+    ROUNDS_8(KW, 8);   \
+    ROUNDS_8(KW, 16);  \
+    ROUNDS_8(KW, 24);  \
+    ROUNDS_8(KW, 32);  \
+    ROUNDS_8(KW, 40);  \
+    ROUNDS_8(KW, 48);  \
+    ROUNDS_8(KW, 56)
+
+#define KW_SCHEDULE(i) (K[i] + w[i])
+#define KW_TABLE(i) (kw[i])
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline void store_state(const uint32_t *state, uint8_t *dest)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        dest[i * 4] = state[i] >> 24;
+        dest[i * 4 + 1] = state[i] >> 16;
+        dest[i * 4 + 2] = state[i] >> 8;
+        dest[i * 4 + 3] = state[i];
+    }
+}
+
+void sha256_soft_expand(uint32_t *w, int from)
+{
+    for (int i = from; i < 64; i++)
+    {
+        w[i] = sigma1(w[i - 2]) + w[i - 7] + sigma0(w[i - 15]) + w[i - 16];
+    }
+}
+
+void sha256_soft_rounds(uint32_t *v, const uint32_t *w, int from, int to)
+{
+    uint32_t a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+    for (int i = from; i < to; i++)
+    {
+        uint32_t t1 = h + SIGMA1(e) + CH(e, f, g) + K[i] + w[i];
+        uint32_t t2 = SIGMA0(a) + MAJ(a, b, c);
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    v[0] = a, v[1] = b, v[2] = c, v[3] = d, v[4] = e, v[5] = f, v[6] = g, v[7] = h;
+}
+
+// w holds the 16 message words, the rest of the schedule is filled in
+static void compress(uint32_t *state, uint32_t *w)
+{
+    sha256_soft_expand(w, 16);
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6],
+             h = state[7];
+    ROUNDS_64(KW_SCHEDULE);
+    state[0] += a, state[1] += b, state[2] += c, state[3] += d;
+    state[4] += e, state[5] += f, state[6] += g, state[7] += h;
+}
+
+// a block with a precomputed message schedule
+static void compress_kw(uint32_t *state, const uint32_t *kw)
+{
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6],
+             h = state[7];
+    ROUNDS_64(KW_TABLE);
+    state[0] += a, state[1] += b, state[2] += c, state[3] += d;
+    state[4] += e, state[5] += f, state[6] += g, state[7] += h;
+}
+
+static void compress_bytes(uint32_t *state, const uint8_t *block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = load_be32(block + i * 4);
+    }
+    compress(state, w);
+}
+
+void sha256_soft_hash_digest(const uint32_t *digest, uint8_t *hash)
+{
+    uint32_t w[64] = {[8] = 0x80000000, [15] = 32 * 8};
+    memcpy(w, digest, 8 * sizeof(uint32_t));
+    uint32_t state[8];
+    memcpy(state, sha256_iv, sizeof(state));
+    compress(state, w);
+    store_state(state, hash);
+}
+
+void sha256_soft_expand_lanes(uint32_t w[64][SHA256_LANES], int from)
+{
+    for (int i = from; i < 64; i++)
+    {
+        for (int l = 0; l < SHA256_LANES; l++)
+        {
+            w[i][l] = sigma1(w[i - 2][l]) + w[i - 7][l] + sigma0(w[i - 15][l]) + w[i - 16][l];
+        }
+    }
+}
+
+#define ROUND_LANES(a, b, c, d, e, f, g, h, i)                                                      \
+    for (int l = 0; l < SHA256_LANES; l++)                                                         \
+    {                                                                                              \
+        uint32_t t1 = h[l] + SIGMA1(e[l]) + CH(e[l], f[l], g[l]) + K[i] + w[i][l];                 \
+        d[l] += t1;                                                                                \
+        h[l] = t1 + SIGMA0(a[l]) + MAJ(a[l], b[l], c[l]);                                          \
+    }
+
+void sha256_soft_rounds_lanes(uint32_t v[8][SHA256_LANES], const uint32_t w[64][SHA256_LANES], int from)
+{
+    // the letters move through v instead of the values, s[0] is where a currently is
+    uint32_t *s[8];
+    for (int j = 0; j < 8; j++)
+    {
+        s[j] = v[j];
+    }
+    int i = from;
+    for (; i % 8 != 0; i++)
+    {
+        ROUND_LANES(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], i);
+        uint32_t *h = s[7];
+        memmove(s + 1, s, 7 * sizeof(s[0]));
+        s[0] = h;
+    }
+    uint32_t *a = s[0], *b = s[1], *c = s[2], *d = s[3], *e = s[4], *f = s[5], *g = s[6], *h = s[7];
+    for (; i < 64; i += 8)
+    {
+        ROUND_LANES(a, b, c, d, e, f, g, h, i);
+        ROUND_LANES(h, a, b, c, d, e, f, g, i + 1);
+        ROUND_LANES(g, h, a, b, c, d, e, f, i + 2);
+        ROUND_LANES(f, g, h, a, b, c, d, e, i + 3);
+        ROUND_LANES(e, f, g, h, a, b, c, d, i + 4);
+        ROUND_LANES(d, e, f, g, h, a, b, c, i + 5);
+        ROUND_LANES(c, d, e, f, g, h, a, b, i + 6);
+        ROUND_LANES(b, c, d, e, f, g, h, a, i + 7);
+    }
+
+    if (s[0] != v[0])
+    {
+        uint32_t letters[8][SHA256_LANES];
+        for (int j = 0; j < 8; j++)
+        {
+            memcpy(letters[j], s[j], sizeof(letters[j]));
+        }
+        memcpy(v, letters, sizeof(letters));
+    }
+}
+
+void sha256_soft_hash_digest_lanes(const uint32_t digest[8][SHA256_LANES], uint8_t hash[SHA256_LANES][32])
+{
+    uint32_t w[64][SHA256_LANES];
+    uint32_t v[8][SHA256_LANES];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int l = 0; l < SHA256_LANES; l++)
+        {
+            w[i][l] = i < 8 ? digest[i][l] : i == 8 ? 0x80000000 : i == 15 ? 32 * 8 : 0;
+        }
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        for (int l = 0; l < SHA256_LANES; l++)
+        {
+            v[i][l] = sha256_iv[i];
+        }
+    }
+    sha256_soft_expand_lanes(w, 16);
+    sha256_soft_rounds_lanes(v, w, 0);
+    for (int l = 0; l < SHA256_LANES; l++)
+    {
+        uint32_t state[8];
+        for (int i = 0; i < 8; i++)
+        {
+            state[i] = sha256_iv[i] + v[i][l];
+        }
+        store_state(state, hash[l]);
+    }
+}
+
+static void soft_midstate(const uint8_t *block, uint8_t *midstate)
+{
+    uint32_t state[8];
+    memcpy(state, sha256_iv, sizeof(state));
+    compress_bytes(state, block);
+    store_state(state, midstate);
+}
+
+static void soft_double_80(const uint8_t *header, uint8_t *hash)
+{
+    uint32_t state[8];
+    memcpy(state, sha256_iv, sizeof(state));
+    compress_bytes(state, header);
+
+    uint32_t w[64] = {[4] = 0x80000000, [15] = 80 * 8};
+    for (int i = 0; i < 4; i++)
+    {
+        w[i] = load_be32(header + 64 + i * 4);
+    }
+    compress(state, w);
+    sha256_soft_hash_digest(state, hash);
+}
+
+static void soft_double_64(const uint8_t *pair, uint8_t *hash)
+{
+    uint32_t state[8];
+    memcpy(state, sha256_iv, sizeof(state));
+    compress_bytes(state, pair);
+    compress_kw(state, PAD_64_KW);
+    sha256_soft_hash_digest(state, hash);
+}
+
+const sha256_backend sha256_software = {
+    .name = "software",
+    .midstate = soft_midstate,
+    .double_80 = soft_double_80,
+    .double_64 = soft_double_64,
+};
+
+#if CONFIG_STRATUM_SHA256_HARDWARE
+#define BACKEND sha256_hardware
+#else
+#define BACKEND sha256_software
+#endif
+
+void sha256_midstate(const uint8_t *block, uint8_t *midstate)
+{
+    BACKEND.midstate(block, midstate);
+}
+
+void sha256_double_80(const uint8_t *header, uint8_t *hash)
+{
+    BACKEND.double_80(header, hash);
+}
+
+void sha256_double_64(const uint8_t *pair, uint8_t *hash)
+{
+    BACKEND.double_64(pair, hash);
+}
@@ -0,0 +1,78 @@
+#include "sha256.h"
+
+#if SOC_SHA_SUPPORT_RESUME
+
+#include <string.h>
+
+#include "hal/sha_hal.h"
+#include "sha/sha_core.h"
+
+// The peripheral takes the message bytes as they are, padding included, and can continue from a
+// state read back earlier. Blocks are copied first, it is fed whole 32-bit words.
+
+static const uint8_t PAD_64[64] = {[0] = 0x80, [62] = (64 * 8) >> 8, [63] = (64 * 8) & 0xff};
+
+static void hash_block(const void *block, bool first)
+{
+    uint32_t words[16];
+    memcpy(words, block, sizeof(words));
+    sha_hal_hash_block(SHA2_256, words, 16, first);
+}
+
+// the digest registers hold the state big endian already
+static void read_hash(uint8_t *hash)
+{
+    uint32_t state[8];
+    sha_hal_wait_idle();
+    sha_hal_read_digest(SHA2_256, state);
+    memcpy(hash, state, sizeof(state));
+}
+
+// the second hash of a double sha256, hash is replaced
+static void hash_digest(uint8_t *hash)
+{
+    uint8_t block[64] = {[32] = 0x80, [62] = (32 * 8) >> 8, [63] = (32 * 8) & 0xff};
+    memcpy(block, hash, 32);
+    hash_block(block, true);
+    read_hash(hash);
+}
+
+static void hw_midstate(const uint8_t *block, uint8_t *midstate)
+{
+    esp_sha_acquire_hardware();
+    hash_block(block, true);
+    read_hash(midstate);
+    esp_sha_release_hardware();
+}
+
+static void hw_double_80(const uint8_t *header, uint8_t *hash)
+{
+    uint8_t tail[64] = {[16] = 0x80, [62] = (80 * 8) >> 8, [63] = (80 * 8) & 0xff};
+    memcpy(tail, header + 64, 16);
+
+    esp_sha_acquire_hardware();
+    hash_block(header, true);
+    hash_block(tail, false);
+    read_hash(hash);
+    hash_digest(hash);
+    esp_sha_release_hardware();
+}
+
+static void hw_double_64(const uint8_t *pair, uint8_t *hash)
+{
+    esp_sha_acquire_hardware();
+    hash_block(pair, true);
+    hash_block(PAD_64, false);
+    read_hash(hash);
+    hash_digest(hash);
+    esp_sha_release_hardware();
+}
+
+const sha256_backend sha256_hardware = {
+    .name = "hardware",
+    .midstate = hw_midstate,
+    .double_80 = hw_double_80,
+    .double_64 = hw_double_64,
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include "share_tracker.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char * TAG = "share_tracker";
+
+void share_tracker_init(share_tracker * tracker)
+{
+    memset(tracker, 0, sizeof(share_tracker));
+    pthread_mutex_init(&tracker->lock, NULL);
+}
+
+void share_tracker_reset(share_tracker * tracker)
+{
+    pthread_mutex_lock(&tracker->lock);
+    for (int i = 0; i < SHARE_TRACKER_SIZE; i++) {
+        if (tracker->in_flight[i].send_uid != 0) {
+            tracker->in_flight[i].send_uid = 0;
+            tracker->lost++;
+        }
+    }
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+void share_tracker_clear_stats(share_tracker * tracker)
+{
+    pthread_mutex_lock(&tracker->lock);
+    memset(tracker->latency_histogram, 0, sizeof(tracker->latency_histogram));
+    tracker->accepted = 0;
+    tracker->rejected = 0;
+    tracker->lost = 0;
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+void share_tracker_submit(share_tracker * tracker, int send_uid, const char * jobid, double nonce_diff, int64_t job_age_us)
+{
+    pthread_mutex_lock(&tracker->lock);
+    tracked_share * share = &tracker->in_flight[send_uid & (SHARE_TRACKER_SIZE - 1)];
+    if (share->send_uid != 0) {
+        ESP_LOGW(TAG, "No response to share %d for job %s", share->send_uid, share->jobid);
+        tracker->lost++;
+    }
+    share->send_uid = send_uid;
+    share->submit_us = esp_timer_get_time();
+    strncpy(share->jobid, jobid, sizeof(share->jobid) - 1);
+    share->jobid[sizeof(share->jobid) - 1] = '\0';
+    share->nonce_diff = nonce_diff;
+    share->job_age_us = job_age_us;
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+void share_tracker_cancel(share_tracker * tracker, int send_uid)
+{
+    pthread_mutex_lock(&tracker->lock);
+    tracked_share * share = &tracker->in_flight[send_uid & (SHARE_TRACKER_SIZE - 1)];
+    if (share->send_uid == send_uid) {
+        share->send_uid = 0;
+    }
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+// 256 us and below in bucket 0, then four buckets per power of two
+static int latency_bucket(int64_t latency_us)
+{
+    if (latency_us < 256) {
+        return 0;
+    }
+    int msb = 63 - __builtin_clzll(latency_us);
+    int bucket = 1 + (msb - 8) * 4 + ((latency_us >> (msb - 2)) & 3);
+    return bucket < SHARE_LATENCY_BUCKETS ? bucket : SHARE_LATENCY_BUCKETS - 1;
+}
+
+static int64_t latency_bucket_upper_bound(int bucket)
+{
+    if (bucket == 0) {
+        return 256;
+    }
+    int msb = 8 + (bucket - 1) / 4;
+    return (int64_t) (4 + (bucket - 1) % 4 + 1) << (msb - 2);
+}
+
+bool share_tracker_complete(share_tracker * tracker, int send_uid, bool accepted, tracked_share * share, int64_t * latency_us)
+{
+    int64_t now = esp_timer_get_time();
+
+    pthread_mutex_lock(&tracker->lock);
+    tracked_share * entry = &tracker->in_flight[send_uid & (SHARE_TRACKER_SIZE - 1)];
+    if (send_uid == 0 || entry->send_uid != send_uid) {
+        pthread_mutex_unlock(&tracker->lock);
+        return false;
+    }
+
+    int64_t latency = now - entry->submit_us;
+    tracker->latency_histogram[latency_bucket(latency)]++;
+    if (accepted) {
+        tracker->accepted++;
+    } else {
+        tracker->rejected++;
+    }
+    if (share != NULL) {
+        *share = *entry;
+    }
+    if (latency_us != NULL) {
+        *latency_us = latency;
+    }
+    entry->send_uid = 0;
+    pthread_mutex_unlock(&tracker->lock);
+    return true;
+}
+
+int64_t share_tracker_oldest_since(share_tracker * tracker, int64_t since_us)
+{
+    int64_t oldest = 0;
+    pthread_mutex_lock(&tracker->lock);
+    for (int i = 0; i < SHARE_TRACKER_SIZE; i++) {
+        tracked_share * share = &tracker->in_flight[i];
+        if (share->send_uid != 0 && share->submit_us >= since_us && (oldest == 0 || share->submit_us < oldest)) {
+            oldest = share->submit_us;
+        }
+    }
+    pthread_mutex_unlock(&tracker->lock);
+    return oldest;
+}
+
+// lock held
+static int64_t latency_percentile(share_tracker * tracker, uint32_t total, uint32_t percent)
+{
+    if (total == 0) {
+        return 0;
+    }
+    // the smallest bucket that covers at least percent of the responses
+    uint64_t rank = ((uint64_t) total * percent + 99) / 100;
+    uint64_t count = 0;
+    for (int i = 0; i < SHARE_LATENCY_BUCKETS; i++) {
+        count += tracker->latency_histogram[i];
+        if (count >= rank) {
+            return latency_bucket_upper_bound(i);
+        }
+    }
+    return latency_bucket_upper_bound(SHARE_LATENCY_BUCKETS - 1);
+}
+
+void share_tracker_get_stats(share_tracker * tracker, share_tracker_stats * stats)
+{
+    pthread_mutex_lock(&tracker->lock);
+    stats->accepted = tracker->accepted;
+    stats->rejected = tracker->rejected;
+    stats->lost = tracker->lost;
+    stats->in_flight = 0;
+    for (int i = 0; i < SHARE_TRACKER_SIZE; i++) {
+        stats->in_flight += tracker->in_flight[i].send_uid != 0;
+    }
+    uint32_t total = 0;
+    for (int i = 0; i < SHARE_LATENCY_BUCKETS; i++) {
+        total += tracker->latency_histogram[i];
+    }
+    stats->latency_p50_us = latency_percentile(tracker, total, 50);
+    stats->latency_p95_us = latency_percentile(tracker, total, 95);
+    stats->latency_p99_us = latency_percentile(tracker, total, 99);
+    pthread_mutex_unlock(&tracker->lock);
+}
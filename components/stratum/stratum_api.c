@@ -8,101 +8,402 @@
 #include "cJSON.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
+#include "line_buffer.h"
+#include "stratum_tls.h"
+#include "stratum_tx.h"
 #include "lwip/sockets.h"
 #include "utils.h"
+#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 
 #define BUFFER_SIZE 1024
 static const char * TAG = "stratum_api";
 
-static char * json_rpc_buffer = NULL;
-static size_t json_rpc_buffer_size = 0;
-
 static void debug_stratum_tx(const char *);
 int _parse_stratum_subscribe_result_message(const char * result_json_str, char ** extranonce, int * extranonce2_len);
 
-void STRATUM_V1_initialize_buffer()
+const char * STRATUM_V1_receive_jsonrpc_line(line_buffer * buffer, int sockfd)
 {
-    json_rpc_buffer = malloc(BUFFER_SIZE);
-    json_rpc_buffer_size = BUFFER_SIZE;
-    if (json_rpc_buffer == NULL) {
-        printf("Error: Failed to allocate memory for buffer\n");
-        exit(1);
+    const char * line;
+    while ((line = line_buffer_next_line(buffer, NULL)) == NULL) {
+        size_t available;
+        char * dest = line_buffer_write_ptr(buffer, &available);
+        int nbytes = stratum_socket_recv(sockfd, dest, available, 0);
+        if (nbytes <= 0) {
+            if (nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                // receive timeout, the connection and the partial line stay
+                return NULL;
+            }
+            if (nbytes == 0) {
+                ESP_LOGI(TAG, "Error: recv (connection closed by peer)");
+                // not a stale EAGAIN from an earlier call
+                errno = ENOTCONN;
+            } else {
+                ESP_LOGI(TAG, "Error: recv (errno %d: %s)", errno, strerror(errno));
+            }
+            line_buffer_reset(buffer);
+            return NULL;
+        }
+        line_buffer_commit(buffer, nbytes);
     }
-    memset(json_rpc_buffer, 0, BUFFER_SIZE);
+    return line;
 }
 
-void cleanup_stratum_buffer()
+// Minimal JSON tokenizer for the messages that arrive on every block and share. Tokens point
+// into the received line, nothing is copied or allocated until the values are decoded.
+typedef struct
+{
+    const char * start;
+    const char * end;
+} json_token;
+
+static const char * json_skip_ws(const char * p)
 {
-    free(json_rpc_buffer);
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+    return p;
 }
 
-static void realloc_json_buffer(size_t len)
+// Returns the end of the value starting at p or NULL if it is malformed
+static const char * json_skip_value(const char * p)
 {
-    size_t old, new;
+    if (*p == '"') {
+        for (p++; *p != '"'; p++) {
+            if (*p == '\0' || (*p == '\\' && *++p == '\0')) {
+                return NULL;
+            }
+        }
+        return p + 1;
+    }
 
-    old = strlen(json_rpc_buffer);
-    new = old + len + 1;
+    if (*p == '[' || *p == '{') {
+        int depth = 0;
+        do {
+            if (*p == '"') {
+                p = json_skip_value(p);
+                if (p == NULL) {
+                    return NULL;
+                }
+                continue;
+            }
+            if (*p == '[' || *p == '{') {
+                depth++;
+            } else if (*p == ']' || *p == '}') {
+                depth--;
+            } else if (*p == '\0') {
+                return NULL;
+            }
+            p++;
+        } while (depth > 0);
+        return p;
+    }
 
-    if (new < json_rpc_buffer_size) {
-        return;
+    const char * start = p;
+    while (*p != '\0' && *p != ',' && *p != ']' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+        p++;
     }
+    return p == start ? NULL : p;
+}
 
-    new = new + (BUFFER_SIZE - (new % BUFFER_SIZE));
-    void * new_sockbuf = realloc(json_rpc_buffer, new);
+// Reads the next array element or object member. p points behind the opening bracket or behind
+// the previous value. Returns the end of the value, or NULL at the end of the container and on
+// malformed input. value->start is NULL only at the end of the container.
+static const char * json_next(const char * p, json_token * key, json_token * value)
+{
+    value->start = NULL;
+    p = json_skip_ws(p);
+    if (*p == ',') {
+        p = json_skip_ws(p + 1);
+    }
+    if (*p == ']' || *p == '}') {
+        return NULL;
+    }
 
-    if (new_sockbuf == NULL) {
-        fprintf(stderr, "Error: realloc failed in recalloc_sock()\n");
-        ESP_LOGI(TAG, "Restarting System because of ERROR: realloc failed in recalloc_sock");
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-        esp_restart();
+    value->start = p;
+    if (key != NULL) {
+        if (*p != '"' || (key->end = json_skip_value(p)) == NULL) {
+            return NULL;
+        }
+        key->start = p;
+        p = json_skip_ws(key->end);
+        if (*p != ':') {
+            return NULL;
+        }
+        p = json_skip_ws(p + 1);
+        value->start = p;
     }
 
-    json_rpc_buffer = new_sockbuf;
-    memset(json_rpc_buffer + old, 0, new - old);
-    json_rpc_buffer_size = new;
+    value->end = json_skip_value(p);
+    return value->end;
+}
+
+static bool json_is_string(const json_token * token)
+{
+    return token->start != NULL && *token->start == '"';
+}
+
+static size_t json_string_len(const json_token * token)
+{
+    return token->end - token->start - 2;
+}
+
+static bool json_string_equals(const json_token * token, const char * str)
+{
+    size_t len = strlen(str);
+    return json_is_string(token) && json_string_len(token) == len && memcmp(token->start + 1, str, len) == 0;
 }
 
-char * STRATUM_V1_receive_jsonrpc_line(int sockfd)
+static bool json_literal_equals(const json_token * token, const char * literal)
 {
-    if (json_rpc_buffer == NULL) {
-        STRATUM_V1_initialize_buffer();
+    size_t len = strlen(literal);
+    return token->start != NULL && token->end - token->start == len && memcmp(token->start, literal, len) == 0;
+}
+
+static bool json_is_null(const json_token * token)
+{
+    return json_literal_equals(token, "null");
+}
+
+static bool json_is_number(const json_token * token)
+{
+    return token->start != NULL && (*token->start == '-' || (*token->start >= '0' && *token->start <= '9'));
+}
+
+static bool json_hex_to_bin(const json_token * token, uint8_t * dest, size_t len)
+{
+    return json_is_string(token) && json_string_len(token) == len * 2 && hex2bin(token->start + 1, dest, len) == len;
+}
+
+static uint32_t json_hex_to_uint32(const json_token * token)
+{
+    return json_is_string(token) ? strtoul(token->start + 1, NULL, 16) : 0;
+}
+
+static void json_copy_string(const json_token * token, char * dest)
+{
+    size_t len = json_string_len(token);
+    memcpy(dest, token->start + 1, len);
+    dest[len] = '\0';
+}
+
+static void set_error_str(StratumApiV1Message * message, const char * str, size_t len)
+{
+    if (len >= sizeof(message->error_str)) {
+        len = sizeof(message->error_str) - 1;
     }
-    char *line, *tok = NULL;
-    char recv_buffer[BUFFER_SIZE];
-    int nbytes;
-    size_t buflen = 0;
+    memcpy(message->error_str, str, len);
+    message->error_str[len] = '\0';
+}
 
-    if (!strstr(json_rpc_buffer, "\n")) {
-        do {
-            memset(recv_buffer, 0, BUFFER_SIZE);
-            nbytes = recv(sockfd, recv_buffer, BUFFER_SIZE - 1, 0);
-            if (nbytes == -1) {
-                ESP_LOGI(TAG, "Error: recv (errno %d: %s)", errno, strerror(errno));
-                if (json_rpc_buffer) {
-                    free(json_rpc_buffer);
-                    json_rpc_buffer=0;
-                }
-                return 0;
+static mining_notify * parse_mining_notify(const json_token * params, int * should_abandon_work)
+{
+    json_token job_id, prev_block_hash, coinbase_1, coinbase_2, merkle_branches, version, target, ntime, param, last = {0};
+    json_token * fields[] = {&job_id, &prev_block_hash, &coinbase_1, &coinbase_2, &merkle_branches, &version, &target, &ntime};
+    const int n_fields = sizeof(fields) / sizeof(fields[0]);
+
+    const char * p = params->start + 1;
+    int n_params = 0;
+    // params can be variable length, clean_jobs is always the last one
+    while ((p = json_next(p, NULL, &param)) != NULL) {
+        if (n_params < n_fields) {
+            *fields[n_params] = param;
+        }
+        last = param;
+        n_params++;
+    }
+    if (param.start != NULL || n_params < n_fields || !json_is_string(&job_id) || !json_is_string(&coinbase_1) ||
+        !json_is_string(&coinbase_2) || json_string_len(&coinbase_1) % 2 != 0 || json_string_len(&coinbase_2) % 2 != 0 ||
+        *merkle_branches.start != '[') {
+        return NULL;
+    }
+
+    size_t n_merkle_branches = 0;
+    json_token branch;
+    p = merkle_branches.start + 1;
+    while ((p = json_next(p, NULL, &branch)) != NULL) {
+        if (!json_is_string(&branch) || json_string_len(&branch) != HASH_SIZE * 2) {
+            return NULL;
+        }
+        n_merkle_branches++;
+    }
+    if (branch.start != NULL) {
+        return NULL;
+    }
+    if (n_merkle_branches > MAX_MERKLE_BRANCHES) {
+        ESP_LOGE(TAG, "Too many Merkle branches: %u", (unsigned) n_merkle_branches);
+        return NULL;
+    }
+
+    // struct, merkle branches, coinbase halves and job id share one allocation
+    size_t coinbase_1_len = json_string_len(&coinbase_1) / 2;
+    size_t coinbase_2_len = json_string_len(&coinbase_2) / 2;
+    size_t size = sizeof(mining_notify) + HASH_SIZE * n_merkle_branches + coinbase_1_len + coinbase_2_len +
+                  json_string_len(&job_id) + 1;
+    mining_notify * new_work = malloc(size);
+    if (new_work == NULL) {
+        return NULL;
+    }
+
+    uint8_t prev_block_hash_bin[HASH_SIZE];
+    if (!json_hex_to_bin(&prev_block_hash, prev_block_hash_bin, HASH_SIZE)) {
+        free(new_work);
+        return NULL;
+    }
+    // stratum sends the hash as 32-bit words with swapped byte order, store it as it goes into the header
+    flip32bytes(new_work->prev_block_hash, prev_block_hash_bin);
+
+    new_work->merkle_branches = (uint8_t *) (new_work + 1);
+    new_work->n_merkle_branches = 0;
+    p = merkle_branches.start + 1;
+    while ((p = json_next(p, NULL, &branch)) != NULL) {
+        json_hex_to_bin(&branch, new_work->merkle_branches + HASH_SIZE * new_work->n_merkle_branches++, HASH_SIZE);
+    }
+
+    new_work->coinbase_1 = new_work->merkle_branches + HASH_SIZE * n_merkle_branches;
+    new_work->coinbase_1_len = coinbase_1_len;
+    json_hex_to_bin(&coinbase_1, new_work->coinbase_1, coinbase_1_len);
+    new_work->coinbase_2 = new_work->coinbase_1 + coinbase_1_len;
+    new_work->coinbase_2_len = coinbase_2_len;
+    json_hex_to_bin(&coinbase_2, new_work->coinbase_2, coinbase_2_len);
+
+    new_work->job_id = (char *) (new_work->coinbase_2 + coinbase_2_len);
+    json_copy_string(&job_id, new_work->job_id);
+
+    new_work->version = json_hex_to_uint32(&version);
+    new_work->version_mask = 0;
+    new_work->header_only = false;
+    new_work->target = json_hex_to_uint32(&target);
+    new_work->ntime = json_hex_to_uint32(&ntime);
+    new_work->difficulty = 0;
+
+    *should_abandon_work = json_literal_equals(&last, "true");
+    return new_work;
+}
+
+// Handles mining.notify, mining.set_difficulty and boolean results. Returns false for anything
+// else so that it goes through cJSON.
+static bool parse_message_fast(StratumApiV1Message * message, const char * stratum_json)
+{
+    json_token id = {0}, method = {0}, params = {0}, result = {0}, error = {0}, reject_reason = {0};
+    json_token key, value;
+
+    const char * p = json_skip_ws(stratum_json);
+    if (*p != '{') {
+        return false;
+    }
+    p++;
+    while ((p = json_next(p, &key, &value)) != NULL) {
+        if (json_string_equals(&key, "id")) {
+            id = value;
+        } else if (json_string_equals(&key, "method")) {
+            method = value;
+        } else if (json_string_equals(&key, "params")) {
+            params = value;
+        } else if (json_string_equals(&key, "result")) {
+            result = value;
+        } else if (json_string_equals(&key, "error")) {
+            error = value;
+        } else if (json_string_equals(&key, "reject-reason")) {
+            reject_reason = value;
+        }
+    }
+    if (value.start != NULL) {
+        return false;
+    }
+
+    int64_t parsed_id = json_is_number(&id) ? strtoll(id.start, NULL, 10) : -1;
+
+    if (method.start != NULL) {
+        if (json_string_equals(&method, "mining.notify")) {
+            message->message_id = parsed_id;
+            message->method = STRATUM_UNKNOWN;
+            if (params.start == NULL || *params.start != '[') {
+                ESP_LOGE(TAG, "Invalid mining.notify: %s", stratum_json);
+                return true;
+            }
+            message->mining_notification = parse_mining_notify(&params, &message->should_abandon_work);
+            if (message->mining_notification == NULL) {
+                ESP_LOGE(TAG, "Invalid mining.notify: %s", stratum_json);
+                return true;
             }
+            message->method = MINING_NOTIFY;
+            return true;
+        }
 
-            realloc_json_buffer(nbytes);
-            strncat(json_rpc_buffer, recv_buffer, nbytes);
-        } while (!strstr(json_rpc_buffer, "\n"));
-    }
-    buflen = strlen(json_rpc_buffer);
-    tok = strtok(json_rpc_buffer, "\n");
-    line = strdup(tok);
-    int len = strlen(line);
-    if (buflen > len + 1)
-        memmove(json_rpc_buffer, json_rpc_buffer + len + 1, buflen - len + 1);
-    else
-        strcpy(json_rpc_buffer, "");
-    return line;
+        if (json_string_equals(&method, "mining.set_difficulty")) {
+            json_token difficulty;
+            if (params.start == NULL || *params.start != '[' || json_next(params.start + 1, NULL, &difficulty) == NULL ||
+                !json_is_number(&difficulty)) {
+                return false;
+            }
+            double new_difficulty = strtod(difficulty.start, NULL);
+            message->message_id = parsed_id;
+            message->new_difficulty = new_difficulty >= UINT32_MAX ? UINT32_MAX : (uint32_t) new_difficulty;
+            message->method = MINING_SET_DIFFICULTY;
+            return true;
+        }
+
+        return false;
+    }
+
+    // share and setup results, subscribe and configure results go through cJSON
+    bool result_is_bool = json_literal_equals(&result, "true") || json_literal_equals(&result, "false");
+    bool has_error = error.start != NULL && !json_is_null(&error);
+    if (!result_is_bool && !(has_error && json_is_null(&result))) {
+        return false;
+    }
+
+    message->message_id = parsed_id;
+    message->method = parsed_id < 5 ? STRATUM_RESULT_SETUP : STRATUM_RESULT;
+
+    if (has_error) {
+        message->response_success = false;
+        set_error_str(message, "unknown", 7);
+        json_token error_code, error_msg;
+        if (*error.start == '[' && (p = json_next(error.start + 1, NULL, &error_code)) != NULL &&
+            json_next(p, NULL, &error_msg) != NULL && json_is_string(&error_msg)) {
+            set_error_str(message, error_msg.start + 1, json_string_len(&error_msg));
+        }
+    } else if (json_literal_equals(&result, "true")) {
+        message->response_success = true;
+    } else {
+        message->response_success = false;
+        set_error_str(message, "unknown", 7);
+        if (json_is_string(&reject_reason)) {
+            set_error_str(message, reject_reason.start + 1, json_string_len(&reject_reason));
+        }
+    }
+    return true;
 }
 
-void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
+// The id of the mining.notify subscription, either a single [method, id] pair or a list of them.
+// Ids that would need escaping to be sent back are ignored.
+static void parse_subscription_id(cJSON * subscriptions, char * subscription_id)
+{
+    subscription_id[0] = '\0';
+    cJSON * pair = cJSON_IsString(cJSON_GetArrayItem(subscriptions, 0)) ? subscriptions : NULL;
+    for (int i = 0; pair == NULL && i < cJSON_GetArraySize(subscriptions); i++) {
+        cJSON * method = cJSON_GetArrayItem(cJSON_GetArrayItem(subscriptions, i), 0);
+        if (cJSON_IsString(method) && strcmp(method->valuestring, "mining.notify") == 0) {
+            pair = cJSON_GetArrayItem(subscriptions, i);
+        }
+    }
+
+    cJSON * id = cJSON_GetArrayItem(pair, 1);
+    if (!cJSON_IsString(id) || strlen(id->valuestring) >= STRATUM_MAX_SUBSCRIPTION_ID_LEN) {
+        return;
+    }
+    for (const char * c = id->valuestring; *c != '\0'; c++) {
+        if (!isalnum((unsigned char) *c) && *c != '-' && *c != '_' && *c != '.') {
+            return;
+        }
+    }
+    strcpy(subscription_id, id->valuestring);
+}
+
+static void parse_message_cjson(StratumApiV1Message * message, const char * stratum_json)
 {
     cJSON * json = cJSON_Parse(stratum_json);
 
@@ -118,14 +419,22 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
 
     //if there is a method, then use that to decide what to do
     if (method_json != NULL && cJSON_IsString(method_json)) {
-        if (strcmp("mining.notify", method_json->valuestring) == 0) {
-            result = MINING_NOTIFY;
-        } else if (strcmp("mining.set_difficulty", method_json->valuestring) == 0) {
-            result = MINING_SET_DIFFICULTY;
-        } else if (strcmp("mining.set_version_mask", method_json->valuestring) == 0) {
+        if (strcmp("mining.set_version_mask", method_json->valuestring) == 0) {
             result = MINING_SET_VERSION_MASK;
         } else if (strcmp("client.reconnect", method_json->valuestring) == 0) {
             result = CLIENT_RECONNECT;
+        } else if (strcmp("mining.set_extranonce", method_json->valuestring) == 0) {
+            cJSON * params = cJSON_GetObjectItem(json, "params");
+            cJSON * extranonce_json = cJSON_GetArrayItem(params, 0);
+            cJSON * extranonce2_len_json = cJSON_GetArrayItem(params, 1);
+            if (cJSON_IsString(extranonce_json) && cJSON_IsNumber(extranonce2_len_json)) {
+                result = MINING_SET_EXTRANONCE;
+                message->extranonce_str = malloc(strlen(extranonce_json->valuestring) + 1);
+                strcpy(message->extranonce_str, extranonce_json->valuestring);
+                message->extranonce_2_len = extranonce2_len_json->valueint;
+            } else {
+                ESP_LOGE(TAG, "Invalid mining.set_extranonce: %s", stratum_json);
+            }
         } else {
             ESP_LOGI(TAG, "unhandled method in stratum message: %s", stratum_json);
         }
@@ -140,12 +449,12 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
         // if the result is null, then it's a fail
         if (result_json == NULL) {
             message->response_success = false;
-            message->error_str = strdup("unknown");
+            set_error_str(message, "unknown", 7);
             
         // if it's an error, then it's a fail
         } else if (error_json != NULL && !cJSON_IsNull(error_json)) {
             message->response_success = false;
-            message->error_str = strdup("unknown");
+            set_error_str(message, "unknown", 7);
             if (parsed_id < 5) {
                 result = STRATUM_RESULT_SETUP;
             } else {
@@ -156,7 +465,7 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
                 if (len >= 2) {
                     cJSON * error_msg = cJSON_GetArrayItem(error_json, 1);
                     if (cJSON_IsString(error_msg)) {
-                        message->error_str = strdup(cJSON_GetStringValue(error_msg));
+                        set_error_str(message, cJSON_GetStringValue(error_msg), strlen(cJSON_GetStringValue(error_msg)));
                     }
                 }
             }
@@ -172,9 +481,9 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
                 message->response_success = true;
             } else {
                 message->response_success = false;
-                message->error_str = strdup("unknown");
+                set_error_str(message, "unknown", 7);
                 if (cJSON_IsString(reject_reason_json)) {
-                    message->error_str = strdup(cJSON_GetStringValue(reject_reason_json));
+                    set_error_str(message, cJSON_GetStringValue(reject_reason_json), strlen(cJSON_GetStringValue(reject_reason_json)));
                 }                
             }
         
@@ -199,6 +508,7 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
             message->extranonce_str = malloc(strlen(extranonce_json->valuestring) + 1);
             strcpy(message->extranonce_str, extranonce_json->valuestring);
             message->response_success = true;
+            parse_subscription_id(cJSON_GetArrayItem(result_json, 0), message->subscription_id);
 
             //print the extranonce_str
             ESP_LOGI(TAG, "extranonce_str: %s", message->extranonce_str);
@@ -222,44 +532,7 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
 
     message->method = result;
 
-    if (message->method == MINING_NOTIFY) {
-
-        mining_notify * new_work = malloc(sizeof(mining_notify));
-        // new_work->difficulty = difficulty;
-        cJSON * params = cJSON_GetObjectItem(json, "params");
-        new_work->job_id = strdup(cJSON_GetArrayItem(params, 0)->valuestring);
-        new_work->prev_block_hash = strdup(cJSON_GetArrayItem(params, 1)->valuestring);
-        new_work->coinbase_1 = strdup(cJSON_GetArrayItem(params, 2)->valuestring);
-        new_work->coinbase_2 = strdup(cJSON_GetArrayItem(params, 3)->valuestring);
-
-        cJSON * merkle_branch = cJSON_GetArrayItem(params, 4);
-        new_work->n_merkle_branches = cJSON_GetArraySize(merkle_branch);
-        if (new_work->n_merkle_branches > MAX_MERKLE_BRANCHES) {
-            printf("Too many Merkle branches.\n");
-            abort();
-        }
-        new_work->merkle_branches = malloc(HASH_SIZE * new_work->n_merkle_branches);
-        for (size_t i = 0; i < new_work->n_merkle_branches; i++) {
-            hex2bin(cJSON_GetArrayItem(merkle_branch, i)->valuestring, new_work->merkle_branches + HASH_SIZE * i, HASH_SIZE);
-        }
-
-        new_work->version = strtoul(cJSON_GetArrayItem(params, 5)->valuestring, NULL, 16);
-        new_work->target = strtoul(cJSON_GetArrayItem(params, 6)->valuestring, NULL, 16);
-        new_work->ntime = strtoul(cJSON_GetArrayItem(params, 7)->valuestring, NULL, 16);
-
-        message->mining_notification = new_work;
-
-        // params can be varible length
-        int paramsLength = cJSON_GetArraySize(params);
-        int value = cJSON_IsTrue(cJSON_GetArrayItem(params, paramsLength - 1));
-        message->should_abandon_work = value;
-    } else if (message->method == MINING_SET_DIFFICULTY) {
-        cJSON * params = cJSON_GetObjectItem(json, "params");
-        uint32_t difficulty = cJSON_GetArrayItem(params, 0)->valueint;
-
-        message->new_difficulty = difficulty;
-    } else if (message->method == MINING_SET_VERSION_MASK) {
-
+    if (message->method == MINING_SET_VERSION_MASK) {
         cJSON * params = cJSON_GetObjectItem(json, "params");
         uint32_t version_mask = strtoul(cJSON_GetArrayItem(params, 0)->valuestring, NULL, 16);
         message->version_mask = version_mask;
@@ -268,13 +541,15 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
     cJSON_Delete(json);
 }
 
+void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
+{
+    if (!parse_message_fast(message, stratum_json)) {
+        parse_message_cjson(message, stratum_json);
+    }
+}
+
 void STRATUM_V1_free_mining_notify(mining_notify * params)
 {
-    free(params->job_id);
-    free(params->prev_block_hash);
-    free(params->coinbase_1);
-    free(params->coinbase_2);
-    free(params->merkle_branches);
     free(params);
 }
 
@@ -311,44 +586,68 @@ int _parse_stratum_subscribe_result_message(const char * result_json_str, char *
     return 0;
 }
 
-int STRATUM_V1_subscribe(int socket, int send_uid, const char * model)
+int STRATUM_V1_subscribe(stratum_tx * tx, int send_uid, const char * model, const char * subscription_id)
 {
     // Subscribe
     char subscribe_msg[BUFFER_SIZE];
     const esp_app_desc_t *app_desc = esp_app_get_description();
     const char *version = app_desc->version;	
-    sprintf(subscribe_msg, "{\"id\": %d, \"method\": \"mining.subscribe\", \"params\": [\"bitaxe/%s/%s\"]}\n", send_uid, model, version);
+    if (subscription_id != NULL && subscription_id[0] != '\0') {
+        // the id was checked to need no escaping when it was parsed
+        sprintf(subscribe_msg, "{\"id\": %d, \"method\": \"mining.subscribe\", \"params\": [\"bitaxe/%s/%s\", \"%s\"]}\n", send_uid,
+                model, version, subscription_id);
+    } else {
+        sprintf(subscribe_msg, "{\"id\": %d, \"method\": \"mining.subscribe\", \"params\": [\"bitaxe/%s/%s\"]}\n", send_uid, model, version);
+    }
     debug_stratum_tx(subscribe_msg);
 
-    return write(socket, subscribe_msg, strlen(subscribe_msg));
+    return stratum_tx_enqueue(tx, subscribe_msg, strlen(subscribe_msg));
 }
 
-int STRATUM_V1_suggest_difficulty(int socket, int send_uid, uint32_t difficulty)
+int STRATUM_V1_extranonce_subscribe(stratum_tx * tx, int send_uid)
+{
+    char extranonce_msg[BUFFER_SIZE];
+    sprintf(extranonce_msg, "{\"id\": %d, \"method\": \"mining.extranonce.subscribe\", \"params\": []}\n", send_uid);
+    debug_stratum_tx(extranonce_msg);
+
+    return stratum_tx_enqueue(tx, extranonce_msg, strlen(extranonce_msg));
+}
+
+int STRATUM_V1_suggest_difficulty(stratum_tx * tx, int send_uid, uint32_t difficulty)
 {
     char difficulty_msg[BUFFER_SIZE];
     sprintf(difficulty_msg, "{\"id\": %d, \"method\": \"mining.suggest_difficulty\", \"params\": [%ld]}\n", send_uid, difficulty);
     debug_stratum_tx(difficulty_msg);
 
-    return write(socket, difficulty_msg, strlen(difficulty_msg));
+    return stratum_tx_enqueue(tx, difficulty_msg, strlen(difficulty_msg));
+}
+
+int STRATUM_V1_ping(stratum_tx * tx, int send_uid)
+{
+    char ping_msg[BUFFER_SIZE];
+    sprintf(ping_msg, "{\"id\": %d, \"method\": \"mining.ping\", \"params\": []}\n", send_uid);
+    debug_stratum_tx(ping_msg);
+
+    return stratum_tx_enqueue(tx, ping_msg, strlen(ping_msg));
 }
 
-int STRATUM_V1_authenticate(int socket, int send_uid, const char * username, const char * pass)
+int STRATUM_V1_authenticate(stratum_tx * tx, int send_uid, const char * username, const char * pass)
 {
     char authorize_msg[BUFFER_SIZE];
     sprintf(authorize_msg, "{\"id\": %d, \"method\": \"mining.authorize\", \"params\": [\"%s\", \"%s\"]}\n", send_uid, username,
             pass);
     debug_stratum_tx(authorize_msg);
 
-    return write(socket, authorize_msg, strlen(authorize_msg));
+    return stratum_tx_enqueue(tx, authorize_msg, strlen(authorize_msg));
 }
 
-/// @param socket Socket to write to
+/// @param tx Queue of the pool connection
 /// @param username The client’s user name.
 /// @param jobid The job ID for the work being submitted.
 /// @param ntime The hex-encoded time value use in the block header.
 /// @param extranonce_2 The hex-encoded value of extra nonce 2.
 /// @param nonce The hex-encoded nonce value to use in the block header.
-int STRATUM_V1_submit_share(int socket, int send_uid, const char * username, const char * jobid,
+int STRATUM_V1_submit_share(stratum_tx * tx, int send_uid, const char * username, const char * jobid,
                             const char * extranonce_2, const uint32_t ntime,
                             const uint32_t nonce, const uint32_t version)
 {
@@ -358,10 +657,10 @@ int STRATUM_V1_submit_share(int socket, int send_uid, const char * username, con
             send_uid, username, jobid, extranonce_2, ntime, nonce, version);
     debug_stratum_tx(submit_msg);
 
-    return write(socket, submit_msg, strlen(submit_msg));
+    return stratum_tx_enqueue(tx, submit_msg, strlen(submit_msg));
 }
 
-int STRATUM_V1_configure_version_rolling(int socket, int send_uid, uint32_t * version_mask)
+int STRATUM_V1_configure_version_rolling(stratum_tx * tx, int send_uid, uint32_t * version_mask)
 {
     char configure_msg[BUFFER_SIZE * 2];
     sprintf(configure_msg,
@@ -370,7 +669,7 @@ int STRATUM_V1_configure_version_rolling(int socket, int send_uid, uint32_t * ve
             send_uid);
     debug_stratum_tx(configure_msg);
 
-    return write(socket, configure_msg, strlen(configure_msg));
+    return stratum_tx_enqueue(tx, configure_msg, strlen(configure_msg));
 }
 
 static void debug_stratum_tx(const char * msg)
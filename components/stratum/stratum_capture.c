@@ -0,0 +1,208 @@
+#include "stratum_capture.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char * TAG = "stratum_capture";
+
+static const uint8_t MAGIC[4] = {'S', 'C', 'A', 'P'};
+
+static void * capture_malloc(size_t size, bool use_psram)
+{
+    if (use_psram) {
+        void * ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+    return malloc(size);
+}
+
+bool stratum_capture_init(stratum_capture * capture, size_t capacity, bool use_psram)
+{
+    memset(capture, 0, sizeof(stratum_capture));
+    capture->ring = capture_malloc(capacity, use_psram);
+    if (capture->ring == NULL) {
+        ESP_LOGE(TAG, "No memory for a %u byte capture", (unsigned) capacity);
+        return false;
+    }
+    capture->capacity = capacity;
+    capture->psram = use_psram;
+    pthread_mutex_init(&capture->lock, NULL);
+    return true;
+}
+
+void stratum_capture_free(stratum_capture * capture)
+{
+    if (capture->ring == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&capture->lock);
+    free(capture->ring);
+    memset(capture, 0, sizeof(stratum_capture));
+}
+
+static size_t varint_encode(uint64_t value, uint8_t * dest)
+{
+    size_t len = 0;
+    while (value >= 0x80) {
+        dest[len++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    dest[len++] = (uint8_t) value;
+    return len;
+}
+
+// lock held
+static void ring_write(stratum_capture * capture, const void * data, size_t len)
+{
+    size_t pos = (capture->head + capture->used) % capture->capacity;
+    size_t first = len < capture->capacity - pos ? len : capture->capacity - pos;
+    memcpy(capture->ring + pos, data, first);
+    memcpy(capture->ring, (const uint8_t *) data + first, len - first);
+    capture->used += len;
+}
+
+// lock held
+static uint64_t ring_read_varint(stratum_capture * capture, size_t * offset)
+{
+    uint64_t value = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        byte = capture->ring[(capture->head + (*offset)++) % capture->capacity];
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+// lock held, the record after it becomes the oldest one
+static void drop_oldest(stratum_capture * capture)
+{
+    size_t offset = 0;
+    capture->base_us += ring_read_varint(capture, &offset);
+    offset++;
+    offset += ring_read_varint(capture, &offset);
+    capture->head = (capture->head + offset) % capture->capacity;
+    capture->used -= offset;
+    capture->records--;
+    capture->truncated = true;
+}
+
+void stratum_capture_line(stratum_capture * capture, int64_t now_us, uint8_t session, bool sent, const char * line,
+                          size_t len)
+{
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        len--;
+    }
+
+    pthread_mutex_lock(&capture->lock);
+    if (capture->records == 0 && !capture->truncated) {
+        capture->base_us = now_us;
+        capture->last_us = now_us;
+    }
+    // lines from several tasks may come slightly out of order
+    int64_t delta = now_us > capture->last_us ? now_us - capture->last_us : 0;
+    uint8_t prefix[10 + 1 + 10];
+    size_t prefix_len = varint_encode(delta, prefix);
+    prefix[prefix_len++] = (uint8_t) (session << 1 | (sent ? 1 : 0));
+    prefix_len += varint_encode(len, prefix + prefix_len);
+    if (prefix_len + len > capture->capacity) {
+        capture->dropped++;
+        pthread_mutex_unlock(&capture->lock);
+        return;
+    }
+
+    while (capture->capacity - capture->used < prefix_len + len) {
+        drop_oldest(capture);
+    }
+    ring_write(capture, prefix, prefix_len);
+    ring_write(capture, line, len);
+    capture->last_us += delta;
+    capture->records++;
+    pthread_mutex_unlock(&capture->lock);
+}
+
+uint8_t * stratum_capture_export(stratum_capture * capture, size_t * len)
+{
+    pthread_mutex_lock(&capture->lock);
+    uint8_t * data = capture_malloc(STRATUM_CAPTURE_HEADER_SIZE + capture->used, capture->psram);
+    if (data == NULL) {
+        pthread_mutex_unlock(&capture->lock);
+        return NULL;
+    }
+
+    memcpy(data, MAGIC, sizeof(MAGIC));
+    data[4] = STRATUM_CAPTURE_VERSION;
+    data[5] = capture->truncated ? STRATUM_CAPTURE_FLAG_TRUNCATED : 0;
+    data[6] = 0;
+    data[7] = 0;
+    for (int i = 0; i < 8; i++) {
+        data[8 + i] = (uint8_t) ((uint64_t) capture->base_us >> (8 * i));
+    }
+    size_t first = capture->used < capture->capacity - capture->head ? capture->used : capture->capacity - capture->head;
+    memcpy(data + STRATUM_CAPTURE_HEADER_SIZE, capture->ring + capture->head, first);
+    memcpy(data + STRATUM_CAPTURE_HEADER_SIZE + first, capture->ring, capture->used - first);
+    *len = STRATUM_CAPTURE_HEADER_SIZE + capture->used;
+    pthread_mutex_unlock(&capture->lock);
+    return data;
+}
+
+bool stratum_capture_reader_init(stratum_capture_reader * reader, const uint8_t * data, size_t len)
+{
+    if (len < STRATUM_CAPTURE_HEADER_SIZE || memcmp(data, MAGIC, sizeof(MAGIC)) != 0 ||
+        data[4] != STRATUM_CAPTURE_VERSION) {
+        return false;
+    }
+    reader->data = data;
+    reader->len = len;
+    reader->pos = STRATUM_CAPTURE_HEADER_SIZE;
+    reader->flags = data[5];
+    uint64_t base_us = 0;
+    for (int i = 0; i < 8; i++) {
+        base_us |= (uint64_t) data[8 + i] << (8 * i);
+    }
+    reader->timestamp_us = (int64_t) base_us;
+    return true;
+}
+
+static bool read_varint(stratum_capture_reader * reader, uint64_t * value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->pos >= reader->len) {
+            return false;
+        }
+        uint8_t byte = reader->data[reader->pos++];
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool stratum_capture_next(stratum_capture_reader * reader, stratum_capture_record * record)
+{
+    uint64_t delta, len;
+    if (!read_varint(reader, &delta) || reader->pos >= reader->len) {
+        return false;
+    }
+    uint8_t flags = reader->data[reader->pos++];
+    if (!read_varint(reader, &len) || len > reader->len - reader->pos) {
+        return false;
+    }
+
+    reader->timestamp_us += (int64_t) delta;
+    record->timestamp_us = reader->timestamp_us;
+    record->session = flags >> 1;
+    record->sent = flags & 1;
+    record->line = (const char *) reader->data + reader->pos;
+    record->len = len;
+    reader->pos += len;
+    return true;
+}
@@ -0,0 +1,405 @@
+#include "stratum_connect.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/netdb.h"
+
+static const char * TAG = "stratum_connect";
+
+typedef struct
+{
+    char host[STRATUM_DNS_MAX_HOST_LEN];
+    uint16_t port;
+    stratum_address addresses[STRATUM_DNS_MAX_ADDRESSES];
+    int count;
+    int64_t expires_us;
+    int64_t used_us;
+} dns_cache_entry;
+
+// A lookup running on its own thread, so the caller can stop waiting for it. Freed by whichever
+// of the two is done with it last.
+typedef struct
+{
+    stratum_resolver resolve;
+    char host[STRATUM_DNS_MAX_HOST_LEN];
+    uint16_t port;
+    stratum_address addresses[STRATUM_DNS_MAX_ADDRESSES];
+    int count;
+    bool done;
+    int refs;
+} dns_lookup;
+
+static dns_cache_entry dns_cache[STRATUM_DNS_CACHE_SIZE];
+static pthread_mutex_t dns_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t dns_lookup_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dns_lookup_done = PTHREAD_COND_INITIALIZER;
+
+static int getaddrinfo_resolver(const char * host, uint16_t port, stratum_address * addresses, int max_addresses);
+
+static stratum_resolver resolver = getaddrinfo_resolver;
+
+static void set_port(stratum_address * address, uint16_t port)
+{
+    if (address->addr.ss_family == AF_INET6) {
+        ((struct sockaddr_in6 *) &address->addr)->sin6_port = htons(port);
+    } else {
+        ((struct sockaddr_in *) &address->addr)->sin_port = htons(port);
+    }
+}
+
+static int getaddrinfo_resolver(const char * host, uint16_t port, stratum_address * addresses, int max_addresses)
+{
+    // one query per family, lwIP answers AF_UNSPEC with a single address
+    const int families[2] = {AF_INET6, AF_INET};
+    struct addrinfo * results[2] = {NULL, NULL};
+    for (int i = 0; i < 2; i++) {
+        struct addrinfo hints = {
+            .ai_family = families[i],
+            .ai_socktype = SOCK_STREAM,
+        };
+        if (getaddrinfo(host, NULL, &hints, &results[i]) != 0) {
+            results[i] = NULL;
+        }
+    }
+
+    // alternate the families, IPv6 first, so a family without connectivity costs one attempt delay
+    int count = 0;
+    struct addrinfo * next[2] = {results[0], results[1]};
+    while (count < max_addresses && (next[0] != NULL || next[1] != NULL)) {
+        for (int i = 0; i < 2 && count < max_addresses; i++) {
+            if (next[i] == NULL) {
+                continue;
+            }
+            if (next[i]->ai_addrlen <= sizeof(addresses[count].addr)) {
+                memcpy(&addresses[count].addr, next[i]->ai_addr, next[i]->ai_addrlen);
+                addresses[count].len = next[i]->ai_addrlen;
+                set_port(&addresses[count], port);
+                count++;
+            }
+            next[i] = next[i]->ai_next;
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (results[i] != NULL) {
+            freeaddrinfo(results[i]);
+        }
+    }
+    return count;
+}
+
+void stratum_dns_set_resolver(stratum_resolver new_resolver)
+{
+    pthread_mutex_lock(&dns_cache_lock);
+    resolver = new_resolver != NULL ? new_resolver : getaddrinfo_resolver;
+    memset(dns_cache, 0, sizeof(dns_cache));
+    pthread_mutex_unlock(&dns_cache_lock);
+}
+
+// lookup lock held
+static void release_lookup(dns_lookup * lookup)
+{
+    if (--lookup->refs == 0) {
+        free(lookup);
+    }
+}
+
+static void * lookup_thread(void * arg)
+{
+    dns_lookup * lookup = arg;
+    stratum_address addresses[STRATUM_DNS_MAX_ADDRESSES];
+    int count = lookup->resolve(lookup->host, lookup->port, addresses, STRATUM_DNS_MAX_ADDRESSES);
+
+    pthread_mutex_lock(&dns_lookup_lock);
+    memcpy(lookup->addresses, addresses, count * sizeof(stratum_address));
+    lookup->count = count;
+    lookup->done = true;
+    pthread_cond_broadcast(&dns_lookup_done);
+    release_lookup(lookup);
+    pthread_mutex_unlock(&dns_lookup_lock);
+    return NULL;
+}
+
+// getaddrinfo() can't be cancelled, a stalled lookup is left to finish on its own thread
+static int resolve_with_timeout(stratum_resolver resolve, const char * host, uint16_t port, stratum_address * addresses)
+{
+    dns_lookup * lookup = calloc(1, sizeof(dns_lookup));
+    if (lookup == NULL) {
+        return resolve(host, port, addresses, STRATUM_DNS_MAX_ADDRESSES);
+    }
+    lookup->resolve = resolve;
+    strcpy(lookup->host, host);
+    lookup->port = port;
+    lookup->refs = 2;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // getaddrinfo() waits on lwIP's tcpip task, it needs little stack. Platforms with a larger minimum keep their default.
+    pthread_attr_setstacksize(&attr, 4096);
+    pthread_t thread;
+    int ret = pthread_create(&thread, &attr, lookup_thread, lookup);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        free(lookup);
+        return resolve(host, port, addresses, STRATUM_DNS_MAX_ADDRESSES);
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += STRATUM_DNS_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (STRATUM_DNS_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&dns_lookup_lock);
+    int wait = 0;
+    while (!lookup->done && wait != ETIMEDOUT) {
+        wait = pthread_cond_timedwait(&dns_lookup_done, &dns_lookup_lock, &deadline);
+    }
+    int count = 0;
+    if (lookup->done) {
+        count = lookup->count;
+        memcpy(addresses, lookup->addresses, count * sizeof(stratum_address));
+    } else {
+        ESP_LOGW(TAG, "Resolving %s takes longer than %d ms, giving up", host, STRATUM_DNS_TIMEOUT_MS);
+    }
+    release_lookup(lookup);
+    pthread_mutex_unlock(&dns_lookup_lock);
+    return count;
+}
+
+// lock held
+static dns_cache_entry * find_entry(const char * host, uint16_t port)
+{
+    for (int i = 0; i < STRATUM_DNS_CACHE_SIZE; i++) {
+        if (dns_cache[i].count > 0 && dns_cache[i].port == port && strcmp(dns_cache[i].host, host) == 0) {
+            return &dns_cache[i];
+        }
+    }
+    return NULL;
+}
+
+int stratum_dns_resolve(const char * host, uint16_t port, stratum_address * addresses, int max_addresses)
+{
+    if (strlen(host) >= STRATUM_DNS_MAX_HOST_LEN) {
+        return resolver(host, port, addresses, max_addresses);
+    }
+
+    int64_t now = esp_timer_get_time();
+    pthread_mutex_lock(&dns_cache_lock);
+    stratum_resolver resolve = resolver;
+    dns_cache_entry * entry = find_entry(host, port);
+    if (entry != NULL && entry->expires_us > now) {
+        entry->used_us = now;
+        int count = entry->count < max_addresses ? entry->count : max_addresses;
+        memcpy(addresses, entry->addresses, count * sizeof(stratum_address));
+        pthread_mutex_unlock(&dns_cache_lock);
+        return count;
+    }
+    pthread_mutex_unlock(&dns_cache_lock);
+
+    // resolved without the lock, other hosts stay available meanwhile
+    stratum_address resolved[STRATUM_DNS_MAX_ADDRESSES];
+    int resolved_count = resolve_with_timeout(resolve, host, port, resolved);
+    now = esp_timer_get_time();
+
+    pthread_mutex_lock(&dns_cache_lock);
+    entry = find_entry(host, port);
+    if (resolved_count > 0) {
+        if (entry == NULL) {
+            // a free entry or the least recently used one
+            entry = &dns_cache[0];
+            for (int i = 1; i < STRATUM_DNS_CACHE_SIZE && entry->count > 0; i++) {
+                if (dns_cache[i].count == 0 || dns_cache[i].used_us < entry->used_us) {
+                    entry = &dns_cache[i];
+                }
+            }
+            strcpy(entry->host, host);
+            entry->port = port;
+        }
+        memcpy(entry->addresses, resolved, resolved_count * sizeof(stratum_address));
+        entry->count = resolved_count;
+        entry->expires_us = now + (int64_t) STRATUM_DNS_TTL_MS * 1000;
+    } else if (entry != NULL) {
+        ESP_LOGW(TAG, "Unable to resolve %s, using the expired addresses", host);
+    }
+
+    int count = 0;
+    if (entry != NULL) {
+        entry->used_us = now;
+        count = entry->count < max_addresses ? entry->count : max_addresses;
+        memcpy(addresses, entry->addresses, count * sizeof(stratum_address));
+    }
+    pthread_mutex_unlock(&dns_cache_lock);
+    return count;
+}
+
+// the next connect resolves host again, the addresses are still used if that fails
+static void dns_expire(const char * host)
+{
+    pthread_mutex_lock(&dns_cache_lock);
+    for (int i = 0; i < STRATUM_DNS_CACHE_SIZE; i++) {
+        if (dns_cache[i].count > 0 && strcmp(dns_cache[i].host, host) == 0) {
+            dns_cache[i].expires_us = 0;
+        }
+    }
+    pthread_mutex_unlock(&dns_cache_lock);
+}
+
+void stratum_dns_invalidate(const char * host)
+{
+    pthread_mutex_lock(&dns_cache_lock);
+    for (int i = 0; i < STRATUM_DNS_CACHE_SIZE; i++) {
+        if (dns_cache[i].count > 0 && strcmp(dns_cache[i].host, host) == 0) {
+            dns_cache[i].count = 0;
+        }
+    }
+    pthread_mutex_unlock(&dns_cache_lock);
+}
+
+// @return the non-blocking socket with the connect in progress or done, -1 if it failed right away
+static int start_attempt(const stratum_address * address)
+{
+    int sock = socket(address->addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0) {
+        return -1;
+    }
+
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+        int err = errno;
+        close(sock);
+        errno = err;
+        return -1;
+    }
+
+    if (connect(sock, (const struct sockaddr *) &address->addr, address->len) != 0 && errno != EINPROGRESS) {
+        int err = errno;
+        close(sock);
+        errno = err;
+        return -1;
+    }
+    return sock;
+}
+
+int stratum_connect(const char * host, uint16_t port, uint32_t timeout_ms, char * ip_str, size_t ip_str_len)
+{
+    stratum_address addresses[STRATUM_DNS_MAX_ADDRESSES];
+    int count = stratum_dns_resolve(host, port, addresses, STRATUM_DNS_MAX_ADDRESSES);
+    if (count == 0) {
+        errno = EHOSTUNREACH;
+        return STRATUM_CONNECT_ERR_DNS;
+    }
+
+    int sockets[STRATUM_DNS_MAX_ADDRESSES];
+    int started = 0;
+    int failed = 0;
+    int winner = -1;
+    int last_error = ETIMEDOUT;
+    bool out_of_sockets = false;
+    int64_t now = esp_timer_get_time();
+    int64_t deadline_us = now + (int64_t) timeout_ms * 1000;
+    int64_t next_attempt_us = now;
+
+    while (winner < 0 && failed < count && now < deadline_us) {
+        if (started < count && now >= next_attempt_us) {
+            sockets[started] = start_attempt(&addresses[started]);
+            if (sockets[started] < 0) {
+                last_error = errno;
+                out_of_sockets |= errno == ENFILE || errno == EMFILE || errno == ENOBUFS || errno == ENOMEM;
+                failed++;
+            } else {
+                next_attempt_us = now + STRATUM_CONNECT_ATTEMPT_DELAY_MS * 1000;
+            }
+            started++;
+            continue;
+        }
+        if (failed == started) {
+            // nothing in progress, the next address goes right away
+            next_attempt_us = now;
+            continue;
+        }
+
+        fd_set writable, failing;
+        FD_ZERO(&writable);
+        FD_ZERO(&failing);
+        int max_fd = -1;
+        for (int i = 0; i < started; i++) {
+            if (sockets[i] >= 0) {
+                FD_SET(sockets[i], &writable);
+                FD_SET(sockets[i], &failing);
+                max_fd = sockets[i] > max_fd ? sockets[i] : max_fd;
+            }
+        }
+        int64_t wait_until_us = started < count && next_attempt_us < deadline_us ? next_attempt_us : deadline_us;
+        int64_t wait_us = wait_until_us > now ? wait_until_us - now : 0;
+        struct timeval timeout = {.tv_sec = wait_us / 1000000, .tv_usec = wait_us % 1000000};
+        int ready = select(max_fd + 1, NULL, &writable, &failing, &timeout);
+        now = esp_timer_get_time();
+        if (ready <= 0) {
+            continue;
+        }
+
+        for (int i = 0; i < started && winner < 0; i++) {
+            if (sockets[i] < 0 || (!FD_ISSET(sockets[i], &writable) && !FD_ISSET(sockets[i], &failing))) {
+                continue;
+            }
+            int error = 0;
+            socklen_t error_len = sizeof(error);
+            if (getsockopt(sockets[i], SOL_SOCKET, SO_ERROR, &error, &error_len) != 0) {
+                error = errno;
+            }
+            if (error == 0) {
+                winner = i;
+                continue;
+            }
+            last_error = error;
+            close(sockets[i]);
+            sockets[i] = -1;
+            failed++;
+            // a refused address doesn't hold up the next one
+            next_attempt_us = now;
+        }
+    }
+
+    for (int i = 0; i < started; i++) {
+        if (i != winner && sockets[i] >= 0) {
+            close(sockets[i]);
+        }
+    }
+
+    if (winner < 0) {
+        // every address refused, the pool may have moved. A timeout says nothing about the addresses,
+        // the pool or the network may just be down, so they stay as they are.
+        if (failed == count && !out_of_sockets) {
+            dns_expire(host);
+        }
+        errno = last_error;
+        return out_of_sockets && failed == started ? STRATUM_CONNECT_ERR_SOCKET : STRATUM_CONNECT_ERR_CONNECT;
+    }
+
+    int sock = sockets[winner];
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags & ~O_NONBLOCK);
+
+    if (ip_str != NULL) {
+        const struct sockaddr_storage * addr = &addresses[winner].addr;
+        const void * ip = addr->ss_family == AF_INET6 ? (const void *) &((const struct sockaddr_in6 *) addr)->sin6_addr
+                                                      : (const void *) &((const struct sockaddr_in *) addr)->sin_addr;
+        if (inet_ntop(addr->ss_family, ip, ip_str, ip_str_len) == NULL && ip_str_len > 0) {
+            ip_str[0] = '\0';
+        }
+    }
+    return sock;
+}
@@ -0,0 +1,68 @@
+#include "stratum_liveness.h"
+
+void stratum_liveness_init(stratum_liveness * liveness, uint32_t dead_timeout_ms)
+{
+    liveness->dead_timeout_ms = dead_timeout_ms;
+    stratum_liveness_reset(liveness, 0);
+}
+
+void stratum_liveness_reset(stratum_liveness * liveness, int64_t now_us)
+{
+    liveness->last_rx_us = now_us;
+    liveness->last_notify_us = 0;
+    liveness->notify_interval_us = 0;
+    liveness->probe_sent_us = 0;
+    liveness->probe_uid = 0;
+}
+
+void stratum_liveness_received(stratum_liveness * liveness, int64_t now_us, bool notify)
+{
+    liveness->last_rx_us = now_us;
+    liveness->probe_sent_us = 0;
+    if (!notify) {
+        return;
+    }
+    if (liveness->last_notify_us != 0) {
+        int64_t interval = now_us - liveness->last_notify_us;
+        // the notify storms around block changes shouldn't make a quiet pool look dead right after
+        liveness->notify_interval_us =
+            liveness->notify_interval_us == 0 ? interval : (liveness->notify_interval_us * 7 + interval) / 8;
+    }
+    liveness->last_notify_us = now_us;
+}
+
+int64_t stratum_liveness_probe_after_us(const stratum_liveness * liveness)
+{
+    int64_t probe_after = 2 * liveness->notify_interval_us;
+    if (probe_after < STRATUM_LIVENESS_MIN_PROBE_MS * 1000LL) {
+        probe_after = STRATUM_LIVENESS_MIN_PROBE_MS * 1000LL;
+    }
+    // the other half is for the answer
+    int64_t half_timeout = liveness->dead_timeout_ms * 1000LL / 2;
+    return probe_after < half_timeout ? probe_after : half_timeout;
+}
+
+stratum_liveness_action stratum_liveness_check(stratum_liveness * liveness, int64_t now_us, int64_t oldest_request_us)
+{
+    if (liveness->dead_timeout_ms == 0) {
+        return STRATUM_LIVENESS_OK;
+    }
+
+    // the oldest request sent since the pool was last heard from, answered or not the pool was alive before
+    int64_t waiting_since = 0;
+    if (oldest_request_us > liveness->last_rx_us) {
+        waiting_since = oldest_request_us;
+    }
+    if (liveness->probe_sent_us != 0 && (waiting_since == 0 || liveness->probe_sent_us < waiting_since)) {
+        waiting_since = liveness->probe_sent_us;
+    }
+    if (waiting_since != 0 && now_us - waiting_since >= liveness->dead_timeout_ms * 1000LL / 2) {
+        return STRATUM_LIVENESS_DEAD;
+    }
+
+    if (liveness->probe_sent_us == 0 && now_us - liveness->last_rx_us >= stratum_liveness_probe_after_us(liveness)) {
+        liveness->probe_sent_us = now_us;
+        return STRATUM_LIVENESS_PROBE;
+    }
+    return STRATUM_LIVENESS_OK;
+}
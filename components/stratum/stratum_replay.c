@@ -0,0 +1,233 @@
+#include "stratum_replay.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "stratum_capture.h"
+#include "stratum_work.h"
+#include "utils.h"
+
+static const char * TAG = "stratum_replay";
+
+// notifies remembered for the burst statistics, more within a second are counted as this many
+#define NOTIFY_WINDOW 256
+
+// What the session task learns from the pool before the first job
+typedef struct
+{
+    char extranonce_str[STRATUM_MAX_EXTRANONCE_LEN * 2 + 1];
+    int extranonce_2_len;
+    uint32_t extranonce_generation;
+    uint32_t version_mask;
+    uint32_t difficulty;
+} replay_session;
+
+// The sessions of the capture and the work create_jobs_task would keep for them
+typedef struct
+{
+    replay_session sessions[STRATUM_REPLAY_MAX_SESSIONS];
+    stratum_work work[STRATUM_REPLAY_MAX_SESSIONS];
+    stratum_work_session status[STRATUM_REPLAY_MAX_SESSIONS];
+} replay_state;
+
+typedef struct
+{
+    int64_t timestamps[NOTIFY_WINDOW];
+    uint32_t head;
+    uint32_t tail;
+} notify_window;
+
+static uint32_t count_notify(notify_window * window, int64_t timestamp_us)
+{
+    if (window->tail - window->head == NOTIFY_WINDOW) {
+        window->head++;
+    }
+    window->timestamps[window->tail++ % NOTIFY_WINDOW] = timestamp_us;
+    while (timestamp_us - window->timestamps[window->head % NOTIFY_WINDOW] >= 1000000) {
+        window->head++;
+    }
+    return window->tail - window->head;
+}
+
+static void set_extranonce(replay_session * session, char * extranonce_str, int extranonce_2_len)
+{
+    if (extranonce_str == NULL) {
+        return;
+    }
+    strncpy(session->extranonce_str, extranonce_str, sizeof(session->extranonce_str) - 1);
+    session->extranonce_str[sizeof(session->extranonce_str) - 1] = '\0';
+    session->extranonce_2_len = extranonce_2_len;
+    session->extranonce_generation++;
+    free(extranonce_str);
+}
+
+static void read_extranonce(void * ctx, uint8_t session_index, stratum_work_extranonce * extranonce)
+{
+    replay_session * session = &((replay_state *) ctx)->sessions[session_index];
+    extranonce->generation = session->extranonce_generation;
+    extranonce->extranonce_len = hex2bin(session->extranonce_str, extranonce->extranonce, sizeof(extranonce->extranonce));
+    extranonce->extranonce_2_len = session->extranonce_2_len;
+}
+
+// The jobs create_jobs_task would build from its sessions' work until the next notify arrives
+static void generate_jobs(replay_state * state, const stratum_replay_config * config, stratum_replay_stats * stats,
+                          int64_t parse_start_us)
+{
+    for (int i = 0; i < STRATUM_REPLAY_MAX_SESSIONS; i++) {
+        state->status[i].extranonce_generation = state->sessions[i].extranonce_generation;
+    }
+
+    for (int i = 0; i < config->jobs_per_notify; i++) {
+        bool rebuilt = false, ntime_limited = false;
+        stratum_work * work = stratum_work_next(state->work, state->status, STRATUM_REPLAY_MAX_SESSIONS, read_extranonce,
+                                                state, esp_timer_get_time(), &rebuilt, &ntime_limited);
+        bm_job * job = work != NULL ? alloc_bm_job() : NULL;
+        if (job == NULL) {
+            return;
+        }
+        stratum_work_next_job(work, state->sessions[work->notification->session].version_mask, job);
+
+        if (config->serialize != NULL) {
+            config->serialize(config->serialize_ctx, job);
+        }
+        if (config->asic != NULL) {
+            config->asic(config->asic_ctx, job);
+        }
+        free_bm_job(job);
+        stats->jobs++;
+        if (i == 0) {
+            int64_t latency = esp_timer_get_time() - parse_start_us;
+            stats->notify_to_job_max_us = latency > stats->notify_to_job_max_us ? latency : stats->notify_to_job_max_us;
+        }
+    }
+}
+
+static void replay_line(replay_state * state, uint8_t session_index, const char * line, int64_t timestamp_us,
+                        const stratum_replay_config * config, stratum_replay_stats * stats, notify_window * window)
+{
+    replay_session * session = &state->sessions[session_index];
+    StratumApiV1Message message = {0};
+    int64_t parse_start_us = esp_timer_get_time();
+    STRATUM_V1_parse(&message, line);
+    int64_t parsed_us = esp_timer_get_time();
+    stats->parse_us += parsed_us - parse_start_us;
+
+    switch (message.method) {
+    case MINING_NOTIFY: {
+        mining_notify * notification = message.mining_notification;
+        stats->notifies++;
+        stats->clean_jobs += message.should_abandon_work != 0;
+        uint32_t burst = count_notify(window, timestamp_us);
+        stats->notify_burst_max = burst > stats->notify_burst_max ? burst : stats->notify_burst_max;
+
+        mining_notify_set_difficulty(notification, session->difficulty);
+        notification->received_us = parsed_us;
+        notification->session = session_index;
+        // a clean_jobs notify starts a new work generation, as the session task does
+        if (message.should_abandon_work) {
+            state->status[session_index].work_generation++;
+        }
+        notification->generation = state->status[session_index].work_generation;
+        if (stratum_work_accept(&state->work[session_index], notification, read_extranonce, state)) {
+            generate_jobs(state, config, stats, parse_start_us);
+        } else {
+            ESP_LOGW(TAG, "No jobs for notify %s", notification->job_id);
+            STRATUM_V1_free_mining_notify(notification);
+            stats->failed++;
+        }
+        stats->jobs_us += esp_timer_get_time() - parsed_us;
+        break;
+    }
+    case MINING_SET_DIFFICULTY:
+        session->difficulty = message.new_difficulty;
+        break;
+    case MINING_SET_VERSION_MASK:
+    case STRATUM_RESULT_VERSION_MASK:
+        session->version_mask = message.version_mask;
+        break;
+    case STRATUM_RESULT_SUBSCRIBE:
+    case MINING_SET_EXTRANONCE:
+        set_extranonce(session, message.extranonce_str, message.extranonce_2_len);
+        break;
+    default:
+        break;
+    }
+}
+
+bool stratum_replay_run(const uint8_t * capture, size_t len, const stratum_replay_config * config,
+                        stratum_replay_stats * stats)
+{
+    stratum_capture_reader reader;
+    if (!stratum_capture_reader_init(&reader, capture, len)) {
+        return false;
+    }
+    memset(stats, 0, sizeof(stratum_replay_stats));
+
+    notify_window * window = calloc(1, sizeof(notify_window));
+    replay_state * state = calloc(1, sizeof(replay_state));
+    if (window == NULL || state == NULL) {
+        free(window);
+        free(state);
+        return false;
+    }
+    for (int i = 0; i < STRATUM_REPLAY_MAX_SESSIONS; i++) {
+        state->sessions[i].difficulty = 8192;
+        state->status[i].weight = config->weights != NULL ? config->weights[i] : 1;
+    }
+    char * line = NULL;
+    size_t line_capacity = 0;
+
+    stratum_capture_record record;
+    int64_t first_us = 0;
+    int64_t start_us = esp_timer_get_time();
+    bool first = true;
+    while (stratum_capture_next(&reader, &record)) {
+        if (first) {
+            first_us = record.timestamp_us;
+            first = false;
+        }
+        stats->capture_us = record.timestamp_us - first_us;
+        if (record.sent) {
+            stats->sent++;
+            continue;
+        }
+        if (record.session >= STRATUM_REPLAY_MAX_SESSIONS) {
+            continue;
+        }
+        stats->received++;
+
+        if (config->speed > 0) {
+            int64_t due_us = start_us + (int64_t) ((record.timestamp_us - first_us) / config->speed);
+            int64_t now = esp_timer_get_time();
+            if (due_us > now) {
+                usleep(due_us - now);
+            }
+        }
+
+        // the parser works on a terminated line, as it does on the receive buffer
+        if (record.len + 1 > line_capacity) {
+            char * grown = realloc(line, record.len + 1);
+            if (grown == NULL) {
+                ESP_LOGE(TAG, "No memory for a %u byte line", (unsigned) record.len);
+                break;
+            }
+            line = grown;
+            line_capacity = record.len + 1;
+        }
+        memcpy(line, record.line, record.len);
+        line[record.len] = '\0';
+        replay_line(state, record.session, line, record.timestamp_us, config, stats, window);
+    }
+    stats->elapsed_us = esp_timer_get_time() - start_us;
+
+    for (int i = 0; i < STRATUM_REPLAY_MAX_SESSIONS; i++) {
+        stratum_work_release(&state->work[i]);
+    }
+    free(line);
+    free(window);
+    free(state);
+    return true;
+}
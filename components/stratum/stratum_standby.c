@@ -0,0 +1,247 @@
+#include "stratum_standby.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "stratum_connect.h"
+#include "stratum_tls.h"
+
+static const char * TAG = "stratum_standby";
+
+#define STANDBY_TX_BUFFER_SIZE 1024
+
+bool stratum_standby_init(stratum_standby * standby)
+{
+    memset(standby, 0, sizeof(stratum_standby));
+    standby->socket = -1;
+    if (!line_buffer_init(&standby->buffer, STRATUM_LINE_BUFFER_SIZE)) {
+        return false;
+    }
+    if (!stratum_tx_init(&standby->tx, STANDBY_TX_BUFFER_SIZE)) {
+        line_buffer_free(&standby->buffer);
+        return false;
+    }
+    pthread_mutex_init(&standby->lock, NULL);
+    return true;
+}
+
+// lock held
+static void close_locked(stratum_standby * standby)
+{
+    if (standby->socket >= 0) {
+        stratum_socket_close(standby->socket);
+        standby->socket = -1;
+    }
+    free(standby->extranonce_str);
+    standby->extranonce_str = NULL;
+    STRATUM_V1_free_mining_notify(standby->latest_notify);
+    standby->latest_notify = NULL;
+    line_buffer_reset(&standby->buffer);
+}
+
+void stratum_standby_free(stratum_standby * standby)
+{
+    close_locked(standby);
+    pthread_mutex_destroy(&standby->lock);
+    stratum_tx_free(&standby->tx);
+    line_buffer_free(&standby->buffer);
+}
+
+void stratum_standby_close(stratum_standby * standby)
+{
+    pthread_mutex_lock(&standby->lock);
+    close_locked(standby);
+    pthread_mutex_unlock(&standby->lock);
+}
+
+bool stratum_standby_connect(stratum_standby * standby, const char * host, uint16_t port, bool tls, const char * user,
+                             const char * pass, const char * model, uint32_t difficulty, uint32_t connect_timeout_ms)
+{
+    stratum_standby_close(standby);
+
+    int sock = stratum_connect(host, port, connect_timeout_ms, NULL, 0);
+    if (sock == STRATUM_CONNECT_ERR_DNS) {
+        ESP_LOGW(TAG, "Unable to resolve %s", host);
+        return false;
+    }
+    if (sock < 0) {
+        ESP_LOGW(TAG, "Unable to connect to %s:%d (errno %d: %s)", host, port, errno, strerror(errno));
+        return false;
+    }
+    if (tls && !stratum_tls_start(sock, host, port, connect_timeout_ms, NULL)) {
+        stratum_socket_close(sock);
+        return false;
+    }
+
+    struct timeval snd_timeout = {.tv_sec = 5, .tv_usec = 0};
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &snd_timeout, sizeof(snd_timeout)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt SO_SNDTIMEO");
+    }
+
+    // the same setup ids as the primary connection, the responses are told apart by them
+    int send_uid = 1;
+    uint32_t version_mask;
+    stratum_tx_set_socket(&standby->tx, sock);
+    STRATUM_V1_configure_version_rolling(&standby->tx, send_uid++, &version_mask);
+    STRATUM_V1_subscribe(&standby->tx, send_uid++, model, NULL);
+    STRATUM_V1_authenticate(&standby->tx, send_uid++, user, pass);
+    STRATUM_V1_suggest_difficulty(&standby->tx, send_uid++, difficulty);
+    bool sent = stratum_tx_flush(&standby->tx);
+    stratum_tx_set_socket(&standby->tx, -1);
+    if (!sent) {
+        stratum_socket_close(sock);
+        return false;
+    }
+
+    pthread_mutex_lock(&standby->lock);
+    standby->socket = sock;
+    standby->send_uid = send_uid;
+    standby->difficulty = difficulty;
+    standby->version_mask = 0;
+    pthread_mutex_unlock(&standby->lock);
+
+    ESP_LOGI(TAG, "Standby connection to %s:%d opened", host, port);
+    return true;
+}
+
+// lock held, returns false if the connection has to be closed
+static bool process_message(stratum_standby * standby, const char * line)
+{
+    StratumApiV1Message message = {0};
+    STRATUM_V1_parse(&message, line);
+
+    switch (message.method) {
+    case MINING_NOTIFY:
+        message.mining_notification->received_us = esp_timer_get_time();
+        STRATUM_V1_free_mining_notify(standby->latest_notify);
+        standby->latest_notify = message.mining_notification;
+        break;
+    case MINING_SET_DIFFICULTY:
+        standby->difficulty = message.new_difficulty;
+        break;
+    case MINING_SET_VERSION_MASK:
+    case STRATUM_RESULT_VERSION_MASK:
+        standby->version_mask = message.version_mask;
+        break;
+    case STRATUM_RESULT_SUBSCRIBE:
+    case MINING_SET_EXTRANONCE:
+        if (message.extranonce_str != NULL) {
+            free(standby->extranonce_str);
+            standby->extranonce_str = message.extranonce_str;
+            standby->extranonce_2_len = message.extranonce_2_len;
+        }
+        break;
+    case STRATUM_RESULT_SETUP:
+        if (!message.response_success) {
+            ESP_LOGE(TAG, "Standby setup message %lld rejected: %s", message.message_id, message.error_str);
+        }
+        break;
+    case CLIENT_RECONNECT:
+        ESP_LOGW(TAG, "Pool requested reconnect of the standby connection");
+        return false;
+    default:
+        break;
+    }
+    return true;
+}
+
+bool stratum_standby_poll(stratum_standby * standby, uint32_t timeout_ms)
+{
+    pthread_mutex_lock(&standby->lock);
+    int sock = standby->socket;
+    pthread_mutex_unlock(&standby->lock);
+    if (sock < 0) {
+        return false;
+    }
+
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(sock, &readable);
+    struct timeval timeout = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+    // records TLS has already taken off the socket don't make it readable
+    int ready = stratum_socket_pending(sock) ? 1 : select(sock + 1, &readable, NULL, NULL, &timeout);
+
+    pthread_mutex_lock(&standby->lock);
+    if (standby->socket != sock) {
+        // handed over while waiting
+        pthread_mutex_unlock(&standby->lock);
+        return true;
+    }
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+        pthread_mutex_unlock(&standby->lock);
+        return true;
+    }
+
+    size_t available;
+    char * dest = line_buffer_write_ptr(&standby->buffer, &available);
+    int nbytes = ready > 0 ? stratum_socket_recv(sock, dest, available, MSG_DONTWAIT) : -1;
+    if (nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        pthread_mutex_unlock(&standby->lock);
+        return true;
+    }
+    if (nbytes <= 0) {
+        ESP_LOGW(TAG, "Standby connection lost (%s)", nbytes == 0 ? "closed by peer" : strerror(errno));
+        close_locked(standby);
+        pthread_mutex_unlock(&standby->lock);
+        return false;
+    }
+    line_buffer_commit(&standby->buffer, nbytes);
+
+    const char * line;
+    while ((line = line_buffer_next_line(&standby->buffer, NULL)) != NULL) {
+        ESP_LOGD(TAG, "rx: %s", line);
+        if (!process_message(standby, line)) {
+            close_locked(standby);
+            pthread_mutex_unlock(&standby->lock);
+            return false;
+        }
+    }
+    pthread_mutex_unlock(&standby->lock);
+    return true;
+}
+
+// lock held
+static bool ready_locked(stratum_standby * standby)
+{
+    return standby->socket >= 0 && standby->extranonce_str != NULL && standby->latest_notify != NULL;
+}
+
+bool stratum_standby_ready(stratum_standby * standby)
+{
+    pthread_mutex_lock(&standby->lock);
+    bool ready = ready_locked(standby);
+    pthread_mutex_unlock(&standby->lock);
+    return ready;
+}
+
+bool stratum_standby_take(stratum_standby * standby, stratum_standby_session * session, line_buffer * receive_buffer)
+{
+    pthread_mutex_lock(&standby->lock);
+    if (!ready_locked(standby)) {
+        pthread_mutex_unlock(&standby->lock);
+        return false;
+    }
+
+    session->socket = standby->socket;
+    session->send_uid = standby->send_uid;
+    session->extranonce_str = standby->extranonce_str;
+    session->extranonce_2_len = standby->extranonce_2_len;
+    session->difficulty = standby->difficulty;
+    session->version_mask = standby->version_mask;
+    session->latest_notify = standby->latest_notify;
+
+    line_buffer received = standby->buffer;
+    standby->buffer = *receive_buffer;
+    *receive_buffer = received;
+    line_buffer_reset(&standby->buffer);
+
+    standby->socket = -1;
+    standby->extranonce_str = NULL;
+    standby->latest_notify = NULL;
+    pthread_mutex_unlock(&standby->lock);
+    return true;
+}
@@ -0,0 +1,480 @@
+#include "stratum_tls.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "esp_crt_bundle.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "esp_mem.h"
+#include "mbedtls/platform.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+
+#define MAX_HOST_LEN 128
+
+static const char * TAG = "stratum_tls";
+
+typedef struct
+{
+    // -1 while the slot is free
+    int sock;
+    mbedtls_ssl_context ssl;
+    // ssl_read() and ssl_write() come from the receiving and the tx task, never at the same time
+    pthread_mutex_t lock;
+    // errno of the last failed socket call, mbedTLS only reports that it failed
+    int bio_errno;
+    // the certificate chain was verified, only full handshakes do that
+    bool verified;
+} tls_connection;
+
+typedef struct
+{
+    char host[MAX_HOST_LEN];
+    uint16_t port;
+    bool valid;
+    int64_t used_us;
+    mbedtls_ssl_session session;
+} tls_session_entry;
+
+static mbedtls_ssl_config config;
+static mbedtls_x509_crt ca_chain;
+static bool initialized;
+
+static tls_connection connections[STRATUM_TLS_MAX_CONNECTIONS];
+static pthread_mutex_t connections_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static tls_session_entry session_cache[STRATUM_TLS_SESSION_CACHE_SIZE];
+static pthread_mutex_t session_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef MBEDTLS_PLATFORM_MEMORY
+// The calloc hook is process-wide, so it is only different while this thread works on a stratum
+// connection. Other mbedTLS users (HTTPS OTA, esp_http_client) keep ESP-IDF's configured allocator.
+static __thread bool stratum_allocation;
+
+// the record buffers are the bulk of a connection, 16 KB in and 4 KB out, the rest stays in internal RAM
+static void * tls_calloc(size_t count, size_t size)
+{
+    if (stratum_allocation && count * size >= STRATUM_TLS_PSRAM_MIN_ALLOC) {
+        void * ptr = heap_caps_calloc(count, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+    return esp_mbedtls_mem_calloc(count, size);
+}
+
+#define STRATUM_ALLOCATIONS(enabled) (stratum_allocation = (enabled))
+#else
+#define STRATUM_ALLOCATIONS(enabled)
+#endif
+
+static int tls_random(void * ctx, unsigned char * buf, size_t len)
+{
+    esp_fill_random(buf, len);
+    return 0;
+}
+
+static int bio_send(void * ctx, const unsigned char * buf, size_t len)
+{
+    tls_connection * conn = ctx;
+    int sent = send(conn->sock, buf, len, 0);
+    if (sent < 0) {
+        conn->bio_errno = errno;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+    return sent;
+}
+
+// never blocks, the connection lock is held and the caller waits for the socket without it
+static int bio_recv(void * ctx, unsigned char * buf, size_t len)
+{
+    tls_connection * conn = ctx;
+    int received = recv(conn->sock, buf, len, MSG_DONTWAIT);
+    if (received < 0) {
+        conn->bio_errno = errno;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+    return received;
+}
+
+static int record_verification(void * ctx, mbedtls_x509_crt * crt, int depth, uint32_t * flags)
+{
+    ((tls_connection *) ctx)->verified = true;
+    return 0;
+}
+
+bool stratum_tls_init(const char * ca_pem, bool use_psram)
+{
+    if (initialized) {
+        return true;
+    }
+
+#ifdef MBEDTLS_PLATFORM_MEMORY
+    if (use_psram) {
+        // esp_mbedtls_mem_free() frees blocks of any heap, whichever allocator they came from
+        mbedtls_platform_set_calloc_free(tls_calloc, esp_mbedtls_mem_free);
+    }
+#endif
+
+    for (int i = 0; i < STRATUM_TLS_MAX_CONNECTIONS; i++) {
+        connections[i].sock = -1;
+        pthread_mutex_init(&connections[i].lock, NULL);
+    }
+
+    mbedtls_ssl_config_init(&config);
+    mbedtls_x509_crt_init(&ca_chain);
+    int ret = mbedtls_ssl_config_defaults(&config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Unable to set up the TLS configuration (-0x%04x)", -ret);
+        return false;
+    }
+    // TLS 1.2 resumes within the handshake, TLS 1.3 tickets only arrive after it
+    mbedtls_ssl_conf_max_tls_version(&config, MBEDTLS_SSL_VERSION_TLS1_2);
+    mbedtls_ssl_conf_authmode(&config, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_rng(&config, tls_random, NULL);
+    mbedtls_ssl_conf_session_tickets(&config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+    if (ca_pem != NULL) {
+        ret = mbedtls_x509_crt_parse(&ca_chain, (const unsigned char *) ca_pem, strlen(ca_pem) + 1);
+        if (ret != 0) {
+            ESP_LOGE(TAG, "Unable to parse the CA certificates (-0x%04x)", -ret);
+            return false;
+        }
+        mbedtls_ssl_conf_ca_chain(&config, &ca_chain, NULL);
+    } else if (esp_crt_bundle_attach(&config) != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to attach the certificate bundle");
+        return false;
+    }
+
+    initialized = true;
+    return true;
+}
+
+// returns the connection of sock locked, NULL for a plain socket
+static tls_connection * lock_connection(int sock)
+{
+    if (sock < 0 || !initialized) {
+        return NULL;
+    }
+    tls_connection * conn = NULL;
+    pthread_mutex_lock(&connections_lock);
+    for (int i = 0; i < STRATUM_TLS_MAX_CONNECTIONS; i++) {
+        if (connections[i].sock == sock) {
+            conn = &connections[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&connections_lock);
+    if (conn == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&conn->lock);
+    // closed while waiting for the lock
+    if (conn->sock != sock) {
+        pthread_mutex_unlock(&conn->lock);
+        return NULL;
+    }
+    STRATUM_ALLOCATIONS(true);
+    return conn;
+}
+
+static void unlock_connection(tls_connection * conn)
+{
+    STRATUM_ALLOCATIONS(false);
+    pthread_mutex_unlock(&conn->lock);
+}
+
+// lock held
+static tls_session_entry * find_session(const char * host, uint16_t port)
+{
+    for (int i = 0; i < STRATUM_TLS_SESSION_CACHE_SIZE; i++) {
+        if (session_cache[i].valid && session_cache[i].port == port && strcmp(session_cache[i].host, host) == 0) {
+            return &session_cache[i];
+        }
+    }
+    return NULL;
+}
+
+static void save_session(tls_connection * conn, const char * host, uint16_t port)
+{
+    pthread_mutex_lock(&session_cache_lock);
+    tls_session_entry * entry = find_session(host, port);
+    if (entry == NULL) {
+        // a free entry or the least recently used one
+        entry = &session_cache[0];
+        for (int i = 1; i < STRATUM_TLS_SESSION_CACHE_SIZE && entry->valid; i++) {
+            if (!session_cache[i].valid || session_cache[i].used_us < entry->used_us) {
+                entry = &session_cache[i];
+            }
+        }
+        strcpy(entry->host, host);
+        entry->port = port;
+    }
+    if (entry->valid) {
+        mbedtls_ssl_session_free(&entry->session);
+    }
+    mbedtls_ssl_session_init(&entry->session);
+    int ret = mbedtls_ssl_get_session(&conn->ssl, &entry->session);
+    entry->valid = ret == 0;
+    entry->used_us = esp_timer_get_time();
+    if (ret != 0) {
+        mbedtls_ssl_session_free(&entry->session);
+        ESP_LOGW(TAG, "Unable to keep the session of %s:%d (-0x%04x)", host, port, -ret);
+    }
+    pthread_mutex_unlock(&session_cache_lock);
+}
+
+void stratum_tls_forget_session(const char * host, uint16_t port)
+{
+    pthread_mutex_lock(&session_cache_lock);
+    tls_session_entry * entry = find_session(host, port);
+    if (entry != NULL) {
+        mbedtls_ssl_session_free(&entry->session);
+        entry->valid = false;
+    }
+    pthread_mutex_unlock(&session_cache_lock);
+}
+
+// waits until sock is readable or writable, false on timeout
+static bool wait_socket(int sock, bool write, int64_t deadline_us)
+{
+    int64_t remaining_us = deadline_us - esp_timer_get_time();
+    if (remaining_us <= 0) {
+        return false;
+    }
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    struct timeval timeout = {.tv_sec = remaining_us / 1000000, .tv_usec = remaining_us % 1000000};
+    int ready = select(sock + 1, write ? NULL : &fds, write ? &fds : NULL, NULL, &timeout);
+    // an error shows in the next socket call
+    return ready != 0;
+}
+
+static void release_connection(tls_connection * conn)
+{
+    mbedtls_ssl_free(&conn->ssl);
+    pthread_mutex_lock(&connections_lock);
+    conn->sock = -1;
+    pthread_mutex_unlock(&connections_lock);
+}
+
+bool stratum_tls_start(int sock, const char * host, uint16_t port, uint32_t timeout_ms, stratum_tls_handshake_stats * stats)
+{
+    if (!initialized) {
+        ESP_LOGE(TAG, "TLS is not initialized");
+        return false;
+    }
+    if (strlen(host) >= MAX_HOST_LEN) {
+        ESP_LOGE(TAG, "Host name too long: %s", host);
+        return false;
+    }
+
+    size_t internal_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    size_t psram_before = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    int64_t start = esp_timer_get_time();
+
+    tls_connection * conn = NULL;
+    pthread_mutex_lock(&connections_lock);
+    for (int i = 0; i < STRATUM_TLS_MAX_CONNECTIONS; i++) {
+        if (connections[i].sock < 0) {
+            conn = &connections[i];
+            break;
+        }
+    }
+    if (conn != NULL) {
+        // claimed, not found by lock_connection() before the handshake is done since it's locked until then
+        pthread_mutex_lock(&conn->lock);
+        conn->sock = sock;
+        STRATUM_ALLOCATIONS(true);
+    }
+    pthread_mutex_unlock(&connections_lock);
+    if (conn == NULL) {
+        ESP_LOGE(TAG, "All %d TLS connections in use", STRATUM_TLS_MAX_CONNECTIONS);
+        return false;
+    }
+
+    conn->bio_errno = 0;
+    conn->verified = false;
+    mbedtls_ssl_init(&conn->ssl);
+    int ret = mbedtls_ssl_setup(&conn->ssl, &config);
+    if (ret == 0) {
+        // the name for SNI and the one the certificate is checked against
+        ret = mbedtls_ssl_set_hostname(&conn->ssl, host);
+    }
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Unable to set up the TLS connection (-0x%04x)", -ret);
+        release_connection(conn);
+        unlock_connection(conn);
+        return false;
+    }
+    mbedtls_ssl_set_bio(&conn->ssl, conn, bio_send, bio_recv, NULL);
+    mbedtls_ssl_set_verify(&conn->ssl, record_verification, conn);
+
+    pthread_mutex_lock(&session_cache_lock);
+    tls_session_entry * entry = find_session(host, port);
+    bool offered = entry != NULL && mbedtls_ssl_set_session(&conn->ssl, &entry->session) == 0;
+    pthread_mutex_unlock(&session_cache_lock);
+
+    int64_t deadline = start + (int64_t) timeout_ms * 1000;
+    while ((ret = mbedtls_ssl_handshake(&conn->ssl)) != 0) {
+        if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+            !wait_socket(sock, ret == MBEDTLS_ERR_SSL_WANT_WRITE, deadline)) {
+            break;
+        }
+    }
+    if (ret != 0) {
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            ESP_LOGW(TAG, "TLS handshake with %s:%d timed out", host, port);
+        } else if (ret == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
+            ESP_LOGW(TAG, "Certificate of %s:%d not trusted (flags 0x%lx)", host, port,
+                     (unsigned long) mbedtls_ssl_get_verify_result(&conn->ssl));
+        } else {
+            ESP_LOGW(TAG, "TLS handshake with %s:%d failed (-0x%04x)", host, port, -ret);
+        }
+        // a session the pool rejects or that ran into trouble isn't offered again
+        if (offered) {
+            stratum_tls_forget_session(host, port);
+        }
+        release_connection(conn);
+        unlock_connection(conn);
+        return false;
+    }
+
+    int64_t handshake_us = esp_timer_get_time() - start;
+    bool resumed = offered && !conn->verified;
+    ESP_LOGI(TAG, "%s with %s:%d in %lld ms, %s", mbedtls_ssl_get_version(&conn->ssl), host, port,
+             (long long) (handshake_us / 1000), resumed ? "session resumed" : "full handshake");
+    // also after resuming, the pool may have renewed the ticket
+    save_session(conn, host, port);
+    unlock_connection(conn);
+
+    if (stats != NULL) {
+        stats->handshake_us = handshake_us;
+        stats->resumed = resumed;
+        stats->heap_internal = (int32_t) internal_before - (int32_t) heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+        stats->heap_psram = (int32_t) psram_before - (int32_t) heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    }
+    return true;
+}
+
+// SO_RCVTIMEO of sock as a deadline, -1 for none
+static int64_t receive_deadline(int sock)
+{
+    struct timeval timeout = {0};
+    socklen_t len = sizeof(timeout);
+    if (getsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, &len) != 0 || (timeout.tv_sec == 0 && timeout.tv_usec == 0)) {
+        return -1;
+    }
+    return esp_timer_get_time() + (int64_t) timeout.tv_sec * 1000000 + timeout.tv_usec;
+}
+
+int stratum_socket_send(int sock, const void * data, size_t len)
+{
+    tls_connection * conn = lock_connection(sock);
+    if (conn == NULL) {
+        return send(sock, data, len, 0);
+    }
+
+    conn->bio_errno = 0;
+    int ret = mbedtls_ssl_write(&conn->ssl, data, len);
+    int bio_errno = conn->bio_errno;
+    unlock_connection(conn);
+    if (ret < 0) {
+        ESP_LOGD(TAG, "ssl_write failed (-0x%04x)", -ret);
+        errno = ret == MBEDTLS_ERR_SSL_INTERNAL_ERROR && bio_errno != 0 ? bio_errno : EIO;
+        return -1;
+    }
+    return ret;
+}
+
+int stratum_socket_recv(int sock, void * data, size_t len, int flags)
+{
+    tls_connection * conn = lock_connection(sock);
+    if (conn == NULL) {
+        return recv(sock, data, len, flags);
+    }
+
+    int64_t deadline = -2;
+    for (;;) {
+        conn->bio_errno = 0;
+        int ret = mbedtls_ssl_read(&conn->ssl, data, len);
+        int bio_errno = conn->bio_errno;
+        unlock_connection(conn);
+
+        if (ret >= 0) {
+            return ret;
+        }
+        if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY || ret == MBEDTLS_ERR_SSL_CONN_EOF) {
+            return 0;
+        }
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ) {
+            ESP_LOGD(TAG, "ssl_read failed (-0x%04x)", -ret);
+            errno = ret == MBEDTLS_ERR_SSL_INTERNAL_ERROR && bio_errno != 0 ? bio_errno : EIO;
+            return -1;
+        }
+        if (flags & MSG_DONTWAIT) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        // the rest of the record, waited for without the lock so the tx task can send meanwhile
+        if (deadline == -2) {
+            deadline = receive_deadline(sock);
+        }
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sock, &readable);
+        if (deadline >= 0) {
+            if (!wait_socket(sock, false, deadline)) {
+                errno = EAGAIN;
+                return -1;
+            }
+        } else if (select(sock + 1, &readable, NULL, NULL, NULL) < 0 && errno != EINTR) {
+            return -1;
+        }
+
+        conn = lock_connection(sock);
+        if (conn == NULL) {
+            errno = ENOTCONN;
+            return -1;
+        }
+    }
+}
+
+bool stratum_socket_pending(int sock)
+{
+    tls_connection * conn = lock_connection(sock);
+    if (conn == NULL) {
+        return false;
+    }
+    bool pending = mbedtls_ssl_get_bytes_avail(&conn->ssl) > 0 || mbedtls_ssl_check_pending(&conn->ssl);
+    unlock_connection(conn);
+    return pending;
+}
+
+void stratum_socket_close(int sock)
+{
+    if (sock < 0) {
+        return;
+    }
+    tls_connection * conn = lock_connection(sock);
+    if (conn != NULL) {
+        // best effort, a pool that's gone doesn't get to hold the close up
+        int flags = fcntl(sock, F_GETFL, 0);
+        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+        mbedtls_ssl_close_notify(&conn->ssl);
+        release_connection(conn);
+        unlock_connection(conn);
+    }
+    shutdown(sock, SHUT_RDWR);
+    close(sock);
+}
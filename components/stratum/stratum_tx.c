@@ -0,0 +1,185 @@
+#include "stratum_tx.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "stratum_tls.h"
+
+static const char * TAG = "stratum_tx";
+
+bool stratum_tx_init(stratum_tx * tx, size_t capacity)
+{
+    memset(tx, 0, sizeof(stratum_tx));
+    tx->socket = -1;
+
+    // head and tail run freely, the buffer position only stays continuous across their wrap around
+    // for power of two capacities
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        ESP_LOGE(TAG, "Capacity %u is not a power of two", (unsigned) capacity);
+        return false;
+    }
+    tx->buffer = malloc(capacity);
+    if (tx->buffer == NULL) {
+        return false;
+    }
+    tx->capacity = capacity;
+    pthread_mutex_init(&tx->lock, NULL);
+    pthread_mutex_init(&tx->send_lock, NULL);
+    pthread_cond_init(&tx->not_empty, NULL);
+    return true;
+}
+
+void stratum_tx_free(stratum_tx * tx)
+{
+    if (tx->buffer == NULL) {
+        return;
+    }
+    pthread_cond_destroy(&tx->not_empty);
+    pthread_mutex_destroy(&tx->send_lock);
+    pthread_mutex_destroy(&tx->lock);
+    free(tx->buffer);
+    memset(tx, 0, sizeof(stratum_tx));
+    tx->socket = -1;
+}
+
+// lock held
+static void drop_queued(stratum_tx * tx)
+{
+    tx->head = tx->tail;
+    tx->pending_head = tx->pending_tail;
+}
+
+void stratum_tx_set_socket(stratum_tx * tx, int socket)
+{
+    pthread_mutex_lock(&tx->send_lock);
+    pthread_mutex_lock(&tx->lock);
+    drop_queued(tx);
+    tx->socket = socket;
+    pthread_mutex_unlock(&tx->lock);
+    pthread_mutex_unlock(&tx->send_lock);
+}
+
+void stratum_tx_set_capture(stratum_tx * tx, stratum_capture * capture, uint8_t session)
+{
+    pthread_mutex_lock(&tx->lock);
+    tx->capture = capture;
+    tx->capture_session = session;
+    pthread_mutex_unlock(&tx->lock);
+}
+
+int stratum_tx_enqueue(stratum_tx * tx, const char * msg, size_t len)
+{
+    pthread_mutex_lock(&tx->lock);
+    if (tx->socket < 0) {
+        pthread_mutex_unlock(&tx->lock);
+        errno = ENOTCONN;
+        return -1;
+    }
+    if (len > tx->capacity - (tx->tail - tx->head) || tx->pending_tail - tx->pending_head == STRATUM_TX_MAX_PENDING) {
+        tx->dropped++;
+        pthread_mutex_unlock(&tx->lock);
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    size_t pos = tx->tail & (tx->capacity - 1);
+    size_t first = len < tx->capacity - pos ? len : tx->capacity - pos;
+    memcpy(tx->buffer + pos, msg, first);
+    memcpy(tx->buffer, msg + first, len - first);
+    tx->tail += len;
+
+    int64_t now = esp_timer_get_time();
+    tx->pending[tx->pending_tail % STRATUM_TX_MAX_PENDING].end = tx->tail;
+    tx->pending[tx->pending_tail % STRATUM_TX_MAX_PENDING].enqueued_us = now;
+    tx->pending_tail++;
+
+    pthread_cond_signal(&tx->not_empty);
+    stratum_capture * capture = tx->capture;
+    uint8_t capture_session = tx->capture_session;
+    pthread_mutex_unlock(&tx->lock);
+
+    if (capture != NULL) {
+        stratum_capture_line(capture, now, capture_session, true, msg, len);
+    }
+    return len;
+}
+
+void stratum_tx_wait(stratum_tx * tx)
+{
+    pthread_mutex_lock(&tx->lock);
+    while (tx->head == tx->tail) {
+        pthread_cond_wait(&tx->not_empty, &tx->lock);
+    }
+    pthread_mutex_unlock(&tx->lock);
+}
+
+// lock held, accounts every message that was sent completely
+static void complete_messages(stratum_tx * tx, int64_t now)
+{
+    while (tx->pending_head != tx->pending_tail) {
+        size_t end = tx->pending[tx->pending_head % STRATUM_TX_MAX_PENDING].end;
+        if ((ptrdiff_t) (end - tx->head) > 0) {
+            break;
+        }
+        int64_t latency = now - tx->pending[tx->pending_head % STRATUM_TX_MAX_PENDING].enqueued_us;
+        ESP_LOGD(TAG, "Message sent %lld us after it was queued", (long long) latency);
+        tx->latency_total_us += latency;
+        tx->latency_max_us = latency > tx->latency_max_us ? latency : tx->latency_max_us;
+        tx->messages++;
+        tx->pending_head++;
+    }
+}
+
+bool stratum_tx_flush(stratum_tx * tx)
+{
+    bool ok = true;
+
+    pthread_mutex_lock(&tx->send_lock);
+    pthread_mutex_lock(&tx->lock);
+    while (tx->head != tx->tail) {
+        int socket = tx->socket;
+        size_t pos = tx->head & (tx->capacity - 1);
+        size_t len = tx->tail - tx->head;
+        // everything up to the end of the buffer in one go, the wrapped part in the next round
+        len = len < tx->capacity - pos ? len : tx->capacity - pos;
+        pthread_mutex_unlock(&tx->lock);
+
+        // producers only write past tail, so the pending bytes stay put while unlocked
+        ssize_t sent = stratum_socket_send(socket, tx->buffer + pos, len);
+        int send_errno = errno;
+        int64_t now = esp_timer_get_time();
+
+        pthread_mutex_lock(&tx->lock);
+        tx->sends++;
+        if (sent < 0) {
+            ESP_LOGE(TAG, "Unable to send, dropping %u queued bytes (errno %d: %s)", (unsigned) (tx->tail - tx->head),
+                     send_errno, strerror(send_errno));
+            drop_queued(tx);
+            shutdown(socket, SHUT_RDWR);
+            ok = false;
+            break;
+        }
+        tx->head += sent;
+        complete_messages(tx, now);
+    }
+    pthread_mutex_unlock(&tx->lock);
+    pthread_mutex_unlock(&tx->send_lock);
+
+    return ok;
+}
+
+void stratum_tx_get_stats(stratum_tx * tx, stratum_tx_stats * stats)
+{
+    pthread_mutex_lock(&tx->lock);
+    stats->messages = tx->messages;
+    stats->sends = tx->sends;
+    stats->dropped = tx->dropped;
+    stats->queued = tx->tail - tx->head;
+    stats->latency_avg_us = tx->messages > 0 ? tx->latency_total_us / tx->messages : 0;
+    stats->latency_max_us = tx->latency_max_us;
+    pthread_mutex_unlock(&tx->lock);
+}
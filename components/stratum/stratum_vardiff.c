@@ -0,0 +1,46 @@
+#include "stratum_vardiff.h"
+
+void stratum_vardiff_init(stratum_vardiff * vardiff, float shares_per_minute, uint32_t fallback_difficulty)
+{
+    vardiff->shares_per_minute = shares_per_minute;
+    vardiff->fallback_difficulty = fallback_difficulty > 0 ? fallback_difficulty : 1;
+    stratum_vardiff_reset(vardiff);
+}
+
+void stratum_vardiff_reset(stratum_vardiff * vardiff)
+{
+    vardiff->suggested = 0;
+    vardiff->suggested_us = 0;
+}
+
+uint32_t stratum_vardiff_difficulty(const stratum_vardiff * vardiff, double hashrate_ghs)
+{
+    if (vardiff->shares_per_minute <= 0 || hashrate_ghs <= 0) {
+        return vardiff->fallback_difficulty;
+    }
+    double difficulty = hashrate_ghs * 1e9 * 60 / (vardiff->shares_per_minute * 4294967296.0);
+    if (difficulty < 1) {
+        return 1;
+    }
+    return difficulty < UINT32_MAX ? (uint32_t) (difficulty + 0.5) : UINT32_MAX;
+}
+
+bool stratum_vardiff_update(stratum_vardiff * vardiff, double hashrate_ghs, int64_t now_us, uint32_t * difficulty)
+{
+    uint32_t target = stratum_vardiff_difficulty(vardiff, hashrate_ghs);
+    if (vardiff->suggested != 0) {
+        if (now_us - vardiff->suggested_us < (int64_t) STRATUM_VARDIFF_MIN_INTERVAL_MS * 1000) {
+            return false;
+        }
+        // within the band the share rate is close enough, the hashrate estimate is noisy
+        double ratio = (double) target / vardiff->suggested;
+        double band = 1 + STRATUM_VARDIFF_CHANGE_PERCENT / 100.0;
+        if (ratio < band && ratio > 1 / band) {
+            return false;
+        }
+    }
+    vardiff->suggested = target;
+    vardiff->suggested_us = now_us;
+    *difficulty = target;
+    return true;
+}
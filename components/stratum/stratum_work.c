@@ -0,0 +1,155 @@
+#include "stratum_work.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "utils.h"
+
+static const char * TAG = "stratum_work";
+
+// The coinbase only differs in extranonce_2 between jobs, it is built once per notify and extranonce
+static bool build_template(mining_notify * notification, stratum_work_extranonce_fn read_extranonce, void * ctx,
+                           job_template * tmpl, uint32_t * extranonce_generation)
+{
+    stratum_work_extranonce extranonce;
+    read_extranonce(ctx, notification->session, &extranonce);
+    *extranonce_generation = extranonce.generation;
+
+    if (extranonce.extranonce_2_len > MAX_EXTRANONCE_2_LEN) {
+        ESP_LOGE(TAG, "extranonce_2 length exceeds job limits");
+        return false;
+    }
+    if (!job_template_init(tmpl, notification, extranonce.extranonce, extranonce.extranonce_len,
+                           extranonce.extranonce_2_len)) {
+        ESP_LOGE(TAG, "Failed to construct coinbase_tx");
+        return false;
+    }
+    return true;
+}
+
+bool stratum_work_accept(stratum_work * work, mining_notify * notification, stratum_work_extranonce_fn read_extranonce,
+                         void * ctx)
+{
+    if (strlen(notification->job_id) > MAX_JOB_ID_LEN) {
+        ESP_LOGE(TAG, "Job id length exceeds job limits");
+        return false;
+    }
+
+    // header-only jobs come with their merkle root, there's no coinbase to build
+    job_template tmpl = {0};
+    uint32_t extranonce_generation = 0;
+    if (!notification->header_only &&
+        !build_template(notification, read_extranonce, ctx, &tmpl, &extranonce_generation)) {
+        return false;
+    }
+
+    stratum_work_release(work);
+    work->notification = notification;
+    work->tmpl = tmpl;
+    work->extranonce_2 = 0;
+    work->extranonce_generation = extranonce_generation;
+    return true;
+}
+
+void stratum_work_release(stratum_work * work)
+{
+    if (work->notification != NULL) {
+        if (!work->notification->header_only) {
+            job_template_free(&work->tmpl);
+        }
+        STRATUM_V1_free_mining_notify(work->notification);
+        work->notification = NULL;
+    }
+}
+
+// mining.set_extranonce keeps the notify valid, its coinbase is rebuilt with the new extranonce
+static bool rebuild_template(stratum_work * work, stratum_work_extranonce_fn read_extranonce, void * ctx)
+{
+    job_template tmpl;
+    uint32_t extranonce_generation;
+    if (!build_template(work->notification, read_extranonce, ctx, &tmpl, &extranonce_generation)) {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "New extranonce, rebuilding work %s", work->notification->job_id);
+    job_template_free(&work->tmpl);
+    work->tmpl = tmpl;
+    work->extranonce_2 = 0;
+    work->extranonce_generation = extranonce_generation;
+    return true;
+}
+
+// header-only work that already rolled ntime as far ahead as the pool accepts
+static bool ntime_roll_exhausted(const stratum_work * work, int64_t now_us)
+{
+    mining_notify * notification = work->notification;
+    int64_t elapsed_s = (now_us - notification->received_us) / 1000000;
+    return notification->header_only && work->extranonce_2 > elapsed_s + STRATUM_WORK_MAX_NTIME_AHEAD_S;
+}
+
+stratum_work * stratum_work_next(stratum_work * work, const stratum_work_session * sessions, int count,
+                                 stratum_work_extranonce_fn read_extranonce, void * ctx, int64_t now_us, bool * rebuilt,
+                                 bool * ntime_limited)
+{
+    stratum_work * best = NULL;
+    int32_t total_weight = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (work[i].notification == NULL) {
+            continue;
+        }
+        // a clean_jobs notify or reconnect of the session since the notify arrived
+        if (work[i].notification->generation != sessions[i].work_generation) {
+            ESP_LOGI(TAG, "Skipping stale work %s", work[i].notification->job_id);
+            stratum_work_release(&work[i]);
+            continue;
+        }
+        if (!work[i].notification->header_only && work[i].extranonce_generation != sessions[i].extranonce_generation) {
+            if (!rebuild_template(&work[i], read_extranonce, ctx)) {
+                stratum_work_release(&work[i]);
+                continue;
+            }
+            *rebuilt = true;
+        }
+        if (ntime_roll_exhausted(&work[i], now_us)) {
+            *ntime_limited = true;
+            continue;
+        }
+
+        work[i].current_weight += sessions[i].weight;
+        total_weight += sessions[i].weight;
+        if (best == NULL || work[i].current_weight > best->current_weight) {
+            best = &work[i];
+        }
+    }
+
+    if (best != NULL) {
+        best->current_weight -= total_weight;
+    }
+    return best;
+}
+
+void stratum_work_next_job(stratum_work * work, uint32_t version_mask, bm_job * job)
+{
+    mining_notify * notification = work->notification;
+    job_template * tmpl = &work->tmpl;
+
+    if (notification->header_only) {
+        // the merkle root is fixed, ntime is rolled in its place
+        *job = construct_bm_job(notification, notification->merkle_root, version_mask);
+        job->ntime += work->extranonce_2;
+        job->extranonce2[0] = '\0';
+    } else {
+        uint8_t merkle_root[32];
+        job_template_merkle_root(tmpl, notification, work->extranonce_2, merkle_root);
+        *job = construct_bm_job(notification, merkle_root, version_mask);
+        // only needed in hex when submitting a share
+        bin2hex(tmpl->coinbase_tx + tmpl->extranonce_2_offset, tmpl->extranonce_2_len, job->extranonce2,
+                sizeof(job->extranonce2));
+    }
+
+    // lengths were checked against the job limits when the notify was accepted
+    strcpy(job->jobid, notification->job_id);
+    job->version_mask = version_mask;
+    work->extranonce_2++;
+}
@@ -0,0 +1,31 @@
+#include "stratum_test_pool.h"
+
+#include <string.h>
+
+#include "unity.h"
+#include "esp_netif.h"
+#include "lwip/sockets.h"
+
+int stratum_test_pool_listen(uint16_t * port, int backlog)
+{
+    esp_netif_init();
+
+    int listener = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    TEST_ASSERT_TRUE(listener >= 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = 0,
+    };
+    socklen_t addr_len = sizeof(addr);
+    TEST_ASSERT_EQUAL(0, bind(listener, (struct sockaddr *) &addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL(0, listen(listener, backlog));
+    TEST_ASSERT_EQUAL(0, getsockname(listener, (struct sockaddr *) &addr, &addr_len));
+    *port = ntohs(addr.sin_port);
+    return listener;
+}
+
+void stratum_test_pool_send(int client, const char * data)
+{
+    TEST_ASSERT_EQUAL(strlen(data), send(client, data, strlen(data), 0));
+}
@@ -0,0 +1,15 @@
+#ifndef STRATUM_TEST_POOL_H_
+#define STRATUM_TEST_POOL_H_
+
+#include <stdint.h>
+
+// Stand-in pool on a loopback port, what it answers is up to the test. Failures fail the running test.
+
+/// @brief Listens on a free loopback port.
+/// @return the listening socket, the miner connects to port
+int stratum_test_pool_listen(uint16_t * port, int backlog);
+
+/// @brief Sends data from the pool to the miner in one piece.
+void stratum_test_pool_send(int client, const char * data);
+
+#endif /* STRATUM_TEST_POOL_H_ */
@@ -0,0 +1,192 @@
+#include "unity.h"
+#include "line_buffer.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+static void feed(line_buffer * lb, const char * data, size_t len)
+{
+    size_t available;
+    char * dest = line_buffer_write_ptr(lb, &available);
+    TEST_ASSERT_TRUE(len <= available);
+    memcpy(dest, data, len);
+    line_buffer_commit(lb, len);
+}
+
+TEST_CASE("Line buffer splits lines", "[line_buffer]")
+{
+    line_buffer lb;
+    TEST_ASSERT_TRUE(line_buffer_init(&lb, 64));
+
+    size_t len;
+    feed(&lb, "{\"id\":1}\n{\"id\":2}\r\n\n{\"id\"", 25);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":1}", line_buffer_next_line(&lb, &len));
+    TEST_ASSERT_EQUAL(8, len);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":2}", line_buffer_next_line(&lb, &len));
+    TEST_ASSERT_NULL(line_buffer_next_line(&lb, &len));
+
+    feed(&lb, ":3}\n", 4);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":3}", line_buffer_next_line(&lb, &len));
+    TEST_ASSERT_NULL(line_buffer_next_line(&lb, &len));
+
+    line_buffer_free(&lb);
+}
+
+TEST_CASE("Line buffer keeps partial line across compaction", "[line_buffer]")
+{
+    line_buffer lb;
+    TEST_ASSERT_TRUE(line_buffer_init(&lb, 32));
+
+    char expected[32];
+    for (int i = 0; i < 100; i++) {
+        // lines of varying length, split at varying offsets
+        int n = snprintf(expected, sizeof(expected), "line %d %.*s", i, i % 12, "abcdefghijkl");
+        char line[32];
+        memcpy(line, expected, n);
+        line[n] = '\n';
+        int split = i % (n + 1);
+
+        feed(&lb, line, split);
+        feed(&lb, line + split, n + 1 - split);
+        TEST_ASSERT_EQUAL_STRING(expected, line_buffer_next_line(&lb, NULL));
+        TEST_ASSERT_NULL(line_buffer_next_line(&lb, NULL));
+    }
+    TEST_ASSERT_EQUAL(0, lb.overflows);
+
+    line_buffer_free(&lb);
+}
+
+TEST_CASE("Line buffer discards oversized line", "[line_buffer]")
+{
+    line_buffer lb;
+    TEST_ASSERT_TRUE(line_buffer_init(&lb, 16));
+
+    feed(&lb, "0123456789abcdef", 16);
+    TEST_ASSERT_NULL(line_buffer_next_line(&lb, NULL));
+    feed(&lb, "ghij", 4);
+    TEST_ASSERT_NULL(line_buffer_next_line(&lb, NULL));
+    feed(&lb, "klm\nok\n", 7);
+    TEST_ASSERT_EQUAL_STRING("ok", line_buffer_next_line(&lb, NULL));
+    TEST_ASSERT_NULL(line_buffer_next_line(&lb, NULL));
+    TEST_ASSERT_EQUAL(1, lb.overflows);
+
+    line_buffer_free(&lb);
+}
+
+// Previous framing (strstr + realloc + strncat + strtok + strdup + memmove), kept for comparison
+static char * legacy_buffer;
+static size_t legacy_buffer_size;
+
+static char * legacy_frame_line(const char ** stream, const char * end, size_t chunk)
+{
+    while (!strstr(legacy_buffer, "\n")) {
+        size_t nbytes = end - *stream < chunk ? end - *stream : chunk;
+        if (nbytes == 0) {
+            return NULL;
+        }
+        size_t old = strlen(legacy_buffer);
+        if (old + nbytes + 1 >= legacy_buffer_size) {
+            legacy_buffer_size = old + nbytes + 1 + 1024 - ((old + nbytes + 1) % 1024);
+            legacy_buffer = realloc(legacy_buffer, legacy_buffer_size);
+            memset(legacy_buffer + old, 0, legacy_buffer_size - old);
+        }
+        strncat(legacy_buffer, *stream, nbytes);
+        *stream += nbytes;
+    }
+    size_t buflen = strlen(legacy_buffer);
+    char * line = strdup(strtok(legacy_buffer, "\n"));
+    size_t len = strlen(line);
+    if (buflen > len + 1) {
+        memmove(legacy_buffer, legacy_buffer + len + 1, buflen - len + 1);
+    } else {
+        legacy_buffer[0] = '\0';
+    }
+    return line;
+}
+
+// Builds a burst of mining.notify lines with coinbase_len hex chars and 14 merkle branches
+static size_t build_notify_burst(char * dest, int lines, int coinbase_len)
+{
+    size_t pos = 0;
+    for (int i = 0; i < lines; i++) {
+        pos += sprintf(dest + pos, "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"%x\",\"%064x\",\"", i, i);
+        memset(dest + pos, '0' + (i % 10), coinbase_len);
+        pos += coinbase_len;
+        pos += sprintf(dest + pos, "\",\"\",[");
+        for (int b = 0; b < 14; b++) {
+            pos += sprintf(dest + pos, "%s\"%064x\"", b ? "," : "", b);
+        }
+        pos += sprintf(dest + pos, "],\"20000004\",\"1705c739\",\"64495522\",false]}\n");
+    }
+    return pos;
+}
+
+static void benchmark_framers(int coinbase_len)
+{
+    const int lines = 16, rounds = 20;
+    const size_t chunk = 1460; // one TCP segment per recv
+    char * burst = malloc(lines * (coinbase_len + 1400));
+    TEST_ASSERT_NOT_NULL(burst);
+    size_t burst_len = build_notify_burst(burst, lines, coinbase_len);
+
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    size_t min_free = free_before;
+    line_buffer lb;
+    TEST_ASSERT_TRUE(line_buffer_init(&lb, 16 * 1024));
+    int64_t start = esp_timer_get_time();
+    int framed = 0;
+    for (int r = 0; r < rounds; r++) {
+        const char * p = burst;
+        const char * end = burst + burst_len;
+        while (p < end) {
+            size_t available;
+            char * dest = line_buffer_write_ptr(&lb, &available);
+            size_t n = end - p < chunk ? end - p : chunk;
+            n = n < available ? n : available;
+            memcpy(dest, p, n);
+            line_buffer_commit(&lb, n);
+            p += n;
+            while (line_buffer_next_line(&lb, NULL) != NULL) {
+                size_t free_now = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+                min_free = free_now < min_free ? free_now : min_free;
+                framed++;
+            }
+        }
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    line_buffer_free(&lb);
+    TEST_ASSERT_EQUAL(lines * rounds, framed);
+    printf("line_buffer: %d byte coinbase, %.0f bytes/s, peak heap %u bytes\n", coinbase_len,
+           (double) burst_len * rounds * 1000000 / elapsed, (unsigned) (free_before - min_free));
+
+    free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    min_free = free_before;
+    legacy_buffer_size = 1024;
+    legacy_buffer = calloc(1, legacy_buffer_size);
+    start = esp_timer_get_time();
+    framed = 0;
+    for (int r = 0; r < rounds; r++) {
+        const char * p = burst;
+        char * line;
+        while ((line = legacy_frame_line(&p, burst + burst_len, chunk)) != NULL) {
+            size_t free_now = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+            min_free = free_now < min_free ? free_now : min_free;
+            free(line);
+            framed++;
+        }
+    }
+    elapsed = esp_timer_get_time() - start;
+    free(legacy_buffer);
+    TEST_ASSERT_EQUAL(lines * rounds, framed);
+    printf("legacy:      %d byte coinbase, %.0f bytes/s, peak heap %u bytes\n", coinbase_len,
+           (double) burst_len * rounds * 1000000 / elapsed, (unsigned) (free_before - min_free));
+
+    free(burst);
+}
+
+TEST_CASE("Line buffer framing throughput", "[benchmark][not-on-qemu]")
+{
+    benchmark_framers(400);
+    benchmark_framers(4000);
+}
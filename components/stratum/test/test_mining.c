@@ -1,24 +1,45 @@
 #include "unity.h"
 #include "mining.h"
 #include "utils.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
 
 TEST_CASE("Check coinbase tx construction", "[mining]")
 {
-    const char *coinbase_1 = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008";
-    const char *coinbase_2 = "072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000";
-    const char *extranonce = "e9695791";
-    const char *extranonce_2 = "99999999";
-    char *coinbase_tx = construct_coinbase_tx(coinbase_1, coinbase_2, extranonce, extranonce_2);
-    TEST_ASSERT_EQUAL_STRING(coinbase_tx, "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008e969579199999999072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000");
+    uint8_t coinbase_1[58], coinbase_2[51], extranonce[4];
+    hex2bin("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008", coinbase_1, sizeof(coinbase_1));
+    hex2bin("072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000", coinbase_2, sizeof(coinbase_2));
+    hex2bin("e9695791", extranonce, sizeof(extranonce));
+    mining_notify notify_message;
+    notify_message.coinbase_1 = coinbase_1;
+    notify_message.coinbase_1_len = sizeof(coinbase_1);
+    notify_message.coinbase_2 = coinbase_2;
+    notify_message.coinbase_2_len = sizeof(coinbase_2);
+
+    size_t coinbase_tx_len;
+    uint8_t *coinbase_tx = construct_coinbase_tx(&notify_message, extranonce, sizeof(extranonce), 4, &coinbase_tx_len);
+    TEST_ASSERT_EQUAL(117, coinbase_tx_len);
+    extranonce_2_generate(0x99999999, 4, coinbase_tx + sizeof(coinbase_1) + sizeof(extranonce));
+
+    char coinbase_tx_hex[235];
+    bin2hex(coinbase_tx, coinbase_tx_len, coinbase_tx_hex, sizeof(coinbase_tx_hex));
+    TEST_ASSERT_EQUAL_STRING("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008e969579199999999072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000", coinbase_tx_hex);
     free(coinbase_tx);
 }
 
 // Values calculated from esp-miner/components/stratum/test/verifiers/merklecalc.py
 TEST_CASE("Validate merkle root calculation", "[mining]")
 {
-    const char *coinbase_tx = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008e969579199999999072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000";
+    uint8_t coinbase_tx[117];
+    hex2bin("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008e969579199999999072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000", coinbase_tx, sizeof(coinbase_tx));
     uint8_t merkles[12][32];
     int num_merkles = 12;
 
@@ -35,14 +56,17 @@ TEST_CASE("Validate merkle root calculation", "[mining]")
     hex2bin("463c19427286342120039a83218fa87ce45448e246895abac11fff0036076758", merkles[10], 32);
     hex2bin("03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76", merkles[11], 32);
 
-    char *root_hash = calculate_merkle_root_hash(coinbase_tx, merkles, num_merkles);
-    TEST_ASSERT_EQUAL_STRING("adbcbc21e20388422198a55957aedfa0e61be0b8f2b87d7c08510bb9f099a893", root_hash);
-    free(root_hash);
+    uint8_t root_hash[32];
+    calculate_merkle_root_hash(coinbase_tx, sizeof(coinbase_tx), merkles, num_merkles, root_hash);
+    uint8_t expected_root_hash[32];
+    hex2bin("adbcbc21e20388422198a55957aedfa0e61be0b8f2b87d7c08510bb9f099a893", expected_root_hash, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_root_hash, root_hash, 32);
 }
 
 TEST_CASE("Validate another merkle root calculation", "[mining]")
 {
-    const char *coinbase_tx = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff2503777d07062f503253482f0405b8c75208f800880e000000000b2f436f696e48756e74722f0000000001603f352a010000001976a914c633315d376c20a973a758f7422d67f7bfed9c5888ac00000000";
+    uint8_t coinbase_tx[122];
+    hex2bin("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff2503777d07062f503253482f0405b8c75208f800880e000000000b2f436f696e48756e74722f0000000001603f352a010000001976a914c633315d376c20a973a758f7422d67f7bfed9c5888ac00000000", coinbase_tx, sizeof(coinbase_tx));
     uint8_t merkles[5][32];
     int num_merkles = 5;
 
@@ -52,20 +76,109 @@ TEST_CASE("Validate another merkle root calculation", "[mining]")
     hex2bin("9f64f3b0d9edddb14be6f71c3ac2e80455916e207ffc003316c6a515452aa7b4", merkles[3], 32);
     hex2bin("2d0b54af60fad4ae59ec02031f661d026f2bb95e2eeb1e6657a35036c017c595", merkles[4], 32);
 
-    char *root_hash = calculate_merkle_root_hash(coinbase_tx, merkles, num_merkles);
-    TEST_ASSERT_EQUAL_STRING("5cc58f5e84aafc740d521b92a7bf72f4e56c4cc3ad1c2159f1d094f97ac34eee", root_hash);
-    free(root_hash);
+    uint8_t root_hash[32];
+    calculate_merkle_root_hash(coinbase_tx, sizeof(coinbase_tx), merkles, num_merkles, root_hash);
+    uint8_t expected_root_hash[32];
+    hex2bin("5cc58f5e84aafc740d521b92a7bf72f4e56c4cc3ad1c2159f1d094f97ac34eee", expected_root_hash, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_root_hash, root_hash, 32);
+}
+
+static void split_coinbase_tx(mining_notify *notify, uint8_t *coinbase_tx, size_t coinbase_tx_len, size_t coinbase_1_len,
+                              size_t extranonce_len, size_t extranonce_2_len)
+{
+    notify->coinbase_1 = coinbase_tx;
+    notify->coinbase_1_len = coinbase_1_len;
+    notify->coinbase_2 = coinbase_tx + coinbase_1_len + extranonce_len + extranonce_2_len;
+    notify->coinbase_2_len = coinbase_tx_len - coinbase_1_len - extranonce_len - extranonce_2_len;
+}
+
+TEST_CASE("Validate merkle root calculation with job template", "[mining]")
+{
+    uint8_t coinbase_tx[117];
+    hex2bin("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008e969579199999999072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000", coinbase_tx, sizeof(coinbase_tx));
+    uint8_t merkles[12][32];
+    hex2bin("ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81", merkles[0], 32);
+    hex2bin("980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21", merkles[1], 32);
+    hex2bin("a52e9868343c55ce405be8971ff340f562ae9ab6353f07140d01666180e19b52", merkles[2], 32);
+    hex2bin("7435bdfa004e603953b2ed39f118803934d9cf17b06d979ceb682f2251bafac2", merkles[3], 32);
+    hex2bin("2a91f061a22d27cb8f44eea79938fb241ebeb359891aa907f05ffde7ed44e52e", merkles[4], 32);
+    hex2bin("302401f80eb5e958155135e25200bb8ea181ad2d05e804a531c7314d86403cdc", merkles[5], 32);
+    hex2bin("318ecb6161eb9b4cfd802bd730e2d36c167ddf102e70aa7b4158e2870dd47392", merkles[6], 32);
+    hex2bin("1114332a9858e0cf84b2425bb1e59eaabf91dd102d114aa443d57fc1b3beb0c9", merkles[7], 32);
+    hex2bin("f43f38095c810613ed795a44d9fab02ff25269706f454885db9be05cdf9c06e1", merkles[8], 32);
+    hex2bin("3e2fc26b27fddc39668b59099cd9635761bb72ed92404204e12bdff08b16fb75", merkles[9], 32);
+    hex2bin("463c19427286342120039a83218fa87ce45448e246895abac11fff0036076758", merkles[10], 32);
+    hex2bin("03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76", merkles[11], 32);
+
+    mining_notify notify_message;
+    split_coinbase_tx(&notify_message, coinbase_tx, sizeof(coinbase_tx), 58, 4, 4);
+    notify_message.merkle_branches = (uint8_t *)merkles;
+    notify_message.n_merkle_branches = 12;
+
+    // extranonce_2 is in the first block, nothing can be cached
+    job_template tmpl;
+    TEST_ASSERT_TRUE(job_template_init(&tmpl, &notify_message, coinbase_tx + 58, 4, 4));
+    TEST_ASSERT_EQUAL(0, tmpl.prefix_len);
+
+    uint8_t root_hash[32];
+    job_template_merkle_root(&tmpl, &notify_message, 0x12345678, root_hash);
+    job_template_merkle_root(&tmpl, &notify_message, 0x99999999, root_hash);
+    uint8_t expected_root_hash[32];
+    hex2bin("adbcbc21e20388422198a55957aedfa0e61be0b8f2b87d7c08510bb9f099a893", expected_root_hash, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_root_hash, root_hash, 32);
+    job_template_free(&tmpl);
+}
+
+TEST_CASE("Validate merkle root calculation with job template and cached prefix", "[mining]")
+{
+    const char *coinbase_tx_hex = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b0389130cfabe6d6d5cbab26a2599e92916edec5657a94a0708ddb970f5c45b5d12905085617eff8e010000000000000031650707758de07b010000000000001cfd7038212f736c7573682f000000000379ad0c2a000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3ae725d3994b811572c1f345deb98b56b465ef8e153ecbbd27fa37bf1b005161380000000000000000266a24aa21a9ed63b06a7946b190a3fda1d76165b25c9b883bcc6621b040773050ee2a1bb18f1800000000";
+    uint8_t coinbase_tx[260];
+    hex2bin(coinbase_tx_hex, coinbase_tx, sizeof(coinbase_tx));
+    uint8_t merkles[13][32];
+    hex2bin("2b77d9e413e8121cd7a17ff46029591051d0922bd90b2b2a38811af1cb57a2b2", merkles[0], 32);
+    hex2bin("5c8874cef00f3a233939516950e160949ef327891c9090467cead995441d22c5", merkles[1], 32);
+    hex2bin("2d91ff8e19ac5fa69a40081f26c5852d366d608b04d2efe0d5b65d111d0d8074", merkles[2], 32);
+    hex2bin("0ae96f609ad2264112a0b2dfb65624bedbcea3b036a59c0173394bba3a74e887", merkles[3], 32);
+    hex2bin("e62172e63973d69574a82828aeb5711fc5ff97946db10fc7ec32830b24df7bde", merkles[4], 32);
+    hex2bin("adb49456453aab49549a9eb46bb26787fb538e0a5f656992275194c04651ec97", merkles[5], 32);
+    hex2bin("a7bc56d04d2672a8683892d6c8d376c73d250a4871fdf6f57019bcc737d6d2c2", merkles[6], 32);
+    hex2bin("d94eceb8182b4f418cd071e93ec2a8993a0898d4c93bc33d9302f60dbbd0ed10", merkles[7], 32);
+    hex2bin("5ad7788b8c66f8f50d332b88a80077ce10e54281ca472b4ed9bbbbcb6cf99083", merkles[8], 32);
+    hex2bin("9f9d784b33df1b3ed3edb4211afc0dc1909af9758c6f8267e469f5148ed04809", merkles[9], 32);
+    hex2bin("48fd17affa76b23e6fb2257df30374da839d6cb264656a82e34b350722b05123", merkles[10], 32);
+    hex2bin("c4f5ab01913fc186d550c1a28f3f3e9ffaca2016b961a6a751f8cca0089df924", merkles[11], 32);
+    hex2bin("cff737e1d00176dd6bbfa73071adbb370f227cfb5fba186562e4060fcec877e1", merkles[12], 32);
+
+    // treat bytes 100..103 as extranonce_2 so that the first block comes from the cached state
+    mining_notify notify_message;
+    split_coinbase_tx(&notify_message, coinbase_tx, sizeof(coinbase_tx), 96, 4, 4);
+    notify_message.merkle_branches = (uint8_t *)merkles;
+    notify_message.n_merkle_branches = 13;
+    uint32_t extranonce_2 = coinbase_tx[100] | coinbase_tx[101] << 8 | coinbase_tx[102] << 16 | (uint32_t)coinbase_tx[103] << 24;
+
+    job_template tmpl;
+    TEST_ASSERT_TRUE(job_template_init(&tmpl, &notify_message, coinbase_tx + 96, 4, 4));
+    TEST_ASSERT_EQUAL(64, tmpl.prefix_len);
+
+    uint8_t root_hash[32];
+    job_template_merkle_root(&tmpl, &notify_message, extranonce_2 + 1, root_hash);
+    job_template_merkle_root(&tmpl, &notify_message, extranonce_2, root_hash);
+    uint8_t expected_root_hash[32];
+    hex2bin("5bdc1968499c3393873edf8e07a1c3a50a97fc3a9d1a376bbf77087dd63778eb", expected_root_hash, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_root_hash, root_hash, 32);
+    job_template_free(&tmpl);
 }
 
 // Values calculated from esp-miner/components/stratum/test/verifiers/bm1397.py
 TEST_CASE("Validate bm job construction", "[mining]")
 {
     mining_notify notify_message;
-    notify_message.prev_block_hash = "bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000";
+    swap_endian_words("bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000", notify_message.prev_block_hash);
     notify_message.version = 0x20000004;
     notify_message.target = 0x1705dd01;
     notify_message.ntime = 0x64658bd8;
-    const char *merkle_root = "cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4c604a846";
+    uint8_t merkle_root[32];
+    hex2bin("cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4c604a846", merkle_root, 32);
     bm_job job = construct_bm_job(&notify_message, merkle_root, 0);
 
     uint8_t expected_midstate_bin[32];
@@ -73,6 +186,11 @@ TEST_CASE("Validate bm job construction", "[mining]")
     // bytes are reversed for the midstate on the bm job command packet
     reverse_bytes(expected_midstate_bin, 32);
     TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_midstate_bin, job.midstate, 32);
+
+    uint8_t expected_prev_block_hash_be[32];
+    hex2bin("bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000", expected_prev_block_hash_be, 32);
+    reverse_bytes(expected_prev_block_hash_be, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_prev_block_hash_be, job.prev_block_hash_be, 32);
 }
 
 TEST_CASE("Validate version mask incrementing", "[mining]")
@@ -117,35 +235,196 @@ TEST_CASE("Validate version mask incrementing", "[mining]")
 
 TEST_CASE("Test extranonce 2 generation", "[mining extranonce2]")
 {
-    char *first = extranonce_2_generate(0, 4);
-    TEST_ASSERT_EQUAL_STRING("00000000", first);
-    free(first);
+    uint8_t extranonce_2[6];
+    char extranonce_2_hex[13];
 
-    char *second = extranonce_2_generate(1, 4);
-    TEST_ASSERT_EQUAL_STRING("01000000", second);
-    free(second);
+    extranonce_2_generate(0, 4, extranonce_2);
+    bin2hex(extranonce_2, 4, extranonce_2_hex, sizeof(extranonce_2_hex));
+    TEST_ASSERT_EQUAL_STRING("00000000", extranonce_2_hex);
 
-    char *third = extranonce_2_generate(2, 4);
-    TEST_ASSERT_EQUAL_STRING("02000000", third);
-    free(third);
+    extranonce_2_generate(1, 4, extranonce_2);
+    bin2hex(extranonce_2, 4, extranonce_2_hex, sizeof(extranonce_2_hex));
+    TEST_ASSERT_EQUAL_STRING("01000000", extranonce_2_hex);
 
-    char *fourth = extranonce_2_generate(UINT_MAX - 1, 4);
-    TEST_ASSERT_EQUAL_STRING("feffffff", fourth);
-    free(fourth);
+    extranonce_2_generate(2, 4, extranonce_2);
+    bin2hex(extranonce_2, 4, extranonce_2_hex, sizeof(extranonce_2_hex));
+    TEST_ASSERT_EQUAL_STRING("02000000", extranonce_2_hex);
 
-    char *fifth = extranonce_2_generate(UINT_MAX / 2, 6);
-    TEST_ASSERT_EQUAL_STRING("ffffff7f0000", fifth);
-    free(fifth);
+    extranonce_2_generate(UINT_MAX - 1, 4, extranonce_2);
+    bin2hex(extranonce_2, 4, extranonce_2_hex, sizeof(extranonce_2_hex));
+    TEST_ASSERT_EQUAL_STRING("feffffff", extranonce_2_hex);
+
+    extranonce_2_generate(UINT_MAX / 2, 6, extranonce_2);
+    bin2hex(extranonce_2, 6, extranonce_2_hex, sizeof(extranonce_2_hex));
+    TEST_ASSERT_EQUAL_STRING("ffffff7f0000", extranonce_2_hex);
+}
+
+TEST_CASE("Job pool hands out and takes back jobs", "[mining job_pool]")
+{
+    bm_job *jobs[4];
+    bm_job_pool_stats stats;
+    TEST_ASSERT_TRUE(bm_job_pool_init(4, 88));
+
+    for (int i = 0; i < 4; i++) {
+        jobs[i] = alloc_bm_job();
+        TEST_ASSERT_NOT_NULL(jobs[i]);
+    }
+    TEST_ASSERT_NULL(alloc_bm_job());
+    TEST_ASSERT_FALSE(bm_job_pool_init(8, 88));
+
+    // every job has its own job command storage
+    for (int i = 0; i < 4; i++) {
+        memset(bm_job_packet(jobs[i]), i, 88);
+    }
+    for (int i = 0; i < 4; i++) {
+        uint8_t expected[88];
+        memset(expected, i, sizeof(expected));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, bm_job_packet(jobs[i]), sizeof(expected));
+    }
+
+    free_bm_job(jobs[1]);
+    free_bm_job(jobs[2]);
+    // double free and foreign jobs are ignored
+    free_bm_job(jobs[1]);
+    bm_job foreign;
+    free_bm_job(&foreign);
+    TEST_ASSERT_NULL(bm_job_packet(&foreign));
+    free_bm_job(NULL);
+
+    bm_job_pool_get_stats(&stats);
+    TEST_ASSERT_EQUAL(4, stats.capacity);
+    TEST_ASSERT_EQUAL(2, stats.in_use);
+    TEST_ASSERT_EQUAL(4, stats.high_water);
+    TEST_ASSERT_EQUAL(1, stats.exhausted);
+
+    jobs[1] = alloc_bm_job();
+    jobs[2] = alloc_bm_job();
+    TEST_ASSERT_NOT_NULL(jobs[1]);
+    TEST_ASSERT_NOT_NULL(jobs[2]);
+    TEST_ASSERT_TRUE(jobs[1] != jobs[2]);
+    TEST_ASSERT_NULL(alloc_bm_job());
+
+    for (int i = 0; i < 4; i++) {
+        free_bm_job(jobs[i]);
+    }
+    bm_job_pool_get_stats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.in_use);
+}
+
+TEST_CASE("Job pool does not touch the heap after init", "[mining job_pool]")
+{
+    bm_job *active[16] = {NULL};
+    TEST_ASSERT_TRUE(bm_job_pool_init(32, 0));
+
+    // same pattern as the ASIC task: jobs replace the previous job in a rotating slot
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    for (int i = 0; i < 10000; i++) {
+        bm_job *job = alloc_bm_job();
+        TEST_ASSERT_NOT_NULL(job);
+        snprintf(job->jobid, sizeof(job->jobid), "%x", i);
+        free_bm_job(active[i % 16]);
+        active[i % 16] = job;
+    }
+    TEST_ASSERT_EQUAL(free_before, heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+
+    bm_job_pool_stats stats;
+    bm_job_pool_get_stats(&stats);
+    TEST_ASSERT_EQUAL(16, stats.in_use);
+    TEST_ASSERT_EQUAL(17, stats.high_water);
+
+    for (int i = 0; i < 16; i++) {
+        free_bm_job(active[i]);
+    }
+}
+
+TEST_CASE("Job pool references keep a job out of the pool", "[mining job_pool]")
+{
+    TEST_ASSERT_TRUE(bm_job_pool_init(2, 0));
+    bm_job *job = alloc_bm_job();
+    TEST_ASSERT_NOT_NULL(job);
+
+    TEST_ASSERT_TRUE(bm_job_try_ref(job));
+    free_bm_job(job);
+    bm_job_pool_stats stats;
+    bm_job_pool_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, stats.in_use);
+
+    free_bm_job(job);
+    bm_job_pool_get_stats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.in_use);
+    TEST_ASSERT_FALSE(bm_job_try_ref(job));
+    bm_job foreign;
+    TEST_ASSERT_FALSE(bm_job_try_ref(&foreign));
+}
+
+#define LOOKUP_ROUNDS 100000
+
+static struct
+{
+    _Atomic(bm_job *) slot;
+    volatile bool writer_finished;
+    SemaphoreHandle_t done;
+} lookup;
+
+// same pattern as the ASIC task replacing the job in an active job slot
+static void lookup_writer(void *pvParameters)
+{
+    for (uint32_t i = 1; i <= LOOKUP_ROUNDS; i++) {
+        bm_job *job;
+        while ((job = alloc_bm_job()) == NULL) {
+            taskYIELD();
+        }
+        job->ntime = i;
+        job->version = ~i;
+        free_bm_job(atomic_exchange(&lookup.slot, job));
+    }
+    lookup.writer_finished = true;
+    xSemaphoreGive(lookup.done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Job pool lookups race with slot replacement", "[mining job_pool]")
+{
+    TEST_ASSERT_TRUE(bm_job_pool_init(4, 0));
+    atomic_init(&lookup.slot, NULL);
+    lookup.writer_finished = false;
+    lookup.done = xSemaphoreCreateBinary();
+    xTaskCreate(lookup_writer, "lookup writer", 4096, NULL, uxTaskPriorityGet(NULL), NULL);
+
+    // same pattern as ASIC_get_active_job
+    uint32_t last = 0, found = 0;
+    while (!lookup.writer_finished) {
+        bm_job *job = atomic_load(&lookup.slot);
+        if (job == NULL || !bm_job_try_ref(job)) {
+            continue;
+        }
+        if (atomic_load(&lookup.slot) == job) {
+            TEST_ASSERT_EQUAL_HEX32(~job->ntime, job->version);
+            TEST_ASSERT_TRUE(job->ntime >= last);
+            last = job->ntime;
+            found++;
+        }
+        free_bm_job(job);
+    }
+    xSemaphoreTake(lookup.done, portMAX_DELAY);
+    printf("%lu lookups, last job %lu\n", (unsigned long)found, (unsigned long)last);
+
+    free_bm_job(atomic_exchange(&lookup.slot, NULL));
+    bm_job_pool_stats stats;
+    bm_job_pool_get_stats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.in_use);
+    vSemaphoreDelete(lookup.done);
 }
 
 TEST_CASE("Test nonce diff checking", "[mining test_nonce][not-on-qemu]")
 {
     mining_notify notify_message;
-    notify_message.prev_block_hash = "d02b10fc0d4711eae1a805af50a8a83312a2215e00017f2b0000000000000000";
+    swap_endian_words("d02b10fc0d4711eae1a805af50a8a83312a2215e00017f2b0000000000000000", notify_message.prev_block_hash);
     notify_message.version = 0x20000004;
     notify_message.target = 0x1705ae3a;
     notify_message.ntime = 0x646ff1a9;
-    const char *merkle_root = "6d0359c451434605c52a5a9ce074340be47c2c63840731f9edf1db3f26b1cdd9a9f16f64";
+    uint8_t merkle_root[32];
+    hex2bin("6d0359c451434605c52a5a9ce074340be47c2c63840731f9edf1db3f26b1cdd9a9f16f64", merkle_root, 32);
     bm_job job = construct_bm_job(&notify_message, merkle_root, 0);
 
     uint32_t nonce = 0x276E8947;
@@ -156,12 +435,14 @@ TEST_CASE("Test nonce diff checking", "[mining test_nonce][not-on-qemu]")
 TEST_CASE("Test nonce diff checking 2", "[mining test_nonce][not-on-qemu]")
 {
     mining_notify notify_message;
-    notify_message.prev_block_hash = "0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000";
+    swap_endian_words("0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000", notify_message.prev_block_hash);
     notify_message.version = 0x20000004;
     notify_message.target = 0x1705ae3a;
     notify_message.ntime = 0x647025b5;
 
-    const char *coinbase_tx = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b0389130cfabe6d6d5cbab26a2599e92916edec5657a94a0708ddb970f5c45b5d12905085617eff8e010000000000000031650707758de07b010000000000001cfd7038212f736c7573682f000000000379ad0c2a000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3ae725d3994b811572c1f345deb98b56b465ef8e153ecbbd27fa37bf1b005161380000000000000000266a24aa21a9ed63b06a7946b190a3fda1d76165b25c9b883bcc6621b040773050ee2a1bb18f1800000000";
+    const char *coinbase_tx_hex = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b0389130cfabe6d6d5cbab26a2599e92916edec5657a94a0708ddb970f5c45b5d12905085617eff8e010000000000000031650707758de07b010000000000001cfd7038212f736c7573682f000000000379ad0c2a000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3ae725d3994b811572c1f345deb98b56b465ef8e153ecbbd27fa37bf1b005161380000000000000000266a24aa21a9ed63b06a7946b190a3fda1d76165b25c9b883bcc6621b040773050ee2a1bb18f1800000000";
+    uint8_t coinbase_tx[260];
+    hex2bin(coinbase_tx_hex, coinbase_tx, sizeof(coinbase_tx));
     uint8_t merkles[13][32];
     int num_merkles = 13;
 
@@ -179,8 +460,11 @@ TEST_CASE("Test nonce diff checking 2", "[mining test_nonce][not-on-qemu]")
     hex2bin("c4f5ab01913fc186d550c1a28f3f3e9ffaca2016b961a6a751f8cca0089df924", merkles[11], 32);
     hex2bin("cff737e1d00176dd6bbfa73071adbb370f227cfb5fba186562e4060fcec877e1", merkles[12], 32);
 
-    char *merkle_root = calculate_merkle_root_hash(coinbase_tx, merkles, num_merkles);
-    TEST_ASSERT_EQUAL_STRING("5bdc1968499c3393873edf8e07a1c3a50a97fc3a9d1a376bbf77087dd63778eb", merkle_root);
+    uint8_t merkle_root[32];
+    calculate_merkle_root_hash(coinbase_tx, sizeof(coinbase_tx), merkles, num_merkles, merkle_root);
+    uint8_t expected_merkle_root[32];
+    hex2bin("5bdc1968499c3393873edf8e07a1c3a50a97fc3a9d1a376bbf77087dd63778eb", expected_merkle_root, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_merkle_root, merkle_root, 32);
 
     bm_job job = construct_bm_job(&notify_message, merkle_root, 0);
 
@@ -188,3 +472,399 @@ TEST_CASE("Test nonce diff checking 2", "[mining test_nonce][not-on-qemu]")
     double diff = test_nonce_value(&job, nonce, 0);
     TEST_ASSERT_EQUAL_INT(683, (int)diff);
 }
+
+// test_nonce_value before the midstate cache, the whole header double hashed
+static double full_header_nonce_value(const bm_job *job, uint32_t nonce, uint32_t rolled_version)
+{
+    uint8_t header[80], hash[32];
+    memcpy(header, &rolled_version, 4);
+    memcpy(header + 4, job->prev_block_hash, 32);
+    memcpy(header + 36, job->merkle_root, 32);
+    memcpy(header + 68, &job->ntime, 4);
+    memcpy(header + 72, &job->target, 4);
+    memcpy(header + 76, &nonce, 4);
+    mbedtls_sha256(header, 80, hash, 0);
+    mbedtls_sha256(hash, 32, hash, 0);
+    return 26959535291011309493156476344723991336010898738574164086137773096960.0 / le256todouble(hash);
+}
+
+static bm_job nonce_test_job(uint32_t seed)
+{
+    mining_notify notify_message;
+    uint8_t merkle_root[32];
+    for (int i = 0; i < 32; i++) {
+        notify_message.prev_block_hash[i] = seed * 31 + i;
+        merkle_root[i] = seed * 17 + i * 3;
+    }
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705ae3a;
+    notify_message.ntime = 0x647025b5 + seed;
+    return construct_bm_job(&notify_message, merkle_root, STRATUM_DEFAULT_VERSION_MASK);
+}
+
+TEST_CASE("Nonce checking with cached midstates matches hashing the whole header", "[mining test_nonce]")
+{
+    bm_job jobs[3] = {nonce_test_job(1), nonce_test_job(2), nonce_test_job(3)};
+    // the jobs differ only in ntime, which is in the second block
+    bm_job same_first_block = jobs[0];
+    same_first_block.ntime++;
+    static nonce_midstate_cache cache;
+    uint8_t hash[32];
+
+    uint32_t rolled_version = jobs[0].version;
+    for (int i = 0; i < 200; i++) {
+        // a few versions come back several times, with results of other jobs in between
+        if (i % 4 == 0) {
+            rolled_version = increment_bitmask(rolled_version, STRATUM_DEFAULT_VERSION_MASK);
+        }
+        uint32_t nonce = i * 0x9e3779b9;
+        for (int j = 0; j < 3; j++) {
+            test_nonce_hash(&cache, &jobs[j], nonce, rolled_version, hash);
+            TEST_ASSERT_EQUAL_DOUBLE(full_header_nonce_value(&jobs[j], nonce, rolled_version), hash_difficulty(hash));
+        }
+        test_nonce_hash(&cache, &same_first_block, nonce, rolled_version, hash);
+        TEST_ASSERT_EQUAL_DOUBLE(full_header_nonce_value(&same_first_block, nonce, rolled_version), hash_difficulty(hash));
+    }
+}
+
+TEST_CASE("Batched nonce checking matches checking one at a time", "[mining test_nonce]")
+{
+    bm_job jobs[3] = {nonce_test_job(4), nonce_test_job(5), nonce_test_job(6)};
+    nonce_check checks[17];
+    static nonce_midstate_cache cache;
+
+    for (int count = 1; count <= 17; count++) {
+        for (int i = 0; i < count; i++) {
+            // bursts mix jobs and repeat rolled versions
+            checks[i].job = &jobs[(i * 7) % 3];
+            checks[i].rolled_version = increment_bitmask(checks[i].job->version, i % 5 == 0 ? 0 : STRATUM_DEFAULT_VERSION_MASK);
+            checks[i].nonce = (count * 131 + i) * 0x9e3779b9;
+        }
+        test_nonce_hashes(&cache, checks, count);
+        for (int i = 0; i < count; i++) {
+            uint8_t expected[32];
+            // still in the order the results came
+            TEST_ASSERT_EQUAL_PTR(&jobs[(i * 7) % 3], checks[i].job);
+            TEST_ASSERT_EQUAL_HEX32((count * 131 + i) * 0x9e3779b9, checks[i].nonce);
+            test_nonce_hash(NULL, checks[i].job, checks[i].nonce, checks[i].rolled_version, expected);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, checks[i].hash, 32);
+            TEST_ASSERT_EQUAL_DOUBLE(full_header_nonce_value(checks[i].job, checks[i].nonce, checks[i].rolled_version),
+                                     hash_difficulty(checks[i].hash));
+        }
+    }
+}
+
+TEST_CASE("Batched nonce checking throughput", "[benchmark][not-on-qemu]")
+{
+    bm_job jobs[2] = {nonce_test_job(7), nonce_test_job(8)};
+    const int batch_sizes[] = {1, 4, 8, 16};
+    const int results = 4096;
+    nonce_check checks[16];
+    static nonce_midstate_cache cache;
+
+    for (int b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+        int batch_size = batch_sizes[b];
+        uint32_t rolled_version = jobs[0].version;
+        int64_t start = esp_timer_get_time();
+        for (int done = 0; done < results; done += batch_size) {
+            for (int i = 0; i < batch_size; i++) {
+                // a new rolled version every other result, as with a low ticket mask
+                if ((done + i) % 2 == 0) {
+                    rolled_version = increment_bitmask(rolled_version, STRATUM_DEFAULT_VERSION_MASK);
+                }
+                checks[i].job = &jobs[(done + i) % 8 == 0];
+                checks[i].nonce = done + i;
+                checks[i].rolled_version = rolled_version;
+            }
+            test_nonce_hashes(&cache, checks, batch_size);
+        }
+        int64_t elapsed = esp_timer_get_time() - start;
+        printf("Batches of %d: %.0f nonces/s\n", batch_size, results * 1000000.0 / elapsed);
+    }
+}
+
+static void target_to_hash(const hash_target *target, uint8_t *hash)
+{
+    for (int i = 0; i < 32; i++) {
+        hash[i] = target->words[i / 4] >> (8 * (i % 4));
+    }
+}
+
+TEST_CASE("Hash targets from difficulty and nbits", "[mining test_nonce]")
+{
+    hash_target target;
+    hash_target_from_difficulty(1, &target);
+    hash_target diffone = {.words = {[6] = 0xffff0000}};
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(diffone.words, target.words, 8);
+
+    hash_target_from_difficulty(256, &target);
+    hash_target diff256 = {.words = {[6] = 0x00ffff00}};
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(diff256.words, target.words, 8);
+
+    // 0x05ae3a * 256^(0x17 - 3)
+    hash_target_from_nbits(0x1705ae3a, &target);
+    hash_target block = {.words = {[5] = 0x05ae3a}};
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(block.words, target.words, 8);
+
+    hash_target_from_nbits(0x1d00ffff, &target);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(diffone.words, target.words, 8);
+
+    hash_target_from_nbits(0x03123456, &target);
+    hash_target small = {.words = {[0] = 0x123456}};
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(small.words, target.words, 8);
+}
+
+TEST_CASE("Hash target comparison agrees with the difficulty", "[mining test_nonce]")
+{
+    const uint32_t difficulties[] = {1, 256, 1000, 8192, 65536, 1000000, 4294967295u};
+    for (int d = 0; d < sizeof(difficulties) / sizeof(difficulties[0]); d++) {
+        hash_target target;
+        hash_target_from_difficulty(difficulties[d], &target);
+
+        // the target itself meets it, one more does not
+        uint8_t hash[32];
+        target_to_hash(&target, hash);
+        TEST_ASSERT_TRUE(hash_meets_target(hash, &target));
+        TEST_ASSERT_TRUE(hash_difficulty(hash) >= difficulties[d]);
+        for (int i = 0; i < 32 && ++hash[i] == 0; i++) {
+        }
+        TEST_ASSERT_FALSE(hash_meets_target(hash, &target));
+
+        // hashes around the target, as the ASIC returns them
+        uint32_t seed = difficulties[d];
+        for (int i = 0; i < 1000; i++) {
+            target_to_hash(&target, hash);
+            for (int j = 0; j < 28; j++) {
+                seed = seed * 1103515245 + 12345;
+                hash[j] = seed >> 16;
+            }
+            hash[24 + (i % 4)] ^= seed >> 24;
+            double diff = hash_difficulty(hash);
+            // the double can't tell hashes apart this close to the target
+            if (diff / difficulties[d] > 1 - 1e-12 && diff / difficulties[d] < 1 + 1e-12) {
+                continue;
+            }
+            TEST_ASSERT_EQUAL(diff >= difficulties[d], hash_meets_target(hash, &target));
+        }
+    }
+
+    hash_target any;
+    hash_target_from_difficulty(0, &any);
+    uint8_t highest[32];
+    memset(highest, 0xff, sizeof(highest));
+    TEST_ASSERT_TRUE(hash_meets_target(highest, &any));
+}
+
+TEST_CASE("Jobs carry the targets of their notify", "[mining test_nonce]")
+{
+    mining_notify notify_message;
+    uint8_t merkle_root[32] = {0};
+    memset(notify_message.prev_block_hash, 0, sizeof(notify_message.prev_block_hash));
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705ae3a;
+    notify_message.ntime = 0x647025b5;
+    mining_notify_set_difficulty(&notify_message, 2048);
+    bm_job job = construct_bm_job(&notify_message, merkle_root, 0);
+
+    TEST_ASSERT_EQUAL(2048, job.pool_diff);
+    hash_target expected;
+    hash_target_from_difficulty(2048, &expected);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(expected.words, job.pool_target.words, 8);
+    hash_target_from_nbits(0x1705ae3a, &expected);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(expected.words, job.network_target.words, 8);
+
+    for (uint32_t nonce = 0; nonce < 200; nonce++) {
+        uint8_t hash[32];
+        test_nonce_hash(NULL, &job, nonce, job.version, hash);
+        TEST_ASSERT_EQUAL_DOUBLE(test_nonce_value(&job, nonce, job.version), hash_difficulty(hash));
+        TEST_ASSERT_FALSE(hash_meets_target(hash, &job.network_target));
+    }
+}
+
+TEST_CASE("Nonce checking throughput", "[benchmark][not-on-qemu]")
+{
+    bm_job job = nonce_test_job(1);
+    const int iterations = 2000;
+    double full_sum = 0, cached_sum = 0;
+    static nonce_midstate_cache cache;
+    uint8_t hash[32];
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        full_sum += full_header_nonce_value(&job, i, job.version);
+    }
+    int64_t full = esp_timer_get_time() - start;
+
+    // every result for the same rolled version
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        test_nonce_hash(&cache, &job, i, job.version, hash);
+        cached_sum += hash_difficulty(hash);
+    }
+    int64_t cached = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL_DOUBLE(full_sum, cached_sum);
+
+    // every result for another rolled version
+    uint32_t rolled_version = job.version;
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        rolled_version = increment_bitmask(rolled_version, STRATUM_DEFAULT_VERSION_MASK);
+        test_nonce_hash(&cache, &job, i, rolled_version, hash);
+    }
+    int64_t uncached = esp_timer_get_time() - start;
+
+    printf("Nonce checks: whole header %lld ns, cached midstate %lld ns, new rolled version %lld ns\n",
+           (long long)(full * 1000 / iterations), (long long)(cached * 1000 / iterations),
+           (long long)(uncached * 1000 / iterations));
+}
+
+// The per-job work of the pipeline before the job template: the coinbase is assembled from hex strings,
+// decoded and every hash is returned in a new buffer. The merkle root goes through hex as well.
+static bm_job hex_pipeline_job(mining_notify *notify, const char *coinbase_1, const char *coinbase_2,
+                               const char *extranonce, uint32_t extranonce_2)
+{
+    char *extranonce_2_hex = malloc(9);
+    uint8_t extranonce_2_bin[4];
+    extranonce_2_generate(extranonce_2, 4, extranonce_2_bin);
+    bin2hex(extranonce_2_bin, 4, extranonce_2_hex, 9);
+
+    size_t coinbase_tx_hex_len = strlen(coinbase_1) + strlen(extranonce) + strlen(extranonce_2_hex) + strlen(coinbase_2);
+    char *coinbase_tx_hex = malloc(coinbase_tx_hex_len + 1);
+    strcpy(coinbase_tx_hex, coinbase_1);
+    strcat(coinbase_tx_hex, extranonce);
+    strcat(coinbase_tx_hex, extranonce_2_hex);
+    strcat(coinbase_tx_hex, coinbase_2);
+
+    uint8_t *coinbase_tx = malloc(coinbase_tx_hex_len / 2);
+    hex2bin(coinbase_tx_hex, coinbase_tx, coinbase_tx_hex_len / 2);
+    uint8_t both_merkles[64];
+    uint8_t *root = malloc(32);
+    double_sha256_bin(coinbase_tx, coinbase_tx_hex_len / 2, root);
+    memcpy(both_merkles, root, 32);
+    free(root);
+    for (int i = 0; i < notify->n_merkle_branches; i++) {
+        memcpy(both_merkles + 32, notify->merkle_branches + i * 32, 32);
+        root = malloc(32);
+        double_sha256_bin(both_merkles, 64, root);
+        memcpy(both_merkles, root, 32);
+        free(root);
+    }
+
+    char *merkle_root_hex = malloc(65);
+    bin2hex(both_merkles, 32, merkle_root_hex, 65);
+    uint8_t merkle_root[32];
+    hex2bin(merkle_root_hex, merkle_root, 32);
+    bm_job job = construct_bm_job(notify, merkle_root, STRATUM_DEFAULT_VERSION_MASK);
+
+    free(merkle_root_hex);
+    free(coinbase_tx);
+    free(coinbase_tx_hex);
+    free(extranonce_2_hex);
+    return job;
+}
+
+TEST_CASE("Job generation throughput", "[benchmark][not-on-qemu]")
+{
+    uint8_t coinbase_1[120], coinbase_2[200], extranonce[4] = {0xe9, 0x69, 0x57, 0x91};
+    uint8_t merkles[16][32];
+    memset(coinbase_1, 0x11, sizeof(coinbase_1));
+    memset(coinbase_2, 0x22, sizeof(coinbase_2));
+    memset(merkles, 0x07, sizeof(merkles));
+
+    char coinbase_1_hex[sizeof(coinbase_1) * 2 + 1], coinbase_2_hex[sizeof(coinbase_2) * 2 + 1], extranonce_hex[9];
+    bin2hex(coinbase_1, sizeof(coinbase_1), coinbase_1_hex, sizeof(coinbase_1_hex));
+    bin2hex(coinbase_2, sizeof(coinbase_2), coinbase_2_hex, sizeof(coinbase_2_hex));
+    bin2hex(extranonce, sizeof(extranonce), extranonce_hex, sizeof(extranonce_hex));
+
+    mining_notify notify_message;
+    swap_endian_words("0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000", notify_message.prev_block_hash);
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705ae3a;
+    notify_message.ntime = 0x647025b5;
+    notify_message.coinbase_1 = coinbase_1;
+    notify_message.coinbase_1_len = sizeof(coinbase_1);
+    notify_message.coinbase_2 = coinbase_2;
+    notify_message.coinbase_2_len = sizeof(coinbase_2);
+    notify_message.merkle_branches = (uint8_t *)merkles;
+
+    job_template tmpl;
+    TEST_ASSERT_TRUE(job_template_init(&tmpl, &notify_message, extranonce, sizeof(extranonce), 4));
+
+    const int iterations = 1000;
+    for (int num_merkles = 12; num_merkles <= 16; num_merkles += 2) {
+        notify_message.n_merkle_branches = num_merkles;
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            bm_job job = hex_pipeline_job(&notify_message, coinbase_1_hex, coinbase_2_hex, extranonce_hex, i);
+            TEST_ASSERT_EQUAL(4, job.num_midstates);
+        }
+        int64_t before = esp_timer_get_time() - start;
+
+        start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            uint8_t merkle_root[32];
+            job_template_merkle_root(&tmpl, &notify_message, i, merkle_root);
+            bm_job job = construct_bm_job(&notify_message, merkle_root, STRATUM_DEFAULT_VERSION_MASK);
+            TEST_ASSERT_EQUAL(4, job.num_midstates);
+        }
+        int64_t after = esp_timer_get_time() - start;
+
+        // both paths build the same job
+        uint8_t merkle_root[32];
+        job_template_merkle_root(&tmpl, &notify_message, 7, merkle_root);
+        bm_job expected = construct_bm_job(&notify_message, merkle_root, STRATUM_DEFAULT_VERSION_MASK);
+        bm_job job = hex_pipeline_job(&notify_message, coinbase_1_hex, coinbase_2_hex, extranonce_hex, 7);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.merkle_root, job.merkle_root, 32);
+
+        printf("%d merkle branches: hex pipeline %.0f jobs/s, job template %.0f jobs/s\n", num_merkles,
+               iterations * 1000000.0 / before, iterations * 1000000.0 / after);
+    }
+
+    job_template_free(&tmpl);
+}
+
+TEST_CASE("Coinbase hashing with cached prefix", "[benchmark][not-on-qemu]")
+{
+    // coinbase_1 and coinbase_2 sizes, large coinbase_1 carry merge mining commitments, large coinbase_2 many payouts
+    const size_t sizes[][2] = {{90, 102}, {90, 400}, {200, 200}, {400, 600}};
+    uint8_t extranonce[8] = {0};
+    uint8_t *coinbase = malloc(1000);
+    TEST_ASSERT_NOT_NULL(coinbase);
+    memset(coinbase, 0x5a, 1000);
+
+    const int iterations = 1000;
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        mining_notify notify_message;
+        notify_message.coinbase_1 = coinbase;
+        notify_message.coinbase_1_len = sizes[s][0];
+        notify_message.coinbase_2 = coinbase;
+        notify_message.coinbase_2_len = sizes[s][1];
+        notify_message.merkle_branches = NULL;
+        notify_message.n_merkle_branches = 0;
+
+        job_template tmpl;
+        TEST_ASSERT_TRUE(job_template_init(&tmpl, &notify_message, extranonce, 4, 4));
+
+        uint8_t full_root[32], cached_root[32];
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            extranonce_2_generate(i, tmpl.extranonce_2_len, tmpl.coinbase_tx + tmpl.extranonce_2_offset);
+            calculate_merkle_root_hash(tmpl.coinbase_tx, tmpl.coinbase_tx_len, NULL, 0, full_root);
+        }
+        int64_t full = esp_timer_get_time() - start;
+
+        start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            job_template_merkle_root(&tmpl, &notify_message, i, cached_root);
+        }
+        int64_t cached = esp_timer_get_time() - start;
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(full_root, cached_root, 32);
+
+        printf("%u byte coinbase: full %lld ns/job (%u blocks), cached prefix %lld ns/job (%u blocks)\n",
+               (unsigned)tmpl.coinbase_tx_len, (long long)(full * 1000 / iterations), (unsigned)(tmpl.coinbase_tx_len + 72) / 64,
+               (long long)(cached * 1000 / iterations), (unsigned)(tmpl.coinbase_tx_len - tmpl.prefix_len + 72) / 64);
+        job_template_free(&tmpl);
+    }
+
+    free(coinbase);
+}
@@ -0,0 +1,108 @@
+#include "unity.h"
+#include "sha256.h"
+#include "utils.h"
+#include "mbedtls/sha256.h"
+#include "esp_timer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const sha256_backend *backends[] = {
+    &sha256_software,
+#if SOC_SHA_SUPPORT_RESUME
+    &sha256_hardware,
+#endif
+};
+
+#define NUM_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+static void fill(uint8_t *data, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+}
+
+static void mbedtls_double(const uint8_t *data, size_t len, uint8_t *hash)
+{
+    mbedtls_sha256(data, len, hash, 0);
+    mbedtls_sha256(hash, 32, hash, 0);
+}
+
+TEST_CASE("SHA-256 backends hash like mbedTLS", "[sha256]")
+{
+    for (int b = 0; b < NUM_BACKENDS; b++) {
+        for (uint32_t seed = 0; seed < 50; seed++) {
+            uint8_t data[80], expected[32], hash[32];
+            fill(data, sizeof(data), seed);
+
+            mbedtls_double(data, 80, expected);
+            backends[b]->double_80(data, hash);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, hash, 32);
+
+            mbedtls_double(data, 64, expected);
+            backends[b]->double_64(data, hash);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, hash, 32);
+        }
+    }
+}
+
+TEST_CASE("SHA-256 backends calculate midstates", "[sha256]")
+{
+    // the first block of the header in "Validate bm job construction"
+    uint8_t block[64];
+    uint32_t version = 0x20000004;
+    memcpy(block, &version, 4);
+    swap_endian_words("bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000", block + 4);
+    hex2bin("cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4", block + 36, 28);
+
+    uint8_t expected[32];
+    hex2bin("52eadf9168739f8a5d490d3d1574ddd6cb21cae1e35917415f7d5de04d3185f2", expected, 32);
+    for (int b = 0; b < NUM_BACKENDS; b++) {
+        uint8_t midstate[32];
+        backends[b]->midstate(block, midstate);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, midstate, 32);
+    }
+}
+
+TEST_CASE("SHA-256 backend throughput", "[benchmark][not-on-qemu]")
+{
+    const int iterations = 2000;
+    uint8_t data[80], hash[32];
+    fill(data, sizeof(data), 1);
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        mbedtls_double(data, 80, hash);
+    }
+    int64_t header = esp_timer_get_time() - start;
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        mbedtls_double(data, 64, hash);
+    }
+    int64_t pair = esp_timer_get_time() - start;
+    printf("mbedtls: header %lld ns, merkle pair %lld ns\n", (long long)(header * 1000 / iterations),
+           (long long)(pair * 1000 / iterations));
+
+    for (int b = 0; b < NUM_BACKENDS; b++) {
+        start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            backends[b]->midstate(data, hash);
+        }
+        int64_t midstate = esp_timer_get_time() - start;
+        start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            backends[b]->double_80(data, hash);
+        }
+        header = esp_timer_get_time() - start;
+        start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            backends[b]->double_64(data, hash);
+        }
+        pair = esp_timer_get_time() - start;
+        printf("%s: midstate %lld ns, header %lld ns, merkle pair %lld ns\n", backends[b]->name,
+               (long long)(midstate * 1000 / iterations), (long long)(header * 1000 / iterations),
+               (long long)(pair * 1000 / iterations));
+    }
+}
@@ -0,0 +1,108 @@
+#include "unity.h"
+#include "share_tracker.h"
+#include "esp_timer.h"
+
+TEST_CASE("Share tracker matches responses to submitted shares", "[share_tracker]")
+{
+    share_tracker tracker;
+    share_tracker_init(&tracker);
+
+    share_tracker_submit(&tracker, 5, "1a2b", 1024.5, 1500000);
+    share_tracker_submit(&tracker, 6, "1a2c", 4096.0, 200000);
+    share_tracker_submit(&tracker, 7, "1a2c", 512.0, 300000);
+
+    // responses come back in any order, setup ids and duplicates are not shares
+    tracked_share share;
+    int64_t round_trip_us = -1;
+    TEST_ASSERT_TRUE(share_tracker_complete(&tracker, 6, false, &share, &round_trip_us));
+    TEST_ASSERT_EQUAL_STRING("1a2c", share.jobid);
+    TEST_ASSERT_EQUAL_DOUBLE(4096.0, share.nonce_diff);
+    TEST_ASSERT_EQUAL(200000, share.job_age_us);
+    TEST_ASSERT_TRUE(round_trip_us >= 0);
+    TEST_ASSERT_TRUE(share_tracker_complete(&tracker, 5, true, &share, NULL));
+    TEST_ASSERT_EQUAL_STRING("1a2b", share.jobid);
+    TEST_ASSERT_FALSE(share_tracker_complete(&tracker, 5, true, NULL, NULL));
+    TEST_ASSERT_FALSE(share_tracker_complete(&tracker, 3, true, NULL, NULL));
+
+    share_tracker_cancel(&tracker, 7);
+    TEST_ASSERT_FALSE(share_tracker_complete(&tracker, 7, true, NULL, NULL));
+
+    share_tracker_stats stats;
+    share_tracker_get_stats(&tracker, &stats);
+    TEST_ASSERT_EQUAL(1, stats.accepted);
+    TEST_ASSERT_EQUAL(1, stats.rejected);
+    TEST_ASSERT_EQUAL(0, stats.in_flight);
+    TEST_ASSERT_EQUAL(0, stats.lost);
+}
+
+TEST_CASE("Share tracker counts shares without response as lost", "[share_tracker]")
+{
+    share_tracker tracker;
+    share_tracker_init(&tracker);
+
+    share_tracker_submit(&tracker, 5, "1", 1, 0);
+    // reuses the entry of 5
+    share_tracker_submit(&tracker, 5 + SHARE_TRACKER_SIZE, "2", 1, 0);
+    share_tracker_submit(&tracker, 6, "3", 1, 0);
+    TEST_ASSERT_FALSE(share_tracker_complete(&tracker, 5, true, NULL, NULL));
+
+    share_tracker_stats stats;
+    share_tracker_get_stats(&tracker, &stats);
+    TEST_ASSERT_EQUAL(1, stats.lost);
+    TEST_ASSERT_EQUAL(2, stats.in_flight);
+
+    // a new connection starts its ids over
+    share_tracker_reset(&tracker);
+    share_tracker_get_stats(&tracker, &stats);
+    TEST_ASSERT_EQUAL(3, stats.lost);
+    TEST_ASSERT_EQUAL(0, stats.in_flight);
+    TEST_ASSERT_FALSE(share_tracker_complete(&tracker, 6, true, NULL, NULL));
+
+    share_tracker_clear_stats(&tracker);
+    share_tracker_get_stats(&tracker, &stats);
+    TEST_ASSERT_EQUAL(0, stats.lost);
+}
+
+TEST_CASE("Share tracker latency percentiles", "[share_tracker]")
+{
+    share_tracker tracker;
+    share_tracker_init(&tracker);
+
+    share_tracker_stats stats;
+    share_tracker_get_stats(&tracker, &stats);
+    TEST_ASSERT_EQUAL(0, stats.latency_p50_us);
+
+    // the histogram is filled directly, round trips on the test runner are all close to zero
+    for (int i = 0; i < 100; i++) {
+        share_tracker_submit(&tracker, i + 1, "1", 1, 0);
+        tracker.in_flight[(i + 1) % SHARE_TRACKER_SIZE].submit_us -= i < 90 ? 40000 : (i < 98 ? 120000 : 3000000);
+        TEST_ASSERT_TRUE(share_tracker_complete(&tracker, i + 1, true, NULL, NULL));
+    }
+
+    share_tracker_get_stats(&tracker, &stats);
+    TEST_ASSERT_EQUAL(100, stats.accepted);
+    // bucket upper bounds, at most a quarter of a power of two above the measured time
+    TEST_ASSERT_TRUE(stats.latency_p50_us > 40000 && stats.latency_p50_us <= 50000);
+    TEST_ASSERT_TRUE(stats.latency_p95_us > 120000 && stats.latency_p95_us <= 150000);
+    TEST_ASSERT_TRUE(stats.latency_p99_us > 3000000 && stats.latency_p99_us <= 3750000);
+}
+
+TEST_CASE("Share tracker finds the oldest share sent since a point in time", "[share_tracker]")
+{
+    share_tracker tracker;
+    share_tracker_init(&tracker);
+
+    int64_t start_us = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(0, share_tracker_oldest_since(&tracker, 0));
+    share_tracker_submit(&tracker, 5, "1a2b", 1024.0, 0);
+    share_tracker_submit(&tracker, 6, "1a2b", 1024.0, 0);
+    int64_t oldest_us = share_tracker_oldest_since(&tracker, start_us);
+    TEST_ASSERT_TRUE(oldest_us >= start_us && oldest_us <= esp_timer_get_time());
+
+    // answered shares don't count, nor ones sent before
+    share_tracker_complete(&tracker, 5, true, NULL, NULL);
+    share_tracker_complete(&tracker, 6, true, NULL, NULL);
+    TEST_ASSERT_EQUAL(0, share_tracker_oldest_since(&tracker, start_us));
+    share_tracker_submit(&tracker, 7, "1a2b", 1024.0, 0);
+    TEST_ASSERT_EQUAL(0, share_tracker_oldest_since(&tracker, esp_timer_get_time() + 1));
+}
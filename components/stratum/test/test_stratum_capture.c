@@ -0,0 +1,383 @@
+#include "unity.h"
+#include "stratum_capture.h"
+#include "stratum_replay.h"
+#include "stratum_tx.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "utils.h"
+#include <stdio.h>
+#include <string.h>
+
+#define COINBASE_1 "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008"
+#define COINBASE_2 "072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000"
+#define BRANCH "a5e8a0fd0c0e4ef4d6e7e5d8a4d1c3b2a1908f7e6d5c4b3a29180f0e0d0c0b0a"
+
+static void capture_notify(stratum_capture * capture, int64_t now_us, uint8_t session, const char * job_id, bool clean_jobs)
+{
+    char line[512];
+    int len = sprintf(line,
+                      "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"%s\",\"%064x\",\"" COINBASE_1
+                      "\",\"" COINBASE_2 "\",[\"" BRANCH "\"],\"20000004\",\"1705c739\",\"64495522\",%s]}\n",
+                      job_id, 0x1234, clean_jobs ? "true" : "false");
+    stratum_capture_line(capture, now_us, session, false, line, len);
+}
+
+static void capture_string(stratum_capture * capture, int64_t now_us, uint8_t session, bool sent, const char * line)
+{
+    stratum_capture_line(capture, now_us, session, sent, line, strlen(line));
+}
+
+// A subscription and the notifies of two blocks within half a second, the second one announced in a storm
+static void capture_session(stratum_capture * capture, int64_t start_us)
+{
+    capture_string(capture, start_us, 0, true, "{\"id\": 2, \"method\": \"mining.subscribe\", \"params\": [\"bitaxe/BM1366\"]}\n");
+    capture_string(capture, start_us + 20000, 0, false,
+                   "{\"id\":1,\"result\":{\"version-rolling\":true,\"version-rolling.mask\":\"1fffe000\"},\"error\":null}\n");
+    capture_string(capture, start_us + 21000, 0, false,
+                   "{\"id\":2,\"result\":[[[\"mining.notify\",\"ae6812eb4cd7735a302a8a9dd95cf71f\"]],\"e8f2a1b4\",4],\"error\":null}\n");
+    capture_string(capture, start_us + 22000, 0, false, "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[2048]}\n");
+    capture_notify(capture, start_us + 23000, 0, "1", true);
+    capture_notify(capture, start_us + 100000, 0, "2", false);
+    for (int i = 0; i < 5; i++) {
+        char job_id[8];
+        sprintf(job_id, "b%d", i);
+        capture_notify(capture, start_us + 200000 + i * 50000, 0, job_id, i == 0);
+    }
+}
+
+TEST_CASE("Stratum capture exports lines with their timestamps", "[stratum_capture]")
+{
+    stratum_capture capture;
+    TEST_ASSERT_TRUE(stratum_capture_init(&capture, 4096, false));
+    capture_string(&capture, 1000000, 0, true, "{\"id\": 5, \"method\": \"mining.submit\"}\n");
+    capture_string(&capture, 1000150, 2, false, "{\"id\":5,\"result\":true,\"error\":null}\r\n");
+    // a line enqueued by another task just before
+    capture_string(&capture, 1000100, 1, false, "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[512]}");
+    capture_string(&capture, 9000000, 0, false, "");
+
+    size_t len;
+    uint8_t * data = stratum_capture_export(&capture, &len);
+    TEST_ASSERT_NOT_NULL(data);
+    stratum_capture_reader reader;
+    TEST_ASSERT_TRUE(stratum_capture_reader_init(&reader, data, len));
+    TEST_ASSERT_EQUAL(0, reader.flags);
+
+    stratum_capture_record record;
+    TEST_ASSERT_TRUE(stratum_capture_next(&reader, &record));
+    TEST_ASSERT_EQUAL(1000000, record.timestamp_us);
+    TEST_ASSERT_TRUE(record.sent);
+    TEST_ASSERT_EQUAL(0, record.session);
+    TEST_ASSERT_EQUAL_STRING_LEN("{\"id\": 5, \"method\": \"mining.submit\"}", record.line, record.len);
+    TEST_ASSERT_EQUAL(strlen("{\"id\": 5, \"method\": \"mining.submit\"}"), record.len);
+
+    TEST_ASSERT_TRUE(stratum_capture_next(&reader, &record));
+    TEST_ASSERT_EQUAL(1000150, record.timestamp_us);
+    TEST_ASSERT_FALSE(record.sent);
+    TEST_ASSERT_EQUAL(2, record.session);
+    TEST_ASSERT_EQUAL(strlen("{\"id\":5,\"result\":true,\"error\":null}"), record.len);
+
+    TEST_ASSERT_TRUE(stratum_capture_next(&reader, &record));
+    TEST_ASSERT_EQUAL(1000150, record.timestamp_us);
+    TEST_ASSERT_EQUAL(1, record.session);
+
+    TEST_ASSERT_TRUE(stratum_capture_next(&reader, &record));
+    TEST_ASSERT_EQUAL(9000000, record.timestamp_us);
+    TEST_ASSERT_EQUAL(0, record.len);
+    TEST_ASSERT_FALSE(stratum_capture_next(&reader, &record));
+
+    // a cut off download
+    TEST_ASSERT_TRUE(stratum_capture_reader_init(&reader, data, len - 3));
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(stratum_capture_next(&reader, &record));
+    }
+    TEST_ASSERT_FALSE(stratum_capture_next(&reader, &record));
+    TEST_ASSERT_FALSE(stratum_capture_reader_init(&reader, (const uint8_t *) "SCAX", 4));
+
+    free(data);
+    stratum_capture_free(&capture);
+}
+
+TEST_CASE("Stratum capture keeps the newest lines", "[stratum_capture]")
+{
+    stratum_capture capture;
+    TEST_ASSERT_TRUE(stratum_capture_init(&capture, 256, false));
+    for (int i = 0; i < 100; i++) {
+        char line[64];
+        sprintf(line, "{\"id\":%d,\"result\":true,\"error\":null}\n", i);
+        capture_string(&capture, 5000000 + i * 1000, 0, false, line);
+    }
+    char too_long[300];
+    memset(too_long, 'x', sizeof(too_long) - 1);
+    too_long[sizeof(too_long) - 1] = '\0';
+    capture_string(&capture, 6000000, 0, false, too_long);
+    TEST_ASSERT_EQUAL(1, capture.dropped);
+
+    size_t len;
+    uint8_t * data = stratum_capture_export(&capture, &len);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_TRUE(len <= STRATUM_CAPTURE_HEADER_SIZE + 256);
+    stratum_capture_reader reader;
+    TEST_ASSERT_TRUE(stratum_capture_reader_init(&reader, data, len));
+    TEST_ASSERT_EQUAL(STRATUM_CAPTURE_FLAG_TRUNCATED, reader.flags);
+
+    // the oldest remaining lines still have their own timestamps
+    stratum_capture_record record;
+    int count = 0, id = -1;
+    while (stratum_capture_next(&reader, &record)) {
+        int next_id;
+        TEST_ASSERT_EQUAL(1, sscanf(record.line, "{\"id\":%d", &next_id));
+        TEST_ASSERT_TRUE(id < 0 || next_id == id + 1);
+        id = next_id;
+        TEST_ASSERT_EQUAL(5000000 + id * 1000, record.timestamp_us);
+        count++;
+    }
+    TEST_ASSERT_EQUAL(99, id);
+    TEST_ASSERT_EQUAL(capture.records, count);
+    TEST_ASSERT_TRUE(count > 3);
+
+    free(data);
+    stratum_capture_free(&capture);
+}
+
+TEST_CASE("Stratum capture records the messages a connection sends", "[stratum_capture]")
+{
+    // nothing is sent, the messages only need a connection to be queued for
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    TEST_ASSERT_TRUE(sock >= 0);
+    stratum_capture capture;
+    TEST_ASSERT_TRUE(stratum_capture_init(&capture, 1024, false));
+    stratum_tx tx;
+    TEST_ASSERT_TRUE(stratum_tx_init(&tx, 1024));
+    stratum_tx_set_socket(&tx, sock);
+    stratum_tx_set_capture(&tx, &capture, 3);
+
+    const char * msg = "{\"id\": 7, \"method\": \"mining.suggest_difficulty\", \"params\": [1024]}\n";
+    TEST_ASSERT_EQUAL(strlen(msg), stratum_tx_enqueue(&tx, msg, strlen(msg)));
+    stratum_tx_set_capture(&tx, NULL, 0);
+    TEST_ASSERT_EQUAL(strlen(msg), stratum_tx_enqueue(&tx, msg, strlen(msg)));
+
+    size_t len;
+    uint8_t * data = stratum_capture_export(&capture, &len);
+    stratum_capture_reader reader;
+    TEST_ASSERT_TRUE(stratum_capture_reader_init(&reader, data, len));
+    stratum_capture_record record;
+    TEST_ASSERT_TRUE(stratum_capture_next(&reader, &record));
+    TEST_ASSERT_TRUE(record.sent);
+    TEST_ASSERT_EQUAL(3, record.session);
+    TEST_ASSERT_EQUAL(strlen(msg) - 1, record.len);
+    TEST_ASSERT_FALSE(stratum_capture_next(&reader, &record));
+
+    free(data);
+    stratum_tx_free(&tx);
+    stratum_capture_free(&capture);
+    close(sock);
+}
+
+// the BM1366 job command
+#define STUB_PACKET_LEN 88
+
+typedef struct
+{
+    int jobs;
+    int framed;
+    bm_job first_job;
+    bm_job last_job;
+} stub_asic;
+
+// Copies what goes into a BM1366 job command, the asic component frames it on the device
+static void stub_serialize_job(void * ctx, bm_job * job)
+{
+    uint8_t * packet = bm_job_packet(job);
+    memcpy(packet, &job->starting_nonce, 4);
+    memcpy(packet + 4, &job->target, 4);
+    memcpy(packet + 8, &job->ntime, 4);
+    memcpy(packet + 12, job->merkle_root_be, 32);
+    memcpy(packet + 44, job->prev_block_hash_be, 32);
+    memcpy(packet + 76, &job->version, 4);
+    job->packet_len = STUB_PACKET_LEN;
+}
+
+static void stub_asic_send_work(void * ctx, const bm_job * job)
+{
+    stub_asic * asic = ctx;
+    asic->framed += job->packet_len == STUB_PACKET_LEN && memcmp(bm_job_packet(job) + 12, job->merkle_root_be, 32) == 0;
+    if (asic->jobs++ == 0) {
+        asic->first_job = *job;
+    }
+    asic->last_job = *job;
+}
+
+TEST_CASE("Stratum replay generates the jobs of a capture", "[stratum_capture]")
+{
+    stratum_capture capture;
+    TEST_ASSERT_TRUE(stratum_capture_init(&capture, 16384, false));
+    capture_session(&capture, 3000000);
+    size_t len;
+    uint8_t * data = stratum_capture_export(&capture, &len);
+    TEST_ASSERT_TRUE(bm_job_pool_init(1, STUB_PACKET_LEN));
+
+    stub_asic asic = {0};
+    stratum_replay_config config = {
+        .speed = 0,
+        .jobs_per_notify = 3,
+        .serialize = stub_serialize_job,
+        .asic = stub_asic_send_work,
+        .asic_ctx = &asic,
+    };
+    stratum_replay_stats stats;
+    TEST_ASSERT_TRUE(stratum_replay_run(data, len, &config, &stats));
+    TEST_ASSERT_EQUAL(1, stats.sent);
+    TEST_ASSERT_EQUAL(10, stats.received);
+    TEST_ASSERT_EQUAL(7, stats.notifies);
+    TEST_ASSERT_EQUAL(2, stats.clean_jobs);
+    TEST_ASSERT_EQUAL(0, stats.failed);
+    TEST_ASSERT_EQUAL(21, stats.jobs);
+    TEST_ASSERT_EQUAL(21, asic.jobs);
+    TEST_ASSERT_EQUAL(21, asic.framed);
+    TEST_ASSERT_EQUAL(7, stats.notify_burst_max);
+    TEST_ASSERT_EQUAL(400000, stats.capture_us);
+
+    // the first job as the session task and create_jobs_task would have built it
+    TEST_ASSERT_EQUAL_STRING("1", asic.first_job.jobid);
+    TEST_ASSERT_EQUAL_STRING("00000000", asic.first_job.extranonce2);
+    TEST_ASSERT_EQUAL(2048, asic.first_job.pool_diff);
+    TEST_ASSERT_EQUAL_HEX32(0x1fffe000, asic.first_job.version_mask);
+    TEST_ASSERT_EQUAL_HEX32(0x20000004, asic.first_job.version);
+
+    mining_notify notify = {0};
+    uint8_t coinbase_1[sizeof(COINBASE_1) / 2], coinbase_2[sizeof(COINBASE_2) / 2], branch[32], extranonce[4];
+    notify.coinbase_1 = coinbase_1;
+    notify.coinbase_1_len = hex2bin(COINBASE_1, coinbase_1, sizeof(coinbase_1));
+    notify.coinbase_2 = coinbase_2;
+    notify.coinbase_2_len = hex2bin(COINBASE_2, coinbase_2, sizeof(coinbase_2));
+    hex2bin(BRANCH, branch, sizeof(branch));
+    hex2bin("e8f2a1b4", extranonce, sizeof(extranonce));
+    size_t coinbase_tx_len;
+    uint8_t * coinbase_tx = construct_coinbase_tx(&notify, extranonce, sizeof(extranonce), 4, &coinbase_tx_len);
+    TEST_ASSERT_NOT_NULL(coinbase_tx);
+    uint8_t merkle_root[32];
+    calculate_merkle_root_hash(coinbase_tx, coinbase_tx_len, (const uint8_t(*)[32]) branch, 1, merkle_root);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(merkle_root, asic.first_job.merkle_root, 32);
+    free(coinbase_tx);
+
+    TEST_ASSERT_EQUAL_STRING("b4", asic.last_job.jobid);
+    TEST_ASSERT_EQUAL_STRING("02000000", asic.last_job.extranonce2);
+
+    TEST_ASSERT_FALSE(stratum_replay_run((const uint8_t *) "not a capture", 13, &config, &stats));
+
+    free(data);
+    stratum_capture_free(&capture);
+}
+
+// The jobs of a replay per session, in the order the ASIC got them
+typedef struct
+{
+    int jobs[2];
+    char extranonce2[2][24][MAX_EXTRANONCE_2_LEN * 2 + 1];
+} session_asic;
+
+static void session_asic_send_work(void * ctx, const bm_job * job)
+{
+    session_asic * asic = ctx;
+    TEST_ASSERT_TRUE(job->session < 2 && asic->jobs[job->session] < 24);
+    strcpy(asic->extranonce2[job->session][asic->jobs[job->session]++], job->extranonce2);
+}
+
+TEST_CASE("Stratum replay weighs sessions and rebuilds work on a new extranonce", "[stratum_capture]")
+{
+    stratum_capture capture;
+    TEST_ASSERT_TRUE(stratum_capture_init(&capture, 16384, false));
+    for (uint8_t session = 0; session < 2; session++) {
+        capture_string(&capture, 1000 + session, session, false,
+                       "{\"id\":2,\"result\":[[[\"mining.notify\",\"ae6812eb4cd7735a302a8a9dd95cf71f\"]],\"e8f2a1b4\",4],\"error\":null}\n");
+    }
+    capture_notify(&capture, 10000, 0, "a", true);
+    capture_notify(&capture, 20000, 1, "b", true);
+    capture_string(&capture, 30000, 0, false, "{\"id\":null,\"method\":\"mining.set_extranonce\",\"params\":[\"0a0b0c0d\",4]}\n");
+    capture_notify(&capture, 40000, 1, "c", false);
+    size_t len;
+    uint8_t * data = stratum_capture_export(&capture, &len);
+    TEST_ASSERT_TRUE(bm_job_pool_init(1, STUB_PACKET_LEN));
+
+    session_asic asic = {0};
+    const int32_t weights[STRATUM_REPLAY_MAX_SESSIONS] = {3, 1};
+    stratum_replay_config config = {
+        .speed = 0,
+        .jobs_per_notify = 8,
+        .weights = weights,
+        .asic = session_asic_send_work,
+        .asic_ctx = &asic,
+    };
+    stratum_replay_stats stats;
+    TEST_ASSERT_TRUE(stratum_replay_run(data, len, &config, &stats));
+    TEST_ASSERT_EQUAL(24, stats.jobs);
+
+    // all jobs go to the only session with work, then three to one
+    TEST_ASSERT_EQUAL(8 + 6 + 6, asic.jobs[0]);
+    TEST_ASSERT_EQUAL(2 + 2, asic.jobs[1]);
+    TEST_ASSERT_EQUAL_STRING("0d000000", asic.extranonce2[0][13]);
+    // the coinbase of session 0 was rebuilt for the new extranonce, its extranonce_2 starts over
+    TEST_ASSERT_EQUAL_STRING("00000000", asic.extranonce2[0][14]);
+    TEST_ASSERT_EQUAL_STRING("01000000", asic.extranonce2[1][1]);
+    // the notify replaced the work of session 1
+    TEST_ASSERT_EQUAL_STRING("00000000", asic.extranonce2[1][2]);
+
+    free(data);
+    stratum_capture_free(&capture);
+}
+
+TEST_CASE("Stratum replay keeps the original timing", "[stratum_capture]")
+{
+    stratum_capture capture;
+    TEST_ASSERT_TRUE(stratum_capture_init(&capture, 16384, false));
+    capture_session(&capture, 0);
+    size_t len;
+    uint8_t * data = stratum_capture_export(&capture, &len);
+    TEST_ASSERT_TRUE(bm_job_pool_init(1, STUB_PACKET_LEN));
+
+    stratum_replay_config config = {.speed = 1, .jobs_per_notify = 1};
+    stratum_replay_stats stats;
+    TEST_ASSERT_TRUE(stratum_replay_run(data, len, &config, &stats));
+    TEST_ASSERT_TRUE(stats.elapsed_us >= 400000);
+    TEST_ASSERT_TRUE(stats.elapsed_us < 600000);
+
+    config.speed = 10;
+    TEST_ASSERT_TRUE(stratum_replay_run(data, len, &config, &stats));
+    TEST_ASSERT_TRUE(stats.elapsed_us >= 40000);
+    TEST_ASSERT_TRUE(stats.elapsed_us < 200000);
+
+    free(data);
+    stratum_capture_free(&capture);
+}
+
+TEST_CASE("Stratum replay throughput of a notify storm", "[stratum_capture][benchmark]")
+{
+    stratum_capture capture;
+    TEST_ASSERT_TRUE(stratum_capture_init(&capture, 256 * 1024, false));
+    for (int i = 0; i < 50; i++) {
+        capture_session(&capture, i * 1000000LL);
+    }
+    size_t len;
+    uint8_t * data = stratum_capture_export(&capture, &len);
+    TEST_ASSERT_TRUE(bm_job_pool_init(1, STUB_PACKET_LEN));
+
+    stub_asic asic = {0};
+    stratum_replay_config config = {
+        .speed = 0,
+        .jobs_per_notify = 10,
+        .serialize = stub_serialize_job,
+        .asic = stub_asic_send_work,
+        .asic_ctx = &asic,
+    };
+    stratum_replay_stats stats;
+    TEST_ASSERT_TRUE(stratum_replay_run(data, len, &config, &stats));
+    TEST_ASSERT_EQUAL(350, stats.notifies);
+    printf("Replayed %lu notifies into %lu jobs in %lld ms: parse %lld us and jobs %lld us per notify, "
+           "notify to first job at most %lld us\n",
+           (unsigned long) stats.notifies, (unsigned long) stats.jobs, (long long) stats.elapsed_us / 1000,
+           (long long) (stats.parse_us / stats.notifies), (long long) (stats.jobs_us / stats.notifies),
+           (long long) stats.notify_to_job_max_us);
+
+    free(data);
+    stratum_capture_free(&capture);
+}
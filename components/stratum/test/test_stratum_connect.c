@@ -0,0 +1,225 @@
+#include "unity.h"
+#include "stratum_connect.h"
+#include "stratum_api.h"
+#include "stratum_test_pool.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_DNS_DELAY_MS 300
+
+static struct sockaddr_in test_addresses[STRATUM_DNS_MAX_ADDRESSES];
+static int test_address_count;
+static int resolve_calls;
+// the DNS server stopped answering
+static bool dns_stalled;
+
+// Stand-in for a slow DNS server
+static int slow_resolver(const char * host, uint16_t port, stratum_address * addresses, int max_addresses)
+{
+    resolve_calls++;
+    if (dns_stalled) {
+        vTaskDelay((STRATUM_DNS_TIMEOUT_MS + 1000) / portTICK_PERIOD_MS);
+        return 0;
+    }
+    vTaskDelay(TEST_DNS_DELAY_MS / portTICK_PERIOD_MS);
+    int count = test_address_count < max_addresses ? test_address_count : max_addresses;
+    for (int i = 0; i < count; i++) {
+        memcpy(&addresses[i].addr, &test_addresses[i], sizeof(struct sockaddr_in));
+        addresses[i].len = sizeof(struct sockaddr_in);
+    }
+    return count;
+}
+
+static void add_test_address(uint16_t port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = htons(port),
+    };
+    test_addresses[test_address_count++] = addr;
+}
+
+// A listener whose accept backlog is full drops further SYNs, like an address nothing answers from
+static int open_blackhole(uint16_t * port, int * fillers, int filler_count)
+{
+    int listener = stratum_test_pool_listen(port, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = htons(*port),
+    };
+    for (int i = 0; i < filler_count; i++) {
+        fillers[i] = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+        fcntl(fillers[i], F_SETFL, O_NONBLOCK);
+        connect(fillers[i], (struct sockaddr *) &addr, sizeof(addr));
+    }
+    vTaskDelay(100 / portTICK_PERIOD_MS);
+    return listener;
+}
+
+// Accepts a connection and sends the first job right away
+static int pool_accept_and_notify(int listener)
+{
+    int client = accept(listener, NULL, NULL);
+    TEST_ASSERT_TRUE(client >= 0);
+    const char * notify = "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"1\",\"00\",\"01\",\"ff\",[],\"20000004\","
+                          "\"1705c739\",\"64495522\",true]}\n";
+    TEST_ASSERT_EQUAL(strlen(notify), send(client, notify, strlen(notify), 0));
+    return client;
+}
+
+// Time from starting to connect until the pool's first job has been read
+static int64_t connect_to_first_notify(uint16_t port, int listener, int * pool)
+{
+    line_buffer buffer;
+    TEST_ASSERT_TRUE(line_buffer_init(&buffer, STRATUM_LINE_BUFFER_SIZE));
+
+    int64_t start_us = esp_timer_get_time();
+    char ip[48];
+    int sock = stratum_connect("pool.test", port, 5000, ip, sizeof(ip));
+    TEST_ASSERT_TRUE(sock >= 0);
+    TEST_ASSERT_EQUAL_STRING("127.0.0.1", ip);
+    *pool = pool_accept_and_notify(listener);
+    const char * line = STRATUM_V1_receive_jsonrpc_line(&buffer, sock);
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    TEST_ASSERT_NOT_NULL(line);
+    TEST_ASSERT_NOT_NULL(strstr(line, "mining.notify"));
+
+    close(sock);
+    line_buffer_free(&buffer);
+    return elapsed_us;
+}
+
+TEST_CASE("Stratum connect resolves a pool once until it fails", "[stratum_connect]")
+{
+    uint16_t port;
+    int listener = stratum_test_pool_listen(&port, 1);
+    test_address_count = 0;
+    add_test_address(port);
+    resolve_calls = 0;
+    stratum_dns_set_resolver(slow_resolver);
+
+    int pool;
+    int64_t first_us = connect_to_first_notify(port, listener, &pool);
+    close(pool);
+    int64_t reconnect_us = connect_to_first_notify(port, listener, &pool);
+    close(pool);
+    printf("Connect to first notify: %lld us resolving, %lld us cached\n", (long long) first_us, (long long) reconnect_us);
+    TEST_ASSERT_EQUAL(1, resolve_calls);
+    TEST_ASSERT_TRUE(first_us >= TEST_DNS_DELAY_MS * 1000);
+    TEST_ASSERT_TRUE(reconnect_us < TEST_DNS_DELAY_MS * 1000);
+
+    // the pool went away, the attempt after the failed one looks it up again
+    close(listener);
+    TEST_ASSERT_EQUAL(STRATUM_CONNECT_ERR_CONNECT, stratum_connect("pool.test", port, 1000, NULL, 0));
+    TEST_ASSERT_EQUAL(1, resolve_calls);
+    TEST_ASSERT_EQUAL(STRATUM_CONNECT_ERR_CONNECT, stratum_connect("pool.test", port, 1000, NULL, 0));
+    TEST_ASSERT_EQUAL(2, resolve_calls);
+
+    // the host doesn't resolve anymore, its last addresses are still tried
+    test_address_count = 0;
+    TEST_ASSERT_EQUAL(STRATUM_CONNECT_ERR_CONNECT, stratum_connect("pool.test", port, 1000, NULL, 0));
+    TEST_ASSERT_EQUAL(3, resolve_calls);
+    stratum_dns_invalidate("pool.test");
+    TEST_ASSERT_EQUAL(STRATUM_CONNECT_ERR_DNS, stratum_connect("pool.test", port, 1000, NULL, 0));
+    stratum_dns_set_resolver(NULL);
+}
+
+TEST_CASE("Stratum connect moves past a blackholed address", "[stratum_connect]")
+{
+    uint16_t blackhole_port, port;
+    int fillers[2];
+    int blackhole = open_blackhole(&blackhole_port, fillers, 2);
+    int listener = stratum_test_pool_listen(&port, 1);
+
+    // every address of the pool host is tried, the blackholed one first
+    test_address_count = 0;
+    add_test_address(blackhole_port);
+    add_test_address(port);
+    resolve_calls = 0;
+    stratum_dns_set_resolver(slow_resolver);
+
+    int pool;
+    int64_t elapsed_us = connect_to_first_notify(port, listener, &pool);
+    printf("Connect to first notify past a blackholed address: %lld us\n", (long long) elapsed_us);
+    TEST_ASSERT_TRUE(elapsed_us < (TEST_DNS_DELAY_MS + 4 * STRATUM_CONNECT_ATTEMPT_DELAY_MS) * 1000);
+    close(pool);
+
+    // only the blackhole, the connect timeout bounds the wait
+    test_address_count = 0;
+    add_test_address(blackhole_port);
+    stratum_dns_invalidate("pool.test");
+    int64_t start_us = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(STRATUM_CONNECT_ERR_CONNECT, stratum_connect("pool.test", blackhole_port, 500, NULL, 0));
+    int64_t timeout_us = esp_timer_get_time() - start_us;
+    TEST_ASSERT_TRUE(timeout_us >= (TEST_DNS_DELAY_MS + 500) * 1000);
+    TEST_ASSERT_TRUE(timeout_us < (TEST_DNS_DELAY_MS + 1500) * 1000);
+
+    // a timeout keeps the addresses, the pool or the network may just be down
+    int calls = resolve_calls;
+    TEST_ASSERT_EQUAL(STRATUM_CONNECT_ERR_CONNECT, stratum_connect("pool.test", blackhole_port, 500, NULL, 0));
+    TEST_ASSERT_EQUAL(calls, resolve_calls);
+
+    stratum_dns_set_resolver(NULL);
+    close(fillers[0]);
+    close(fillers[1]);
+    close(blackhole);
+    close(listener);
+}
+
+TEST_CASE("Stratum connect doesn't wait on a refused address", "[stratum_connect]")
+{
+    uint16_t refused_port, port;
+    int refused = stratum_test_pool_listen(&refused_port, 1);
+    close(refused);
+    int listener = stratum_test_pool_listen(&port, 1);
+
+    test_address_count = 0;
+    add_test_address(refused_port);
+    add_test_address(port);
+    stratum_dns_set_resolver(slow_resolver);
+
+    int64_t start_us = esp_timer_get_time();
+    int sock = stratum_connect("pool.test", port, 5000, NULL, 0);
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    TEST_ASSERT_TRUE(sock >= 0);
+    TEST_ASSERT_TRUE(elapsed_us < (TEST_DNS_DELAY_MS + STRATUM_CONNECT_ATTEMPT_DELAY_MS) * 1000);
+
+    close(sock);
+    stratum_dns_set_resolver(NULL);
+    close(listener);
+}
+
+TEST_CASE("Stratum connect doesn't wait on a stalled resolver", "[stratum_connect]")
+{
+    uint16_t port;
+    int listener = stratum_test_pool_listen(&port, 1);
+    test_address_count = 0;
+    add_test_address(port);
+    stratum_dns_set_resolver(slow_resolver);
+    int sock = stratum_connect("pool.test", port, 5000, NULL, 0);
+    TEST_ASSERT_TRUE(sock >= 0);
+    close(sock);
+
+    // the pool refuses, the next attempt looks it up again and gets no answer
+    close(listener);
+    TEST_ASSERT_EQUAL(STRATUM_CONNECT_ERR_CONNECT, stratum_connect("pool.test", port, 1000, NULL, 0));
+    dns_stalled = true;
+    resolve_calls = 0;
+    int64_t start_us = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(STRATUM_CONNECT_ERR_CONNECT, stratum_connect("pool.test", port, 1000, NULL, 0));
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    TEST_ASSERT_EQUAL(1, resolve_calls);
+    TEST_ASSERT_TRUE(elapsed_us >= STRATUM_DNS_TIMEOUT_MS * 1000);
+    TEST_ASSERT_TRUE(elapsed_us < (STRATUM_DNS_TIMEOUT_MS + 1000) * 1000);
+
+    // the abandoned lookup finishes on its own
+    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    dns_stalled = false;
+    stratum_dns_set_resolver(NULL);
+}
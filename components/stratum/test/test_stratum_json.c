@@ -1,5 +1,9 @@
 #include "unity.h"
 #include "stratum_api.h"
+#include "utils.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
 
 TEST_CASE("Parse stratum method", "[stratum]")
 {
@@ -66,6 +70,11 @@ TEST_CASE("Parse stratum set_difficulty params", "[mining.set_difficulty]")
     STRATUM_V1_parse(&stratum_api_v1_message, json_string);
     TEST_ASSERT_EQUAL(MINING_SET_DIFFICULTY, stratum_api_v1_message.method);
     TEST_ASSERT_EQUAL(1638, stratum_api_v1_message.new_difficulty);
+
+    json_string = "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[2048.0]}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL(MINING_SET_DIFFICULTY, stratum_api_v1_message.method);
+    TEST_ASSERT_EQUAL(2048, stratum_api_v1_message.new_difficulty);
 }
 
 TEST_CASE("Parse stratum notify params", "[mining.notify]")
@@ -80,12 +89,100 @@ TEST_CASE("Parse stratum notify params", "[mining.notify]")
                               "\"20000004\",\"1705c739\",\"64495522\",false]}";
     STRATUM_V1_parse(&stratum_api_v1_message, json_string);
     TEST_ASSERT_EQUAL_STRING("1d2e0c4d3d", stratum_api_v1_message.mining_notification->job_id);
-    TEST_ASSERT_EQUAL_STRING("ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000", stratum_api_v1_message.mining_notification->prev_block_hash);
-    TEST_ASSERT_EQUAL_STRING("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000", stratum_api_v1_message.mining_notification->coinbase_1);
-    TEST_ASSERT_EQUAL_STRING("41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000", stratum_api_v1_message.mining_notification->coinbase_2);
+    uint8_t expected_prev_block_hash[32];
+    swap_endian_words("ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000", expected_prev_block_hash);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_prev_block_hash, stratum_api_v1_message.mining_notification->prev_block_hash, 32);
+    uint8_t expected_coinbase_1[90];
+    hex2bin("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000", expected_coinbase_1, sizeof(expected_coinbase_1));
+    TEST_ASSERT_EQUAL(90, stratum_api_v1_message.mining_notification->coinbase_1_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_coinbase_1, stratum_api_v1_message.mining_notification->coinbase_1, sizeof(expected_coinbase_1));
+    uint8_t expected_coinbase_2[155];
+    hex2bin("41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000", expected_coinbase_2, sizeof(expected_coinbase_2));
+    TEST_ASSERT_EQUAL(155, stratum_api_v1_message.mining_notification->coinbase_2_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_coinbase_2, stratum_api_v1_message.mining_notification->coinbase_2, sizeof(expected_coinbase_2));
     TEST_ASSERT_EQUAL_UINT32(0x20000004, stratum_api_v1_message.mining_notification->version);
     TEST_ASSERT_EQUAL_UINT32(0x1705c739, stratum_api_v1_message.mining_notification->target);
     TEST_ASSERT_EQUAL_UINT32(0x64495522, stratum_api_v1_message.mining_notification->ntime);
+    TEST_ASSERT_EQUAL(12, stratum_api_v1_message.mining_notification->n_merkle_branches);
+    uint8_t expected_merkle_branch[32];
+    hex2bin("03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76", expected_merkle_branch, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_merkle_branch, stratum_api_v1_message.mining_notification->merkle_branches + 11 * 32, 32);
+    STRATUM_V1_free_mining_notify(stratum_api_v1_message.mining_notification);
+}
+
+TEST_CASE("Parse stratum notify with whitespace and reordered keys", "[mining.notify]")
+{
+    StratumApiV1Message stratum_api_v1_message = {};
+    const char *json_string = " { \"params\" : [ \"ab\" , \"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\" , "
+                              "\"0100\", \"\", [ ], \"20000004\", \"1705c739\", \"64495522\", true ] ,"
+                              " \"extra\": {\"a\": [1, \"]\"]}, \"method\" : \"mining.notify\", \"id\" : null } ";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL(MINING_NOTIFY, stratum_api_v1_message.method);
+    TEST_ASSERT_EQUAL_INT(1, stratum_api_v1_message.should_abandon_work);
+    TEST_ASSERT_EQUAL_STRING("ab", stratum_api_v1_message.mining_notification->job_id);
+    TEST_ASSERT_EQUAL(2, stratum_api_v1_message.mining_notification->coinbase_1_len);
+    TEST_ASSERT_EQUAL_HEX8(0x01, stratum_api_v1_message.mining_notification->coinbase_1[0]);
+    TEST_ASSERT_EQUAL(0, stratum_api_v1_message.mining_notification->coinbase_2_len);
+    TEST_ASSERT_EQUAL(0, stratum_api_v1_message.mining_notification->n_merkle_branches);
+    TEST_ASSERT_EQUAL_UINT32(0x64495522, stratum_api_v1_message.mining_notification->ntime);
+    STRATUM_V1_free_mining_notify(stratum_api_v1_message.mining_notification);
+}
+
+TEST_CASE("Parse stratum invalid notify", "[mining.notify]")
+{
+    StratumApiV1Message stratum_api_v1_message = {};
+    // prevhash too short
+    const char *json_string = "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
+                              "[\"ab\",\"ef4b9a48\",\"0100\",\"00\",[],\"20000004\",\"1705c739\",\"64495522\",true]}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL(STRATUM_UNKNOWN, stratum_api_v1_message.method);
+
+    // missing ntime
+    json_string = "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
+                  "[\"ab\",\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\",\"0100\",\"00\",[],\"20000004\"]}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL(STRATUM_UNKNOWN, stratum_api_v1_message.method);
+}
+
+TEST_CASE("Parse stratum notify throughput", "[benchmark][not-on-qemu]")
+{
+    // 14 merkle branches and a 300 byte coinbase, typical for a large pool
+    char * json_string = malloc(4096);
+    TEST_ASSERT_NOT_NULL(json_string);
+    int len = sprintf(json_string, "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"1d2e0c4d3d\","
+                                   "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\",\"");
+    memset(json_string + len, 'a', 300);
+    len += 300;
+    len += sprintf(json_string + len, "\",\"");
+    memset(json_string + len, 'b', 300);
+    len += 300;
+    len += sprintf(json_string + len, "\",[");
+    for (int i = 0; i < 14; i++) {
+        len += sprintf(json_string + len, "%s\"%064x\"", i ? "," : "", i);
+    }
+    sprintf(json_string + len, "],\"20000004\",\"1705c739\",\"64495522\",false]}");
+
+    const int iterations = 1000;
+    StratumApiV1Message stratum_api_v1_message = {};
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+        STRATUM_V1_free_mining_notify(stratum_api_v1_message.mining_notification);
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL(MINING_NOTIFY, stratum_api_v1_message.method);
+    printf("mining.notify parse: %lld us per message\n", (long long) (elapsed / iterations));
+
+    const char * result_string = "{\"id\":1234,\"result\":null,\"error\":[23,\"Low difficulty share\",null]}";
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        STRATUM_V1_parse(&stratum_api_v1_message, result_string);
+    }
+    elapsed = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL(STRATUM_RESULT, stratum_api_v1_message.method);
+    printf("submit result parse: %lld us per message\n", (long long) (elapsed / iterations));
+
+    free(json_string);
 }
 
 // 'private' function
@@ -105,6 +202,50 @@ TEST_CASE("Parse stratum notify params", "[mining.notify]")
 //     TEST_ASSERT_EQUAL_INT(extranonce2_len, 4);
 // }
 
+TEST_CASE("Parse stratum subscribe result with subscription id", "[mining.subscribe]")
+{
+    StratumApiV1Message message = {};
+    const char * json_string = "{\"result\":["
+        "[[\"mining.set_difficulty\",\"deadbeef0001\"],"
+        "[\"mining.notify\",\"731ec5e0649606ff\"]],"
+        "\"e9695791\",4],"
+        "\"id\":2,\"error\":null}";
+    STRATUM_V1_parse(&message, json_string);
+    TEST_ASSERT_EQUAL(STRATUM_RESULT_SUBSCRIBE, message.method);
+    TEST_ASSERT_TRUE(message.response_success);
+    TEST_ASSERT_EQUAL_STRING("e9695791", message.extranonce_str);
+    TEST_ASSERT_EQUAL_INT(4, message.extranonce_2_len);
+    TEST_ASSERT_EQUAL_STRING("731ec5e0649606ff", message.subscription_id);
+    free(message.extranonce_str);
+
+    // a single pair, and an id that can't be sent back without escaping
+    StratumApiV1Message single = {};
+    STRATUM_V1_parse(&single, "{\"id\":2,\"result\":[[\"mining.notify\",\"ae6812eb4cd7735a\"],\"08000002\",8],\"error\":null}");
+    TEST_ASSERT_EQUAL_STRING("ae6812eb4cd7735a", single.subscription_id);
+    free(single.extranonce_str);
+
+    StratumApiV1Message unsafe = {};
+    STRATUM_V1_parse(&unsafe, "{\"id\":2,\"result\":[[[\"mining.notify\",\"a\\\"b\"]],\"08000002\",8],\"error\":null}");
+    TEST_ASSERT_EQUAL(STRATUM_RESULT_SUBSCRIBE, unsafe.method);
+    TEST_ASSERT_EQUAL_STRING("", unsafe.subscription_id);
+    free(unsafe.extranonce_str);
+}
+
+TEST_CASE("Parse stratum mining.set_extranonce params", "[stratum]")
+{
+    StratumApiV1Message message = {};
+    STRATUM_V1_parse(&message, "{\"id\":null,\"method\":\"mining.set_extranonce\",\"params\":[\"0a0b0c0d\",6]}");
+    TEST_ASSERT_EQUAL(MINING_SET_EXTRANONCE, message.method);
+    TEST_ASSERT_EQUAL_STRING("0a0b0c0d", message.extranonce_str);
+    TEST_ASSERT_EQUAL_INT(6, message.extranonce_2_len);
+    free(message.extranonce_str);
+
+    StratumApiV1Message invalid = {};
+    STRATUM_V1_parse(&invalid, "{\"id\":null,\"method\":\"mining.set_extranonce\",\"params\":[6]}");
+    TEST_ASSERT_EQUAL(STRATUM_UNKNOWN, invalid.method);
+    TEST_ASSERT_NULL(invalid.extranonce_str);
+}
+
 TEST_CASE("Parse stratum mining.set_version_mask params", "[stratum]")
 {
     StratumApiV1Message stratum_api_v1_message = {};
@@ -181,3 +322,13 @@ TEST_CASE("Parse stratum result alternative error", "[stratum]")
     TEST_ASSERT_FALSE(stratum_api_v1_message.response_success);
     TEST_ASSERT_EQUAL_STRING("Above target 2", stratum_api_v1_message.error_str);
 }
+
+TEST_CASE("Parse stratum result error without message", "[stratum]")
+{
+    StratumApiV1Message stratum_api_v1_message = {};
+    const char *json_string = "{\"id\":6,\"result\":false,\"error\":null}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL(STRATUM_RESULT, stratum_api_v1_message.method);
+    TEST_ASSERT_FALSE(stratum_api_v1_message.response_success);
+    TEST_ASSERT_EQUAL_STRING("unknown", stratum_api_v1_message.error_str);
+}
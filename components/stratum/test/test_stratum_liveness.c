@@ -0,0 +1,206 @@
+#include "unity.h"
+#include "stratum_liveness.h"
+#include "stratum_api.h"
+#include "stratum_tx.h"
+#include "stratum_test_pool.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SECOND_US 1000000LL
+
+TEST_CASE("Stratum liveness probes after twice the notify interval", "[stratum_liveness]")
+{
+    stratum_liveness liveness;
+    stratum_liveness_init(&liveness, 120000);
+    stratum_liveness_reset(&liveness, 0);
+
+    // before the notify cadence is known
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_MIN_PROBE_MS * 1000LL, stratum_liveness_probe_after_us(&liveness));
+
+    stratum_liveness_received(&liveness, 0, true);
+    stratum_liveness_received(&liveness, 30 * SECOND_US, true);
+    stratum_liveness_received(&liveness, 60 * SECOND_US, true);
+    TEST_ASSERT_EQUAL(60 * SECOND_US, stratum_liveness_probe_after_us(&liveness));
+
+    // a pool with slow notifies still gets half the dead timeout to answer the probe
+    stratum_liveness_received(&liveness, 360 * SECOND_US, true);
+    TEST_ASSERT_EQUAL(60 * SECOND_US, stratum_liveness_probe_after_us(&liveness));
+
+    // one that notifies every second isn't probed for every short pause
+    stratum_liveness_reset(&liveness, 0);
+    for (int i = 0; i < 10; i++) {
+        stratum_liveness_received(&liveness, i * SECOND_US, true);
+    }
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_MIN_PROBE_MS * 1000LL, stratum_liveness_probe_after_us(&liveness));
+}
+
+TEST_CASE("Stratum liveness declares a silent pool dead", "[stratum_liveness]")
+{
+    stratum_liveness liveness;
+    stratum_liveness_init(&liveness, 120000);
+    stratum_liveness_reset(&liveness, 0);
+    stratum_liveness_received(&liveness, 0, true);
+    stratum_liveness_received(&liveness, 30 * SECOND_US, true);
+    stratum_liveness_received(&liveness, 60 * SECOND_US, true);
+
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_OK, stratum_liveness_check(&liveness, 100 * SECOND_US, 0));
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_PROBE, stratum_liveness_check(&liveness, 120 * SECOND_US, 0));
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_OK, stratum_liveness_check(&liveness, 121 * SECOND_US, 0));
+
+    // the answer, an error from a pool without mining.ping
+    stratum_liveness_received(&liveness, 121 * SECOND_US, false);
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_OK, stratum_liveness_check(&liveness, 150 * SECOND_US, 0));
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_PROBE, stratum_liveness_check(&liveness, 181 * SECOND_US, 0));
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_OK, stratum_liveness_check(&liveness, 240 * SECOND_US, 0));
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_DEAD, stratum_liveness_check(&liveness, 241 * SECOND_US, 0));
+
+    // 0 leaves it to TCP
+    stratum_liveness_init(&liveness, 0);
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_OK, stratum_liveness_check(&liveness, 3600 * SECOND_US, 0));
+}
+
+TEST_CASE("Stratum liveness waits half the dead timeout for share responses", "[stratum_liveness]")
+{
+    stratum_liveness liveness;
+    stratum_liveness_init(&liveness, 120000);
+    stratum_liveness_reset(&liveness, 0);
+    stratum_liveness_received(&liveness, 0, true);
+    stratum_liveness_received(&liveness, 30 * SECOND_US, true);
+    stratum_liveness_received(&liveness, 60 * SECOND_US, true);
+
+    // a share sent before the pool was last heard from says nothing about the connection
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_OK, stratum_liveness_check(&liveness, 115 * SECOND_US, 50 * SECOND_US));
+
+    // a share without response since
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_OK, stratum_liveness_check(&liveness, 100 * SECOND_US, 70 * SECOND_US));
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_PROBE, stratum_liveness_check(&liveness, 125 * SECOND_US, 70 * SECOND_US));
+    TEST_ASSERT_EQUAL(STRATUM_LIVENESS_DEAD, stratum_liveness_check(&liveness, 130 * SECOND_US, 70 * SECOND_US));
+}
+
+// What the miner sent to the pool so far, without waiting
+static void pool_drain(int client, char * dest, size_t size)
+{
+    size_t len = strlen(dest);
+    int nbytes;
+    while (len < size - 1 && (nbytes = recv(client, dest + len, size - 1 - len, MSG_DONTWAIT)) > 0) {
+        len += nbytes;
+    }
+    dest[len] = '\0';
+}
+
+// The receive loop of a session with a short receive timeout, until the connection is considered dead
+static int64_t run_until_dead(int sock, stratum_tx * tx, line_buffer * buffer, stratum_liveness * liveness, int * send_uid,
+                              int pool, char * pool_received, size_t pool_received_size, bool answer_probe)
+{
+    for (;;) {
+        const char * line = STRATUM_V1_receive_jsonrpc_line(buffer, sock);
+        int64_t now = esp_timer_get_time();
+        if (line != NULL) {
+            StratumApiV1Message message = {0};
+            STRATUM_V1_parse(&message, line);
+            stratum_liveness_received(liveness, now, message.method == MINING_NOTIFY);
+            if (message.method == MINING_NOTIFY) {
+                STRATUM_V1_free_mining_notify(message.mining_notification);
+            }
+            continue;
+        }
+        TEST_ASSERT_EQUAL(EAGAIN, errno);
+
+        stratum_liveness_action action = stratum_liveness_check(liveness, now, 0);
+        if (action == STRATUM_LIVENESS_DEAD) {
+            return now;
+        }
+        if (action == STRATUM_LIVENESS_PROBE) {
+            liveness->probe_uid = (*send_uid)++;
+            TEST_ASSERT_TRUE(STRATUM_V1_ping(tx, liveness->probe_uid) > 0);
+            TEST_ASSERT_TRUE(stratum_tx_flush(tx));
+            if (answer_probe) {
+                char answer[128];
+                sprintf(answer, "{\"id\":%d,\"result\":null,\"error\":[20,\"Unknown method\",null]}\n", liveness->probe_uid);
+                stratum_test_pool_send(pool, answer);
+                answer_probe = false;
+            }
+        }
+        pool_drain(pool, pool_received, pool_received_size);
+    }
+}
+
+TEST_CASE("Stratum liveness detects a pool that silently stops responding", "[stratum_liveness]")
+{
+    const uint32_t dead_timeout_ms = 2000;
+    uint16_t port;
+    int listener = stratum_test_pool_listen(&port, 1);
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = htons(port),
+    };
+    TEST_ASSERT_EQUAL(0, connect(sock, (struct sockaddr *) &addr, sizeof(addr)));
+    int pool = accept(listener, NULL, NULL);
+    TEST_ASSERT_TRUE(pool >= 0);
+    // the receive loop wakes up this often to check on the connection
+    struct timeval tick = {.tv_sec = 0, .tv_usec = 100000};
+    TEST_ASSERT_EQUAL(0, setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tick, sizeof(tick)));
+
+    line_buffer buffer;
+    TEST_ASSERT_TRUE(line_buffer_init(&buffer, STRATUM_LINE_BUFFER_SIZE));
+    stratum_tx tx;
+    TEST_ASSERT_TRUE(stratum_tx_init(&tx, 1024));
+    stratum_tx_set_socket(&tx, sock);
+    stratum_liveness liveness;
+    stratum_liveness_init(&liveness, dead_timeout_ms);
+    stratum_liveness_reset(&liveness, esp_timer_get_time());
+    int send_uid = 10;
+
+    // jobs every 200 ms
+    for (int i = 0; i < 5; i++) {
+        char notify[256];
+        sprintf(notify,
+                "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"%d\",\"%064x\",\"01000000\",\"ffffffff\",[],"
+                "\"20000004\",\"1705c739\",\"64495522\",false]}\n",
+                i, 0);
+        stratum_test_pool_send(pool, notify);
+        const char * line = STRATUM_V1_receive_jsonrpc_line(&buffer, sock);
+        TEST_ASSERT_NOT_NULL(line);
+        stratum_liveness_received(&liveness, esp_timer_get_time(), true);
+        vTaskDelay(200 / portTICK_PERIOD_MS);
+    }
+
+    // a receive timeout in the middle of a line keeps the connection and what arrived
+    stratum_test_pool_send(pool, "{\"id\":null,\"method\":\"mining.set_diff");
+    TEST_ASSERT_NULL(STRATUM_V1_receive_jsonrpc_line(&buffer, sock));
+    TEST_ASSERT_EQUAL(EAGAIN, errno);
+    stratum_test_pool_send(pool, "iculty\",\"params\":[512]}\n");
+    const char * line = STRATUM_V1_receive_jsonrpc_line(&buffer, sock);
+    TEST_ASSERT_NOT_NULL(line);
+    StratumApiV1Message message = {0};
+    STRATUM_V1_parse(&message, line);
+    TEST_ASSERT_EQUAL(MINING_SET_DIFFICULTY, message.method);
+    TEST_ASSERT_EQUAL(512, message.new_difficulty);
+    stratum_liveness_received(&liveness, esp_timer_get_time(), false);
+
+    // the pool answers the first probe, then keeps the connection open and says nothing
+    char pool_received[1024] = "";
+    int64_t dead_us = run_until_dead(sock, &tx, &buffer, &liveness, &send_uid, pool, pool_received, sizeof(pool_received), true);
+    int64_t detection_us = dead_us - liveness.last_rx_us;
+    printf("Silent pool detected as dead %lld ms after its last answer, dead timeout %lu ms\n", (long long) detection_us / 1000,
+           (unsigned long) dead_timeout_ms);
+    const char * first_probe = strstr(pool_received, "\"mining.ping\"");
+    TEST_ASSERT_NOT_NULL(first_probe);
+    TEST_ASSERT_NOT_NULL(strstr(first_probe + 1, "\"mining.ping\""));
+    TEST_ASSERT_TRUE(detection_us >= dead_timeout_ms * 1000LL / 2);
+    // plus a tick of the receive timeout
+    TEST_ASSERT_TRUE(detection_us <= dead_timeout_ms * 1000LL + 200000);
+
+    stratum_tx_free(&tx);
+    line_buffer_free(&buffer);
+    close(pool);
+    close(sock);
+    close(listener);
+}
@@ -0,0 +1,167 @@
+#include "unity.h"
+#include "stratum_standby.h"
+#include "stratum_test_pool.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include <stdio.h>
+#include <string.h>
+
+static void pool_expect_line(int client, const char * method)
+{
+    char line[512];
+    size_t len = 0;
+    char c;
+    do {
+        TEST_ASSERT_EQUAL(1, recv(client, &c, 1, 0));
+        TEST_ASSERT_TRUE(len < sizeof(line) - 1);
+        line[len++] = c;
+    } while (c != '\n');
+    line[len] = '\0';
+    TEST_ASSERT_NOT_NULL(strstr(line, method));
+}
+
+static int notify(char * dest, const char * job_id)
+{
+    return sprintf(dest,
+                   "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"%s\",\"%064x\",\"01000000\",\"ffffffff\",[],"
+                   "\"20000004\",\"1705c739\",\"64495522\",false]}\n",
+                   job_id, 0);
+}
+
+// Accepts the standby's connection and answers its handshake
+static int pool_accept_standby(int listener)
+{
+    int client = accept(listener, NULL, NULL);
+    TEST_ASSERT_TRUE(client >= 0);
+    pool_expect_line(client, "\"mining.configure\"");
+    pool_expect_line(client, "\"mining.subscribe\"");
+    pool_expect_line(client, "\"mining.authorize\"");
+    pool_expect_line(client, "\"mining.suggest_difficulty\"");
+
+    stratum_test_pool_send(client, "{\"id\":1,\"result\":{\"version-rolling\":true,\"version-rolling.mask\":\"1fffe000\"},\"error\":null}\n"
+                      "{\"id\":2,\"result\":[[[\"mining.notify\",\"ae6812eb4cd7735a302a8a9dd95cf71f\"]],\"e8f2a1b4\",8],\"error\":null}\n"
+                      "{\"id\":3,\"result\":true,\"error\":null}\n"
+                      "{\"id\":4,\"result\":true,\"error\":null}\n"
+                      "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[2048]}\n");
+    return client;
+}
+
+static void poll_until_ready(stratum_standby * standby)
+{
+    for (int i = 0; i < 50 && !stratum_standby_ready(standby); i++) {
+        TEST_ASSERT_TRUE(stratum_standby_poll(standby, 100));
+    }
+    TEST_ASSERT_TRUE(stratum_standby_ready(standby));
+}
+
+TEST_CASE("Stratum standby takes over with the latest job when the primary fails", "[stratum_standby]")
+{
+    uint16_t fallback_port, primary_port;
+    int fallback_listener = stratum_test_pool_listen(&fallback_port, 1);
+    int primary_listener = stratum_test_pool_listen(&primary_port, 1);
+
+    line_buffer receive_buffer;
+    TEST_ASSERT_TRUE(line_buffer_init(&receive_buffer, STRATUM_LINE_BUFFER_SIZE));
+    stratum_standby standby;
+    TEST_ASSERT_TRUE(stratum_standby_init(&standby));
+    TEST_ASSERT_TRUE(stratum_standby_connect(&standby, "127.0.0.1", fallback_port, false, "user", "x", "BM1366", 1000, 5000));
+    int fallback = pool_accept_standby(fallback_listener);
+
+    char msg[512];
+    notify(msg, "a");
+    stratum_test_pool_send(fallback, msg);
+    poll_until_ready(&standby);
+
+    // newer job, and the beginning of one the primary connection has to finish reading after the handover
+    int len = notify(msg, "b");
+    len += notify(msg + len, "c");
+    TEST_ASSERT_EQUAL(len - 20, send(fallback, msg, len - 20, 0));
+    TEST_ASSERT_TRUE(stratum_standby_poll(&standby, 100));
+
+    // the primary pool goes away
+    int primary = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    struct sockaddr_in primary_addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = htons(primary_port),
+    };
+    TEST_ASSERT_EQUAL(0, connect(primary, (struct sockaddr *) &primary_addr, sizeof(primary_addr)));
+    int primary_pool = accept(primary_listener, NULL, NULL);
+    close(primary_pool);
+    TEST_ASSERT_NULL(STRATUM_V1_receive_jsonrpc_line(&receive_buffer, primary));
+    int64_t lost_us = esp_timer_get_time();
+
+    stratum_standby_session session;
+    TEST_ASSERT_TRUE(stratum_standby_take(&standby, &session, &receive_buffer));
+    int64_t failover_us = esp_timer_get_time() - lost_us;
+    printf("Job of the fallback pool available %lld us after the primary connection was lost\n", (long long) failover_us);
+    TEST_ASSERT_TRUE(failover_us < 1000000);
+
+    TEST_ASSERT_NOT_NULL(session.latest_notify);
+    TEST_ASSERT_EQUAL_STRING("b", session.latest_notify->job_id);
+    TEST_ASSERT_EQUAL_STRING("e8f2a1b4", session.extranonce_str);
+    TEST_ASSERT_EQUAL(8, session.extranonce_2_len);
+    TEST_ASSERT_EQUAL(2048, session.difficulty);
+    TEST_ASSERT_EQUAL_HEX32(0x1fffe000, session.version_mask);
+    TEST_ASSERT_EQUAL(5, session.send_uid);
+    TEST_ASSERT_FALSE(stratum_standby_ready(&standby));
+    TEST_ASSERT_FALSE(stratum_standby_poll(&standby, 0));
+
+    // the rest of the line arrives on the adopted connection
+    stratum_test_pool_send(fallback, msg + len - 20);
+    const char * line = STRATUM_V1_receive_jsonrpc_line(&receive_buffer, session.socket);
+    TEST_ASSERT_NOT_NULL(line);
+    StratumApiV1Message message = {0};
+    STRATUM_V1_parse(&message, line);
+    TEST_ASSERT_EQUAL(MINING_NOTIFY, message.method);
+    TEST_ASSERT_EQUAL_STRING("c", message.mining_notification->job_id);
+
+    STRATUM_V1_free_mining_notify(message.mining_notification);
+    STRATUM_V1_free_mining_notify(session.latest_notify);
+    free(session.extranonce_str);
+    close(session.socket);
+    stratum_standby_free(&standby);
+    close(primary);
+    close(fallback);
+    close(primary_listener);
+    close(fallback_listener);
+    line_buffer_free(&receive_buffer);
+}
+
+TEST_CASE("Stratum standby is not ready before a job or after the pool left", "[stratum_standby]")
+{
+    uint16_t port;
+    int listener = stratum_test_pool_listen(&port, 1);
+
+    line_buffer receive_buffer;
+    TEST_ASSERT_TRUE(line_buffer_init(&receive_buffer, STRATUM_LINE_BUFFER_SIZE));
+    stratum_standby standby;
+    TEST_ASSERT_TRUE(stratum_standby_init(&standby));
+    TEST_ASSERT_TRUE(stratum_standby_connect(&standby, "127.0.0.1", port, false, "user", "x", "BM1366", 1000, 5000));
+    int pool = pool_accept_standby(listener);
+
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(stratum_standby_poll(&standby, 20));
+    }
+    stratum_standby_session session;
+    TEST_ASSERT_FALSE(stratum_standby_ready(&standby));
+    TEST_ASSERT_FALSE(stratum_standby_take(&standby, &session, &receive_buffer));
+
+    char msg[512];
+    notify(msg, "a");
+    stratum_test_pool_send(pool, msg);
+    poll_until_ready(&standby);
+
+    close(pool);
+    bool connected = true;
+    for (int i = 0; i < 50 && connected; i++) {
+        connected = stratum_standby_poll(&standby, 100);
+    }
+    TEST_ASSERT_FALSE(connected);
+    TEST_ASSERT_FALSE(stratum_standby_ready(&standby));
+    TEST_ASSERT_FALSE(stratum_standby_take(&standby, &session, &receive_buffer));
+
+    stratum_standby_free(&standby);
+    line_buffer_free(&receive_buffer);
+    close(listener);
+}
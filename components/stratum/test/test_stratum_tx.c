@@ -0,0 +1,252 @@
+#include "unity.h"
+#include "stratum_tx.h"
+#include "esp_netif.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include <stdio.h>
+#include <string.h>
+
+// Connected TCP pair over loopback, the tx side writes into sockets[0]
+static void open_connection(int sockets[2])
+{
+    esp_netif_init();
+
+    int listener = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    TEST_ASSERT_TRUE(listener >= 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = 0,
+    };
+    socklen_t addr_len = sizeof(addr);
+    TEST_ASSERT_EQUAL(0, bind(listener, (struct sockaddr *) &addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL(0, listen(listener, 1));
+    TEST_ASSERT_EQUAL(0, getsockname(listener, (struct sockaddr *) &addr, &addr_len));
+
+    sockets[0] = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    TEST_ASSERT_EQUAL(0, connect(sockets[0], (struct sockaddr *) &addr, sizeof(addr)));
+    sockets[1] = accept(listener, NULL, NULL);
+    TEST_ASSERT_TRUE(sockets[1] >= 0);
+    close(listener);
+}
+
+static void close_connection(int sockets[2])
+{
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+static void receive_exactly(int socket, char * dest, size_t len)
+{
+    size_t received = 0;
+    while (received < len) {
+        int n = recv(socket, dest + received, len - received, 0);
+        TEST_ASSERT_TRUE(n > 0);
+        received += n;
+    }
+    dest[len] = '\0';
+}
+
+TEST_CASE("Stratum TX coalesces queued messages into one send", "[stratum_tx]")
+{
+    int sockets[2];
+    open_connection(sockets);
+    stratum_tx tx;
+    TEST_ASSERT_TRUE(stratum_tx_init(&tx, 1024));
+    stratum_tx_set_socket(&tx, sockets[0]);
+
+    char expected[256] = "";
+    for (int i = 0; i < 5; i++) {
+        char msg[64];
+        int len = sprintf(msg, "{\"id\": %d, \"method\": \"mining.submit\"}\n", i);
+        TEST_ASSERT_EQUAL(len, stratum_tx_enqueue(&tx, msg, len));
+        strcat(expected, msg);
+    }
+
+    TEST_ASSERT_TRUE(stratum_tx_flush(&tx));
+    stratum_tx_stats stats;
+    stratum_tx_get_stats(&tx, &stats);
+    TEST_ASSERT_EQUAL(5, stats.messages);
+    TEST_ASSERT_EQUAL(1, stats.sends);
+    TEST_ASSERT_EQUAL(0, stats.queued);
+    TEST_ASSERT_TRUE(stats.latency_max_us >= stats.latency_avg_us);
+
+    char received[256];
+    receive_exactly(sockets[1], received, strlen(expected));
+    TEST_ASSERT_EQUAL_STRING(expected, received);
+
+    stratum_tx_free(&tx);
+    close_connection(sockets);
+}
+
+TEST_CASE("Stratum TX rejects messages without socket or space", "[stratum_tx]")
+{
+    int sockets[2];
+    open_connection(sockets);
+    stratum_tx tx;
+    TEST_ASSERT_FALSE(stratum_tx_init(&tx, 1000));
+    TEST_ASSERT_TRUE(stratum_tx_init(&tx, 64));
+
+    TEST_ASSERT_EQUAL(-1, stratum_tx_enqueue(&tx, "{}\n", 3));
+    TEST_ASSERT_EQUAL(ENOTCONN, errno);
+
+    stratum_tx_set_socket(&tx, sockets[0]);
+    const char msg[] = "{\"id\": 1, \"method\": \"x\"}\n";
+    TEST_ASSERT_EQUAL(sizeof(msg) - 1, stratum_tx_enqueue(&tx, msg, sizeof(msg) - 1));
+    TEST_ASSERT_EQUAL(sizeof(msg) - 1, stratum_tx_enqueue(&tx, msg, sizeof(msg) - 1));
+    TEST_ASSERT_EQUAL(-1, stratum_tx_enqueue(&tx, msg, sizeof(msg) - 1));
+    TEST_ASSERT_EQUAL(ENOBUFS, errno);
+
+    stratum_tx_stats stats;
+    stratum_tx_get_stats(&tx, &stats);
+    TEST_ASSERT_EQUAL(1, stats.dropped);
+    TEST_ASSERT_EQUAL(2 * (sizeof(msg) - 1), stats.queued);
+
+    // a new connection starts empty
+    stratum_tx_set_socket(&tx, sockets[0]);
+    stratum_tx_get_stats(&tx, &stats);
+    TEST_ASSERT_EQUAL(0, stats.queued);
+
+    stratum_tx_free(&tx);
+    close_connection(sockets);
+}
+
+TEST_CASE("Stratum TX keeps messages intact across wrap around", "[stratum_tx]")
+{
+    int sockets[2];
+    open_connection(sockets);
+    stratum_tx tx;
+    TEST_ASSERT_TRUE(stratum_tx_init(&tx, 64));
+    stratum_tx_set_socket(&tx, sockets[0]);
+
+    for (int i = 0; i < 50; i++) {
+        char msg[32], received[32];
+        int len = sprintf(msg, "{\"id\": %d, \"m\": \"%.*s\"}\n", i, i % 9, "abcdefghi");
+        TEST_ASSERT_EQUAL(len, stratum_tx_enqueue(&tx, msg, len));
+        TEST_ASSERT_TRUE(stratum_tx_flush(&tx));
+        receive_exactly(sockets[1], received, len);
+        TEST_ASSERT_EQUAL_STRING(msg, received);
+    }
+
+    stratum_tx_stats stats;
+    stratum_tx_get_stats(&tx, &stats);
+    TEST_ASSERT_EQUAL(50, stats.messages);
+    // messages crossing the end of the buffer take two sends
+    TEST_ASSERT_TRUE(stats.sends > 50);
+
+    stratum_tx_free(&tx);
+    close_connection(sockets);
+}
+
+TEST_CASE("Stratum TX drops the queue when the socket fails", "[stratum_tx]")
+{
+    int sockets[2];
+    open_connection(sockets);
+    stratum_tx tx;
+    TEST_ASSERT_TRUE(stratum_tx_init(&tx, 256));
+    stratum_tx_set_socket(&tx, sockets[0]);
+
+    shutdown(sockets[0], SHUT_WR);
+    TEST_ASSERT_EQUAL(3, stratum_tx_enqueue(&tx, "{}\n", 3));
+    TEST_ASSERT_FALSE(stratum_tx_flush(&tx));
+
+    stratum_tx_stats stats;
+    stratum_tx_get_stats(&tx, &stats);
+    TEST_ASSERT_EQUAL(0, stats.queued);
+    TEST_ASSERT_EQUAL(0, stats.messages);
+
+    stratum_tx_free(&tx);
+    close_connection(sockets);
+}
+
+#define PRODUCER_MESSAGES 500
+
+static struct
+{
+    stratum_tx tx;
+    SemaphoreHandle_t done;
+    volatile bool stop;
+} concurrent;
+
+static void tx_writer(void * pvParameters)
+{
+    while (!concurrent.stop) {
+        stratum_tx_wait(&concurrent.tx);
+        stratum_tx_flush(&concurrent.tx);
+    }
+    xSemaphoreGive(concurrent.done);
+    vTaskDelete(NULL);
+}
+
+static void tx_producer(void * pvParameters)
+{
+    int producer = (int) (intptr_t) pvParameters;
+    for (int i = 0; i < PRODUCER_MESSAGES; i++) {
+        char msg[64];
+        int len = sprintf(msg, "{\"id\": %d, \"producer\": %d, \"pad\": \"%.*s\"}\n", i, producer, i % 17, "xxxxxxxxxxxxxxxxx");
+        // backpressure is up to the caller, retry like a setup message would
+        while (stratum_tx_enqueue(&concurrent.tx, msg, len) < 0) {
+            vTaskDelay(1);
+        }
+    }
+    xSemaphoreGive(concurrent.done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Stratum TX writer interleaves whole messages from several tasks", "[stratum_tx]")
+{
+    int sockets[2];
+    open_connection(sockets);
+    memset(&concurrent, 0, sizeof(concurrent));
+    TEST_ASSERT_TRUE(stratum_tx_init(&concurrent.tx, 512));
+    stratum_tx_set_socket(&concurrent.tx, sockets[0]);
+    concurrent.done = xSemaphoreCreateCounting(3, 0);
+
+    xTaskCreate(tx_writer, "tx writer", 4096, NULL, uxTaskPriorityGet(NULL), NULL);
+    xTaskCreate(tx_producer, "tx producer 0", 4096, (void *) 0, uxTaskPriorityGet(NULL), NULL);
+    xTaskCreate(tx_producer, "tx producer 1", 4096, (void *) 1, uxTaskPriorityGet(NULL), NULL);
+
+    // every line is complete and each producer's lines arrive in order
+    int next_id[2] = {0, 0};
+    char line[128];
+    size_t line_len = 0;
+    while (next_id[0] < PRODUCER_MESSAGES || next_id[1] < PRODUCER_MESSAGES) {
+        char c;
+        TEST_ASSERT_EQUAL(1, recv(sockets[1], &c, 1, 0));
+        if (c != '\n') {
+            TEST_ASSERT_TRUE(line_len < sizeof(line) - 1);
+            line[line_len++] = c;
+            continue;
+        }
+        line[line_len] = '\0';
+        line_len = 0;
+
+        int id, producer, pad_start;
+        TEST_ASSERT_EQUAL(2, sscanf(line, "{\"id\": %d, \"producer\": %d, \"pad\": \"%n", &id, &producer, &pad_start));
+        TEST_ASSERT_TRUE(producer == 0 || producer == 1);
+        TEST_ASSERT_EQUAL(next_id[producer], id);
+        TEST_ASSERT_EQUAL(id % 17, strspn(line + pad_start, "x"));
+        TEST_ASSERT_EQUAL_STRING("\"}", line + pad_start + id % 17);
+        next_id[producer]++;
+    }
+    xSemaphoreTake(concurrent.done, portMAX_DELAY);
+    xSemaphoreTake(concurrent.done, portMAX_DELAY);
+
+    stratum_tx_stats stats;
+    stratum_tx_get_stats(&concurrent.tx, &stats);
+    printf("%lu messages in %lu sends, %lu rejected while full, avg latency %lld us, max %lld us\n",
+           (unsigned long) stats.messages, (unsigned long) stats.sends, (unsigned long) stats.dropped,
+           (long long) stats.latency_avg_us, (long long) stats.latency_max_us);
+    TEST_ASSERT_EQUAL(2 * PRODUCER_MESSAGES, stats.messages);
+
+    // wake the writer with an empty line so it sees the stop flag
+    concurrent.stop = true;
+    TEST_ASSERT_EQUAL(1, stratum_tx_enqueue(&concurrent.tx, "\n", 1));
+    xSemaphoreTake(concurrent.done, portMAX_DELAY);
+
+    stratum_tx_free(&concurrent.tx);
+    vSemaphoreDelete(concurrent.done);
+    close_connection(sockets);
+}
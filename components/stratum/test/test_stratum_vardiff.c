@@ -0,0 +1,49 @@
+#include "unity.h"
+#include "stratum_vardiff.h"
+
+#define MINUTE_US (60 * 1000000LL)
+
+TEST_CASE("Stratum vardiff sizes the difficulty for the share rate", "[stratum_vardiff]")
+{
+    stratum_vardiff vardiff;
+    stratum_vardiff_init(&vardiff, 6, 1000);
+
+    // 500 GH/s, 6 shares per minute: 500e9 * 60 / (6 * 2^32)
+    TEST_ASSERT_EQUAL(1164, stratum_vardiff_difficulty(&vardiff, 500));
+    TEST_ASSERT_EQUAL(2794, stratum_vardiff_difficulty(&vardiff, 1200));
+    // a small device still gets at least difficulty 1
+    TEST_ASSERT_EQUAL(1, stratum_vardiff_difficulty(&vardiff, 0.1));
+    // unknown hashrate
+    TEST_ASSERT_EQUAL(1000, stratum_vardiff_difficulty(&vardiff, 0));
+
+    stratum_vardiff_init(&vardiff, 0, 1000);
+    TEST_ASSERT_EQUAL(1000, stratum_vardiff_difficulty(&vardiff, 500));
+}
+
+TEST_CASE("Stratum vardiff suggests again when the hashrate changes materially", "[stratum_vardiff]")
+{
+    stratum_vardiff vardiff;
+    stratum_vardiff_init(&vardiff, 6, 1000);
+    int64_t now = 10 * MINUTE_US;
+    uint32_t difficulty = 0;
+
+    TEST_ASSERT_TRUE(stratum_vardiff_update(&vardiff, 500, now, &difficulty));
+    TEST_ASSERT_EQUAL(1164, difficulty);
+
+    // noise in the measured hashrate
+    now += 5 * MINUTE_US;
+    TEST_ASSERT_FALSE(stratum_vardiff_update(&vardiff, 560, now, &difficulty));
+    TEST_ASSERT_FALSE(stratum_vardiff_update(&vardiff, 420, now, &difficulty));
+
+    // a frequency change, not right after the last suggestion
+    TEST_ASSERT_TRUE(stratum_vardiff_update(&vardiff, 700, now, &difficulty));
+    TEST_ASSERT_EQUAL(1630, difficulty);
+    TEST_ASSERT_FALSE(stratum_vardiff_update(&vardiff, 350, now + MINUTE_US, &difficulty));
+    TEST_ASSERT_TRUE(stratum_vardiff_update(&vardiff, 350, now + 3 * MINUTE_US, &difficulty));
+    TEST_ASSERT_EQUAL(815, difficulty);
+
+    // a new connection gets the current difficulty right away
+    stratum_vardiff_reset(&vardiff);
+    TEST_ASSERT_TRUE(stratum_vardiff_update(&vardiff, 350, now + 3 * MINUTE_US, &difficulty));
+    TEST_ASSERT_EQUAL(815, difficulty);
+}
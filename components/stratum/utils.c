@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "mbedtls/sha256.h"
+#include "sha256.h"
 
 
 #if defined(__GNUC__) || defined(__clang__)
@@ -94,15 +95,12 @@ size_t bin2hex(const uint8_t *restrict bin, size_t bin_len, char *restrict hex,
     return bin_len * 2;
 }
 
-uint8_t *double_sha256_bin(const uint8_t *data, const size_t data_len) {
+void double_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest) {
 	
     uint8_t first_hash_output[32];
-	uint8_t *second_hash_output = malloc(32);
 
     mbedtls_sha256(data, data_len, first_hash_output, 0);
-    mbedtls_sha256(first_hash_output, 32, second_hash_output, 0);
-
-    return second_hash_output;
+    mbedtls_sha256(first_hash_output, 32, dest, 0);
 }
 
 void single_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest) {
@@ -123,14 +121,10 @@ void single_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest
 
 void midstate_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest) {
 	
-    mbedtls_sha256_context midstate;
-
-    // Calculate midstate
-    mbedtls_sha256_init(&midstate);
-    mbedtls_sha256_starts(&midstate, 0);
-    mbedtls_sha256_update(&midstate, data, 64);
-
-    flip32bytes(dest, midstate.state);
+    // the ASIC takes the state words in memory order
+    uint8_t midstate[32];
+    sha256_midstate(data, midstate);
+    flip32bytes(dest, midstate);
 }
 
 void swap_endian_words(const char *hex_words, uint8_t *output) {
@@ -0,0 +1,108 @@
+#ifndef SV2_CLIENT_H_
+#define SV2_CLIENT_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "stratum_api.h"
+#include "stratum_tx.h"
+#include "sv2_noise.h"
+#include "sv2_protocol.h"
+
+// future jobs kept until the SetNewPrevHash that activates them
+#define SV2_CLIENT_MAX_JOBS 8
+// largest message the client sends, a SetupConnection with long strings
+#define SV2_CLIENT_MAX_FRAME 1024
+
+// An encrypted Stratum V2 mining connection with a single channel. Its messages are handed out as
+// StratumApiV1Message so the session loop treats both protocols alike, jobs become mining_notify.
+typedef struct
+{
+    // the x-only authority key the pool's certificate has to be signed with
+    const uint8_t * authority_key;
+    // the endpoint as configured, for SetupConnection
+    const char * host;
+    uint16_t port;
+    const char * user;
+    // the device
+    const char * vendor;
+    const char * hardware_version;
+    const char * firmware;
+    // announced in the channel request, the pool picks the initial target from it
+    float nominal_hashrate;
+    uint32_t difficulty;
+    // extended channels hand out the coinbase and leave the merkle root to the miner,
+    // standard channels send header-only jobs with the merkle root
+    bool extended;
+    // unix time to check the certificate against, 0 while unknown
+    uint32_t now;
+} sv2_client_config;
+
+typedef struct
+{
+    uint32_t job_id;
+    // built without the prev hash, nbits and ntime of the tip it is mined on
+    mining_notify * notify;
+    size_t notify_size;
+    bool has_min_ntime;
+} sv2_job;
+
+typedef struct
+{
+    int sock;
+    // the writer task sends the encrypted frames in the order they were encrypted in
+    stratum_tx * tx;
+    sv2_noise noise;
+    // held while encrypting and enqueueing a frame, the nonces must reach the pool in order
+    pthread_mutex_t send_lock;
+    uint8_t send_frame[SV2_CLIENT_MAX_FRAME];
+    uint8_t send_encrypted[SV2_NOISE_HEADER_SIZE + SV2_CLIENT_MAX_FRAME + SV2_NOISE_MAC_SIZE];
+    uint8_t * receive_buffer;
+
+    bool extended;
+    uint32_t channel_id;
+    uint8_t extranonce_prefix[SV2_MAX_EXTRANONCE_SIZE];
+    size_t extranonce_prefix_len;
+    size_t extranonce_size;
+    uint32_t difficulty;
+
+    sv2_job jobs[SV2_CLIENT_MAX_JOBS];
+    // the chain tip of the last SetNewPrevHash
+    bool has_prev_hash;
+    uint8_t prev_hash[32];
+    uint32_t min_ntime;
+    uint32_t nbits;
+
+    // messages produced by the channel setup or a batch acknowledgement, handed out before reading more
+    bool pending_difficulty;
+    bool pending_version_mask;
+    bool pending_extranonce;
+    // SubmitShares.Success covers every sequence number up to last_sequence_number
+    uint32_t acked_sequence;
+    uint32_t acked_until;
+} sv2_client;
+
+bool sv2_client_init(sv2_client * client, stratum_tx * tx);
+void sv2_client_free(sv2_client * client);
+
+/// @brief Runs the handshake, SetupConnection and opens the channel on a connected socket.
+/// The caller hands the socket to tx afterwards, nothing is enqueued before.
+bool sv2_client_connect(sv2_client * client, int sock, const sv2_client_config * config);
+
+/// @brief Drops the state of the connection, the jobs it still holds are freed.
+void sv2_client_disconnect(sv2_client * client);
+
+/// @brief Blocks until the next message that matters to the session loop.
+/// MINING_NOTIFY, MINING_SET_DIFFICULTY, MINING_SET_VERSION_MASK, MINING_SET_EXTRANONCE and CLIENT_RECONNECT
+/// are filled in like the V1 parser does, share results come as STRATUM_RESULT with the sequence number as id.
+/// @return false if the connection failed or the pool closed the channel
+bool sv2_client_receive(sv2_client * client, StratumApiV1Message * message);
+
+/// @brief Queues SubmitShares on the channel, thread safe.
+/// @param extranonce_2 hex, only used on extended channels
+/// @param version the full rolled version, not just the rolled bits as in V1
+/// @return like stratum_tx_enqueue()
+int sv2_client_submit_share(sv2_client * client, uint32_t sequence_number, const char * job_id, const char * extranonce_2,
+                            uint32_t ntime, uint32_t nonce, uint32_t version);
+
+#endif /* SV2_CLIENT_H_ */
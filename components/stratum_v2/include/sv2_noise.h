@@ -0,0 +1,104 @@
+#ifndef SV2_NOISE_H_
+#define SV2_NOISE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sv2_protocol.h"
+
+// Noise_NX_Secp256k1+EllSwift_ChaChaPoly_SHA256, the handshake and transport encryption of Stratum V2.
+// The pool proves its static key with a certificate signed by its authority key, the miner stays anonymous.
+
+#define SV2_NOISE_KEY_SIZE 32
+// public keys travel ElligatorSwift encoded (BIP324), indistinguishable from random bytes
+#define SV2_NOISE_ELLSWIFT_SIZE 64
+#define SV2_NOISE_MAC_SIZE 16
+// version U16, valid_from U32, not_valid_after U32, BIP340 signature
+#define SV2_NOISE_CERT_SIZE 74
+#define SV2_NOISE_ACT1_SIZE SV2_NOISE_ELLSWIFT_SIZE
+#define SV2_NOISE_ACT2_SIZE                                                                                  \
+    (SV2_NOISE_ELLSWIFT_SIZE + SV2_NOISE_ELLSWIFT_SIZE + SV2_NOISE_MAC_SIZE + SV2_NOISE_CERT_SIZE + SV2_NOISE_MAC_SIZE)
+// largest encrypted chunk including its MAC, longer payloads are split
+#define SV2_NOISE_MAX_CHUNK 65535
+#define SV2_NOISE_HEADER_SIZE (SV2_HEADER_SIZE + SV2_NOISE_MAC_SIZE)
+
+typedef enum
+{
+    SV2_NOISE_OK,
+    SV2_NOISE_ERR_CRYPTO,
+    SV2_NOISE_ERR_DECRYPT,
+    SV2_NOISE_ERR_CERT_SIGNATURE,
+    SV2_NOISE_ERR_CERT_EXPIRED,
+} sv2_noise_result;
+
+typedef struct
+{
+    uint8_t key[SV2_NOISE_KEY_SIZE];
+    uint64_t nonce;
+} sv2_cipher;
+
+typedef struct
+{
+    // symmetric state of the handshake
+    uint8_t h[32];
+    uint8_t ck[32];
+    sv2_cipher handshake;
+    bool has_key;
+
+    uint8_t e_secret[SV2_NOISE_KEY_SIZE];
+    uint8_t e_ellswift[SV2_NOISE_ELLSWIFT_SIZE];
+    uint8_t re_ellswift[SV2_NOISE_ELLSWIFT_SIZE];
+
+    // transport keys after the handshake
+    sv2_cipher send;
+    sv2_cipher recv;
+} sv2_noise;
+
+/// @brief Starts the handshake as the miner.
+/// @param act1 receives the message for the pool
+bool sv2_noise_initiator_start(sv2_noise * noise, uint8_t * act1);
+
+/// @brief Completes the handshake with the pool's answer and checks its certificate.
+/// @param authority_key x-only public key of the pool's authority
+/// @param now unix time to check the certificate validity against, 0 while the clock isn't set
+sv2_noise_result sv2_noise_initiator_finish(sv2_noise * noise, const uint8_t * act2, const uint8_t * authority_key,
+                                            uint32_t now);
+
+/// @brief The pool side, for testing against a local pool.
+/// @param cert from sv2_noise_sign_certificate() for the x-only key of static_secret
+bool sv2_noise_responder_reply(sv2_noise * noise, const uint8_t * act1, const uint8_t * static_secret, const uint8_t * cert,
+                               uint8_t * act2);
+
+/// @brief Signs the certificate of a pool's static key with the authority's secret key.
+bool sv2_noise_sign_certificate(const uint8_t * authority_secret, const uint8_t * static_key, uint16_t version,
+                                uint32_t valid_from, uint32_t not_valid_after, uint8_t * cert);
+
+/// @brief The BIP340 x-only public key of a secret key.
+bool sv2_noise_public_key(const uint8_t * secret, uint8_t * key);
+
+/// @brief BIP340 signature of a 32-byte message, with zero auxiliary randomness.
+bool sv2_noise_sign(const uint8_t * secret, const uint8_t * msg, uint8_t * sig);
+
+/// @brief Decodes an ElligatorSwift encoded key (BIP324) to its x-only public key.
+bool sv2_noise_ellswift_decode(const uint8_t * encoded, uint8_t * key);
+
+/// @brief The BIP324 x-only ECDH secret of two ElligatorSwift encoded keys.
+/// @param initiator whether secret belongs to ell_initiator rather than ell_responder
+bool sv2_noise_ellswift_xdh(const uint8_t * ell_initiator, const uint8_t * ell_responder, const uint8_t * secret,
+                            bool initiator, uint8_t * shared);
+
+/// @brief Decodes an authority key in the base58check form pools publish, e.g. in stratum2+tcp URLs.
+bool sv2_noise_decode_authority_key(const char * encoded, uint8_t * key);
+
+/// @return the size of a payload of len bytes once encrypted, with a MAC per chunk
+size_t sv2_noise_encrypted_size(size_t len);
+
+/// @brief Encrypts a message, the header and the payload separately as the spec requires.
+/// @param out receives SV2_NOISE_HEADER_SIZE + sv2_noise_encrypted_size(payload length) bytes
+bool sv2_noise_encrypt_frame(sv2_cipher * cipher, const uint8_t * frame, size_t frame_len, uint8_t * out);
+
+/// @brief Decrypts an encrypted header or payload in place.
+/// @return the plaintext length, or -1 if the MAC doesn't match
+int sv2_noise_decrypt(sv2_cipher * cipher, uint8_t * data, size_t len);
+
+#endif /* SV2_NOISE_H_ */
@@ -0,0 +1,125 @@
+#ifndef SV2_PROTOCOL_H_
+#define SV2_PROTOCOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Stratum V2 binary framing. Every message is a 6-byte header, extension_type U16, msg_type U8 and
+// msg_length U24, followed by the payload. All integers are little-endian.
+#define SV2_HEADER_SIZE 6
+// set in extension_type for messages whose payload starts with a channel_id
+#define SV2_CHANNEL_MSG_BIT 0x8000
+// largest payload taken from the pool, a NewExtendedMiningJob with a big coinbase still fits
+#define SV2_MAX_PAYLOAD_SIZE (16 * 1024)
+#define SV2_MAX_MERKLE_PATH 32
+#define SV2_MAX_EXTRANONCE_SIZE 32
+
+#define SV2_PROTOCOL_MINING 0
+#define SV2_PROTOCOL_VERSION 2
+
+// SetupConnection flags of the mining protocol
+#define SV2_SETUP_REQUIRES_STANDARD_JOBS 0x01
+#define SV2_SETUP_REQUIRES_WORK_SELECTION 0x02
+#define SV2_SETUP_REQUIRES_VERSION_ROLLING 0x04
+
+typedef enum
+{
+    SV2_MSG_SETUP_CONNECTION = 0x00,
+    SV2_MSG_SETUP_CONNECTION_SUCCESS = 0x01,
+    SV2_MSG_SETUP_CONNECTION_ERROR = 0x02,
+    SV2_MSG_CHANNEL_ENDPOINT_CHANGED = 0x03,
+    SV2_MSG_RECONNECT = 0x04,
+    SV2_MSG_OPEN_STANDARD_MINING_CHANNEL = 0x10,
+    SV2_MSG_OPEN_STANDARD_MINING_CHANNEL_SUCCESS = 0x11,
+    SV2_MSG_OPEN_MINING_CHANNEL_ERROR = 0x12,
+    SV2_MSG_OPEN_EXTENDED_MINING_CHANNEL = 0x13,
+    SV2_MSG_OPEN_EXTENDED_MINING_CHANNEL_SUCCESS = 0x14,
+    SV2_MSG_NEW_MINING_JOB = 0x15,
+    SV2_MSG_UPDATE_CHANNEL = 0x16,
+    SV2_MSG_UPDATE_CHANNEL_ERROR = 0x17,
+    SV2_MSG_CLOSE_CHANNEL = 0x18,
+    SV2_MSG_SET_EXTRANONCE_PREFIX = 0x19,
+    SV2_MSG_SUBMIT_SHARES_STANDARD = 0x1a,
+    SV2_MSG_SUBMIT_SHARES_EXTENDED = 0x1b,
+    SV2_MSG_SUBMIT_SHARES_SUCCESS = 0x1c,
+    SV2_MSG_SUBMIT_SHARES_ERROR = 0x1d,
+    SV2_MSG_NEW_EXTENDED_MINING_JOB = 0x1f,
+    SV2_MSG_SET_NEW_PREV_HASH = 0x20,
+    SV2_MSG_SET_TARGET = 0x21,
+    // the mining protocol's Reconnect of earlier spec revisions, handled like SV2_MSG_RECONNECT
+    SV2_MSG_MINING_RECONNECT = 0x25,
+} sv2_msg_type;
+
+typedef struct
+{
+    uint16_t extension_type;
+    uint8_t msg_type;
+    uint32_t msg_length;
+} sv2_frame_header;
+
+// Appends to a fixed buffer. Writes past the end set overflow and are dropped, so a message is
+// written without checks and the flag tested once at the end.
+typedef struct
+{
+    uint8_t * data;
+    size_t capacity;
+    size_t len;
+    bool overflow;
+} sv2_writer;
+
+// Reads from a received payload. Reads past the end set error and return zeros.
+typedef struct
+{
+    const uint8_t * data;
+    size_t len;
+    size_t pos;
+    bool error;
+} sv2_reader;
+
+void sv2_writer_init(sv2_writer * writer, uint8_t * data, size_t capacity);
+void sv2_write_u8(sv2_writer * writer, uint8_t value);
+void sv2_write_bool(sv2_writer * writer, bool value);
+void sv2_write_u16(sv2_writer * writer, uint16_t value);
+void sv2_write_u24(sv2_writer * writer, uint32_t value);
+void sv2_write_u32(sv2_writer * writer, uint32_t value);
+void sv2_write_u64(sv2_writer * writer, uint64_t value);
+void sv2_write_f32(sv2_writer * writer, float value);
+void sv2_write_u256(sv2_writer * writer, const uint8_t * value);
+void sv2_write_bytes(sv2_writer * writer, const void * data, size_t len);
+void sv2_write_str0_255(sv2_writer * writer, const char * str);
+void sv2_write_b0_32(sv2_writer * writer, const uint8_t * data, size_t len);
+void sv2_write_b0_64k(sv2_writer * writer, const uint8_t * data, size_t len);
+void sv2_write_option_u32(sv2_writer * writer, bool present, uint32_t value);
+
+/// @brief Starts a message with a header whose length is filled in by sv2_frame_end().
+/// @return the offset of the header
+size_t sv2_frame_begin(sv2_writer * writer, uint8_t msg_type, bool channel_msg);
+
+/// @return false if the message didn't fit
+bool sv2_frame_end(sv2_writer * writer, size_t header_offset);
+
+void sv2_parse_header(const uint8_t * data, sv2_frame_header * header);
+
+void sv2_reader_init(sv2_reader * reader, const uint8_t * data, size_t len);
+uint8_t sv2_read_u8(sv2_reader * reader);
+bool sv2_read_bool(sv2_reader * reader);
+uint16_t sv2_read_u16(sv2_reader * reader);
+uint32_t sv2_read_u32(sv2_reader * reader);
+uint64_t sv2_read_u64(sv2_reader * reader);
+float sv2_read_f32(sv2_reader * reader);
+void sv2_read_u256(sv2_reader * reader, uint8_t * value);
+/// @brief Copies the string, truncated to fit dest_size with the terminator.
+void sv2_read_str0_255(sv2_reader * reader, char * dest, size_t dest_size);
+/// @return the bytes inside the payload, NULL on error
+const uint8_t * sv2_read_b0_32(sv2_reader * reader, size_t * len);
+const uint8_t * sv2_read_b0_64k(sv2_reader * reader, size_t * len);
+uint32_t sv2_read_option_u32(sv2_reader * reader, bool * present);
+
+/// @brief Converts a U256 target to a difficulty, saturating at UINT32_MAX.
+uint32_t sv2_target_to_difficulty(const uint8_t * target);
+
+/// @brief The target of a difficulty, as sent in max_target.
+void sv2_difficulty_to_target(double difficulty, uint8_t * target);
+
+#endif /* SV2_PROTOCOL_H_ */
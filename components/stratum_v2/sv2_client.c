@@ -0,0 +1,667 @@
+#include "sv2_client.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "share_tracker.h"
+#include "utils.h"
+
+static const char * TAG = "sv2_client";
+
+// there is a single channel per connection, opened with this request id
+#define SV2_OPEN_CHANNEL_REQUEST_ID 1
+// extranonce_2 bytes the job creation rolls on extended channels
+#define SV2_MIN_EXTRANONCE_SIZE 4
+// a U32 job id in decimal
+#define SV2_JOB_ID_SIZE 11
+
+bool sv2_client_init(sv2_client * client, stratum_tx * tx)
+{
+    memset(client, 0, sizeof(sv2_client));
+    client->sock = -1;
+    client->tx = tx;
+    client->receive_buffer = malloc(sv2_noise_encrypted_size(SV2_MAX_PAYLOAD_SIZE));
+    if (client->receive_buffer == NULL) {
+        return false;
+    }
+    pthread_mutex_init(&client->send_lock, NULL);
+    return true;
+}
+
+void sv2_client_free(sv2_client * client)
+{
+    sv2_client_disconnect(client);
+    pthread_mutex_destroy(&client->send_lock);
+    free(client->receive_buffer);
+    client->receive_buffer = NULL;
+}
+
+static void free_job(sv2_job * job)
+{
+    STRATUM_V1_free_mining_notify(job->notify);
+    job->notify = NULL;
+}
+
+void sv2_client_disconnect(sv2_client * client)
+{
+    for (int i = 0; i < SV2_CLIENT_MAX_JOBS; i++) {
+        free_job(&client->jobs[i]);
+    }
+    pthread_mutex_lock(&client->send_lock);
+    client->sock = -1;
+    // the keys of a finished session are of no use to anyone
+    memset(&client->noise, 0, sizeof(client->noise));
+    pthread_mutex_unlock(&client->send_lock);
+    client->has_prev_hash = false;
+    client->pending_difficulty = false;
+    client->pending_version_mask = false;
+    client->pending_extranonce = false;
+    client->acked_sequence = 0;
+    client->acked_until = 0;
+}
+
+static bool send_all(int sock, const uint8_t * data, size_t len)
+{
+    while (len > 0) {
+        int sent = send(sock, data, len, 0);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+static bool recv_all(int sock, uint8_t * data, size_t len)
+{
+    while (len > 0) {
+        int received = recv(sock, data, len, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        len -= received;
+    }
+    return true;
+}
+
+// send_lock held, encrypts the message in send_frame
+// @return the length of the encrypted frame in send_encrypted, 0 on failure
+static size_t encrypt_frame(sv2_client * client, sv2_writer * writer, size_t header_offset)
+{
+    if (!sv2_frame_end(writer, header_offset)) {
+        ESP_LOGE(TAG, "Message too long");
+        return 0;
+    }
+    if (!sv2_noise_encrypt_frame(&client->noise.send, client->send_frame, writer->len, client->send_encrypted)) {
+        ESP_LOGE(TAG, "Failed to encrypt message");
+        return 0;
+    }
+    return SV2_NOISE_HEADER_SIZE + sv2_noise_encrypted_size(writer->len - SV2_HEADER_SIZE);
+}
+
+// Reads the next message, its payload is left decrypted at the start of receive_buffer
+static bool receive_frame(sv2_client * client, sv2_frame_header * header)
+{
+    uint8_t * buffer = client->receive_buffer;
+    if (!recv_all(client->sock, buffer, SV2_NOISE_HEADER_SIZE)) {
+        return false;
+    }
+    if (sv2_noise_decrypt(&client->noise.recv, buffer, SV2_NOISE_HEADER_SIZE) != SV2_HEADER_SIZE) {
+        ESP_LOGE(TAG, "Failed to decrypt message header");
+        return false;
+    }
+    sv2_parse_header(buffer, header);
+    if (header->msg_length > SV2_MAX_PAYLOAD_SIZE) {
+        ESP_LOGE(TAG, "Message 0x%02x too long: %lu bytes", header->msg_type, (unsigned long) header->msg_length);
+        return false;
+    }
+
+    size_t encrypted_len = sv2_noise_encrypted_size(header->msg_length);
+    if (!recv_all(client->sock, buffer, encrypted_len)) {
+        return false;
+    }
+    if (sv2_noise_decrypt(&client->noise.recv, buffer, encrypted_len) != (int) header->msg_length) {
+        ESP_LOGE(TAG, "Failed to decrypt message 0x%02x", header->msg_type);
+        return false;
+    }
+    return true;
+}
+
+static bool handshake(sv2_client * client, const sv2_client_config * config)
+{
+    uint8_t act1[SV2_NOISE_ACT1_SIZE];
+    uint8_t act2[SV2_NOISE_ACT2_SIZE];
+    if (!sv2_noise_initiator_start(&client->noise, act1)) {
+        ESP_LOGE(TAG, "Failed to create the handshake key");
+        return false;
+    }
+    if (!send_all(client->sock, act1, sizeof(act1)) || !recv_all(client->sock, act2, sizeof(act2))) {
+        ESP_LOGE(TAG, "Handshake failed (errno %d: %s)", errno, strerror(errno));
+        return false;
+    }
+
+    switch (sv2_noise_initiator_finish(&client->noise, act2, config->authority_key, config->now)) {
+    case SV2_NOISE_OK:
+        return true;
+    case SV2_NOISE_ERR_DECRYPT:
+        ESP_LOGE(TAG, "Handshake failed, the pool's answer doesn't decrypt");
+        return false;
+    case SV2_NOISE_ERR_CERT_SIGNATURE:
+        ESP_LOGE(TAG, "The pool's certificate is not signed by the configured authority key");
+        return false;
+    case SV2_NOISE_ERR_CERT_EXPIRED:
+        ESP_LOGE(TAG, "The pool's certificate is not valid at this time");
+        return false;
+    default:
+        ESP_LOGE(TAG, "Handshake failed");
+        return false;
+    }
+}
+
+// Sends a setup message and waits for its answer, no other messages are expected until the channel is open
+static bool request(sv2_client * client, sv2_writer * writer, size_t header_offset, sv2_frame_header * response)
+{
+    pthread_mutex_lock(&client->send_lock);
+    size_t len = encrypt_frame(client, writer, header_offset);
+    bool sent = len > 0 && send_all(client->sock, client->send_encrypted, len);
+    pthread_mutex_unlock(&client->send_lock);
+    if (!sent) {
+        return false;
+    }
+    return receive_frame(client, response);
+}
+
+static bool setup_connection(sv2_client * client, const sv2_client_config * config)
+{
+    uint32_t flags = SV2_SETUP_REQUIRES_VERSION_ROLLING;
+    if (!config->extended) {
+        flags |= SV2_SETUP_REQUIRES_STANDARD_JOBS;
+    }
+
+    sv2_writer writer;
+    sv2_writer_init(&writer, client->send_frame, sizeof(client->send_frame));
+    size_t header = sv2_frame_begin(&writer, SV2_MSG_SETUP_CONNECTION, false);
+    sv2_write_u8(&writer, SV2_PROTOCOL_MINING);
+    sv2_write_u16(&writer, SV2_PROTOCOL_VERSION);
+    sv2_write_u16(&writer, SV2_PROTOCOL_VERSION);
+    sv2_write_u32(&writer, flags);
+    sv2_write_str0_255(&writer, config->host);
+    sv2_write_u16(&writer, config->port);
+    sv2_write_str0_255(&writer, config->vendor);
+    sv2_write_str0_255(&writer, config->hardware_version);
+    sv2_write_str0_255(&writer, config->firmware);
+    sv2_write_str0_255(&writer, "");
+
+    sv2_frame_header response;
+    if (!request(client, &writer, header, &response)) {
+        return false;
+    }
+
+    sv2_reader reader;
+    sv2_reader_init(&reader, client->receive_buffer, response.msg_length);
+    if (response.msg_type == SV2_MSG_SETUP_CONNECTION_SUCCESS) {
+        uint16_t version = sv2_read_u16(&reader);
+        uint32_t pool_flags = sv2_read_u32(&reader);
+        ESP_LOGI(TAG, "Connection set up, version %u, flags %08lx", version, (unsigned long) pool_flags);
+        return true;
+    }
+    if (response.msg_type == SV2_MSG_SETUP_CONNECTION_ERROR) {
+        char error[64];
+        sv2_read_u32(&reader);
+        sv2_read_str0_255(&reader, error, sizeof(error));
+        ESP_LOGE(TAG, "Pool refused the connection: %s", error);
+        return false;
+    }
+    ESP_LOGE(TAG, "Unexpected message 0x%02x during setup", response.msg_type);
+    return false;
+}
+
+static void set_target(sv2_client * client, const uint8_t * target)
+{
+    client->difficulty = sv2_target_to_difficulty(target);
+    client->pending_difficulty = true;
+}
+
+static bool set_extranonce_prefix(sv2_client * client, const uint8_t * prefix, size_t len)
+{
+    if (prefix == NULL || len + client->extranonce_size > SV2_MAX_EXTRANONCE_SIZE) {
+        ESP_LOGE(TAG, "Invalid extranonce prefix of %u bytes", (unsigned) len);
+        return false;
+    }
+    memcpy(client->extranonce_prefix, prefix, len);
+    client->extranonce_prefix_len = len;
+    // only the coinbase of extended channels holds it, standard jobs come with their merkle root
+    client->pending_extranonce = client->extended;
+    return true;
+}
+
+static bool open_channel(sv2_client * client, const sv2_client_config * config)
+{
+    uint8_t max_target[32];
+    sv2_difficulty_to_target(config->difficulty, max_target);
+
+    sv2_writer writer;
+    sv2_writer_init(&writer, client->send_frame, sizeof(client->send_frame));
+    size_t header = sv2_frame_begin(&writer, config->extended ? SV2_MSG_OPEN_EXTENDED_MINING_CHANNEL
+                                                              : SV2_MSG_OPEN_STANDARD_MINING_CHANNEL, false);
+    sv2_write_u32(&writer, SV2_OPEN_CHANNEL_REQUEST_ID);
+    sv2_write_str0_255(&writer, config->user);
+    sv2_write_f32(&writer, config->nominal_hashrate);
+    sv2_write_u256(&writer, max_target);
+    if (config->extended) {
+        sv2_write_u16(&writer, SV2_MIN_EXTRANONCE_SIZE);
+    }
+
+    sv2_frame_header response;
+    if (!request(client, &writer, header, &response)) {
+        return false;
+    }
+
+    sv2_reader reader;
+    sv2_reader_init(&reader, client->receive_buffer, response.msg_length);
+    uint8_t target[32];
+    const uint8_t * prefix;
+    size_t prefix_len;
+    if (response.msg_type == SV2_MSG_OPEN_STANDARD_MINING_CHANNEL_SUCCESS && !config->extended) {
+        sv2_read_u32(&reader);
+        client->channel_id = sv2_read_u32(&reader);
+        sv2_read_u256(&reader, target);
+        prefix = sv2_read_b0_32(&reader, &prefix_len);
+        client->extranonce_size = 0;
+    } else if (response.msg_type == SV2_MSG_OPEN_EXTENDED_MINING_CHANNEL_SUCCESS && config->extended) {
+        sv2_read_u32(&reader);
+        client->channel_id = sv2_read_u32(&reader);
+        sv2_read_u256(&reader, target);
+        client->extranonce_size = sv2_read_u16(&reader);
+        prefix = sv2_read_b0_32(&reader, &prefix_len);
+        if (client->extranonce_size < SV2_MIN_EXTRANONCE_SIZE) {
+            ESP_LOGE(TAG, "Pool offers %u extranonce bytes, %d needed", (unsigned) client->extranonce_size,
+                     SV2_MIN_EXTRANONCE_SIZE);
+            return false;
+        }
+    } else if (response.msg_type == SV2_MSG_OPEN_MINING_CHANNEL_ERROR) {
+        char error[64];
+        sv2_read_u32(&reader);
+        sv2_read_str0_255(&reader, error, sizeof(error));
+        ESP_LOGE(TAG, "Pool refused to open the channel: %s", error);
+        return false;
+    } else {
+        ESP_LOGE(TAG, "Unexpected message 0x%02x while opening the channel", response.msg_type);
+        return false;
+    }
+    if (reader.error || !set_extranonce_prefix(client, prefix, prefix_len)) {
+        ESP_LOGE(TAG, "Malformed channel setup");
+        return false;
+    }
+
+    client->pending_version_mask = true;
+    set_target(client, target);
+    ESP_LOGI(TAG, "Opened %s channel %lu, difficulty %lu", config->extended ? "extended" : "standard",
+             (unsigned long) client->channel_id, (unsigned long) client->difficulty);
+    return true;
+}
+
+bool sv2_client_connect(sv2_client * client, int sock, const sv2_client_config * config)
+{
+    sv2_client_disconnect(client);
+    client->sock = sock;
+    client->extended = config->extended;
+    return handshake(client, config) && setup_connection(client, config) && open_channel(client, config);
+}
+
+// job_id, coinbase and merkle branches follow the struct in one allocation, like the V1 parser lays it out
+static void layout_notify(mining_notify * notify)
+{
+    notify->merkle_branches = (uint8_t *) (notify + 1);
+    notify->coinbase_1 = notify->merkle_branches + HASH_SIZE * notify->n_merkle_branches;
+    notify->coinbase_2 = notify->coinbase_1 + notify->coinbase_1_len;
+    notify->job_id = (char *) (notify->coinbase_2 + notify->coinbase_2_len);
+}
+
+static mining_notify * alloc_notify(size_t n_merkle_branches, size_t coinbase_1_len, size_t coinbase_2_len, size_t * size)
+{
+    *size = sizeof(mining_notify) + HASH_SIZE * n_merkle_branches + coinbase_1_len + coinbase_2_len + SV2_JOB_ID_SIZE;
+    mining_notify * notify = calloc(1, *size);
+    if (notify == NULL) {
+        return NULL;
+    }
+    notify->n_merkle_branches = n_merkle_branches;
+    notify->coinbase_1_len = coinbase_1_len;
+    notify->coinbase_2_len = coinbase_2_len;
+    layout_notify(notify);
+    return notify;
+}
+
+// A copy of the job on the current chain tip for the session, which takes ownership of it
+static mining_notify * activate_job(sv2_client * client, const sv2_job * job, uint32_t ntime)
+{
+    mining_notify * notify = malloc(job->notify_size);
+    if (notify == NULL) {
+        return NULL;
+    }
+    memcpy(notify, job->notify, job->notify_size);
+    layout_notify(notify);
+    memcpy(notify->prev_block_hash, client->prev_hash, HASH_SIZE);
+    notify->target = client->nbits;
+    notify->ntime = ntime;
+    return notify;
+}
+
+static sv2_job * find_job(sv2_client * client, uint32_t job_id)
+{
+    for (int i = 0; i < SV2_CLIENT_MAX_JOBS; i++) {
+        if (client->jobs[i].notify != NULL && client->jobs[i].job_id == job_id) {
+            return &client->jobs[i];
+        }
+    }
+    return NULL;
+}
+
+// Takes a new job, it is mined right away unless it waits for the next SetNewPrevHash
+static bool add_job(sv2_client * client, sv2_job * job, uint32_t min_ntime, StratumApiV1Message * message)
+{
+    snprintf(job->notify->job_id, SV2_JOB_ID_SIZE, "%lu", (unsigned long) job->job_id);
+
+    if (job->has_min_ntime) {
+        if (!client->has_prev_hash) {
+            ESP_LOGW(TAG, "Job %lu before the first SetNewPrevHash, ignoring it", (unsigned long) job->job_id);
+            free_job(job);
+            return true;
+        }
+        // later jobs on the same tip don't invalidate the earlier ones
+        message->mining_notification = activate_job(client, job, min_ntime);
+        free_job(job);
+        if (message->mining_notification == NULL) {
+            return false;
+        }
+        message->method = MINING_NOTIFY;
+        message->should_abandon_work = 0;
+        return true;
+    }
+
+    // a future job, kept in place of the oldest one
+    sv2_job * slot = &client->jobs[0];
+    for (int i = 0; i < SV2_CLIENT_MAX_JOBS; i++) {
+        if (client->jobs[i].notify == NULL) {
+            slot = &client->jobs[i];
+            break;
+        }
+        if (client->jobs[i].job_id < slot->job_id) {
+            slot = &client->jobs[i];
+        }
+    }
+    free_job(slot);
+    *slot = *job;
+    return true;
+}
+
+static bool new_mining_job(sv2_client * client, sv2_reader * reader, StratumApiV1Message * message)
+{
+    sv2_job job = {0};
+    sv2_read_u32(reader);
+    job.job_id = sv2_read_u32(reader);
+    uint32_t min_ntime = sv2_read_option_u32(reader, &job.has_min_ntime);
+    uint32_t version = sv2_read_u32(reader);
+    size_t merkle_root_len;
+    const uint8_t * merkle_root = sv2_read_b0_32(reader, &merkle_root_len);
+    if (reader->error || merkle_root_len != HASH_SIZE) {
+        ESP_LOGE(TAG, "Malformed NewMiningJob");
+        return false;
+    }
+
+    job.notify = alloc_notify(0, 0, 0, &job.notify_size);
+    if (job.notify == NULL) {
+        return false;
+    }
+    job.notify->version = version;
+    job.notify->header_only = true;
+    memcpy(job.notify->merkle_root, merkle_root, HASH_SIZE);
+    return add_job(client, &job, min_ntime, message);
+}
+
+static bool new_extended_mining_job(sv2_client * client, sv2_reader * reader, StratumApiV1Message * message)
+{
+    sv2_job job = {0};
+    sv2_read_u32(reader);
+    job.job_id = sv2_read_u32(reader);
+    uint32_t min_ntime = sv2_read_option_u32(reader, &job.has_min_ntime);
+    uint32_t version = sv2_read_u32(reader);
+    bool version_rolling_allowed = sv2_read_bool(reader);
+    size_t n_merkle_branches = sv2_read_u8(reader);
+    if (n_merkle_branches > MAX_MERKLE_BRANCHES) {
+        ESP_LOGE(TAG, "Too many Merkle branches: %u", (unsigned) n_merkle_branches);
+        return false;
+    }
+    uint8_t merkle_branches[MAX_MERKLE_BRANCHES][HASH_SIZE];
+    for (size_t i = 0; i < n_merkle_branches; i++) {
+        sv2_read_u256(reader, merkle_branches[i]);
+    }
+    size_t prefix_len, suffix_len;
+    const uint8_t * prefix = sv2_read_b0_64k(reader, &prefix_len);
+    const uint8_t * suffix = sv2_read_b0_64k(reader, &suffix_len);
+    if (reader->error) {
+        ESP_LOGE(TAG, "Malformed NewExtendedMiningJob");
+        return false;
+    }
+    if (!version_rolling_allowed) {
+        ESP_LOGW(TAG, "Job %lu doesn't allow version rolling", (unsigned long) job.job_id);
+    }
+
+    job.notify = alloc_notify(n_merkle_branches, prefix_len, suffix_len, &job.notify_size);
+    if (job.notify == NULL) {
+        return false;
+    }
+    job.notify->version = version;
+    memcpy(job.notify->merkle_branches, merkle_branches, HASH_SIZE * n_merkle_branches);
+    memcpy(job.notify->coinbase_1, prefix, prefix_len);
+    memcpy(job.notify->coinbase_2, suffix, suffix_len);
+    return add_job(client, &job, min_ntime, message);
+}
+
+static bool set_new_prev_hash(sv2_client * client, sv2_reader * reader, StratumApiV1Message * message)
+{
+    sv2_read_u32(reader);
+    uint32_t job_id = sv2_read_u32(reader);
+    sv2_read_u256(reader, client->prev_hash);
+    client->min_ntime = sv2_read_u32(reader);
+    client->nbits = sv2_read_u32(reader);
+    if (reader->error) {
+        ESP_LOGE(TAG, "Malformed SetNewPrevHash");
+        return false;
+    }
+    client->has_prev_hash = true;
+
+    sv2_job * job = find_job(client, job_id);
+    if (job == NULL) {
+        ESP_LOGW(TAG, "SetNewPrevHash for unknown job %lu", (unsigned long) job_id);
+        return true;
+    }
+    message->mining_notification = activate_job(client, job, client->min_ntime);
+    if (message->mining_notification == NULL) {
+        return false;
+    }
+    message->method = MINING_NOTIFY;
+    message->should_abandon_work = 1;
+
+    // jobs from before the activated one were meant for an earlier tip
+    for (int i = 0; i < SV2_CLIENT_MAX_JOBS; i++) {
+        if (client->jobs[i].notify != NULL && client->jobs[i].job_id <= job_id) {
+            free_job(&client->jobs[i]);
+        }
+    }
+    return true;
+}
+
+// @return false if the connection has to be closed
+static bool process_message(sv2_client * client, const sv2_frame_header * header, StratumApiV1Message * message)
+{
+    sv2_reader reader;
+    sv2_reader_init(&reader, client->receive_buffer, header->msg_length);
+
+    switch (header->msg_type) {
+    case SV2_MSG_NEW_MINING_JOB:
+        return new_mining_job(client, &reader, message);
+    case SV2_MSG_NEW_EXTENDED_MINING_JOB:
+        return new_extended_mining_job(client, &reader, message);
+    case SV2_MSG_SET_NEW_PREV_HASH:
+        return set_new_prev_hash(client, &reader, message);
+    case SV2_MSG_SET_TARGET: {
+        uint8_t target[32];
+        sv2_read_u32(&reader);
+        sv2_read_u256(&reader, target);
+        if (!reader.error) {
+            set_target(client, target);
+        }
+        return !reader.error;
+    }
+    case SV2_MSG_SET_EXTRANONCE_PREFIX: {
+        size_t len;
+        sv2_read_u32(&reader);
+        const uint8_t * prefix = sv2_read_b0_32(&reader, &len);
+        return !reader.error && set_extranonce_prefix(client, prefix, len);
+    }
+    case SV2_MSG_SUBMIT_SHARES_SUCCESS: {
+        sv2_read_u32(&reader);
+        uint32_t last_sequence_number = sv2_read_u32(&reader);
+        if (!reader.error && last_sequence_number > client->acked_until) {
+            client->acked_until = last_sequence_number;
+            // older sequence numbers can't be in flight anymore
+            if (client->acked_until - client->acked_sequence > SHARE_TRACKER_SIZE) {
+                client->acked_sequence = client->acked_until - SHARE_TRACKER_SIZE;
+            }
+        }
+        return !reader.error;
+    }
+    case SV2_MSG_SUBMIT_SHARES_ERROR:
+        sv2_read_u32(&reader);
+        message->message_id = sv2_read_u32(&reader);
+        sv2_read_str0_255(&reader, message->error_str, sizeof(message->error_str));
+        message->method = STRATUM_RESULT;
+        message->response_success = false;
+        return !reader.error;
+    case SV2_MSG_RECONNECT:
+    case SV2_MSG_MINING_RECONNECT:
+        message->method = CLIENT_RECONNECT;
+        return true;
+    case SV2_MSG_CLOSE_CHANNEL: {
+        char reason[64];
+        sv2_read_u32(&reader);
+        sv2_read_str0_255(&reader, reason, sizeof(reason));
+        ESP_LOGW(TAG, "Pool closed the channel: %s", reason);
+        return false;
+    }
+    default:
+        ESP_LOGD(TAG, "Ignoring message 0x%02x", header->msg_type);
+        return true;
+    }
+}
+
+// Hands out what the channel setup and the last messages left for the session, one at a time
+static bool take_pending(sv2_client * client, StratumApiV1Message * message)
+{
+    if (client->pending_difficulty) {
+        client->pending_difficulty = false;
+        message->method = MINING_SET_DIFFICULTY;
+        message->new_difficulty = client->difficulty;
+        return true;
+    }
+    if (client->pending_version_mask) {
+        client->pending_version_mask = false;
+        // BIP320 bits, REQUIRES_VERSION_ROLLING makes the pool accept them
+        message->method = MINING_SET_VERSION_MASK;
+        message->version_mask = STRATUM_DEFAULT_VERSION_MASK;
+        return true;
+    }
+    if (client->pending_extranonce) {
+        char * extranonce_str = malloc(client->extranonce_prefix_len * 2 + 1);
+        if (extranonce_str == NULL) {
+            return false;
+        }
+        client->pending_extranonce = false;
+        bin2hex(client->extranonce_prefix, client->extranonce_prefix_len, extranonce_str,
+                client->extranonce_prefix_len * 2 + 1);
+        message->method = MINING_SET_EXTRANONCE;
+        message->extranonce_str = extranonce_str;
+        message->extranonce_2_len = client->extranonce_size;
+        return true;
+    }
+    if (client->acked_sequence < client->acked_until) {
+        message->method = STRATUM_RESULT;
+        message->message_id = ++client->acked_sequence;
+        message->response_success = true;
+        return true;
+    }
+    return false;
+}
+
+bool sv2_client_receive(sv2_client * client, StratumApiV1Message * message)
+{
+    while (1) {
+        message->method = STRATUM_UNKNOWN;
+        message->mining_notification = NULL;
+        message->extranonce_str = NULL;
+        message->error_str[0] = '\0';
+        if (take_pending(client, message)) {
+            return true;
+        }
+
+        sv2_frame_header header;
+        if (!receive_frame(client, &header) || !process_message(client, &header, message)) {
+            return false;
+        }
+        if (message->method != STRATUM_UNKNOWN) {
+            return true;
+        }
+    }
+}
+
+int sv2_client_submit_share(sv2_client * client, uint32_t sequence_number, const char * job_id, const char * extranonce_2,
+                            uint32_t ntime, uint32_t nonce, uint32_t version)
+{
+    pthread_mutex_lock(&client->send_lock);
+    if (client->sock < 0) {
+        // disconnected meanwhile, the keys are gone
+        pthread_mutex_unlock(&client->send_lock);
+        errno = ENOTCONN;
+        return -1;
+    }
+    sv2_writer writer;
+    sv2_writer_init(&writer, client->send_frame, sizeof(client->send_frame));
+    size_t header = sv2_frame_begin(&writer, client->extended ? SV2_MSG_SUBMIT_SHARES_EXTENDED : SV2_MSG_SUBMIT_SHARES_STANDARD,
+                                    true);
+    sv2_write_u32(&writer, client->channel_id);
+    sv2_write_u32(&writer, sequence_number);
+    sv2_write_u32(&writer, strtoul(job_id, NULL, 10));
+    sv2_write_u32(&writer, nonce);
+    sv2_write_u32(&writer, ntime);
+    sv2_write_u32(&writer, version);
+    if (client->extended) {
+        uint8_t extranonce[SV2_MAX_EXTRANONCE_SIZE];
+        sv2_write_b0_32(&writer, extranonce, hex2bin(extranonce_2, extranonce, sizeof(extranonce)));
+    }
+
+    // a frame that doesn't make it into the queue must not use up a nonce, the pool would fail to decrypt the next one
+    uint64_t nonce_before = client->noise.send.nonce;
+    int ret = -1;
+    size_t len = encrypt_frame(client, &writer, header);
+    if (len > 0) {
+        ret = stratum_tx_enqueue(client->tx, (const char *) client->send_encrypted, len);
+    }
+    if (ret < 0) {
+        client->noise.send.nonce = nonce_before;
+    }
+    pthread_mutex_unlock(&client->send_lock);
+    return ret;
+}
@@ -0,0 +1,1051 @@
+#include "sv2_noise.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_random.h"
+#include "mbedtls/bignum.h"
+#include "mbedtls/chachapoly.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/md.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/sha256.h"
+
+static const char * TAG = "sv2_noise";
+
+static const char * PROTOCOL_NAME = "Noise_NX_Secp256k1+EllSwift_ChaChaPoly_SHA256";
+
+// attempts to find an ElligatorSwift encoding, each one succeeds with about 1/4 probability
+#define ELLSWIFT_ENCODE_ATTEMPTS 256
+
+static int fill_random(void * ctx, unsigned char * buf, size_t len)
+{
+    esp_fill_random(buf, len);
+    return 0;
+}
+
+static void sha256_2(const uint8_t * a, size_t a_len, const uint8_t * b, size_t b_len, uint8_t * out)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, a, a_len);
+    mbedtls_sha256_update(&ctx, b, b_len);
+    mbedtls_sha256_finish(&ctx, out);
+    mbedtls_sha256_free(&ctx);
+}
+
+// BIP340 tagged hash of up to three concatenated parts
+static void tagged_hash(const char * tag, const uint8_t * a, size_t a_len, const uint8_t * b, size_t b_len,
+                        const uint8_t * c, size_t c_len, uint8_t * out)
+{
+    uint8_t tag_hash[32];
+    mbedtls_sha256((const uint8_t *) tag, strlen(tag), tag_hash, 0);
+
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, tag_hash, 32);
+    mbedtls_sha256_update(&ctx, tag_hash, 32);
+    mbedtls_sha256_update(&ctx, a, a_len);
+    mbedtls_sha256_update(&ctx, b, b_len);
+    mbedtls_sha256_update(&ctx, c, c_len);
+    mbedtls_sha256_finish(&ctx, out);
+    mbedtls_sha256_free(&ctx);
+}
+
+static void hmac_sha256(const uint8_t * key, const uint8_t * data, size_t len, uint8_t * out)
+{
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), key, 32, data, len, out);
+}
+
+// Noise HKDF with two outputs
+static void hkdf2(const uint8_t * ck, const uint8_t * ikm, size_t ikm_len, uint8_t * out1, uint8_t * out2)
+{
+    uint8_t temp_key[32];
+    uint8_t input[33];
+    hmac_sha256(ck, ikm, ikm_len, temp_key);
+    input[0] = 0x01;
+    hmac_sha256(temp_key, input, 1, out1);
+    memcpy(input, out1, 32);
+    input[32] = 0x02;
+    hmac_sha256(temp_key, input, 33, out2);
+    mbedtls_platform_zeroize(temp_key, sizeof(temp_key));
+}
+
+static void cipher_nonce(uint64_t n, uint8_t * nonce)
+{
+    // 32 bits of zeros followed by the little-endian counter
+    memset(nonce, 0, 4);
+    for (int i = 0; i < 8; i++) {
+        nonce[4 + i] = n >> (8 * i);
+    }
+}
+
+static bool cipher_encrypt(sv2_cipher * cipher, const uint8_t * ad, size_t ad_len, const uint8_t * in, size_t len,
+                           uint8_t * out)
+{
+    uint8_t nonce[12];
+    cipher_nonce(cipher->nonce++, nonce);
+    mbedtls_chachapoly_context ctx;
+    mbedtls_chachapoly_init(&ctx);
+    bool ok = mbedtls_chachapoly_setkey(&ctx, cipher->key) == 0 &&
+              mbedtls_chachapoly_encrypt_and_tag(&ctx, len, nonce, ad, ad_len, in, out, out + len) == 0;
+    mbedtls_chachapoly_free(&ctx);
+    return ok;
+}
+
+// out may be in
+static bool cipher_decrypt(sv2_cipher * cipher, const uint8_t * ad, size_t ad_len, const uint8_t * in, size_t len,
+                           uint8_t * out)
+{
+    if (len < SV2_NOISE_MAC_SIZE) {
+        return false;
+    }
+    uint8_t nonce[12];
+    cipher_nonce(cipher->nonce++, nonce);
+    size_t plain_len = len - SV2_NOISE_MAC_SIZE;
+    mbedtls_chachapoly_context ctx;
+    mbedtls_chachapoly_init(&ctx);
+    bool ok = mbedtls_chachapoly_setkey(&ctx, cipher->key) == 0 &&
+              mbedtls_chachapoly_auth_decrypt(&ctx, plain_len, nonce, ad, ad_len, in + plain_len, in, out) == 0;
+    mbedtls_chachapoly_free(&ctx);
+    return ok;
+}
+
+static void mix_hash(sv2_noise * noise, const uint8_t * data, size_t len)
+{
+    sha256_2(noise->h, 32, data, len, noise->h);
+}
+
+static void mix_key(sv2_noise * noise, const uint8_t * ikm)
+{
+    hkdf2(noise->ck, ikm, 32, noise->ck, noise->handshake.key);
+    noise->handshake.nonce = 0;
+    noise->has_key = true;
+}
+
+// out receives len + SV2_NOISE_MAC_SIZE bytes once a key is mixed in, len bytes before
+static bool encrypt_and_hash(sv2_noise * noise, const uint8_t * plaintext, size_t len, uint8_t * out)
+{
+    if (!noise->has_key) {
+        memcpy(out, plaintext, len);
+        mix_hash(noise, out, len);
+        return true;
+    }
+    if (!cipher_encrypt(&noise->handshake, noise->h, 32, plaintext, len, out)) {
+        return false;
+    }
+    mix_hash(noise, out, len + SV2_NOISE_MAC_SIZE);
+    return true;
+}
+
+static bool decrypt_and_hash(sv2_noise * noise, const uint8_t * ciphertext, size_t len, uint8_t * out)
+{
+    if (!noise->has_key) {
+        memcpy(out, ciphertext, len);
+        mix_hash(noise, ciphertext, len);
+        return true;
+    }
+    uint8_t h[32];
+    memcpy(h, noise->h, 32);
+    mix_hash(noise, ciphertext, len);
+    return cipher_decrypt(&noise->handshake, h, 32, ciphertext, len, out);
+}
+
+static void initialize_symmetric(sv2_noise * noise)
+{
+    memset(noise, 0, sizeof(sv2_noise));
+    // the protocol name is longer than a hash
+    mbedtls_sha256((const uint8_t *) PROTOCOL_NAME, strlen(PROTOCOL_NAME), noise->h, 0);
+    memcpy(noise->ck, noise->h, 32);
+    // empty prologue
+    mix_hash(noise, NULL, 0);
+}
+
+static void split(sv2_noise * noise, bool initiator)
+{
+    uint8_t k1[32], k2[32];
+    hkdf2(noise->ck, NULL, 0, k1, k2);
+    memcpy(initiator ? noise->send.key : noise->recv.key, k1, 32);
+    memcpy(initiator ? noise->recv.key : noise->send.key, k2, 32);
+    noise->send.nonce = 0;
+    noise->recv.nonce = 0;
+    mbedtls_platform_zeroize(k1, sizeof(k1));
+    mbedtls_platform_zeroize(k2, sizeof(k2));
+    mbedtls_platform_zeroize(noise->e_secret, sizeof(noise->e_secret));
+    mbedtls_platform_zeroize(&noise->handshake, sizeof(noise->handshake));
+    mbedtls_platform_zeroize(noise->ck, sizeof(noise->ck));
+}
+
+// secp256k1 group with the constants of the field arithmetic below
+typedef struct
+{
+    mbedtls_ecp_group grp;
+    mbedtls_mpi sqrt_exp; // (p + 1) / 4
+    mbedtls_mpi seven;
+} curve;
+
+static int curve_init(curve * c)
+{
+    int ret;
+    mbedtls_ecp_group_init(&c->grp);
+    mbedtls_mpi_init(&c->sqrt_exp);
+    mbedtls_mpi_init(&c->seven);
+    MBEDTLS_MPI_CHK(mbedtls_ecp_group_load(&c->grp, MBEDTLS_ECP_DP_SECP256K1));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_add_int(&c->sqrt_exp, &c->grp.P, 1));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_shift_r(&c->sqrt_exp, 2));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&c->seven, 7));
+cleanup:
+    return ret;
+}
+
+static void curve_free(curve * c)
+{
+    mbedtls_mpi_free(&c->seven);
+    mbedtls_mpi_free(&c->sqrt_exp);
+    mbedtls_ecp_group_free(&c->grp);
+}
+
+static int fe_mul(curve * c, mbedtls_mpi * r, const mbedtls_mpi * a, const mbedtls_mpi * b)
+{
+    int ret;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mul_mpi(r, a, b));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(r, r, &c->grp.P));
+cleanup:
+    return ret;
+}
+
+static int fe_add(curve * c, mbedtls_mpi * r, const mbedtls_mpi * a, const mbedtls_mpi * b)
+{
+    int ret;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_add_mpi(r, a, b));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(r, r, &c->grp.P));
+cleanup:
+    return ret;
+}
+
+static int fe_sub(curve * c, mbedtls_mpi * r, const mbedtls_mpi * a, const mbedtls_mpi * b)
+{
+    int ret;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(r, a, b));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(r, r, &c->grp.P));
+cleanup:
+    return ret;
+}
+
+static int fe_mul_int(curve * c, mbedtls_mpi * r, const mbedtls_mpi * a, int b)
+{
+    int ret;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mul_int(r, a, b < 0 ? -b : b));
+    if (b < 0) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(r, &c->grp.P, r));
+    }
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(r, r, &c->grp.P));
+cleanup:
+    return ret;
+}
+
+// a / b, b must not be 0
+static int fe_div(curve * c, mbedtls_mpi * r, const mbedtls_mpi * a, const mbedtls_mpi * b)
+{
+    int ret;
+    mbedtls_mpi inv;
+    mbedtls_mpi_init(&inv);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_inv_mod(&inv, b, &c->grp.P));
+    MBEDTLS_MPI_CHK(fe_mul(c, r, a, &inv));
+cleanup:
+    mbedtls_mpi_free(&inv);
+    return ret;
+}
+
+// sets is_square and r to a square root of a, if there is one
+static int fe_sqrt(curve * c, mbedtls_mpi * r, const mbedtls_mpi * a, bool * is_square)
+{
+    int ret;
+    mbedtls_mpi check;
+    mbedtls_mpi_init(&check);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_exp_mod(r, a, &c->sqrt_exp, &c->grp.P, NULL));
+    MBEDTLS_MPI_CHK(fe_mul(c, &check, r, r));
+    *is_square = mbedtls_mpi_cmp_mpi(&check, a) == 0;
+cleanup:
+    mbedtls_mpi_free(&check);
+    return ret;
+}
+
+// x^3 + 7
+static int curve_rhs(curve * c, mbedtls_mpi * r, const mbedtls_mpi * x)
+{
+    int ret;
+    MBEDTLS_MPI_CHK(fe_mul(c, r, x, x));
+    MBEDTLS_MPI_CHK(fe_mul(c, r, r, x));
+    MBEDTLS_MPI_CHK(fe_add(c, r, r, &c->seven));
+cleanup:
+    return ret;
+}
+
+static int is_valid_x(curve * c, const mbedtls_mpi * x, bool * valid)
+{
+    int ret;
+    mbedtls_mpi rhs, root;
+    mbedtls_mpi_init(&rhs);
+    mbedtls_mpi_init(&root);
+    MBEDTLS_MPI_CHK(curve_rhs(c, &rhs, x));
+    MBEDTLS_MPI_CHK(fe_sqrt(c, &root, &rhs, valid));
+cleanup:
+    mbedtls_mpi_free(&root);
+    mbedtls_mpi_free(&rhs);
+    return ret;
+}
+
+// The point with x and an even y, fails if x isn't on the curve
+static int lift_x(curve * c, mbedtls_ecp_point * point, const mbedtls_mpi * x, bool * valid)
+{
+    int ret;
+    mbedtls_mpi rhs, y;
+    mbedtls_mpi_init(&rhs);
+    mbedtls_mpi_init(&y);
+    *valid = false;
+    if (mbedtls_mpi_cmp_mpi(x, &c->grp.P) >= 0) {
+        ret = 0;
+        goto cleanup;
+    }
+    MBEDTLS_MPI_CHK(curve_rhs(c, &rhs, x));
+    MBEDTLS_MPI_CHK(fe_sqrt(c, &y, &rhs, valid));
+    if (!*valid) {
+        goto cleanup;
+    }
+    if (mbedtls_mpi_get_bit(&y, 0)) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(&y, &c->grp.P, &y));
+    }
+
+    uint8_t encoded[65];
+    encoded[0] = 0x04;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(x, encoded + 1, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&y, encoded + 33, 32));
+    MBEDTLS_MPI_CHK(mbedtls_ecp_point_read_binary(&c->grp, point, encoded, sizeof(encoded)));
+cleanup:
+    mbedtls_mpi_free(&y);
+    mbedtls_mpi_free(&rhs);
+    return ret;
+}
+
+// x-only coordinate and y parity of a point
+static int point_xy(curve * c, const mbedtls_ecp_point * point, uint8_t * x, bool * odd_y)
+{
+    uint8_t encoded[65];
+    size_t len;
+    int ret = mbedtls_ecp_point_write_binary(&c->grp, point, MBEDTLS_ECP_PF_UNCOMPRESSED, &len, encoded, sizeof(encoded));
+    if (ret == 0 && len != sizeof(encoded)) {
+        // the point at infinity
+        ret = MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+    }
+    if (ret == 0) {
+        memcpy(x, encoded + 1, 32);
+        if (odd_y != NULL) {
+            *odd_y = encoded[64] & 1;
+        }
+    }
+    return ret;
+}
+
+// XSwiftEC from BIP324, the x coordinate (u, t) encodes
+static int ellswift_decode(curve * c, const uint8_t * encoded, mbedtls_mpi * x)
+{
+    int ret;
+    mbedtls_mpi u, t, gu, t2, X, Y, num, den, tmp, minus_3_sqrt;
+    mbedtls_mpi_init(&u);
+    mbedtls_mpi_init(&t);
+    mbedtls_mpi_init(&gu);
+    mbedtls_mpi_init(&t2);
+    mbedtls_mpi_init(&X);
+    mbedtls_mpi_init(&Y);
+    mbedtls_mpi_init(&num);
+    mbedtls_mpi_init(&den);
+    mbedtls_mpi_init(&tmp);
+    mbedtls_mpi_init(&minus_3_sqrt);
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&u, encoded, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&t, encoded + 32, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&u, &u, &c->grp.P));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&t, &t, &c->grp.P));
+    if (mbedtls_mpi_cmp_int(&u, 0) == 0) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&u, 1));
+    }
+    if (mbedtls_mpi_cmp_int(&t, 0) == 0) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&t, 1));
+    }
+
+    // g(u) = u^3 + 7, t is doubled if g(u) + t^2 is 0
+    MBEDTLS_MPI_CHK(curve_rhs(c, &gu, &u));
+    MBEDTLS_MPI_CHK(fe_mul(c, &t2, &t, &t));
+    MBEDTLS_MPI_CHK(fe_add(c, &tmp, &gu, &t2));
+    if (mbedtls_mpi_cmp_int(&tmp, 0) == 0) {
+        MBEDTLS_MPI_CHK(fe_mul_int(c, &t, &t, 2));
+        MBEDTLS_MPI_CHK(fe_mul(c, &t2, &t, &t));
+    }
+
+    // X = (g(u) - t^2) / 2t, Y = (X + t) / (sqrt(-3) * u)
+    MBEDTLS_MPI_CHK(fe_sub(c, &num, &gu, &t2));
+    MBEDTLS_MPI_CHK(fe_mul_int(c, &den, &t, 2));
+    MBEDTLS_MPI_CHK(fe_div(c, &X, &num, &den));
+
+    bool valid;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_sub_int(&tmp, &c->grp.P, 3));
+    MBEDTLS_MPI_CHK(fe_sqrt(c, &minus_3_sqrt, &tmp, &valid));
+    MBEDTLS_MPI_CHK(fe_add(c, &num, &X, &t));
+    MBEDTLS_MPI_CHK(fe_mul(c, &den, &minus_3_sqrt, &u));
+    MBEDTLS_MPI_CHK(fe_div(c, &Y, &num, &den));
+
+    // the first of x3 = u + 4Y^2, x2 = (-X/Y - u) / 2 and x1 = (X/Y - u) / 2 on the curve
+    MBEDTLS_MPI_CHK(fe_mul(c, &tmp, &Y, &Y));
+    MBEDTLS_MPI_CHK(fe_mul_int(c, &tmp, &tmp, 4));
+    MBEDTLS_MPI_CHK(fe_add(c, x, &u, &tmp));
+    MBEDTLS_MPI_CHK(is_valid_x(c, x, &valid));
+    if (valid) {
+        goto cleanup;
+    }
+    MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&den, 2));
+    MBEDTLS_MPI_CHK(fe_div(c, &tmp, &X, &Y));
+    MBEDTLS_MPI_CHK(fe_mul_int(c, &num, &tmp, -1));
+    MBEDTLS_MPI_CHK(fe_sub(c, &num, &num, &u));
+    MBEDTLS_MPI_CHK(fe_div(c, x, &num, &den));
+    MBEDTLS_MPI_CHK(is_valid_x(c, x, &valid));
+    if (valid) {
+        goto cleanup;
+    }
+    MBEDTLS_MPI_CHK(fe_sub(c, &num, &tmp, &u));
+    MBEDTLS_MPI_CHK(fe_div(c, x, &num, &den));
+
+cleanup:
+    mbedtls_mpi_free(&minus_3_sqrt);
+    mbedtls_mpi_free(&tmp);
+    mbedtls_mpi_free(&den);
+    mbedtls_mpi_free(&num);
+    mbedtls_mpi_free(&Y);
+    mbedtls_mpi_free(&X);
+    mbedtls_mpi_free(&t2);
+    mbedtls_mpi_free(&gu);
+    mbedtls_mpi_free(&t);
+    mbedtls_mpi_free(&u);
+    return ret;
+}
+
+// XSwiftECInv from BIP324, sets found and t so that XSwiftEC(u, t) = x for the given case
+static int ellswift_inverse(curve * c, const mbedtls_mpi * x, const mbedtls_mpi * u, int which, mbedtls_mpi * t, bool * found)
+{
+    int ret;
+    mbedtls_mpi s, v, w, r, gu, tmp, tmp2, minus_3_sqrt;
+    mbedtls_mpi_init(&s);
+    mbedtls_mpi_init(&v);
+    mbedtls_mpi_init(&w);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&gu);
+    mbedtls_mpi_init(&tmp);
+    mbedtls_mpi_init(&tmp2);
+    mbedtls_mpi_init(&minus_3_sqrt);
+    *found = false;
+
+    bool ok;
+    MBEDTLS_MPI_CHK(curve_rhs(c, &gu, u));
+    if ((which & 2) == 0) {
+        // -x - u must not be on the curve
+        MBEDTLS_MPI_CHK(fe_add(c, &tmp, x, u));
+        MBEDTLS_MPI_CHK(fe_mul_int(c, &tmp, &tmp, -1));
+        MBEDTLS_MPI_CHK(is_valid_x(c, &tmp, &ok));
+        if (ok) {
+            goto cleanup;
+        }
+        // s = -g(u) / (u^2 + u*v + v^2)
+        MBEDTLS_MPI_CHK(mbedtls_mpi_copy(&v, x));
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp, u, u));
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp2, u, &v));
+        MBEDTLS_MPI_CHK(fe_add(c, &tmp, &tmp, &tmp2));
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp2, &v, &v));
+        MBEDTLS_MPI_CHK(fe_add(c, &tmp, &tmp, &tmp2));
+        if (mbedtls_mpi_cmp_int(&tmp, 0) == 0) {
+            goto cleanup;
+        }
+        MBEDTLS_MPI_CHK(fe_mul_int(c, &tmp2, &gu, -1));
+        MBEDTLS_MPI_CHK(fe_div(c, &s, &tmp2, &tmp));
+    } else {
+        // s = x - u, r = sqrt(-s * (4 g(u) + 3 s u^2)), v = (r / s - u) / 2
+        MBEDTLS_MPI_CHK(fe_sub(c, &s, x, u));
+        if (mbedtls_mpi_cmp_int(&s, 0) == 0) {
+            goto cleanup;
+        }
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp, u, u));
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp, &tmp, &s));
+        MBEDTLS_MPI_CHK(fe_mul_int(c, &tmp, &tmp, 3));
+        MBEDTLS_MPI_CHK(fe_mul_int(c, &tmp2, &gu, 4));
+        MBEDTLS_MPI_CHK(fe_add(c, &tmp, &tmp, &tmp2));
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp, &tmp, &s));
+        MBEDTLS_MPI_CHK(fe_mul_int(c, &tmp, &tmp, -1));
+        MBEDTLS_MPI_CHK(fe_sqrt(c, &r, &tmp, &ok));
+        if (!ok || ((which & 1) && mbedtls_mpi_cmp_int(&r, 0) == 0)) {
+            goto cleanup;
+        }
+        if (which & 1) {
+            MBEDTLS_MPI_CHK(fe_mul_int(c, &r, &r, -1));
+        }
+        MBEDTLS_MPI_CHK(fe_div(c, &tmp, &r, &s));
+        MBEDTLS_MPI_CHK(fe_sub(c, &tmp, &tmp, u));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&tmp2, 2));
+        MBEDTLS_MPI_CHK(fe_div(c, &v, &tmp, &tmp2));
+    }
+
+    MBEDTLS_MPI_CHK(fe_sqrt(c, &w, &s, &ok));
+    if (!ok) {
+        goto cleanup;
+    }
+
+    // t = +-w * (u * (1 +- sqrt(-3)) / 2 + v)
+    MBEDTLS_MPI_CHK(mbedtls_mpi_sub_int(&tmp, &c->grp.P, 3));
+    MBEDTLS_MPI_CHK(fe_sqrt(c, &minus_3_sqrt, &tmp, &ok));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&tmp, 1));
+    if (which & 1) {
+        MBEDTLS_MPI_CHK(fe_add(c, &tmp, &tmp, &minus_3_sqrt));
+    } else {
+        MBEDTLS_MPI_CHK(fe_sub(c, &tmp, &tmp, &minus_3_sqrt));
+    }
+    MBEDTLS_MPI_CHK(fe_mul(c, &tmp, &tmp, u));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&tmp2, 2));
+    MBEDTLS_MPI_CHK(fe_div(c, &tmp, &tmp, &tmp2));
+    MBEDTLS_MPI_CHK(fe_add(c, &tmp, &tmp, &v));
+    MBEDTLS_MPI_CHK(fe_mul(c, t, &tmp, &w));
+    if ((which & 4) == 0) {
+        MBEDTLS_MPI_CHK(fe_mul_int(c, t, t, -1));
+    }
+    *found = true;
+
+cleanup:
+    mbedtls_mpi_free(&minus_3_sqrt);
+    mbedtls_mpi_free(&tmp2);
+    mbedtls_mpi_free(&tmp);
+    mbedtls_mpi_free(&gu);
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&w);
+    mbedtls_mpi_free(&v);
+    mbedtls_mpi_free(&s);
+    return ret;
+}
+
+// A random ElligatorSwift encoding of the public key of secret
+static int ellswift_create(curve * c, const uint8_t * secret, uint8_t * encoded)
+{
+    int ret;
+    mbedtls_mpi d, x, u, t, decoded;
+    mbedtls_ecp_point point;
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&x);
+    mbedtls_mpi_init(&u);
+    mbedtls_mpi_init(&t);
+    mbedtls_mpi_init(&decoded);
+    mbedtls_ecp_point_init(&point);
+
+    uint8_t x_bytes[32];
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&d, secret, 32));
+    MBEDTLS_MPI_CHK(mbedtls_ecp_mul(&c->grp, &point, &d, &c->grp.G, fill_random, NULL));
+    MBEDTLS_MPI_CHK(point_xy(c, &point, x_bytes, NULL));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&x, x_bytes, 32));
+
+    for (int attempt = 0; attempt < ELLSWIFT_ENCODE_ATTEMPTS; attempt++) {
+        uint8_t random[33];
+        esp_fill_random(random, sizeof(random));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&u, random, 32));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&u, &u, &c->grp.P));
+        if (mbedtls_mpi_cmp_int(&u, 0) == 0) {
+            continue;
+        }
+        bool found;
+        MBEDTLS_MPI_CHK(ellswift_inverse(c, &x, &u, random[32] & 7, &t, &found));
+        if (!found) {
+            continue;
+        }
+        MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&u, encoded, 32));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&t, encoded + 32, 32));
+        // cheap next to the point multiplication, and catches a bad encoding before the pool does
+        MBEDTLS_MPI_CHK(ellswift_decode(c, encoded, &decoded));
+        if (mbedtls_mpi_cmp_mpi(&decoded, &x) == 0) {
+            goto cleanup;
+        }
+    }
+    ret = MBEDTLS_ERR_ECP_RANDOM_FAILED;
+
+cleanup:
+    mbedtls_ecp_point_free(&point);
+    mbedtls_mpi_free(&decoded);
+    mbedtls_mpi_free(&t);
+    mbedtls_mpi_free(&u);
+    mbedtls_mpi_free(&x);
+    mbedtls_mpi_free(&d);
+    return ret;
+}
+
+// BIP324 x-only ECDH, hashed with both encodings, the initiator's first
+static int ellswift_xdh(curve * c, const uint8_t * ell_initiator, const uint8_t * ell_responder, const uint8_t * secret,
+                        bool initiator, uint8_t * shared)
+{
+    int ret;
+    mbedtls_mpi d, x;
+    mbedtls_ecp_point peer, product;
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&x);
+    mbedtls_ecp_point_init(&peer);
+    mbedtls_ecp_point_init(&product);
+
+    bool valid;
+    MBEDTLS_MPI_CHK(ellswift_decode(c, initiator ? ell_responder : ell_initiator, &x));
+    MBEDTLS_MPI_CHK(lift_x(c, &peer, &x, &valid));
+    if (!valid) {
+        ret = MBEDTLS_ERR_ECP_INVALID_KEY;
+        goto cleanup;
+    }
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&d, secret, 32));
+    MBEDTLS_MPI_CHK(mbedtls_ecp_mul(&c->grp, &product, &d, &peer, fill_random, NULL));
+
+    uint8_t x_bytes[32];
+    MBEDTLS_MPI_CHK(point_xy(c, &product, x_bytes, NULL));
+    uint8_t encodings[2 * SV2_NOISE_ELLSWIFT_SIZE];
+    memcpy(encodings, ell_initiator, SV2_NOISE_ELLSWIFT_SIZE);
+    memcpy(encodings + SV2_NOISE_ELLSWIFT_SIZE, ell_responder, SV2_NOISE_ELLSWIFT_SIZE);
+    tagged_hash("bip324_ellswift_xonly_ecdh", encodings, sizeof(encodings), x_bytes, 32, NULL, 0, shared);
+    mbedtls_platform_zeroize(x_bytes, sizeof(x_bytes));
+
+cleanup:
+    mbedtls_ecp_point_free(&product);
+    mbedtls_ecp_point_free(&peer);
+    mbedtls_mpi_free(&x);
+    mbedtls_mpi_free(&d);
+    return ret;
+}
+
+static int generate_secret(curve * c, uint8_t * secret)
+{
+    int ret;
+    mbedtls_mpi d;
+    mbedtls_mpi_init(&d);
+    do {
+        esp_fill_random(secret, 32);
+        MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&d, secret, 32));
+    } while (mbedtls_mpi_cmp_int(&d, 0) == 0 || mbedtls_mpi_cmp_mpi(&d, &c->grp.N) >= 0);
+cleanup:
+    mbedtls_mpi_free(&d);
+    return ret;
+}
+
+// BIP340 verification of a signature over a 32-byte message
+static int schnorr_verify(curve * c, const uint8_t * key, const uint8_t * msg, const uint8_t * sig, bool * valid)
+{
+    int ret;
+    mbedtls_mpi x, r, s, e;
+    mbedtls_ecp_point pub, point_r;
+    mbedtls_mpi_init(&x);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+    mbedtls_mpi_init(&e);
+    mbedtls_ecp_point_init(&pub);
+    mbedtls_ecp_point_init(&point_r);
+    *valid = false;
+
+    bool on_curve;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&x, key, 32));
+    MBEDTLS_MPI_CHK(lift_x(c, &pub, &x, &on_curve));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&r, sig, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&s, sig + 32, 32));
+    if (!on_curve || mbedtls_mpi_cmp_mpi(&r, &c->grp.P) >= 0 || mbedtls_mpi_cmp_mpi(&s, &c->grp.N) >= 0) {
+        goto cleanup;
+    }
+
+    // R = s*G - e*P
+    uint8_t challenge[32];
+    tagged_hash("BIP0340/challenge", sig, 32, key, 32, msg, 32, challenge);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&e, challenge, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&e, &e, &c->grp.N));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(&e, &c->grp.N, &e));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&e, &e, &c->grp.N));
+    MBEDTLS_MPI_CHK(mbedtls_ecp_muladd(&c->grp, &point_r, &s, &c->grp.G, &e, &pub));
+    if (mbedtls_ecp_is_zero(&point_r)) {
+        goto cleanup;
+    }
+
+    uint8_t r_x[32];
+    bool odd_y;
+    MBEDTLS_MPI_CHK(point_xy(c, &point_r, r_x, &odd_y));
+    *valid = !odd_y && memcmp(r_x, sig, 32) == 0;
+
+cleanup:
+    mbedtls_ecp_point_free(&point_r);
+    mbedtls_ecp_point_free(&pub);
+    mbedtls_mpi_free(&e);
+    mbedtls_mpi_free(&s);
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&x);
+    return ret;
+}
+
+// BIP340 signing with zero auxiliary randomness
+static int schnorr_sign(curve * c, const uint8_t * secret, const uint8_t * msg, uint8_t * sig)
+{
+    int ret;
+    mbedtls_mpi d, k, e;
+    mbedtls_ecp_point point;
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&k);
+    mbedtls_mpi_init(&e);
+    mbedtls_ecp_point_init(&point);
+
+    uint8_t pub_x[32], d_bytes[32], t[32], hash[32];
+    bool odd_y;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&d, secret, 32));
+    MBEDTLS_MPI_CHK(mbedtls_ecp_mul(&c->grp, &point, &d, &c->grp.G, fill_random, NULL));
+    MBEDTLS_MPI_CHK(point_xy(c, &point, pub_x, &odd_y));
+    if (odd_y) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(&d, &c->grp.N, &d));
+    }
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&d, d_bytes, 32));
+
+    static const uint8_t aux[32] = {0};
+    tagged_hash("BIP0340/aux", aux, 32, NULL, 0, NULL, 0, hash);
+    for (int i = 0; i < 32; i++) {
+        t[i] = d_bytes[i] ^ hash[i];
+    }
+    tagged_hash("BIP0340/nonce", t, 32, pub_x, 32, msg, 32, hash);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&k, hash, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&k, &k, &c->grp.N));
+    if (mbedtls_mpi_cmp_int(&k, 0) == 0) {
+        ret = MBEDTLS_ERR_ECP_RANDOM_FAILED;
+        goto cleanup;
+    }
+    MBEDTLS_MPI_CHK(mbedtls_ecp_mul(&c->grp, &point, &k, &c->grp.G, fill_random, NULL));
+    MBEDTLS_MPI_CHK(point_xy(c, &point, sig, &odd_y));
+    if (odd_y) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(&k, &c->grp.N, &k));
+    }
+
+    // s = k + e*d
+    tagged_hash("BIP0340/challenge", sig, 32, pub_x, 32, msg, 32, hash);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&e, hash, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&e, &e, &c->grp.N));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mul_mpi(&e, &e, &d));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_add_mpi(&e, &e, &k));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&e, &e, &c->grp.N));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&e, sig + 32, 32));
+
+cleanup:
+    mbedtls_platform_zeroize(d_bytes, sizeof(d_bytes));
+    mbedtls_platform_zeroize(t, sizeof(t));
+    mbedtls_ecp_point_free(&point);
+    mbedtls_mpi_free(&e);
+    mbedtls_mpi_free(&k);
+    mbedtls_mpi_free(&d);
+    return ret;
+}
+
+// The message the certificate signs, the hash of its fields and the pool's x-only static key
+static void certificate_hash(const uint8_t * cert, const uint8_t * static_key, uint8_t * hash)
+{
+    sha256_2(cert, SV2_NOISE_CERT_SIZE - 64, static_key, 32, hash);
+}
+
+bool sv2_noise_initiator_start(sv2_noise * noise, uint8_t * act1)
+{
+    curve c;
+    initialize_symmetric(noise);
+    int ret = curve_init(&c);
+    if (ret == 0) {
+        ret = generate_secret(&c, noise->e_secret);
+    }
+    if (ret == 0) {
+        ret = ellswift_create(&c, noise->e_secret, noise->e_ellswift);
+    }
+    curve_free(&c);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to create the ephemeral key (-0x%04x)", (unsigned) -ret);
+        return false;
+    }
+
+    // -> e
+    memcpy(act1, noise->e_ellswift, SV2_NOISE_ELLSWIFT_SIZE);
+    mix_hash(noise, noise->e_ellswift, SV2_NOISE_ELLSWIFT_SIZE);
+    // empty payload, no key yet
+    mix_hash(noise, NULL, 0);
+    return true;
+}
+
+sv2_noise_result sv2_noise_initiator_finish(sv2_noise * noise, const uint8_t * act2, const uint8_t * authority_key,
+                                            uint32_t now)
+{
+    curve c;
+    uint8_t shared[32];
+    uint8_t rs_ellswift[SV2_NOISE_ELLSWIFT_SIZE];
+    uint8_t cert[SV2_NOISE_CERT_SIZE];
+    sv2_noise_result result = SV2_NOISE_ERR_CRYPTO;
+    mbedtls_mpi rs_x;
+    mbedtls_mpi_init(&rs_x);
+    if (curve_init(&c) != 0) {
+        goto done;
+    }
+
+    // <- e, ee
+    memcpy(noise->re_ellswift, act2, SV2_NOISE_ELLSWIFT_SIZE);
+    mix_hash(noise, noise->re_ellswift, SV2_NOISE_ELLSWIFT_SIZE);
+    if (ellswift_xdh(&c, noise->e_ellswift, noise->re_ellswift, noise->e_secret, true, shared) != 0) {
+        goto done;
+    }
+    mix_key(noise, shared);
+
+    // s, es
+    const uint8_t * encrypted_static = act2 + SV2_NOISE_ELLSWIFT_SIZE;
+    if (!decrypt_and_hash(noise, encrypted_static, SV2_NOISE_ELLSWIFT_SIZE + SV2_NOISE_MAC_SIZE, rs_ellswift)) {
+        result = SV2_NOISE_ERR_DECRYPT;
+        goto done;
+    }
+    if (ellswift_xdh(&c, noise->e_ellswift, rs_ellswift, noise->e_secret, true, shared) != 0) {
+        goto done;
+    }
+    mix_key(noise, shared);
+
+    // the certificate
+    const uint8_t * encrypted_cert = encrypted_static + SV2_NOISE_ELLSWIFT_SIZE + SV2_NOISE_MAC_SIZE;
+    if (!decrypt_and_hash(noise, encrypted_cert, SV2_NOISE_CERT_SIZE + SV2_NOISE_MAC_SIZE, cert)) {
+        result = SV2_NOISE_ERR_DECRYPT;
+        goto done;
+    }
+
+    uint8_t static_key[32], hash[32];
+    bool valid;
+    if (ellswift_decode(&c, rs_ellswift, &rs_x) != 0 || mbedtls_mpi_write_binary(&rs_x, static_key, 32) != 0) {
+        goto done;
+    }
+    certificate_hash(cert, static_key, hash);
+    if (schnorr_verify(&c, authority_key, hash, cert + SV2_NOISE_CERT_SIZE - 64, &valid) != 0) {
+        goto done;
+    }
+    if (!valid) {
+        result = SV2_NOISE_ERR_CERT_SIGNATURE;
+        goto done;
+    }
+    uint32_t valid_from = cert[2] | (cert[3] << 8) | (cert[4] << 16) | ((uint32_t) cert[5] << 24);
+    uint32_t not_valid_after = cert[6] | (cert[7] << 8) | (cert[8] << 16) | ((uint32_t) cert[9] << 24);
+    if (now != 0 && (now < valid_from || now > not_valid_after)) {
+        result = SV2_NOISE_ERR_CERT_EXPIRED;
+        goto done;
+    }
+
+    split(noise, true);
+    result = SV2_NOISE_OK;
+
+done:
+    mbedtls_platform_zeroize(shared, sizeof(shared));
+    mbedtls_mpi_free(&rs_x);
+    curve_free(&c);
+    return result;
+}
+
+bool sv2_noise_responder_reply(sv2_noise * noise, const uint8_t * act1, const uint8_t * static_secret, const uint8_t * cert,
+                               uint8_t * act2)
+{
+    curve c;
+    uint8_t shared[32];
+    uint8_t s_ellswift[SV2_NOISE_ELLSWIFT_SIZE];
+    bool ok = false;
+    initialize_symmetric(noise);
+    if (curve_init(&c) != 0) {
+        goto done;
+    }
+
+    // -> e
+    memcpy(noise->re_ellswift, act1, SV2_NOISE_ELLSWIFT_SIZE);
+    mix_hash(noise, noise->re_ellswift, SV2_NOISE_ELLSWIFT_SIZE);
+    mix_hash(noise, NULL, 0);
+
+    // <- e, ee
+    if (generate_secret(&c, noise->e_secret) != 0 || ellswift_create(&c, noise->e_secret, noise->e_ellswift) != 0 ||
+        ellswift_create(&c, static_secret, s_ellswift) != 0) {
+        goto done;
+    }
+    memcpy(act2, noise->e_ellswift, SV2_NOISE_ELLSWIFT_SIZE);
+    mix_hash(noise, noise->e_ellswift, SV2_NOISE_ELLSWIFT_SIZE);
+    if (ellswift_xdh(&c, noise->re_ellswift, noise->e_ellswift, noise->e_secret, false, shared) != 0) {
+        goto done;
+    }
+    mix_key(noise, shared);
+
+    // s, es
+    uint8_t * out = act2 + SV2_NOISE_ELLSWIFT_SIZE;
+    if (!encrypt_and_hash(noise, s_ellswift, SV2_NOISE_ELLSWIFT_SIZE, out)) {
+        goto done;
+    }
+    if (ellswift_xdh(&c, noise->re_ellswift, s_ellswift, static_secret, false, shared) != 0) {
+        goto done;
+    }
+    mix_key(noise, shared);
+
+    out += SV2_NOISE_ELLSWIFT_SIZE + SV2_NOISE_MAC_SIZE;
+    if (!encrypt_and_hash(noise, cert, SV2_NOISE_CERT_SIZE, out)) {
+        goto done;
+    }
+
+    split(noise, false);
+    ok = true;
+
+done:
+    mbedtls_platform_zeroize(shared, sizeof(shared));
+    curve_free(&c);
+    return ok;
+}
+
+bool sv2_noise_public_key(const uint8_t * secret, uint8_t * key)
+{
+    curve c;
+    mbedtls_mpi d;
+    mbedtls_ecp_point point;
+    mbedtls_mpi_init(&d);
+    mbedtls_ecp_point_init(&point);
+    int ret = curve_init(&c);
+    if (ret == 0) {
+        ret = mbedtls_mpi_read_binary(&d, secret, 32);
+    }
+    if (ret == 0) {
+        ret = mbedtls_ecp_mul(&c.grp, &point, &d, &c.grp.G, fill_random, NULL);
+    }
+    if (ret == 0) {
+        ret = point_xy(&c, &point, key, NULL);
+    }
+    mbedtls_ecp_point_free(&point);
+    mbedtls_mpi_free(&d);
+    curve_free(&c);
+    return ret == 0;
+}
+
+bool sv2_noise_sign(const uint8_t * secret, const uint8_t * msg, uint8_t * sig)
+{
+    curve c;
+    int ret = curve_init(&c);
+    if (ret == 0) {
+        ret = schnorr_sign(&c, secret, msg, sig);
+    }
+    curve_free(&c);
+    return ret == 0;
+}
+
+bool sv2_noise_ellswift_decode(const uint8_t * encoded, uint8_t * key)
+{
+    curve c;
+    mbedtls_mpi x;
+    mbedtls_mpi_init(&x);
+    int ret = curve_init(&c);
+    if (ret == 0) {
+        ret = ellswift_decode(&c, encoded, &x);
+    }
+    if (ret == 0) {
+        ret = mbedtls_mpi_write_binary(&x, key, 32);
+    }
+    mbedtls_mpi_free(&x);
+    curve_free(&c);
+    return ret == 0;
+}
+
+bool sv2_noise_ellswift_xdh(const uint8_t * ell_initiator, const uint8_t * ell_responder, const uint8_t * secret,
+                            bool initiator, uint8_t * shared)
+{
+    curve c;
+    int ret = curve_init(&c);
+    if (ret == 0) {
+        ret = ellswift_xdh(&c, ell_initiator, ell_responder, secret, initiator, shared);
+    }
+    curve_free(&c);
+    return ret == 0;
+}
+
+bool sv2_noise_sign_certificate(const uint8_t * authority_secret, const uint8_t * static_key, uint16_t version,
+                                uint32_t valid_from, uint32_t not_valid_after, uint8_t * cert)
+{
+    sv2_writer writer;
+    sv2_writer_init(&writer, cert, SV2_NOISE_CERT_SIZE);
+    sv2_write_u16(&writer, version);
+    sv2_write_u32(&writer, valid_from);
+    sv2_write_u32(&writer, not_valid_after);
+
+    uint8_t hash[32];
+    certificate_hash(cert, static_key, hash);
+    return sv2_noise_sign(authority_secret, hash, cert + SV2_NOISE_CERT_SIZE - 64);
+}
+
+bool sv2_noise_decode_authority_key(const char * encoded, uint8_t * key)
+{
+    static const char * ALPHABET = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+    // version U16 1, the x-only key and the checksum
+    uint8_t decoded[2 + 32 + 4] = {0};
+
+    size_t len = strlen(encoded);
+    for (size_t i = 0; i < len; i++) {
+        const char * digit = strchr(ALPHABET, encoded[i]);
+        if (digit == NULL) {
+            return false;
+        }
+        // decoded = decoded * 58 + digit, big-endian
+        uint32_t carry = digit - ALPHABET;
+        for (int j = sizeof(decoded) - 1; j >= 0; j--) {
+            carry += decoded[j] * 58;
+            decoded[j] = carry;
+            carry >>= 8;
+        }
+        if (carry != 0) {
+            return false;
+        }
+    }
+
+    uint8_t checksum[32];
+    mbedtls_sha256(decoded, 34, checksum, 0);
+    mbedtls_sha256(checksum, 32, checksum, 0);
+    if (memcmp(checksum, decoded + 34, 4) != 0 || decoded[0] != 1 || decoded[1] != 0) {
+        return false;
+    }
+    memcpy(key, decoded + 2, 32);
+    return true;
+}
+
+size_t sv2_noise_encrypted_size(size_t len)
+{
+    size_t chunk = SV2_NOISE_MAX_CHUNK - SV2_NOISE_MAC_SIZE;
+    return len + SV2_NOISE_MAC_SIZE * ((len + chunk - 1) / chunk);
+}
+
+bool sv2_noise_encrypt_frame(sv2_cipher * cipher, const uint8_t * frame, size_t frame_len, uint8_t * out)
+{
+    if (!cipher_encrypt(cipher, NULL, 0, frame, SV2_HEADER_SIZE, out)) {
+        return false;
+    }
+    out += SV2_NOISE_HEADER_SIZE;
+    const uint8_t * payload = frame + SV2_HEADER_SIZE;
+    size_t remaining = frame_len - SV2_HEADER_SIZE;
+    while (remaining > 0) {
+        size_t chunk = remaining < SV2_NOISE_MAX_CHUNK - SV2_NOISE_MAC_SIZE ? remaining : SV2_NOISE_MAX_CHUNK - SV2_NOISE_MAC_SIZE;
+        if (!cipher_encrypt(cipher, NULL, 0, payload, chunk, out)) {
+            return false;
+        }
+        payload += chunk;
+        out += chunk + SV2_NOISE_MAC_SIZE;
+        remaining -= chunk;
+    }
+    return true;
+}
+
+int sv2_noise_decrypt(sv2_cipher * cipher, uint8_t * data, size_t len)
+{
+    size_t plain_len = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t chunk = len - pos < SV2_NOISE_MAX_CHUNK ? len - pos : SV2_NOISE_MAX_CHUNK;
+        // in place, then moved next to the previous chunk
+        if (!cipher_decrypt(cipher, NULL, 0, data + pos, chunk, data + pos)) {
+            return -1;
+        }
+        memmove(data + plain_len, data + pos, chunk - SV2_NOISE_MAC_SIZE);
+        plain_len += chunk - SV2_NOISE_MAC_SIZE;
+        pos += chunk;
+    }
+    return plain_len;
+}
@@ -0,0 +1,284 @@
+#include "sv2_protocol.h"
+
+#include <math.h>
+#include <string.h>
+
+// difficulty 1, 0xffff * 2^208
+#define SV2_DIFF1_TARGET 0x1.fffep+223
+
+void sv2_writer_init(sv2_writer * writer, uint8_t * data, size_t capacity)
+{
+    writer->data = data;
+    writer->capacity = capacity;
+    writer->len = 0;
+    writer->overflow = false;
+}
+
+void sv2_write_bytes(sv2_writer * writer, const void * data, size_t len)
+{
+    if (writer->overflow || writer->capacity - writer->len < len) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->data + writer->len, data, len);
+    writer->len += len;
+}
+
+static void write_le(sv2_writer * writer, uint64_t value, size_t size)
+{
+    uint8_t bytes[8];
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = value >> (8 * i);
+    }
+    sv2_write_bytes(writer, bytes, size);
+}
+
+void sv2_write_u8(sv2_writer * writer, uint8_t value)
+{
+    write_le(writer, value, 1);
+}
+
+void sv2_write_bool(sv2_writer * writer, bool value)
+{
+    write_le(writer, value ? 1 : 0, 1);
+}
+
+void sv2_write_u16(sv2_writer * writer, uint16_t value)
+{
+    write_le(writer, value, 2);
+}
+
+void sv2_write_u24(sv2_writer * writer, uint32_t value)
+{
+    write_le(writer, value, 3);
+}
+
+void sv2_write_u32(sv2_writer * writer, uint32_t value)
+{
+    write_le(writer, value, 4);
+}
+
+void sv2_write_u64(sv2_writer * writer, uint64_t value)
+{
+    write_le(writer, value, 8);
+}
+
+void sv2_write_f32(sv2_writer * writer, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    write_le(writer, bits, 4);
+}
+
+void sv2_write_u256(sv2_writer * writer, const uint8_t * value)
+{
+    sv2_write_bytes(writer, value, 32);
+}
+
+void sv2_write_str0_255(sv2_writer * writer, const char * str)
+{
+    size_t len = strlen(str);
+    if (len > 255) {
+        writer->overflow = true;
+        return;
+    }
+    sv2_write_u8(writer, len);
+    sv2_write_bytes(writer, str, len);
+}
+
+void sv2_write_b0_32(sv2_writer * writer, const uint8_t * data, size_t len)
+{
+    if (len > 32) {
+        writer->overflow = true;
+        return;
+    }
+    sv2_write_u8(writer, len);
+    sv2_write_bytes(writer, data, len);
+}
+
+void sv2_write_b0_64k(sv2_writer * writer, const uint8_t * data, size_t len)
+{
+    if (len > UINT16_MAX) {
+        writer->overflow = true;
+        return;
+    }
+    sv2_write_u16(writer, len);
+    sv2_write_bytes(writer, data, len);
+}
+
+void sv2_write_option_u32(sv2_writer * writer, bool present, uint32_t value)
+{
+    sv2_write_bool(writer, present);
+    if (present) {
+        sv2_write_u32(writer, value);
+    }
+}
+
+size_t sv2_frame_begin(sv2_writer * writer, uint8_t msg_type, bool channel_msg)
+{
+    size_t header_offset = writer->len;
+    sv2_write_u16(writer, channel_msg ? SV2_CHANNEL_MSG_BIT : 0);
+    sv2_write_u8(writer, msg_type);
+    sv2_write_u24(writer, 0);
+    return header_offset;
+}
+
+bool sv2_frame_end(sv2_writer * writer, size_t header_offset)
+{
+    if (writer->overflow) {
+        return false;
+    }
+    size_t msg_length = writer->len - header_offset - SV2_HEADER_SIZE;
+    uint8_t * length = writer->data + header_offset + 3;
+    length[0] = msg_length;
+    length[1] = msg_length >> 8;
+    length[2] = msg_length >> 16;
+    return true;
+}
+
+void sv2_parse_header(const uint8_t * data, sv2_frame_header * header)
+{
+    header->extension_type = data[0] | (data[1] << 8);
+    header->msg_type = data[2];
+    header->msg_length = data[3] | (data[4] << 8) | ((uint32_t) data[5] << 16);
+}
+
+void sv2_reader_init(sv2_reader * reader, const uint8_t * data, size_t len)
+{
+    reader->data = data;
+    reader->len = len;
+    reader->pos = 0;
+    reader->error = false;
+}
+
+// @return the next len bytes, NULL past the end
+static const uint8_t * read_bytes(sv2_reader * reader, size_t len)
+{
+    if (reader->error || reader->len - reader->pos < len) {
+        reader->error = true;
+        return NULL;
+    }
+    const uint8_t * bytes = reader->data + reader->pos;
+    reader->pos += len;
+    return bytes;
+}
+
+static uint64_t read_le(sv2_reader * reader, size_t size)
+{
+    const uint8_t * bytes = read_bytes(reader, size);
+    uint64_t value = 0;
+    for (size_t i = 0; bytes != NULL && i < size; i++) {
+        value |= (uint64_t) bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+uint8_t sv2_read_u8(sv2_reader * reader)
+{
+    return read_le(reader, 1);
+}
+
+bool sv2_read_bool(sv2_reader * reader)
+{
+    return read_le(reader, 1) & 1;
+}
+
+uint16_t sv2_read_u16(sv2_reader * reader)
+{
+    return read_le(reader, 2);
+}
+
+uint32_t sv2_read_u32(sv2_reader * reader)
+{
+    return read_le(reader, 4);
+}
+
+uint64_t sv2_read_u64(sv2_reader * reader)
+{
+    return read_le(reader, 8);
+}
+
+float sv2_read_f32(sv2_reader * reader)
+{
+    uint32_t bits = read_le(reader, 4);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void sv2_read_u256(sv2_reader * reader, uint8_t * value)
+{
+    const uint8_t * bytes = read_bytes(reader, 32);
+    if (bytes != NULL) {
+        memcpy(value, bytes, 32);
+    } else {
+        memset(value, 0, 32);
+    }
+}
+
+void sv2_read_str0_255(sv2_reader * reader, char * dest, size_t dest_size)
+{
+    size_t len = sv2_read_u8(reader);
+    const uint8_t * bytes = read_bytes(reader, len);
+    if (bytes == NULL) {
+        len = 0;
+    }
+    if (len >= dest_size) {
+        len = dest_size - 1;
+    }
+    memcpy(dest, bytes, len);
+    dest[len] = '\0';
+}
+
+const uint8_t * sv2_read_b0_32(sv2_reader * reader, size_t * len)
+{
+    *len = sv2_read_u8(reader);
+    if (*len > 32) {
+        reader->error = true;
+    }
+    return read_bytes(reader, *len);
+}
+
+const uint8_t * sv2_read_b0_64k(sv2_reader * reader, size_t * len)
+{
+    *len = sv2_read_u16(reader);
+    return read_bytes(reader, *len);
+}
+
+uint32_t sv2_read_option_u32(sv2_reader * reader, bool * present)
+{
+    *present = sv2_read_bool(reader);
+    return *present ? sv2_read_u32(reader) : 0;
+}
+
+uint32_t sv2_target_to_difficulty(const uint8_t * target)
+{
+    double value = 0;
+    for (int i = 31; i >= 0; i--) {
+        value = value * 256 + target[i];
+    }
+    if (value <= 0) {
+        return UINT32_MAX;
+    }
+    double difficulty = SV2_DIFF1_TARGET / value;
+    if (difficulty >= UINT32_MAX) {
+        return UINT32_MAX;
+    }
+    return difficulty < 1 ? 1 : (uint32_t) difficulty;
+}
+
+void sv2_difficulty_to_target(double difficulty, uint8_t * target)
+{
+    if (difficulty <= 1) {
+        // anything at difficulty 1 or below, e.g. the max_target of a miner without a preference
+        memset(target, 0xff, 32);
+        return;
+    }
+    double value = SV2_DIFF1_TARGET / difficulty;
+    for (int i = 31; i >= 0; i--) {
+        double unit = ldexp(1, 8 * i);
+        double byte = floor(value / unit);
+        target[i] = byte;
+        value -= byte * unit;
+    }
+}
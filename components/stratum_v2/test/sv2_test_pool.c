@@ -0,0 +1,125 @@
+#include "sv2_test_pool.h"
+
+#include <string.h>
+
+#include "esp_netif.h"
+#include "lwip/sockets.h"
+
+bool sv2_test_pool_open(sv2_test_pool * pool, uint32_t valid_from, uint32_t not_valid_after)
+{
+    esp_netif_init();
+    memset(pool, 0, sizeof(sv2_test_pool));
+    pool->sock = -1;
+
+    // fixed keys keep the tests reproducible, the handshake still uses fresh ephemeral keys
+    uint8_t authority_secret[32];
+    memset(authority_secret, 0x42, sizeof(authority_secret));
+    memset(pool->static_secret, 0x17, sizeof(pool->static_secret));
+    uint8_t static_key[32];
+    if (!sv2_noise_public_key(authority_secret, pool->authority_key) ||
+        !sv2_noise_public_key(pool->static_secret, static_key) ||
+        !sv2_noise_sign_certificate(authority_secret, static_key, 0, valid_from, not_valid_after, pool->cert)) {
+        return false;
+    }
+
+    pool->listener = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (pool->listener < 0) {
+        return false;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = 0,
+    };
+    socklen_t addr_len = sizeof(addr);
+    if (bind(pool->listener, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(pool->listener, 1) != 0 ||
+        getsockname(pool->listener, (struct sockaddr *) &addr, &addr_len) != 0) {
+        close(pool->listener);
+        return false;
+    }
+    pool->port = ntohs(addr.sin_port);
+    return true;
+}
+
+void sv2_test_pool_close(sv2_test_pool * pool)
+{
+    if (pool->sock >= 0) {
+        close(pool->sock);
+        pool->sock = -1;
+    }
+    close(pool->listener);
+}
+
+static bool recv_all(int sock, uint8_t * data, size_t len)
+{
+    while (len > 0) {
+        int received = recv(sock, data, len, 0);
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        len -= received;
+    }
+    return true;
+}
+
+static bool send_all(int sock, const uint8_t * data, size_t len)
+{
+    while (len > 0) {
+        int sent = send(sock, data, len, 0);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+bool sv2_test_pool_accept(sv2_test_pool * pool)
+{
+    pool->sock = accept(pool->listener, NULL, NULL);
+    if (pool->sock < 0) {
+        return false;
+    }
+
+    uint8_t act1[SV2_NOISE_ACT1_SIZE];
+    uint8_t act2[SV2_NOISE_ACT2_SIZE];
+    return recv_all(pool->sock, act1, sizeof(act1)) &&
+           sv2_noise_responder_reply(&pool->noise, act1, pool->static_secret, pool->cert, act2) &&
+           send_all(pool->sock, act2, sizeof(act2));
+}
+
+sv2_writer * sv2_test_pool_begin(sv2_test_pool * pool, uint8_t msg_type, bool channel_msg)
+{
+    sv2_writer_init(&pool->writer, pool->frame, sizeof(pool->frame));
+    pool->header_offset = sv2_frame_begin(&pool->writer, msg_type, channel_msg);
+    return &pool->writer;
+}
+
+size_t sv2_test_pool_encrypt(sv2_test_pool * pool)
+{
+    if (!sv2_frame_end(&pool->writer, pool->header_offset) ||
+        !sv2_noise_encrypt_frame(&pool->noise.send, pool->frame, pool->writer.len, pool->encrypted)) {
+        return 0;
+    }
+    return SV2_NOISE_HEADER_SIZE + sv2_noise_encrypted_size(pool->writer.len - SV2_HEADER_SIZE);
+}
+
+bool sv2_test_pool_send(sv2_test_pool * pool)
+{
+    size_t len = sv2_test_pool_encrypt(pool);
+    return len > 0 && send_all(pool->sock, pool->encrypted, len);
+}
+
+bool sv2_test_pool_receive(sv2_test_pool * pool, sv2_frame_header * header)
+{
+    if (!recv_all(pool->sock, pool->payload, SV2_NOISE_HEADER_SIZE) ||
+        sv2_noise_decrypt(&pool->noise.recv, pool->payload, SV2_NOISE_HEADER_SIZE) != SV2_HEADER_SIZE) {
+        return false;
+    }
+    sv2_parse_header(pool->payload, header);
+    size_t encrypted_len = sv2_noise_encrypted_size(header->msg_length);
+    return header->msg_length <= SV2_MAX_PAYLOAD_SIZE && recv_all(pool->sock, pool->payload, encrypted_len) &&
+           sv2_noise_decrypt(&pool->noise.recv, pool->payload, encrypted_len) == (int) header->msg_length;
+}
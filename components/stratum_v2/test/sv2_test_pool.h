@@ -0,0 +1,46 @@
+#ifndef SV2_TEST_POOL_H_
+#define SV2_TEST_POOL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sv2_noise.h"
+#include "sv2_protocol.h"
+
+// Stand-in Stratum V2 pool on a loopback port. Runs the responder side of the handshake with a
+// certificate of its own authority and exchanges encrypted frames, the messages are up to the test.
+typedef struct
+{
+    int listener;
+    uint16_t port;
+    int sock;
+    sv2_noise noise;
+    uint8_t authority_key[32];
+    uint8_t static_secret[32];
+    uint8_t cert[SV2_NOISE_CERT_SIZE];
+
+    sv2_writer writer;
+    size_t header_offset;
+    uint8_t frame[SV2_MAX_PAYLOAD_SIZE];
+    uint8_t encrypted[SV2_NOISE_HEADER_SIZE + SV2_MAX_PAYLOAD_SIZE + 2 * SV2_NOISE_MAC_SIZE];
+    uint8_t payload[SV2_MAX_PAYLOAD_SIZE + 2 * SV2_NOISE_MAC_SIZE];
+} sv2_test_pool;
+
+/// @brief Listens on a free loopback port with a certificate valid in [valid_from, not_valid_after].
+bool sv2_test_pool_open(sv2_test_pool * pool, uint32_t valid_from, uint32_t not_valid_after);
+void sv2_test_pool_close(sv2_test_pool * pool);
+
+/// @brief Accepts the next connection and answers its handshake.
+bool sv2_test_pool_accept(sv2_test_pool * pool);
+
+/// @brief Starts a message in pool->writer, sent with sv2_test_pool_send().
+sv2_writer * sv2_test_pool_begin(sv2_test_pool * pool, uint8_t msg_type, bool channel_msg);
+bool sv2_test_pool_send(sv2_test_pool * pool);
+
+/// @brief Encrypts the message started with sv2_test_pool_begin() without sending it.
+/// @return the encrypted frame in pool->encrypted, 0 on failure
+size_t sv2_test_pool_encrypt(sv2_test_pool * pool);
+
+/// @brief Receives the next message, its payload is left in pool->payload.
+bool sv2_test_pool_receive(sv2_test_pool * pool, sv2_frame_header * header);
+
+#endif /* SV2_TEST_POOL_H_ */
@@ -0,0 +1,209 @@
+#include "unity.h"
+#include "stratum_api.h"
+#include "sv2_noise.h"
+#include "sv2_protocol.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+// the job of the V1 notify benchmark: 14 merkle branches and 150 byte coinbase halves
+#define BRANCHES 14
+#define COINBASE_LEN 150
+#define ITERATIONS 1000
+
+static const char * USER = "bc1qnp980s5fpp8l94p5cvttmtdqy8rvrq74qly2yrfmzkdsntqzlc5qkc4rkq.bitaxe";
+
+static char * v1_notify(void)
+{
+    char * json_string = malloc(4096);
+    TEST_ASSERT_NOT_NULL(json_string);
+    int len = sprintf(json_string, "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"1d2e0c4d3d\","
+                                   "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\",\"");
+    memset(json_string + len, 'a', COINBASE_LEN * 2);
+    len += COINBASE_LEN * 2;
+    len += sprintf(json_string + len, "\",\"");
+    memset(json_string + len, 'b', COINBASE_LEN * 2);
+    len += COINBASE_LEN * 2;
+    len += sprintf(json_string + len, "\",[");
+    for (int i = 0; i < BRANCHES; i++) {
+        len += sprintf(json_string + len, "%s\"%064x\"", i ? "," : "", i);
+    }
+    sprintf(json_string + len, "],\"20000004\",\"1705c739\",\"64495522\",false]}\n");
+    return json_string;
+}
+
+// NewExtendedMiningJob and the SetNewPrevHash that activates it, as one V1 notify
+static void v2_extended_job(sv2_writer * writer)
+{
+    uint8_t hash[32] = {0};
+    uint8_t coinbase[COINBASE_LEN];
+    memset(coinbase, 0xaa, sizeof(coinbase));
+    size_t header = sv2_frame_begin(writer, SV2_MSG_NEW_EXTENDED_MINING_JOB, true);
+    sv2_write_u32(writer, 1);
+    sv2_write_u32(writer, 0x1d2e0c4d);
+    sv2_write_option_u32(writer, false, 0);
+    sv2_write_u32(writer, 0x20000004);
+    sv2_write_bool(writer, true);
+    sv2_write_u8(writer, BRANCHES);
+    for (int i = 0; i < BRANCHES; i++) {
+        sv2_write_u256(writer, hash);
+    }
+    sv2_write_b0_64k(writer, coinbase, sizeof(coinbase));
+    sv2_write_b0_64k(writer, coinbase, sizeof(coinbase));
+    TEST_ASSERT_TRUE(sv2_frame_end(writer, header));
+}
+
+static void v2_prev_hash(sv2_writer * writer)
+{
+    uint8_t hash[32] = {0};
+    size_t header = sv2_frame_begin(writer, SV2_MSG_SET_NEW_PREV_HASH, true);
+    sv2_write_u32(writer, 1);
+    sv2_write_u32(writer, 0x1d2e0c4d);
+    sv2_write_u256(writer, hash);
+    sv2_write_u32(writer, 0x64495522);
+    sv2_write_u32(writer, 0x1705c739);
+    TEST_ASSERT_TRUE(sv2_frame_end(writer, header));
+}
+
+static void v2_new_mining_job(sv2_writer * writer)
+{
+    uint8_t merkle_root[32] = {0};
+    size_t header = sv2_frame_begin(writer, SV2_MSG_NEW_MINING_JOB, true);
+    sv2_write_u32(writer, 1);
+    sv2_write_u32(writer, 0x1d2e0c4d);
+    sv2_write_option_u32(writer, true, 0x64495522);
+    sv2_write_u32(writer, 0x20000004);
+    sv2_write_b0_32(writer, merkle_root, sizeof(merkle_root));
+    TEST_ASSERT_TRUE(sv2_frame_end(writer, header));
+}
+
+static void v2_submit(sv2_writer * writer, bool extended)
+{
+    uint8_t extranonce[8] = {0};
+    size_t header = sv2_frame_begin(writer, extended ? SV2_MSG_SUBMIT_SHARES_EXTENDED : SV2_MSG_SUBMIT_SHARES_STANDARD, true);
+    sv2_write_u32(writer, 1);
+    sv2_write_u32(writer, 1234);
+    sv2_write_u32(writer, 0x1d2e0c4d);
+    sv2_write_u32(writer, 0xdeadbeef);
+    sv2_write_u32(writer, 0x64495522);
+    sv2_write_u32(writer, 0x20a4e000);
+    if (extended) {
+        sv2_write_b0_32(writer, extranonce, sizeof(extranonce));
+    }
+    TEST_ASSERT_TRUE(sv2_frame_end(writer, header));
+}
+
+static void handshake(sv2_noise * miner, sv2_noise * pool)
+{
+    uint8_t authority_secret[32], static_secret[32], authority_key[32], static_key[32];
+    uint8_t cert[SV2_NOISE_CERT_SIZE], act1[SV2_NOISE_ACT1_SIZE], act2[SV2_NOISE_ACT2_SIZE];
+    memset(authority_secret, 0x42, sizeof(authority_secret));
+    memset(static_secret, 0x17, sizeof(static_secret));
+    TEST_ASSERT_TRUE(sv2_noise_public_key(authority_secret, authority_key));
+    TEST_ASSERT_TRUE(sv2_noise_public_key(static_secret, static_key));
+    TEST_ASSERT_TRUE(sv2_noise_sign_certificate(authority_secret, static_key, 0, 0, UINT32_MAX, cert));
+    TEST_ASSERT_TRUE(sv2_noise_initiator_start(miner, act1));
+    TEST_ASSERT_TRUE(sv2_noise_responder_reply(pool, act1, static_secret, cert, act2));
+    TEST_ASSERT_EQUAL(SV2_NOISE_OK, sv2_noise_initiator_finish(miner, act2, authority_key, 0));
+}
+
+static size_t encrypted_size(const sv2_writer * writer)
+{
+    return SV2_NOISE_HEADER_SIZE + sv2_noise_encrypted_size(writer->len - SV2_HEADER_SIZE);
+}
+
+// Decrypts a frame like the client does and walks its payload, the V2 counterpart of parsing the JSON
+static int64_t receive_us(sv2_noise * pool, sv2_noise * miner, void (*build)(sv2_writer *), uint8_t * frame,
+                          uint8_t * encrypted, size_t size)
+{
+    sv2_writer writer;
+    int64_t elapsed = 0;
+    for (int i = 0; i < ITERATIONS; i++) {
+        sv2_writer_init(&writer, frame, size);
+        build(&writer);
+        TEST_ASSERT_TRUE(sv2_noise_encrypt_frame(&pool->send, frame, writer.len, encrypted));
+        size_t payload_len = writer.len - SV2_HEADER_SIZE;
+
+        int64_t start = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(SV2_HEADER_SIZE, sv2_noise_decrypt(&miner->recv, encrypted, SV2_NOISE_HEADER_SIZE));
+        int len = sv2_noise_decrypt(&miner->recv, encrypted + SV2_NOISE_HEADER_SIZE, sv2_noise_encrypted_size(payload_len));
+        sv2_reader reader;
+        sv2_reader_init(&reader, encrypted + SV2_NOISE_HEADER_SIZE, len);
+        while (reader.pos < reader.len) {
+            sv2_read_u8(&reader);
+        }
+        elapsed += esp_timer_get_time() - start;
+        TEST_ASSERT_EQUAL(payload_len, len);
+    }
+    return elapsed / ITERATIONS;
+}
+
+TEST_CASE("SV2 bytes and CPU per job and share compared to V1", "[benchmark][not-on-qemu]")
+{
+    uint8_t * frame = malloc(SV2_MAX_PAYLOAD_SIZE);
+    uint8_t * encrypted = malloc(SV2_MAX_PAYLOAD_SIZE + SV2_NOISE_HEADER_SIZE + 2 * SV2_NOISE_MAC_SIZE);
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_NOT_NULL(encrypted);
+    sv2_noise miner, pool;
+    handshake(&miner, &pool);
+
+    char * notify = v1_notify();
+    StratumApiV1Message message = {};
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < ITERATIONS; i++) {
+        STRATUM_V1_parse(&message, notify);
+        STRATUM_V1_free_mining_notify(message.mining_notification);
+    }
+    int64_t v1_notify_us = (esp_timer_get_time() - start) / ITERATIONS;
+    TEST_ASSERT_EQUAL(MINING_NOTIFY, message.method);
+    char submit[256];
+    int v1_submit_len = snprintf(submit, sizeof(submit),
+                                 "{\"id\": %d, \"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"%s\", \"%08lx\", "
+                                 "\"%08lx\", \"%08lx\"]}\n",
+                                 1234, USER, "1d2e0c4d3d", "0000000000000000", 0x64495522ul, 0xdeadbeeful, 0x00a4e000ul);
+
+    sv2_writer writer;
+    sv2_writer_init(&writer, frame, SV2_MAX_PAYLOAD_SIZE);
+    v2_extended_job(&writer);
+    size_t extended_job = encrypted_size(&writer);
+    sv2_writer_init(&writer, frame, SV2_MAX_PAYLOAD_SIZE);
+    v2_prev_hash(&writer);
+    size_t prev_hash = encrypted_size(&writer);
+    sv2_writer_init(&writer, frame, SV2_MAX_PAYLOAD_SIZE);
+    v2_new_mining_job(&writer);
+    size_t standard_job = encrypted_size(&writer);
+    sv2_writer_init(&writer, frame, SV2_MAX_PAYLOAD_SIZE);
+    v2_submit(&writer, true);
+    size_t extended_submit = encrypted_size(&writer);
+    sv2_writer_init(&writer, frame, SV2_MAX_PAYLOAD_SIZE);
+    v2_submit(&writer, false);
+    size_t standard_submit = encrypted_size(&writer);
+
+    int64_t extended_job_us = receive_us(&pool, &miner, v2_extended_job, frame, encrypted, SV2_MAX_PAYLOAD_SIZE);
+    int64_t standard_job_us = receive_us(&pool, &miner, v2_new_mining_job, frame, encrypted, SV2_MAX_PAYLOAD_SIZE);
+
+    // shares go the other way, encrypting them is the miner's cost
+    start = esp_timer_get_time();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sv2_writer_init(&writer, frame, SV2_MAX_PAYLOAD_SIZE);
+        v2_submit(&writer, true);
+        TEST_ASSERT_TRUE(sv2_noise_encrypt_frame(&miner.send, frame, writer.len, encrypted));
+    }
+    int64_t extended_submit_us = (esp_timer_get_time() - start) / ITERATIONS;
+
+    printf("V1 mining.notify: %u bytes, %lld us to parse\n", (unsigned) strlen(notify), (long long) v1_notify_us);
+    printf("V1 mining.submit: %d bytes\n", v1_submit_len);
+    printf("V2 extended job: %u + %u bytes, %lld us to decrypt and read\n", (unsigned) extended_job, (unsigned) prev_hash,
+           (long long) extended_job_us);
+    printf("V2 standard job: %u bytes, %lld us to decrypt and read\n", (unsigned) standard_job, (long long) standard_job_us);
+    printf("V2 submit: %u bytes extended, %u bytes standard, %lld us to encrypt\n", (unsigned) extended_submit,
+           (unsigned) standard_submit, (long long) extended_submit_us);
+
+    // the binary framing beats JSON on every message even with the MACs
+    TEST_ASSERT_LESS_THAN(strlen(notify), extended_job + prev_hash);
+    TEST_ASSERT_LESS_THAN(v1_submit_len, extended_submit);
+
+    free(notify);
+    free(encrypted);
+    free(frame);
+}
@@ -0,0 +1,472 @@
+#include "unity.h"
+#include "sv2_client.h"
+#include "sv2_test_pool.h"
+#include "mining.h"
+#include "utils.h"
+#include "lwip/sockets.h"
+#include <pthread.h>
+#include <string.h>
+
+#define CHANNEL_ID 7
+#define NBITS 0x1705c739
+#define MIN_NTIME 0x64495522
+
+// What the stand-in pool saw, checked once its thread is done since Unity can't fail from another thread
+typedef struct
+{
+    sv2_test_pool pool;
+    bool extended;
+    bool done;
+    uint32_t setup_flags;
+    char vendor[32];
+    char user[64];
+    uint16_t min_extranonce_size;
+    uint8_t submit_type;
+    uint32_t sequence_number;
+    uint32_t job_id;
+    uint32_t nonce;
+    uint32_t ntime;
+    uint32_t version;
+    uint8_t extranonce[32];
+    size_t extranonce_len;
+} pool_script;
+
+static const uint8_t PREFIX[] = {0xe8, 0xf2, 0xa1, 0xb4};
+static const uint8_t COINBASE_1[] = {0x01, 0x00, 0x00, 0x00, 0x01, 0xff, 0xff};
+static const uint8_t COINBASE_2[] = {0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00};
+
+static int connect_client(uint16_t port)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = htons(port),
+    };
+    TEST_ASSERT_EQUAL(0, connect(sock, (struct sockaddr *) &addr, sizeof(addr)));
+    return sock;
+}
+
+static void write_target(sv2_writer * writer, double difficulty)
+{
+    uint8_t target[32];
+    sv2_difficulty_to_target(difficulty, target);
+    sv2_write_u256(writer, target);
+}
+
+static void write_prev_hash(sv2_writer * writer, uint32_t job_id)
+{
+    uint8_t prev_hash[32];
+    for (int i = 0; i < 32; i++) {
+        prev_hash[i] = i;
+    }
+    sv2_write_u32(writer, CHANNEL_ID);
+    sv2_write_u32(writer, job_id);
+    sv2_write_u256(writer, prev_hash);
+    sv2_write_u32(writer, MIN_NTIME);
+    sv2_write_u32(writer, NBITS);
+}
+
+// Answers SetupConnection and the channel request
+static bool pool_open_channel(pool_script * script)
+{
+    sv2_test_pool * pool = &script->pool;
+    sv2_frame_header header;
+    sv2_reader reader;
+    if (!sv2_test_pool_accept(pool) || !sv2_test_pool_receive(pool, &header) ||
+        header.msg_type != SV2_MSG_SETUP_CONNECTION) {
+        return false;
+    }
+    char host[64], unused[64];
+    sv2_reader_init(&reader, pool->payload, header.msg_length);
+    sv2_read_u8(&reader);
+    sv2_read_u16(&reader);
+    sv2_read_u16(&reader);
+    script->setup_flags = sv2_read_u32(&reader);
+    sv2_read_str0_255(&reader, host, sizeof(host));
+    sv2_read_u16(&reader);
+    sv2_read_str0_255(&reader, script->vendor, sizeof(script->vendor));
+    sv2_read_str0_255(&reader, unused, sizeof(unused));
+
+    sv2_writer * writer = sv2_test_pool_begin(pool, SV2_MSG_SETUP_CONNECTION_SUCCESS, false);
+    sv2_write_u16(writer, SV2_PROTOCOL_VERSION);
+    sv2_write_u32(writer, 0);
+    if (!sv2_test_pool_send(pool) || !sv2_test_pool_receive(pool, &header)) {
+        return false;
+    }
+
+    sv2_reader_init(&reader, pool->payload, header.msg_length);
+    uint32_t request_id = sv2_read_u32(&reader);
+    sv2_read_str0_255(&reader, script->user, sizeof(script->user));
+    sv2_read_f32(&reader);
+    uint8_t max_target[32];
+    sv2_read_u256(&reader, max_target);
+    if (script->extended) {
+        if (header.msg_type != SV2_MSG_OPEN_EXTENDED_MINING_CHANNEL) {
+            return false;
+        }
+        script->min_extranonce_size = sv2_read_u16(&reader);
+        writer = sv2_test_pool_begin(pool, SV2_MSG_OPEN_EXTENDED_MINING_CHANNEL_SUCCESS, false);
+        sv2_write_u32(writer, request_id);
+        sv2_write_u32(writer, CHANNEL_ID);
+        write_target(writer, 1024);
+        sv2_write_u16(writer, 8);
+        sv2_write_b0_32(writer, PREFIX, sizeof(PREFIX));
+    } else {
+        if (header.msg_type != SV2_MSG_OPEN_STANDARD_MINING_CHANNEL) {
+            return false;
+        }
+        writer = sv2_test_pool_begin(pool, SV2_MSG_OPEN_STANDARD_MINING_CHANNEL_SUCCESS, false);
+        sv2_write_u32(writer, request_id);
+        sv2_write_u32(writer, CHANNEL_ID);
+        write_target(writer, 1024);
+        sv2_write_b0_32(writer, PREFIX, sizeof(PREFIX));
+        sv2_write_u32(writer, 0);
+    }
+    return !reader.error && sv2_test_pool_send(pool);
+}
+
+static bool pool_receive_share(pool_script * script)
+{
+    sv2_test_pool * pool = &script->pool;
+    sv2_frame_header header;
+    if (!sv2_test_pool_receive(pool, &header)) {
+        return false;
+    }
+    sv2_reader reader;
+    sv2_reader_init(&reader, pool->payload, header.msg_length);
+    script->submit_type = header.msg_type;
+    sv2_read_u32(&reader);
+    script->sequence_number = sv2_read_u32(&reader);
+    script->job_id = sv2_read_u32(&reader);
+    script->nonce = sv2_read_u32(&reader);
+    script->ntime = sv2_read_u32(&reader);
+    script->version = sv2_read_u32(&reader);
+    if (header.msg_type == SV2_MSG_SUBMIT_SHARES_EXTENDED) {
+        const uint8_t * extranonce = sv2_read_b0_32(&reader, &script->extranonce_len);
+        if (extranonce != NULL) {
+            memcpy(script->extranonce, extranonce, script->extranonce_len);
+        }
+    }
+    return !reader.error && (header.extension_type & SV2_CHANNEL_MSG_BIT) != 0;
+}
+
+static void * extended_pool(void * arg)
+{
+    pool_script * script = (pool_script *) arg;
+    sv2_test_pool * pool = &script->pool;
+    if (!pool_open_channel(script)) {
+        return NULL;
+    }
+
+    // a future job, mined once the pool announces the tip it builds on
+    sv2_writer * writer = sv2_test_pool_begin(pool, SV2_MSG_NEW_EXTENDED_MINING_JOB, true);
+    sv2_write_u32(writer, CHANNEL_ID);
+    sv2_write_u32(writer, 3);
+    sv2_write_option_u32(writer, false, 0);
+    sv2_write_u32(writer, 0x20000000);
+    sv2_write_bool(writer, true);
+    sv2_write_u8(writer, 2);
+    uint8_t branch[32];
+    memset(branch, 0xaa, sizeof(branch));
+    sv2_write_u256(writer, branch);
+    memset(branch, 0xbb, sizeof(branch));
+    sv2_write_u256(writer, branch);
+    sv2_write_b0_64k(writer, COINBASE_1, sizeof(COINBASE_1));
+    sv2_write_b0_64k(writer, COINBASE_2, sizeof(COINBASE_2));
+    if (!sv2_test_pool_send(pool)) {
+        return NULL;
+    }
+    write_prev_hash(sv2_test_pool_begin(pool, SV2_MSG_SET_NEW_PREV_HASH, true), 3);
+    if (!sv2_test_pool_send(pool) || !pool_receive_share(script)) {
+        return NULL;
+    }
+
+    writer = sv2_test_pool_begin(pool, SV2_MSG_SUBMIT_SHARES_SUCCESS, true);
+    sv2_write_u32(writer, CHANNEL_ID);
+    sv2_write_u32(writer, script->sequence_number);
+    sv2_write_u32(writer, 1);
+    sv2_write_u64(writer, 1024);
+    if (!sv2_test_pool_send(pool)) {
+        return NULL;
+    }
+    writer = sv2_test_pool_begin(pool, SV2_MSG_SET_TARGET, true);
+    sv2_write_u32(writer, CHANNEL_ID);
+    write_target(writer, 4096);
+    script->done = sv2_test_pool_send(pool);
+    return NULL;
+}
+
+static void * standard_pool(void * arg)
+{
+    pool_script * script = (pool_script *) arg;
+    sv2_test_pool * pool = &script->pool;
+    if (!pool_open_channel(script)) {
+        return NULL;
+    }
+
+    uint8_t merkle_root[32];
+    memset(merkle_root, 0xcc, sizeof(merkle_root));
+    sv2_writer * writer = sv2_test_pool_begin(pool, SV2_MSG_NEW_MINING_JOB, true);
+    sv2_write_u32(writer, CHANNEL_ID);
+    sv2_write_u32(writer, 5);
+    sv2_write_option_u32(writer, false, 0);
+    sv2_write_u32(writer, 0x20000000);
+    sv2_write_b0_32(writer, merkle_root, sizeof(merkle_root));
+    if (!sv2_test_pool_send(pool)) {
+        return NULL;
+    }
+    write_prev_hash(sv2_test_pool_begin(pool, SV2_MSG_SET_NEW_PREV_HASH, true), 5);
+    if (!sv2_test_pool_send(pool)) {
+        return NULL;
+    }
+
+    // a second job on the same tip, valid right away
+    memset(merkle_root, 0xdd, sizeof(merkle_root));
+    writer = sv2_test_pool_begin(pool, SV2_MSG_NEW_MINING_JOB, true);
+    sv2_write_u32(writer, CHANNEL_ID);
+    sv2_write_u32(writer, 6);
+    sv2_write_option_u32(writer, true, MIN_NTIME + 10);
+    sv2_write_u32(writer, 0x20000000);
+    sv2_write_b0_32(writer, merkle_root, sizeof(merkle_root));
+    if (!sv2_test_pool_send(pool) || !pool_receive_share(script) || !pool_receive_share(script)) {
+        return NULL;
+    }
+
+    writer = sv2_test_pool_begin(pool, SV2_MSG_SUBMIT_SHARES_SUCCESS, true);
+    sv2_write_u32(writer, CHANNEL_ID);
+    sv2_write_u32(writer, 1);
+    sv2_write_u32(writer, 1);
+    sv2_write_u64(writer, 1024);
+    if (!sv2_test_pool_send(pool)) {
+        return NULL;
+    }
+    writer = sv2_test_pool_begin(pool, SV2_MSG_SUBMIT_SHARES_ERROR, true);
+    sv2_write_u32(writer, CHANNEL_ID);
+    sv2_write_u32(writer, 2);
+    sv2_write_str0_255(writer, "difficulty-too-low");
+    script->done = sv2_test_pool_send(pool);
+    return NULL;
+}
+
+static void start_client(sv2_client * client, stratum_tx * tx, pool_script * script, const uint8_t * authority_key,
+                         bool * connected)
+{
+    TEST_ASSERT_TRUE(stratum_tx_init(tx, 1024));
+    TEST_ASSERT_TRUE(sv2_client_init(client, tx));
+    int sock = connect_client(script->pool.port);
+    sv2_client_config config = {
+        .authority_key = authority_key,
+        .host = "127.0.0.1",
+        .port = script->pool.port,
+        .user = "bc1qtest.bitaxe",
+        .vendor = "bitaxe",
+        .hardware_version = "BM1366",
+        .firmware = "test",
+        .nominal_hashrate = 500e9,
+        .difficulty = 1000,
+        .extended = script->extended,
+        .now = 1750000000,
+    };
+    *connected = sv2_client_connect(client, sock, &config);
+    if (*connected) {
+        stratum_tx_set_socket(tx, sock);
+    } else {
+        close(sock);
+    }
+}
+
+static void stop_client(sv2_client * client, stratum_tx * tx)
+{
+    int sock = client->sock;
+    stratum_tx_set_socket(tx, -1);
+    sv2_client_free(client);
+    stratum_tx_free(tx);
+    close(sock);
+}
+
+static void expect_message(sv2_client * client, StratumApiV1Message * message, stratum_method method)
+{
+    TEST_ASSERT_TRUE(sv2_client_receive(client, message));
+    TEST_ASSERT_EQUAL(method, message->method);
+}
+
+TEST_CASE("SV2 client mines extended jobs from the stand-in pool", "[sv2_client]")
+{
+    static pool_script script;
+    memset(&script, 0, sizeof(script));
+    script.extended = true;
+    TEST_ASSERT_TRUE(sv2_test_pool_open(&script.pool, 1700000000, 1800000000));
+    pthread_t thread;
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, extended_pool, &script));
+
+    static sv2_client client;
+    stratum_tx tx;
+    bool connected;
+    start_client(&client, &tx, &script, script.pool.authority_key, &connected);
+    TEST_ASSERT_TRUE(connected);
+
+    StratumApiV1Message message = {0};
+    expect_message(&client, &message, MINING_SET_DIFFICULTY);
+    TEST_ASSERT_EQUAL(1024, message.new_difficulty);
+    expect_message(&client, &message, MINING_SET_VERSION_MASK);
+    TEST_ASSERT_EQUAL_HEX32(0x1fffe000, message.version_mask);
+    expect_message(&client, &message, MINING_SET_EXTRANONCE);
+    TEST_ASSERT_EQUAL_STRING("e8f2a1b4", message.extranonce_str);
+    TEST_ASSERT_EQUAL(8, message.extranonce_2_len);
+    free(message.extranonce_str);
+
+    expect_message(&client, &message, MINING_NOTIFY);
+    mining_notify * notify = message.mining_notification;
+    TEST_ASSERT_TRUE(message.should_abandon_work);
+    TEST_ASSERT_EQUAL_STRING("3", notify->job_id);
+    TEST_ASSERT_FALSE(notify->header_only);
+    TEST_ASSERT_EQUAL_HEX32(0x20000000, notify->version);
+    TEST_ASSERT_EQUAL_HEX32(NBITS, notify->target);
+    TEST_ASSERT_EQUAL_HEX32(MIN_NTIME, notify->ntime);
+    TEST_ASSERT_EQUAL(2, notify->n_merkle_branches);
+    TEST_ASSERT_EQUAL(0xbb, notify->merkle_branches[32]);
+    TEST_ASSERT_EQUAL(31, notify->prev_block_hash[31]);
+
+    // the job creation builds the same coinbase as for a V1 notify
+    job_template tmpl;
+    TEST_ASSERT_TRUE(job_template_init(&tmpl, notify, PREFIX, sizeof(PREFIX), 8));
+    uint8_t merkle_root[32], expected_root[32];
+    job_template_merkle_root(&tmpl, notify, 0x12345678, merkle_root);
+    uint8_t coinbase[sizeof(COINBASE_1) + sizeof(PREFIX) + 8 + sizeof(COINBASE_2)];
+    memcpy(coinbase, COINBASE_1, sizeof(COINBASE_1));
+    memcpy(coinbase + sizeof(COINBASE_1), PREFIX, sizeof(PREFIX));
+    extranonce_2_generate(0x12345678, 8, coinbase + sizeof(COINBASE_1) + sizeof(PREFIX));
+    memcpy(coinbase + sizeof(COINBASE_1) + sizeof(PREFIX) + 8, COINBASE_2, sizeof(COINBASE_2));
+    calculate_merkle_root_hash(coinbase, sizeof(coinbase), (const uint8_t(*)[32]) notify->merkle_branches, 2, expected_root);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_root, merkle_root, 32);
+
+    char extranonce_2[17];
+    bin2hex(tmpl.coinbase_tx + tmpl.extranonce_2_offset, 8, extranonce_2, sizeof(extranonce_2));
+    // six u32 fields and the 8-byte extranonce behind the encrypted header
+    TEST_ASSERT_EQUAL(SV2_NOISE_HEADER_SIZE + 24 + 1 + 8 + SV2_NOISE_MAC_SIZE,
+                      sv2_client_submit_share(&client, 1, notify->job_id, extranonce_2, notify->ntime, 0xdeadbeef, 0x20a4e000));
+    TEST_ASSERT_TRUE(stratum_tx_flush(&tx));
+    job_template_free(&tmpl);
+    STRATUM_V1_free_mining_notify(notify);
+
+    expect_message(&client, &message, STRATUM_RESULT);
+    TEST_ASSERT_EQUAL(1, message.message_id);
+    TEST_ASSERT_TRUE(message.response_success);
+    expect_message(&client, &message, MINING_SET_DIFFICULTY);
+    TEST_ASSERT_EQUAL(4096, message.new_difficulty);
+    // the pool hangs up after its script
+    pthread_join(thread, NULL);
+    sv2_test_pool_close(&script.pool);
+    TEST_ASSERT_FALSE(sv2_client_receive(&client, &message));
+    stop_client(&client, &tx);
+
+    TEST_ASSERT_TRUE(script.done);
+    TEST_ASSERT_EQUAL_HEX32(SV2_SETUP_REQUIRES_VERSION_ROLLING, script.setup_flags);
+    TEST_ASSERT_EQUAL_STRING("bitaxe", script.vendor);
+    TEST_ASSERT_EQUAL_STRING("bc1qtest.bitaxe", script.user);
+    TEST_ASSERT_EQUAL(4, script.min_extranonce_size);
+    TEST_ASSERT_EQUAL(SV2_MSG_SUBMIT_SHARES_EXTENDED, script.submit_type);
+    TEST_ASSERT_EQUAL(1, script.sequence_number);
+    TEST_ASSERT_EQUAL(3, script.job_id);
+    TEST_ASSERT_EQUAL_HEX32(0xdeadbeef, script.nonce);
+    TEST_ASSERT_EQUAL_HEX32(MIN_NTIME, script.ntime);
+    TEST_ASSERT_EQUAL_HEX32(0x20a4e000, script.version);
+    TEST_ASSERT_EQUAL(8, script.extranonce_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(coinbase + sizeof(COINBASE_1) + sizeof(PREFIX), script.extranonce, 8);
+}
+
+TEST_CASE("SV2 client mines header-only jobs of a standard channel", "[sv2_client]")
+{
+    static pool_script script;
+    memset(&script, 0, sizeof(script));
+    TEST_ASSERT_TRUE(sv2_test_pool_open(&script.pool, 1700000000, 1800000000));
+    pthread_t thread;
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, standard_pool, &script));
+
+    static sv2_client client;
+    stratum_tx tx;
+    bool connected;
+    start_client(&client, &tx, &script, script.pool.authority_key, &connected);
+    TEST_ASSERT_TRUE(connected);
+
+    StratumApiV1Message message = {0};
+    expect_message(&client, &message, MINING_SET_DIFFICULTY);
+    expect_message(&client, &message, MINING_SET_VERSION_MASK);
+
+    expect_message(&client, &message, MINING_NOTIFY);
+    mining_notify * notify = message.mining_notification;
+    TEST_ASSERT_TRUE(message.should_abandon_work);
+    TEST_ASSERT_TRUE(notify->header_only);
+    TEST_ASSERT_EQUAL_STRING("5", notify->job_id);
+    TEST_ASSERT_EQUAL(0xcc, notify->merkle_root[0]);
+    TEST_ASSERT_EQUAL_HEX32(MIN_NTIME, notify->ntime);
+
+    // the merkle root goes straight into the job
+    bm_job job = construct_bm_job(notify, notify->merkle_root, 0x1fffe000);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(notify->merkle_root, job.merkle_root, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(notify->prev_block_hash, job.prev_block_hash, 32);
+    TEST_ASSERT_TRUE(sv2_client_submit_share(&client, 1, notify->job_id, "", notify->ntime + 1, 1, 0x20000000) > 0);
+    STRATUM_V1_free_mining_notify(notify);
+
+    expect_message(&client, &message, MINING_NOTIFY);
+    notify = message.mining_notification;
+    TEST_ASSERT_FALSE(message.should_abandon_work);
+    TEST_ASSERT_EQUAL_STRING("6", notify->job_id);
+    TEST_ASSERT_EQUAL(0xdd, notify->merkle_root[0]);
+    TEST_ASSERT_EQUAL_HEX32(MIN_NTIME + 10, notify->ntime);
+    TEST_ASSERT_EQUAL(31, notify->prev_block_hash[31]);
+    TEST_ASSERT_TRUE(sv2_client_submit_share(&client, 2, notify->job_id, "", notify->ntime, 2, 0x20000000) > 0);
+    TEST_ASSERT_TRUE(stratum_tx_flush(&tx));
+    STRATUM_V1_free_mining_notify(notify);
+
+    expect_message(&client, &message, STRATUM_RESULT);
+    TEST_ASSERT_EQUAL(1, message.message_id);
+    TEST_ASSERT_TRUE(message.response_success);
+    expect_message(&client, &message, STRATUM_RESULT);
+    TEST_ASSERT_EQUAL(2, message.message_id);
+    TEST_ASSERT_FALSE(message.response_success);
+    TEST_ASSERT_EQUAL_STRING("difficulty-too-low", message.error_str);
+
+    pthread_join(thread, NULL);
+    sv2_test_pool_close(&script.pool);
+    stop_client(&client, &tx);
+
+    TEST_ASSERT_TRUE(script.done);
+    TEST_ASSERT_EQUAL_HEX32(SV2_SETUP_REQUIRES_VERSION_ROLLING | SV2_SETUP_REQUIRES_STANDARD_JOBS, script.setup_flags);
+    TEST_ASSERT_EQUAL(SV2_MSG_SUBMIT_SHARES_STANDARD, script.submit_type);
+    TEST_ASSERT_EQUAL(2, script.sequence_number);
+    TEST_ASSERT_EQUAL(6, script.job_id);
+    TEST_ASSERT_EQUAL(2, script.nonce);
+}
+
+static void * handshake_only_pool(void * arg)
+{
+    pool_script * script = (pool_script *) arg;
+    script->done = sv2_test_pool_accept(&script->pool);
+    return NULL;
+}
+
+TEST_CASE("SV2 client refuses a pool signed by another authority", "[sv2_client]")
+{
+    static pool_script script;
+    memset(&script, 0, sizeof(script));
+    TEST_ASSERT_TRUE(sv2_test_pool_open(&script.pool, 1700000000, 1800000000));
+    pthread_t thread;
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, handshake_only_pool, &script));
+
+    uint8_t other_key[32];
+    memcpy(other_key, script.pool.authority_key, 32);
+    other_key[5] ^= 0x80;
+    static sv2_client client;
+    stratum_tx tx;
+    bool connected;
+    start_client(&client, &tx, &script, other_key, &connected);
+    pthread_join(thread, NULL);
+    TEST_ASSERT_TRUE(script.done);
+    TEST_ASSERT_FALSE(connected);
+
+    stratum_tx_free(&tx);
+    sv2_client_free(&client);
+    sv2_test_pool_close(&script.pool);
+}
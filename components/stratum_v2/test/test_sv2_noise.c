@@ -0,0 +1,168 @@
+#include "unity.h"
+#include "sv2_noise.h"
+#include "utils.h"
+#include <string.h>
+
+static void make_pool(uint8_t * authority_key, uint8_t * static_secret, uint8_t * cert, uint32_t not_valid_after)
+{
+    uint8_t authority_secret[32], static_key[32];
+    memset(authority_secret, 0x42, sizeof(authority_secret));
+    memset(static_secret, 0x17, 32);
+    TEST_ASSERT_TRUE(sv2_noise_public_key(authority_secret, authority_key));
+    TEST_ASSERT_TRUE(sv2_noise_public_key(static_secret, static_key));
+    TEST_ASSERT_TRUE(sv2_noise_sign_certificate(authority_secret, static_key, 0, 1700000000, not_valid_after, cert));
+}
+
+TEST_CASE("SV2 public keys match the BIP340 test vectors", "[sv2_noise]")
+{
+    uint8_t secret[32] = {0};
+    secret[31] = 3;
+    uint8_t key[32], expected[32];
+    TEST_ASSERT_TRUE(sv2_noise_public_key(secret, key));
+    hex2bin("f9308a019258c31049344f85f89d5229b531c845836f99b08601f113bce036f9", expected, sizeof(expected));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, key, 32);
+}
+
+TEST_CASE("SV2 signatures match the BIP340 test vectors", "[sv2_noise]")
+{
+    uint8_t secret[32] = {0};
+    secret[31] = 3;
+    uint8_t msg[32] = {0};
+    uint8_t sig[64], expected[64];
+    TEST_ASSERT_TRUE(sv2_noise_sign(secret, msg, sig));
+    hex2bin("e907831f80848d1069a5371b402410364bdf1c5f8307b0084c55f1ce2dca8215"
+            "25f66a4a85ea8b71e482a74f382d2ce5ebeee8fdb2172f477df4900d310536c0",
+            expected, sizeof(expected));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, sig, 64);
+
+    // vector 1 with zero auxiliary randomness, as libsecp256k1 signs it
+    hex2bin("b7e151628aed2a6abf7158809cf4f3c762e7160f38b4da56a784d9045190cfef", secret, sizeof(secret));
+    hex2bin("243f6a8885a308d313198a2e03707344a4093822299f31d0082efa98ec4e6c89", msg, sizeof(msg));
+    TEST_ASSERT_TRUE(sv2_noise_sign(secret, msg, sig));
+    hex2bin("eb8eadc001fa1f3d08f19db7027ddb0affa61c0357d4b577f8bb1978837382c8"
+            "5ae9ccc675360d9055cb2a2bda001bc5c62df9b5ed936caccfd00b169ede131d",
+            expected, sizeof(expected));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, sig, 64);
+}
+
+TEST_CASE("SV2 ElligatorSwift keys decode as BIP324 specifies", "[sv2_noise]")
+{
+    static const char * vectors[][2] = {
+        // u = 0 and t = 0 both stand for 1
+        {"0000000000000000000000000000000000000000000000000000000000000000"
+         "0000000000000000000000000000000000000000000000000000000000000000",
+         "edd1fd3e327ce90cc7a3542614289aee9682003e9cf7dcc9cf2ca9743be5aa0c"},
+        // u and t are reduced mod p
+        {"ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"
+         "ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff",
+         "a9d2410259b9697cce4599ef2f96fbe8b47d53dcdff28ba28810f0607b89a740"},
+        {"fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f"
+         "2d711642b726b04401627ca9fbac32f5c8530fb1903cc4db02258717921a4881",
+         "5e9ff857c784082b24f0b8bf493228beae95858f4e54584558ac6a4f6dfafb30"},
+        {"0000000000000000000000000000000000000000000000000000000000000000"
+         "0101010101010101010101010101010101010101010101010101010101010101",
+         "2c2342e80a366a53ef237722dcd68bddce43f6e21b48494570fcbfde58620851"},
+        {"0bfe935e70c321c7ca3afc75ce0d0ca2f98b5422e008bb31c00c6d7f1f1c0ad6"
+         "e3b98a4da31a127d4bde6e43033f66ba274cab0eb7eb1c70ec41402bf6273dd8",
+         "b062ac3b65d43d441f1c53dc5da7416b1640600cc39e9f1658f987f19fd44585"},
+    };
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        uint8_t encoded[SV2_NOISE_ELLSWIFT_SIZE], key[32], expected[32];
+        hex2bin(vectors[i][0], encoded, sizeof(encoded));
+        hex2bin(vectors[i][1], expected, sizeof(expected));
+        TEST_ASSERT_TRUE(sv2_noise_ellswift_decode(encoded, key));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, key, 32);
+    }
+}
+
+TEST_CASE("SV2 x-only ECDH matches BIP324", "[sv2_noise]")
+{
+    uint8_t initiator_secret[32], responder_secret[32];
+    memset(initiator_secret, 0x11, sizeof(initiator_secret));
+    memset(responder_secret, 0x22, sizeof(responder_secret));
+    uint8_t ell_initiator[SV2_NOISE_ELLSWIFT_SIZE], ell_responder[SV2_NOISE_ELLSWIFT_SIZE];
+    hex2bin("671193c0af3e9af55e0528f8d0a19a69805547c9394a6d05a6edc652f1a2810a"
+            "831f4453449e66d4b3afa39fccfd035644905cfe3d93b4cfc9b373c8c6bf2f5d",
+            ell_initiator, sizeof(ell_initiator));
+    hex2bin("7fc149d2dd84a5780086d5592ff01e1e899ddea93ef2635aaac97a9e94a5edfb"
+            "181a7dfda608da34152a6cdedb9102412826ba186966d007dd99c1ded1364364",
+            ell_responder, sizeof(ell_responder));
+
+    uint8_t shared[32], expected[32];
+    hex2bin("98b0308daa94dd977f3deec17ecf1b0ccb734939de554a67c07792f4533a9874", expected, sizeof(expected));
+    TEST_ASSERT_TRUE(sv2_noise_ellswift_xdh(ell_initiator, ell_responder, initiator_secret, true, shared));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, shared, 32);
+    TEST_ASSERT_TRUE(sv2_noise_ellswift_xdh(ell_initiator, ell_responder, responder_secret, false, shared));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, shared, 32);
+}
+
+TEST_CASE("SV2 authority keys decode from base58check", "[sv2_noise]")
+{
+    uint8_t key[32], expected[32];
+    // the authority key of the reference implementation's example pool
+    TEST_ASSERT_TRUE(sv2_noise_decode_authority_key("9auqWEzQDVyd2oe1JVGFLMLHZtCo2FFqZwtKA5gd9xbuEu7PH72", key));
+    hex2bin("24ee3c3804a1aaa4c03b80ea19f7a5863c916e8994b7db94a3bad7ee092b6ce7", expected, sizeof(expected));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, key, 32);
+
+    TEST_ASSERT_FALSE(sv2_noise_decode_authority_key("9auqWEzQDVyd2oe1JVGFLMLHZtCo2FFqZwtKA5gd9xbuEu7PH73", key));
+    TEST_ASSERT_FALSE(sv2_noise_decode_authority_key("0auqWEzQDVyd2oe1JVGFLMLHZtCo2FFqZwtKA5gd9xbuEu7PH72", key));
+}
+
+TEST_CASE("SV2 handshake agrees on the transport keys", "[sv2_noise]")
+{
+    uint8_t authority_key[32], static_secret[32], cert[SV2_NOISE_CERT_SIZE];
+    make_pool(authority_key, static_secret, cert, 1800000000);
+
+    sv2_noise miner, pool;
+    uint8_t act1[SV2_NOISE_ACT1_SIZE], act2[SV2_NOISE_ACT2_SIZE];
+    TEST_ASSERT_TRUE(sv2_noise_initiator_start(&miner, act1));
+    TEST_ASSERT_TRUE(sv2_noise_responder_reply(&pool, act1, static_secret, cert, act2));
+    TEST_ASSERT_EQUAL(SV2_NOISE_OK, sv2_noise_initiator_finish(&miner, act2, authority_key, 1750000000));
+
+    uint8_t frame[SV2_HEADER_SIZE + 5] = {0, 0, SV2_MSG_SET_TARGET, 5, 0, 0, 'h', 'e', 'l', 'l', 'o'};
+    uint8_t encrypted[SV2_NOISE_HEADER_SIZE + 5 + SV2_NOISE_MAC_SIZE];
+    for (int i = 0; i < 2; i++) {
+        // nonces advance in step on both ends
+        TEST_ASSERT_TRUE(sv2_noise_encrypt_frame(&miner.send, frame, sizeof(frame), encrypted));
+        TEST_ASSERT_EQUAL(SV2_HEADER_SIZE, sv2_noise_decrypt(&pool.recv, encrypted, SV2_NOISE_HEADER_SIZE));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(frame, encrypted, SV2_HEADER_SIZE);
+        TEST_ASSERT_EQUAL(5, sv2_noise_decrypt(&pool.recv, encrypted + SV2_NOISE_HEADER_SIZE, 5 + SV2_NOISE_MAC_SIZE));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY("hello", encrypted + SV2_NOISE_HEADER_SIZE, 5);
+    }
+
+    TEST_ASSERT_TRUE(sv2_noise_encrypt_frame(&pool.send, frame, sizeof(frame), encrypted));
+    encrypted[SV2_NOISE_HEADER_SIZE] ^= 1;
+    TEST_ASSERT_EQUAL(SV2_HEADER_SIZE, sv2_noise_decrypt(&miner.recv, encrypted, SV2_NOISE_HEADER_SIZE));
+    TEST_ASSERT_EQUAL(-1, sv2_noise_decrypt(&miner.recv, encrypted + SV2_NOISE_HEADER_SIZE, 5 + SV2_NOISE_MAC_SIZE));
+}
+
+TEST_CASE("SV2 handshake rejects foreign and expired certificates", "[sv2_noise]")
+{
+    uint8_t authority_key[32], static_secret[32], cert[SV2_NOISE_CERT_SIZE];
+    make_pool(authority_key, static_secret, cert, 1800000000);
+
+    sv2_noise miner, pool;
+    uint8_t act1[SV2_NOISE_ACT1_SIZE], act2[SV2_NOISE_ACT2_SIZE];
+    TEST_ASSERT_TRUE(sv2_noise_initiator_start(&miner, act1));
+    TEST_ASSERT_TRUE(sv2_noise_responder_reply(&pool, act1, static_secret, cert, act2));
+    sv2_noise retry = miner;
+    sv2_noise retry_expired = miner;
+
+    uint8_t other_key[32];
+    memcpy(other_key, authority_key, 32);
+    other_key[0] ^= 1;
+    TEST_ASSERT_EQUAL(SV2_NOISE_ERR_CERT_SIGNATURE, sv2_noise_initiator_finish(&miner, act2, other_key, 0));
+    TEST_ASSERT_EQUAL(SV2_NOISE_ERR_CERT_EXPIRED, sv2_noise_initiator_finish(&retry_expired, act2, authority_key, 1900000000));
+
+    act2[SV2_NOISE_ACT2_SIZE - 1] ^= 1;
+    TEST_ASSERT_EQUAL(SV2_NOISE_ERR_DECRYPT, sv2_noise_initiator_finish(&retry, act2, authority_key, 0));
+}
+
+TEST_CASE("SV2 payloads longer than a Noise message are split into chunks", "[sv2_noise]")
+{
+    TEST_ASSERT_EQUAL(0, sv2_noise_encrypted_size(0));
+    TEST_ASSERT_EQUAL(100 + SV2_NOISE_MAC_SIZE, sv2_noise_encrypted_size(100));
+    TEST_ASSERT_EQUAL(SV2_NOISE_MAX_CHUNK, sv2_noise_encrypted_size(SV2_NOISE_MAX_CHUNK - SV2_NOISE_MAC_SIZE));
+    TEST_ASSERT_EQUAL(SV2_NOISE_MAX_CHUNK + 1 + SV2_NOISE_MAC_SIZE,
+                      sv2_noise_encrypted_size(SV2_NOISE_MAX_CHUNK - SV2_NOISE_MAC_SIZE + 1));
+}
@@ -0,0 +1,82 @@
+#include "unity.h"
+#include "sv2_protocol.h"
+#include <string.h>
+
+TEST_CASE("SV2 frames encode little-endian fields behind the header", "[sv2_protocol]")
+{
+    uint8_t buffer[64];
+    sv2_writer writer;
+    sv2_writer_init(&writer, buffer, sizeof(buffer));
+    size_t header = sv2_frame_begin(&writer, SV2_MSG_SUBMIT_SHARES_STANDARD, true);
+    sv2_write_u32(&writer, 0x04030201);
+    sv2_write_u16(&writer, 0x0605);
+    sv2_write_option_u32(&writer, false, 0);
+    sv2_write_option_u32(&writer, true, 0x0a090807);
+    sv2_write_str0_255(&writer, "ab");
+    TEST_ASSERT_TRUE(sv2_frame_end(&writer, header));
+
+    static const uint8_t expected[] = {0x00, 0x80, 0x1a, 15, 0, 0, 1, 2, 3, 4, 5, 6, 0, 1, 7, 8, 9, 10, 2, 'a', 'b'};
+    TEST_ASSERT_EQUAL(sizeof(expected), writer.len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, buffer, sizeof(expected));
+
+    sv2_frame_header parsed;
+    sv2_parse_header(buffer, &parsed);
+    TEST_ASSERT_EQUAL_HEX32(SV2_CHANNEL_MSG_BIT, parsed.extension_type);
+    TEST_ASSERT_EQUAL(SV2_MSG_SUBMIT_SHARES_STANDARD, parsed.msg_type);
+    TEST_ASSERT_EQUAL(15, parsed.msg_length);
+
+    sv2_reader reader;
+    sv2_reader_init(&reader, buffer + SV2_HEADER_SIZE, parsed.msg_length);
+    TEST_ASSERT_EQUAL_HEX32(0x04030201, sv2_read_u32(&reader));
+    TEST_ASSERT_EQUAL_HEX32(0x0605, sv2_read_u16(&reader));
+    bool present;
+    sv2_read_option_u32(&reader, &present);
+    TEST_ASSERT_FALSE(present);
+    TEST_ASSERT_EQUAL_HEX32(0x0a090807, sv2_read_option_u32(&reader, &present));
+    TEST_ASSERT_TRUE(present);
+    char str[8];
+    sv2_read_str0_255(&reader, str, sizeof(str));
+    TEST_ASSERT_EQUAL_STRING("ab", str);
+    TEST_ASSERT_FALSE(reader.error);
+}
+
+TEST_CASE("SV2 reader and writer flag truncated messages", "[sv2_protocol]")
+{
+    uint8_t buffer[8];
+    sv2_writer writer;
+    sv2_writer_init(&writer, buffer, sizeof(buffer));
+    size_t header = sv2_frame_begin(&writer, SV2_MSG_SET_TARGET, true);
+    sv2_write_u32(&writer, 1);
+    TEST_ASSERT_FALSE(sv2_frame_end(&writer, header));
+
+    // a B0_64K whose length runs past the payload
+    static const uint8_t payload[] = {0x10, 0x00, 'a', 'b'};
+    sv2_reader reader;
+    sv2_reader_init(&reader, payload, sizeof(payload));
+    size_t len;
+    TEST_ASSERT_NULL(sv2_read_b0_64k(&reader, &len));
+    TEST_ASSERT_TRUE(reader.error);
+    TEST_ASSERT_EQUAL(0, sv2_read_u32(&reader));
+}
+
+TEST_CASE("SV2 targets convert to pool difficulties", "[sv2_protocol]")
+{
+    uint8_t target[32];
+    sv2_difficulty_to_target(1, target);
+    TEST_ASSERT_EQUAL(1, sv2_target_to_difficulty(target));
+
+    // difficulty 1 is 0xffff << 208, little-endian
+    memset(target, 0, sizeof(target));
+    target[26] = 0xff;
+    target[27] = 0xff;
+    TEST_ASSERT_EQUAL(1, sv2_target_to_difficulty(target));
+
+    uint32_t difficulties[] = {2, 1024, 65536, 1000000};
+    for (int i = 0; i < 4; i++) {
+        sv2_difficulty_to_target(difficulties[i], target);
+        TEST_ASSERT_EQUAL(difficulties[i], sv2_target_to_difficulty(target));
+    }
+
+    memset(target, 0, sizeof(target));
+    TEST_ASSERT_EQUAL(UINT32_MAX, sv2_target_to_difficulty(target));
+}
@@ -0,0 +1,52 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// must be a power of two, head and tail run freely and are masked on access
+#define QUEUE_SIZE 16
+
+// Blocked producers and consumers are woken with this task notification. With a single
+// notification entry it is shared with other users, waits re-check the queue so that is only slower.
+#define WORK_QUEUE_NOTIFY_INDEX (configTASK_NOTIFICATION_ARRAY_ENTRIES - 1)
+
+// Lock-free ring for exactly one producer task and one consumer task. queue_clear() may be
+// called from any task, it claims the queued work with the same compare-and-swap on head as the consumer.
+typedef struct
+{
+    void *buffer[QUEUE_SIZE];
+    // advanced by the consumer and queue_clear()
+    _Atomic uint32_t head;
+    // written by the producer only
+    _Atomic uint32_t tail;
+    // set while the consumer waits for work or the producer for space
+    _Atomic(TaskHandle_t) consumer_waiting;
+    _Atomic(TaskHandle_t) producer_waiting;
+    void (*free_work)(void *work);
+} work_queue;
+
+/// @param free_work called for the work dropped by queue_clear()
+void queue_init(work_queue *queue, void (*free_work)(void *work));
+
+/// @brief Adds work, blocks while the queue is full. Producer only.
+void queue_enqueue(work_queue *queue, void *new_work);
+
+/// @brief Removes the oldest work, blocks while the queue is empty. Consumer only.
+void *queue_dequeue(work_queue *queue);
+
+/// @brief Waits until work is available without taking it. Consumer only.
+/// @return false if the queue is still empty after ticks
+bool queue_wait(work_queue *queue, TickType_t ticks);
+
+/// @brief Frees all work enqueued so far. Safe to call from any task while the producer and
+/// consumer keep running, work they add or take concurrently is not affected.
+void queue_clear(work_queue *queue);
+
+/// @return the number of work items waiting for the consumer
+int queue_count(work_queue *queue);
+
+#endif // WORK_QUEUE_H
@@ -0,0 +1,289 @@
+#include "unity.h"
+#include "work_queue.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+static int freed;
+
+static void count_freed(void *work)
+{
+    freed++;
+}
+
+TEST_CASE("Work queue keeps order across wrap around", "[work_queue]")
+{
+    work_queue queue;
+    queue_init(&queue, count_freed);
+
+    uintptr_t next_in = 1, next_out = 1;
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < QUEUE_SIZE - 3; i++) {
+            queue_enqueue(&queue, (void *)next_in++);
+        }
+        TEST_ASSERT_EQUAL(QUEUE_SIZE - 3, queue_count(&queue));
+        while (queue_count(&queue) > 0) {
+            TEST_ASSERT_EQUAL(next_out++, (uintptr_t)queue_dequeue(&queue));
+        }
+    }
+}
+
+TEST_CASE("Work queue clear frees queued work", "[work_queue]")
+{
+    work_queue queue;
+    queue_init(&queue, count_freed);
+    freed = 0;
+
+    for (uintptr_t i = 1; i <= QUEUE_SIZE; i++) {
+        queue_enqueue(&queue, (void *)i);
+    }
+    TEST_ASSERT_EQUAL(1, (uintptr_t)queue_dequeue(&queue));
+    queue_clear(&queue);
+    TEST_ASSERT_EQUAL(QUEUE_SIZE - 1, freed);
+    TEST_ASSERT_EQUAL(0, queue_count(&queue));
+
+    queue_clear(&queue);
+    TEST_ASSERT_EQUAL(QUEUE_SIZE - 1, freed);
+
+    // a full queue worth of space is available again
+    for (uintptr_t i = 1; i <= QUEUE_SIZE; i++) {
+        queue_enqueue(&queue, (void *)i);
+    }
+    TEST_ASSERT_EQUAL(QUEUE_SIZE, queue_count(&queue));
+    TEST_ASSERT_EQUAL(1, (uintptr_t)queue_dequeue(&queue));
+}
+
+static void delayed_producer(void *pvParameters)
+{
+    vTaskDelay(20 / portTICK_PERIOD_MS);
+    queue_enqueue((work_queue *)pvParameters, (void *)1);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Work queue wait returns on new work or timeout", "[work_queue]")
+{
+    work_queue queue;
+    queue_init(&queue, count_freed);
+
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_FALSE(queue_wait(&queue, 10 / portTICK_PERIOD_MS));
+    TEST_ASSERT_TRUE(esp_timer_get_time() - start >= 9000);
+
+    xTaskCreate(delayed_producer, "delayed producer", 4096, &queue, uxTaskPriorityGet(NULL), NULL);
+    start = esp_timer_get_time();
+    TEST_ASSERT_TRUE(queue_wait(&queue, 1000 / portTICK_PERIOD_MS));
+    TEST_ASSERT_TRUE(esp_timer_get_time() - start < 500000);
+    TEST_ASSERT_EQUAL(1, queue_count(&queue));
+    TEST_ASSERT_TRUE(queue_wait(&queue, 0));
+    TEST_ASSERT_EQUAL(1, (uintptr_t)queue_dequeue(&queue));
+}
+
+#define STRESS_ITEMS 50000
+#define STRESS_DONE ((void *)UINTPTR_MAX)
+
+static struct
+{
+    work_queue queue;
+    uint8_t dequeued[STRESS_ITEMS / 8 + 1];
+    uint8_t cleared[STRESS_ITEMS / 8 + 1];
+    volatile bool producer_finished;
+    SemaphoreHandle_t clearer_finished;
+    SemaphoreHandle_t producer_finished_sem;
+    uint32_t clears;
+    uint32_t bad_clears;
+} stress;
+
+// also runs on the clearer task, where a failed assertion can't unwind the test
+static bool mark(uint8_t *bitmap, uintptr_t item)
+{
+    if (item < 1 || item > STRESS_ITEMS || (bitmap[item / 8] & (1 << (item % 8)))) {
+        return false;
+    }
+    bitmap[item / 8] |= 1 << (item % 8);
+    return true;
+}
+
+static void stress_free(void *work)
+{
+    if (!mark(stress.cleared, (uintptr_t)work)) {
+        stress.bad_clears++;
+    }
+}
+
+static void stress_producer(void *pvParameters)
+{
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i++) {
+        queue_enqueue(&stress.queue, (void *)i);
+        // alternate between running ahead of the consumer and letting it drain the queue
+        if (i % 5000 == 0) {
+            vTaskDelay(1);
+        }
+    }
+    stress.producer_finished = true;
+
+    // nothing may clear the end marker
+    xSemaphoreTake(stress.clearer_finished, portMAX_DELAY);
+    queue_enqueue(&stress.queue, STRESS_DONE);
+    xSemaphoreGive(stress.producer_finished_sem);
+    vTaskDelete(NULL);
+}
+
+static void stress_clearer(void *pvParameters)
+{
+    while (!stress.producer_finished) {
+        queue_clear(&stress.queue);
+        stress.clears++;
+        for (volatile int spin = 0; spin < (stress.clears % 7) * 200; spin++) {
+        }
+        taskYIELD();
+    }
+    xSemaphoreGive(stress.clearer_finished);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Work queue stress with concurrent clear", "[work_queue]")
+{
+    memset(&stress, 0, sizeof(stress));
+    queue_init(&stress.queue, stress_free);
+    stress.clearer_finished = xSemaphoreCreateBinary();
+    stress.producer_finished_sem = xSemaphoreCreateBinary();
+
+    xTaskCreate(stress_producer, "stress producer", 4096, NULL, uxTaskPriorityGet(NULL), NULL);
+    xTaskCreate(stress_clearer, "stress clearer", 4096, NULL, uxTaskPriorityGet(NULL), NULL);
+
+    uintptr_t last = 0;
+    void *work;
+    while ((work = queue_dequeue(&stress.queue)) != STRESS_DONE) {
+        TEST_ASSERT_TRUE((uintptr_t)work > last);
+        last = (uintptr_t)work;
+        TEST_ASSERT_TRUE(mark(stress.dequeued, last));
+    }
+    xSemaphoreTake(stress.producer_finished_sem, portMAX_DELAY);
+    TEST_ASSERT_EQUAL(0, stress.bad_clears);
+
+    // every item was either dequeued or cleared, exactly once
+    int dequeued = 0;
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i++) {
+        bool was_dequeued = stress.dequeued[i / 8] & (1 << (i % 8));
+        bool was_cleared = stress.cleared[i / 8] & (1 << (i % 8));
+        TEST_ASSERT_TRUE(was_dequeued != was_cleared);
+        dequeued += was_dequeued;
+    }
+    TEST_ASSERT_EQUAL(0, queue_count(&stress.queue));
+    printf("%d dequeued, %d cleared in %lu clears\n", dequeued, STRESS_ITEMS - dequeued, (unsigned long)stress.clears);
+
+    vSemaphoreDelete(stress.clearer_finished);
+    vSemaphoreDelete(stress.producer_finished_sem);
+}
+
+// Previous mutex and condition variable queue, kept for comparison
+typedef struct
+{
+    void *buffer[QUEUE_SIZE];
+    int head;
+    int tail;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} legacy_queue;
+
+static void legacy_enqueue(legacy_queue *queue, void *new_work)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == QUEUE_SIZE) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    queue->buffer[queue->tail] = new_work;
+    queue->tail = (queue->tail + 1) % QUEUE_SIZE;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void *legacy_dequeue(legacy_queue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    void *next_work = queue->buffer[queue->head];
+    queue->head = (queue->head + 1) % QUEUE_SIZE;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return next_work;
+}
+
+#define LATENCY_ROUNDS 1000
+
+static struct
+{
+    work_queue queue;
+    legacy_queue legacy;
+    bool use_legacy;
+    volatile int64_t enqueued_at;
+    int64_t total;
+    int64_t max;
+    SemaphoreHandle_t done;
+} latency;
+
+static void latency_consumer(void *pvParameters)
+{
+    for (int i = 0; i < LATENCY_ROUNDS; i++) {
+        if (latency.use_legacy) {
+            legacy_dequeue(&latency.legacy);
+        } else {
+            queue_dequeue(&latency.queue);
+        }
+        int64_t elapsed = esp_timer_get_time() - latency.enqueued_at;
+        latency.total += elapsed;
+        latency.max = elapsed > latency.max ? elapsed : latency.max;
+    }
+    xSemaphoreGive(latency.done);
+    vTaskDelete(NULL);
+}
+
+static void measure_latency(bool use_legacy)
+{
+    latency.use_legacy = use_legacy;
+    latency.total = 0;
+    latency.max = 0;
+    xTaskCreatePinnedToCore(latency_consumer, "latency consumer", 4096, NULL, 10, NULL, 1);
+
+    for (int i = 0; i < LATENCY_ROUNDS; i++) {
+        // the consumer is blocked in dequeue by the time the next work arrives
+        vTaskDelay(1);
+        latency.enqueued_at = esp_timer_get_time();
+        if (use_legacy) {
+            legacy_enqueue(&latency.legacy, (void *)1);
+        } else {
+            queue_enqueue(&latency.queue, (void *)1);
+        }
+    }
+    xSemaphoreTake(latency.done, portMAX_DELAY);
+
+    printf("%s: enqueue to dequeue wakeup avg %lld us, max %lld us\n", use_legacy ? "pthread queue" : "lock-free queue",
+           (long long)(latency.total / LATENCY_ROUNDS), (long long)latency.max);
+}
+
+TEST_CASE("Work queue wakeup latency", "[benchmark][not-on-qemu]")
+{
+    queue_init(&latency.queue, count_freed);
+    memset(&latency.legacy, 0, sizeof(latency.legacy));
+    pthread_mutex_init(&latency.legacy.lock, NULL);
+    pthread_cond_init(&latency.legacy.not_empty, NULL);
+    pthread_cond_init(&latency.legacy.not_full, NULL);
+    latency.done = xSemaphoreCreateBinary();
+
+    // the test task (producer) runs on core 0, the consumer on core 1
+    measure_latency(true);
+    measure_latency(false);
+
+    vSemaphoreDelete(latency.done);
+    pthread_cond_destroy(&latency.legacy.not_empty);
+    pthread_cond_destroy(&latency.legacy.not_full);
+    pthread_mutex_destroy(&latency.legacy.lock);
+}
@@ -0,0 +1,123 @@
+#include "work_queue.h"
+
+_Static_assert((QUEUE_SIZE & (QUEUE_SIZE - 1)) == 0, "QUEUE_SIZE must be a power of two");
+
+#define QUEUE_INDEX(position) ((position) & (QUEUE_SIZE - 1))
+
+void queue_init(work_queue *queue, void (*free_work)(void *work))
+{
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->consumer_waiting, NULL);
+    atomic_init(&queue->producer_waiting, NULL);
+    queue->free_work = free_work;
+}
+
+// The waiter publishes its handle before re-checking the queue and the other side publishes its
+// change before looking for a waiter (both sequentially consistent), so a wakeup can't get lost.
+static void wake_waiting(_Atomic(TaskHandle_t) *waiting)
+{
+    TaskHandle_t task = atomic_load(waiting);
+    if (task != NULL) {
+        xTaskNotifyGiveIndexed(task, WORK_QUEUE_NOTIFY_INDEX);
+    }
+}
+
+static void wait_for_wake(_Atomic(TaskHandle_t) *waiting, TickType_t ticks)
+{
+    ulTaskNotifyTakeIndexed(WORK_QUEUE_NOTIFY_INDEX, pdTRUE, ticks);
+    atomic_store(waiting, NULL);
+}
+
+void queue_enqueue(work_queue *queue, void *new_work)
+{
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    while (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == QUEUE_SIZE)
+    {
+        atomic_store(&queue->producer_waiting, xTaskGetCurrentTaskHandle());
+        if (tail - atomic_load(&queue->head) == QUEUE_SIZE) {
+            wait_for_wake(&queue->producer_waiting, portMAX_DELAY);
+        } else {
+            atomic_store(&queue->producer_waiting, NULL);
+        }
+    }
+
+    queue->buffer[QUEUE_INDEX(tail)] = new_work;
+    atomic_store(&queue->tail, tail + 1);
+
+    wake_waiting(&queue->consumer_waiting);
+}
+
+void *queue_dequeue(work_queue *queue)
+{
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    while (1)
+    {
+        if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) {
+            atomic_store(&queue->consumer_waiting, xTaskGetCurrentTaskHandle());
+            if (head == atomic_load(&queue->tail)) {
+                wait_for_wake(&queue->consumer_waiting, portMAX_DELAY);
+            } else {
+                atomic_store(&queue->consumer_waiting, NULL);
+            }
+            head = atomic_load_explicit(&queue->head, memory_order_acquire);
+            continue;
+        }
+
+        void *next_work = queue->buffer[QUEUE_INDEX(head)];
+        // fails only if queue_clear() took the work first, head is reloaded by the failed exchange
+        if (atomic_compare_exchange_weak(&queue->head, &head, head + 1)) {
+            wake_waiting(&queue->producer_waiting);
+            return next_work;
+        }
+    }
+}
+
+bool queue_wait(work_queue *queue, TickType_t ticks)
+{
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) {
+        atomic_store(&queue->consumer_waiting, xTaskGetCurrentTaskHandle());
+        if (head == atomic_load(&queue->tail)) {
+            wait_for_wake(&queue->consumer_waiting, ticks);
+        } else {
+            atomic_store(&queue->consumer_waiting, NULL);
+        }
+    }
+
+    return queue_count(queue) > 0;
+}
+
+void queue_clear(work_queue *queue)
+{
+    void *cleared[QUEUE_SIZE];
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    uint32_t tail;
+
+    do {
+        tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        // the slots stay untouched by the producer until head has moved past them
+        for (uint32_t position = head; position != tail; position++) {
+            cleared[position - head] = queue->buffer[QUEUE_INDEX(position)];
+        }
+    } while (!atomic_compare_exchange_weak(&queue->head, &head, tail));
+
+    wake_waiting(&queue->producer_waiting);
+
+    for (uint32_t i = 0; i < tail - head; i++) {
+        queue->free_work(cleared[i]);
+    }
+}
+
+int queue_count(work_queue *queue)
+{
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    // head may pass a stale tail if work is taken between the two loads
+    int count = (int32_t)(tail - head);
+    return count < 0 ? 0 : count;
+}
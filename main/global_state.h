@@ -1,14 +1,21 @@
 #ifndef GLOBAL_STATE_H_
 #define GLOBAL_STATE_H_
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include "asic_task.h"
+#include "asic_result_task.h"
 #include "common.h"
 #include "power_management_task.h"
 #include "statistics_task.h"
 #include "serial.h"
 #include "stratum_api.h"
+#include "share_tracker.h"
+#include "stratum_vardiff.h"
+#include "stratum_liveness.h"
+#include "sv2_client.h"
 #include "work_queue.h"
 #include "device_config.h"
 #include "display.h"
@@ -19,11 +26,28 @@
 #define HISTORY_LENGTH 100
 #define DIFF_STRING_SIZE 10
 
+// Entries of the pool table, 0 is the primary and 1 the fallback pool
+#define MAX_POOLS 4
+
 typedef struct {
     char message[64];
     uint32_t count;
 } RejectedReasonStat;
 
+typedef struct
+{
+    char * url; // empty if the entry is not used
+    uint16_t port;
+    char * user;
+    char * pass;
+    // share of the hashrate in split mode, relative to the weights of the other pools
+    uint16_t weight;
+    // base58check authority key, the pool speaks Stratum V2 if set
+    char * authority_key;
+    // stratum+ssl, ignored for Stratum V2 pools that encrypt with Noise
+    bool tls;
+} PoolConfig;
+
 typedef struct
 {
     double duration_start;
@@ -49,15 +73,21 @@ typedef struct
     char ap_ssid[32];
     bool ap_enabled;
     bool is_connected;
-    char * pool_url;
-    char * fallback_pool_url;
-    uint16_t pool_port;
-    uint16_t fallback_pool_port;
-    char * pool_user;
-    char * fallback_pool_user;
-    char * pool_pass;
-    char * fallback_pool_pass;
-    bool is_using_fallback;
+    // in priority order for failover
+    PoolConfig pools[MAX_POOLS];
+    // pool of the stratum connection when not splitting, entries after 0 are fallbacks
+    int active_pool;
+    // mine on every pool with a weight at the same time instead of failing over
+    bool pool_split;
+    // keep an idle connection to the fallback pool open while mining on the primary one
+    bool fallback_hot_standby;
+    uint16_t connect_timeout_ms;
+    // a connection silent for this long despite probes is closed, 0 leaves it to TCP
+    uint16_t dead_timeout_s;
+    // ring size for capturing the stratum lines in KB, 0 when not capturing
+    uint16_t stratum_capture_kb;
+    // the suggested difficulty targets this share rate, 0 for the fixed default difficulty
+    uint16_t shares_per_minute;
     uint16_t overheat_mode;
     uint16_t power_fault;
     uint32_t lastClockSync;
@@ -76,8 +106,57 @@ typedef struct
     bool finished;
 } SelfTestModule;
 
+// A connection to one pool, with everything that shares for its jobs are submitted with
 typedef struct
 {
+    // index into SYSTEM_MODULE.pools, follows the failover when not splitting
+    int pool;
+    // jobs are scheduled in proportion to the weights of the sessions
+    uint16_t weight;
+
+    int sock;
+    line_buffer rx_buffer;
+    // every message to the pool goes through here, written by the session's stratum tx task
+    stratum_tx tx;
+    // mining.submit requests waiting for the pool's response
+    share_tracker share_tracker;
+    // allocated if any pool the session may connect to speaks Stratum V2, shares go through it while sv2_active
+    sv2_client * sv2;
+    bool sv2_active;
+
+    // A message ID that must be unique per request that expects a response.
+    // For requests not expecting a response (called notifications), this is null.
+    // Taken by the session task and the share task, only through atomic_fetch_add().
+    atomic_int send_uid;
+
+    // Replaced in place by mining.set_extranonce, under extranonce_lock since the job creation reads it.
+    // The generation is bumped by every change, the coinbase of the current notify is rebuilt then.
+    char extranonce_str[STRATUM_MAX_EXTRANONCE_LEN * 2 + 1];
+    int extranonce_2_len;
+    _Atomic uint32_t extranonce_generation;
+    pthread_mutex_t extranonce_lock;
+    // the subscription to resume after a short disconnect from subscribed_pool, empty if there is none
+    char subscription_id[STRATUM_MAX_SUBSCRIPTION_ID_LEN];
+    int subscribed_pool;
+    int64_t disconnected_us;
+    // 0 until the pool answers mining.configure
+    uint32_t version_mask;
+    uint32_t stratum_difficulty;
+    // what mining.suggest_difficulty asked for, sized for the session's part of the hashrate
+    stratum_vardiff vardiff;
+    // notices a connection that died without being closed
+    stratum_liveness liveness;
+
+    // Bumped by every clean_jobs notify and reconnect. Notifies, jobs and the ASIC results for them
+    // carry the generation of their session they were created in, anything older than this is stale.
+    _Atomic uint32_t work_generation;
+    // when the current work generation started, for logging how fast new work reaches the ASIC
+    int64_t work_generation_start_us;
+} StratumSession;
+
+typedef struct
+{
+    // notifies of every session, the session tasks enqueue one at a time
     work_queue stratum_queue;
     work_queue ASIC_jobs_queue;
 
@@ -85,27 +164,21 @@ typedef struct
     DeviceConfig DEVICE_CONFIG;
     DisplayConfig DISPLAY_CONFIG;
     AsicTaskModule ASIC_TASK_MODULE;
+    AsicResultModule ASIC_RESULT_MODULE;
     PowerManagementModule POWER_MANAGEMENT_MODULE;
     SelfTestModule SELF_TEST_MODULE;
     StatisticsModule STATISTICS_MODULE;
 
-    char * extranonce_str;
-    int extranonce_2_len;
-    int abandon_work;
-
-    uint8_t * valid_jobs;
-    pthread_mutex_t valid_jobs_lock;
+    // one per pool when splitting, otherwise a single session following the failover
+    StratumSession sessions[MAX_POOLS];
+    int session_count;
+    // the lines of every session, NULL when not capturing
+    stratum_capture * stratum_capture;
 
-    uint32_t stratum_difficulty;
+    // rolled by the ASIC, the bits every connected pool allows
     uint32_t version_mask;
     bool new_stratum_version_rolling_msg;
 
-    int sock;
-
-    // A message ID that must be unique per request that expects a response.
-    // For requests not expecting a response (called notifications), this is null.
-    int send_uid;
-
     bool ASIC_initalized;
     bool psram_is_available;
 } GlobalState;
@@ -0,0 +1,52 @@
+import { ComponentFixture, TestBed } from '@angular/core/testing';
+import { FormBuilder } from '@angular/forms';
+import { ToastrService } from 'ngx-toastr';
+import { of } from 'rxjs';
+import { LoadingService } from 'src/app/services/loading.service';
+import { SystemService } from 'src/app/services/system.service';
+
+import { PoolComponent } from './pool.component';
+
+describe('PoolComponent', () => {
+  let component: PoolComponent;
+  let fixture: ComponentFixture<PoolComponent>;
+  let systemService: jasmine.SpyObj<SystemService>;
+
+  beforeEach(() => {
+    systemService = jasmine.createSpyObj('SystemService', ['getInfo', 'updateSystem', 'restart']);
+    systemService.getInfo.and.returnValue(of({
+      stratumURL: 'public-pool.io',
+      stratumPort: 21496,
+      stratumUser: 'user',
+      fallbackStratumURL: 'solo.ckpool.org',
+      fallbackStratumPort: 3333,
+      fallbackStratumUser: 'user',
+      fallbackHotStandby: 1
+    } as any));
+    systemService.updateSystem.and.returnValue(of(true));
+
+    TestBed.configureTestingModule({
+      declarations: [PoolComponent],
+      providers: [
+        FormBuilder,
+        LoadingService,
+        { provide: SystemService, useValue: systemService },
+        { provide: ToastrService, useValue: jasmine.createSpyObj('ToastrService', ['success', 'warning', 'error']) }
+      ]
+    });
+    fixture = TestBed.createComponent(PoolComponent);
+    component = fixture.componentInstance;
+    component.ngOnInit();
+  });
+
+  it('should post the hot standby checkbox as a number', () => {
+    expect(component.form.value.fallbackHotStandby).toBeTrue();
+
+    component.updateSystem();
+    expect(systemService.updateSystem).toHaveBeenCalledWith('', jasmine.objectContaining({ fallbackHotStandby: 1 }));
+
+    component.form.patchValue({ fallbackHotStandby: false });
+    component.updateSystem();
+    expect(systemService.updateSystem).toHaveBeenCalledWith('', jasmine.objectContaining({ fallbackHotStandby: 0 }));
+  });
+});
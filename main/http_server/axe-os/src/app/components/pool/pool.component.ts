@@ -53,7 +53,8 @@ export class PoolComponent implements OnInit {
           stratumUser: [info.stratumUser, [Validators.required]],
           stratumPassword: ['*****', [Validators.required]],
           fallbackStratumUser: [info.fallbackStratumUser, [Validators.required]],
-          fallbackStratumPassword: ['password', [Validators.required]]
+          fallbackStratumPassword: ['password', [Validators.required]],
+          fallbackHotStandby: [info.fallbackHotStandby == 1]
         });
       });
   }
@@ -65,6 +66,8 @@ export class PoolComponent implements OnInit {
       delete form.stratumPassword;
     }
 
+    form.fallbackHotStandby = form.fallbackHotStandby == true ? 1 : 0;
+
     this.systemService.updateSystem(this.uri, form)
       .pipe(this.loadingService.lockUIUntilComplete())
       .subscribe({
@@ -36,6 +36,22 @@ export class SystemService {
         bestDiff: "0",
         bestSessionDiff: "0",
         freeHeap: 200504,
+        jobPoolInUse: 17,
+        jobPoolHighWater: 29,
+        jobPoolCapacity: 141,
+        resultQueueDepth: 0,
+        resultQueueHighWater: 3,
+        resultsDropped: 0,
+        stratumTxMessages: 412,
+        stratumTxSends: 398,
+        stratumTxDropped: 0,
+        stratumTxLatencyAvgUs: 850,
+        stratumTxLatencyMaxUs: 41000,
+        sharesInFlight: 0,
+        sharesLost: 0,
+        shareLatencyP50Ms: 49.152,
+        shareLatencyP95Ms: 131.072,
+        shareLatencyP99Ms: 262.144,
         coreVoltage: 1200,
         coreVoltageActual: 1200,
         hostname: "Bitaxe",
@@ -58,6 +74,19 @@ export class SystemService {
         fallbackStratumPort: 21497,
         stratumUser: "bc1q99n3pu025yyu0jlywpmwzalyhm36tg5u37w20d.bitaxe-U1",
         fallbackStratumUser: "bc1q99n3pu025yyu0jlywpmwzalyhm36tg5u37w20d.bitaxe-U1",
+        fallbackHotStandby: 0,
+        poolSplit: 0,
+        sharesPerMinute: 6,
+        stratumCaptureSize: 0,
+        pools: [
+          { url: "public-pool.io", port: 21496, user: "bc1q99n3pu025yyu0jlywpmwzalyhm36tg5u37w20d.bitaxe-U1", weight: 1, authorityKey: "", tls: 0 },
+          { url: "test.public-pool.io", port: 21497, user: "bc1q99n3pu025yyu0jlywpmwzalyhm36tg5u37w20d.bitaxe-U1", weight: 1, authorityKey: "", tls: 0 },
+          { url: "", port: 3333, user: "", weight: 1, authorityKey: "", tls: 0 },
+          { url: "", port: 3333, user: "", weight: 1, authorityKey: "", tls: 0 }
+        ],
+        stratumSessions: [
+          { pool: 1, url: "test.public-pool.io", weight: 1, connected: true, stratumV2: false, stratumDiff: 1000, sharesAccepted: 1, sharesRejected: 0, sharesLost: 0, shareLatencyP50Ms: 49.152 }
+        ],
         isUsingFallbackStratum: true,
         frequency: 485,
         version: "2.0",
@@ -5,6 +5,28 @@ interface ISharesRejectedStat {
     count: number;
 }
 
+interface IPoolConfig {
+    url: string;
+    port: number;
+    user: string;
+    weight: number;
+    authorityKey: string;
+    tls: number;
+}
+
+interface IStratumSession {
+    pool: number;
+    url: string;
+    weight: number;
+    connected: boolean;
+    stratumV2: boolean;
+    stratumDiff: number;
+    sharesAccepted: number;
+    sharesRejected: number;
+    sharesLost: number;
+    shareLatencyP50Ms: number;
+}
+
 export interface ISystemInfo {
 
     display: string;
@@ -23,6 +45,22 @@ export interface ISystemInfo {
     bestDiff: string,
     bestSessionDiff: string,
     freeHeap: number,
+    jobPoolInUse: number,
+    jobPoolHighWater: number,
+    jobPoolCapacity: number,
+    resultQueueDepth: number,
+    resultQueueHighWater: number,
+    resultsDropped: number,
+    stratumTxMessages: number,
+    stratumTxSends: number,
+    stratumTxDropped: number,
+    stratumTxLatencyAvgUs: number,
+    stratumTxLatencyMaxUs: number,
+    sharesInFlight: number,
+    sharesLost: number,
+    shareLatencyP50Ms: number,
+    shareLatencyP95Ms: number,
+    shareLatencyP99Ms: number,
     coreVoltage: number,
     hostname: string,
     macAddr: string,
@@ -44,6 +82,12 @@ export interface ISystemInfo {
     isUsingFallbackStratum: boolean,
     stratumUser: string,
     fallbackStratumUser: string,
+    fallbackHotStandby: number,
+    poolSplit: number,
+    sharesPerMinute: number,
+    stratumCaptureSize: number,
+    pools: IPoolConfig[],
+    stratumSessions: IStratumSession[],
     frequency: number,
     version: string,
     idfVersion: string,
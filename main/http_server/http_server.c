@@ -29,6 +29,7 @@
 
 #include "cJSON.h"
 #include "global_state.h"
+#include "system.h"
 #include "nvs_config.h"
 #include "vcore.h"
 #include "power.h"
@@ -449,6 +450,46 @@ static esp_err_t PATCH_update_settings(httpd_req_t * req)
     if ((item = cJSON_GetObjectItem(root, "fallbackStratumPort")) != NULL) {
         nvs_config_set_u16(NVS_CONFIG_FALLBACK_STRATUM_PORT, item->valueint);
     }
+    if ((item = cJSON_GetObjectItem(root, "fallbackHotStandby")) != NULL) {
+        // the web UI posts a checkbox, older clients a number
+        nvs_config_set_u16(NVS_CONFIG_FALLBACK_HOT_STANDBY, cJSON_IsBool(item) ? cJSON_IsTrue(item) : item->valueint);
+    }
+    if ((item = cJSON_GetObjectItem(root, "poolSplit")) != NULL) {
+        nvs_config_set_u16(NVS_CONFIG_POOL_SPLIT, item->valueint);
+    }
+    if ((item = cJSON_GetObjectItem(root, "sharesPerMinute")) != NULL) {
+        nvs_config_set_u16(NVS_CONFIG_SHARES_PER_MINUTE, item->valueint);
+    }
+    if ((item = cJSON_GetObjectItem(root, "stratumCaptureSize")) != NULL) {
+        nvs_config_set_u16(NVS_CONFIG_STRATUM_CAPTURE_SIZE, item->valueint);
+    }
+    // entries 0 and 1 are the primary and fallback pool
+    cJSON * pools = cJSON_GetObjectItem(root, "pools");
+    for (int i = 0; i < MAX_POOLS && i < cJSON_GetArraySize(pools); i++) {
+        const PoolNvsConfig * nvs = &SYSTEM_POOL_NVS_CONFIG[i];
+        cJSON * pool = cJSON_GetArrayItem(pools, i);
+        if (cJSON_IsString(item = cJSON_GetObjectItem(pool, "url"))) {
+            nvs_config_set_string(nvs->url_key, item->valuestring);
+        }
+        if (cJSON_IsNumber(item = cJSON_GetObjectItem(pool, "port"))) {
+            nvs_config_set_u16(nvs->port_key, item->valueint);
+        }
+        if (cJSON_IsString(item = cJSON_GetObjectItem(pool, "user"))) {
+            nvs_config_set_string(nvs->user_key, item->valuestring);
+        }
+        if (cJSON_IsString(item = cJSON_GetObjectItem(pool, "password"))) {
+            nvs_config_set_string(nvs->pass_key, item->valuestring);
+        }
+        if (cJSON_IsNumber(item = cJSON_GetObjectItem(pool, "weight"))) {
+            nvs_config_set_u16(nvs->weight_key, item->valueint);
+        }
+        if (cJSON_IsString(item = cJSON_GetObjectItem(pool, "authorityKey"))) {
+            nvs_config_set_string(nvs->authority_key_key, item->valuestring);
+        }
+        if (cJSON_IsNumber(item = cJSON_GetObjectItem(pool, "tls"))) {
+            nvs_config_set_u16(nvs->tls_key, item->valueint);
+        }
+    }
     if (cJSON_IsString(item = cJSON_GetObjectItem(root, "ssid"))) {
         nvs_config_set_string(NVS_CONFIG_WIFI_SSID, item->valuestring);
     }
@@ -577,13 +618,64 @@ static esp_err_t GET_system_info(httpd_req_t * req)
     cJSON_AddNumberToObject(root, "expectedHashrate", expected_hashrate);
     cJSON_AddStringToObject(root, "bestDiff", GLOBAL_STATE->SYSTEM_MODULE.best_diff_string);
     cJSON_AddStringToObject(root, "bestSessionDiff", GLOBAL_STATE->SYSTEM_MODULE.best_session_diff_string);
-    cJSON_AddNumberToObject(root, "stratumDiff", GLOBAL_STATE->stratum_difficulty);
+    cJSON_AddNumberToObject(root, "stratumDiff", GLOBAL_STATE->sessions[0].stratum_difficulty);
 
-    cJSON_AddNumberToObject(root, "isUsingFallbackStratum", GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback);
+    cJSON_AddNumberToObject(root, "isUsingFallbackStratum", GLOBAL_STATE->SYSTEM_MODULE.active_pool != 0);
 
     cJSON_AddNumberToObject(root, "isPSRAMAvailable", GLOBAL_STATE->psram_is_available);
 
     cJSON_AddNumberToObject(root, "freeHeap", esp_get_free_heap_size());
+
+    bm_job_pool_stats job_pool_stats;
+    bm_job_pool_get_stats(&job_pool_stats);
+    cJSON_AddNumberToObject(root, "jobPoolInUse", job_pool_stats.in_use);
+    cJSON_AddNumberToObject(root, "jobPoolHighWater", job_pool_stats.high_water);
+    cJSON_AddNumberToObject(root, "jobPoolCapacity", job_pool_stats.capacity);
+
+    AsicResultModule * asic_result = &GLOBAL_STATE->ASIC_RESULT_MODULE;
+    cJSON_AddNumberToObject(root, "resultQueueDepth", asic_result->results ? uxQueueMessagesWaiting(asic_result->results) : 0);
+    cJSON_AddNumberToObject(root, "resultQueueHighWater", atomic_load(&asic_result->queue_high_water));
+    cJSON_AddNumberToObject(root, "resultsDropped", atomic_load(&asic_result->dropped));
+
+    // the first session, the only one unless the hashrate is split across pools
+    stratum_tx_stats tx_stats = {0};
+    share_tracker_stats share_stats = {0};
+    if (GLOBAL_STATE->session_count > 0) {
+        stratum_tx_get_stats(&GLOBAL_STATE->sessions[0].tx, &tx_stats);
+        share_tracker_get_stats(&GLOBAL_STATE->sessions[0].share_tracker, &share_stats);
+    }
+    cJSON_AddNumberToObject(root, "stratumTxMessages", tx_stats.messages);
+    cJSON_AddNumberToObject(root, "stratumTxSends", tx_stats.sends);
+    cJSON_AddNumberToObject(root, "stratumTxDropped", tx_stats.dropped);
+    cJSON_AddNumberToObject(root, "stratumTxLatencyAvgUs", tx_stats.latency_avg_us);
+    cJSON_AddNumberToObject(root, "stratumTxLatencyMaxUs", tx_stats.latency_max_us);
+
+    cJSON_AddNumberToObject(root, "sharesInFlight", share_stats.in_flight);
+    cJSON_AddNumberToObject(root, "sharesLost", share_stats.lost);
+    cJSON_AddNumberToObject(root, "shareLatencyP50Ms", share_stats.latency_p50_us / 1000.0);
+    cJSON_AddNumberToObject(root, "shareLatencyP95Ms", share_stats.latency_p95_us / 1000.0);
+    cJSON_AddNumberToObject(root, "shareLatencyP99Ms", share_stats.latency_p99_us / 1000.0);
+
+    cJSON * sessions = cJSON_CreateArray();
+    cJSON_AddItemToObject(root, "stratumSessions", sessions);
+    for (int i = 0; i < GLOBAL_STATE->session_count; i++) {
+        StratumSession * session = &GLOBAL_STATE->sessions[i];
+        share_tracker_get_stats(&session->share_tracker, &share_stats);
+
+        cJSON * session_obj = cJSON_CreateObject();
+        cJSON_AddNumberToObject(session_obj, "pool", session->pool);
+        cJSON_AddStringToObject(session_obj, "url", GLOBAL_STATE->SYSTEM_MODULE.pools[session->pool].url);
+        cJSON_AddNumberToObject(session_obj, "weight", session->weight);
+        cJSON_AddBoolToObject(session_obj, "connected", session->sock >= 0);
+        cJSON_AddBoolToObject(session_obj, "stratumV2", session->sv2_active);
+        cJSON_AddNumberToObject(session_obj, "stratumDiff", session->stratum_difficulty);
+        cJSON_AddNumberToObject(session_obj, "sharesAccepted", share_stats.accepted);
+        cJSON_AddNumberToObject(session_obj, "sharesRejected", share_stats.rejected);
+        cJSON_AddNumberToObject(session_obj, "sharesLost", share_stats.lost);
+        cJSON_AddNumberToObject(session_obj, "shareLatencyP50Ms", share_stats.latency_p50_us / 1000.0);
+        cJSON_AddItemToArray(sessions, session_obj);
+    }
+
     cJSON_AddNumberToObject(root, "coreVoltage", nvs_config_get_u16(NVS_CONFIG_ASIC_VOLTAGE, CONFIG_ASIC_VOLTAGE));
     cJSON_AddNumberToObject(root, "coreVoltageActual", VCORE_get_voltage_mv(GLOBAL_STATE));
     cJSON_AddNumberToObject(root, "frequency", frequency);
@@ -616,6 +708,32 @@ static esp_err_t GET_system_info(httpd_req_t * req)
     cJSON_AddNumberToObject(root, "fallbackStratumPort", nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_PORT, CONFIG_FALLBACK_STRATUM_PORT));
     cJSON_AddStringToObject(root, "stratumUser", stratumUser);
     cJSON_AddStringToObject(root, "fallbackStratumUser", fallbackStratumUser);
+    cJSON_AddNumberToObject(root, "fallbackHotStandby", nvs_config_get_u16(NVS_CONFIG_FALLBACK_HOT_STANDBY, 0));
+    cJSON_AddNumberToObject(root, "poolSplit", nvs_config_get_u16(NVS_CONFIG_POOL_SPLIT, 0));
+    cJSON_AddNumberToObject(root, "sharesPerMinute", nvs_config_get_u16(NVS_CONFIG_SHARES_PER_MINUTE, CONFIG_STRATUM_SHARES_PER_MINUTE));
+    cJSON_AddNumberToObject(root, "stratumCaptureSize", nvs_config_get_u16(NVS_CONFIG_STRATUM_CAPTURE_SIZE, CONFIG_STRATUM_CAPTURE_SIZE));
+
+    cJSON * pools = cJSON_CreateArray();
+    cJSON_AddItemToObject(root, "pools", pools);
+    for (int i = 0; i < MAX_POOLS; i++) {
+        const PoolNvsConfig * nvs = &SYSTEM_POOL_NVS_CONFIG[i];
+        char * url = nvs_config_get_string(nvs->url_key, nvs->default_url);
+        char * user = nvs_config_get_string(nvs->user_key, nvs->default_user);
+        char * authority_key = nvs_config_get_string(nvs->authority_key_key, "");
+
+        cJSON * pool = cJSON_CreateObject();
+        cJSON_AddStringToObject(pool, "url", url);
+        cJSON_AddNumberToObject(pool, "port", nvs_config_get_u16(nvs->port_key, nvs->default_port));
+        cJSON_AddStringToObject(pool, "user", user);
+        cJSON_AddNumberToObject(pool, "weight", nvs_config_get_u16(nvs->weight_key, 1));
+        cJSON_AddStringToObject(pool, "authorityKey", authority_key);
+        cJSON_AddNumberToObject(pool, "tls", nvs_config_get_u16(nvs->tls_key, 0));
+        cJSON_AddItemToArray(pools, pool);
+
+        free(url);
+        free(user);
+        free(authority_key);
+    }
 
     cJSON_AddStringToObject(root, "version", esp_app_get_description()->version);
     cJSON_AddStringToObject(root, "idfVersion", esp_get_idf_version());
@@ -793,6 +911,37 @@ static esp_err_t GET_system_statistics_dashboard(httpd_req_t * req)
     return ESP_OK;
 }
 
+static esp_err_t GET_stratum_capture(httpd_req_t * req)
+{
+    if (is_network_allowed(req) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    }
+
+    // Set CORS headers
+    if (set_cors_headers(req) != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_OK;
+    }
+
+    if (GLOBAL_STATE->stratum_capture == NULL) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Stratum capture is off");
+    }
+
+    // a copy, the stratum tasks keep capturing meanwhile
+    size_t len;
+    uint8_t * capture = stratum_capture_export(GLOBAL_STATE->stratum_capture, &len);
+    if (capture == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"stratum.scap\"");
+    esp_err_t err = httpd_resp_send(req, (const char *) capture, len);
+    free(capture);
+    return err;
+}
+
 esp_err_t POST_WWW_update(httpd_req_t * req)
 {
     if (is_network_allowed(req) != ESP_OK) {
@@ -1132,6 +1281,15 @@ esp_err_t start_rest_server(void * pvParameters)
     };
     httpd_register_uri_handler(server, &system_statistics_dashboard_get_uri);
 
+    /* URI handler for downloading the stratum capture */
+    httpd_uri_t stratum_capture_get_uri = {
+        .uri = "/api/system/stratum/capture", 
+        .method = HTTP_GET, 
+        .handler = GET_stratum_capture, 
+        .user_ctx = rest_context
+    };
+    httpd_register_uri_handler(server, &stratum_capture_get_uri);
+
     /* URI handler for WiFi scan */
     httpd_uri_t wifi_scan_get_uri = {
         .uri = "/api/system/wifi/scan",
@@ -23,15 +23,22 @@
 #include "device_config.h"
 
 static GlobalState GLOBAL_STATE = {
-    .extranonce_str = NULL, 
-    .extranonce_2_len = 0, 
-    .abandon_work = 0, 
     .version_mask = 0,
     .ASIC_initalized = false
 };
 
 static const char * TAG = "bitaxe";
 
+static void free_mining_notify(void * work)
+{
+    STRATUM_V1_free_mining_notify(work);
+}
+
+static void free_job(void * work)
+{
+    free_bm_job(work);
+}
+
 void app_main(void)
 {
     ESP_LOGI(TAG, "Welcome to the bitaxe - FOSS || GTFO!");
@@ -99,8 +106,26 @@ void app_main(void)
 
     wifi_softap_off();
 
-    queue_init(&GLOBAL_STATE.stratum_queue);
-    queue_init(&GLOBAL_STATE.ASIC_jobs_queue);
+    queue_init(&GLOBAL_STATE.stratum_queue, free_mining_notify);
+    queue_init(&GLOBAL_STATE.ASIC_jobs_queue, free_job);
+
+    if (!bm_job_pool_init(JOB_POOL_SIZE, ASIC_get_job_packet_len(&GLOBAL_STATE))) {
+        GLOBAL_STATE.SYSTEM_MODULE.asic_status = "Job pool allocation failed";
+        ESP_LOGE(TAG, "Job pool allocation failed");
+        return;
+    }
+
+    if (!stratum_init_sessions(&GLOBAL_STATE)) {
+        GLOBAL_STATE.SYSTEM_MODULE.asic_status = "Stratum buffer allocation failed";
+        ESP_LOGE(TAG, "Stratum buffer allocation failed");
+        return;
+    }
+
+    if (!ASIC_result_init(&GLOBAL_STATE)) {
+        GLOBAL_STATE.SYSTEM_MODULE.asic_status = "Result queue allocation failed";
+        ESP_LOGE(TAG, "Result queue allocation failed");
+        return;
+    }
 
     SERIAL_init();
 
@@ -119,5 +144,6 @@ void app_main(void)
     xTaskCreate(create_jobs_task, "stratum miner", 8192, (void *) &GLOBAL_STATE, 10, NULL);
     xTaskCreate(ASIC_task, "asic", 8192, (void *) &GLOBAL_STATE, 10, NULL);
     xTaskCreate(ASIC_result_task, "asic result", 8192, (void *) &GLOBAL_STATE, 15, NULL);
+    xTaskCreate(ASIC_share_task, "asic share", 8192, (void *) &GLOBAL_STATE, 10, NULL);
     xTaskCreate(statistics_task, "statistics", 8192, (void *) &GLOBAL_STATE, 3, NULL);
 }
@@ -16,6 +16,34 @@
 #define NVS_CONFIG_STRATUM_PASS "stratumpass"
 #define NVS_CONFIG_FALLBACK_STRATUM_USER "fbstratumuser"
 #define NVS_CONFIG_FALLBACK_STRATUM_PASS "fbstratumpass"
+#define NVS_CONFIG_FALLBACK_HOT_STANDBY "fbhotstandby"
+#define NVS_CONFIG_STRATUM_WEIGHT "stratumweight"
+#define NVS_CONFIG_FALLBACK_STRATUM_WEIGHT "fbstratumweight"
+#define NVS_CONFIG_POOL_2_URL "pool2url"
+#define NVS_CONFIG_POOL_2_PORT "pool2port"
+#define NVS_CONFIG_POOL_2_USER "pool2user"
+#define NVS_CONFIG_POOL_2_PASS "pool2pass"
+#define NVS_CONFIG_POOL_2_WEIGHT "pool2weight"
+#define NVS_CONFIG_POOL_3_URL "pool3url"
+#define NVS_CONFIG_POOL_3_PORT "pool3port"
+#define NVS_CONFIG_POOL_3_USER "pool3user"
+#define NVS_CONFIG_POOL_3_PASS "pool3pass"
+#define NVS_CONFIG_POOL_3_WEIGHT "pool3weight"
+// base58check authority key of a Stratum V2 pool, the pool is spoken to in V1 while empty
+#define NVS_CONFIG_STRATUM_SV2_KEY "stratumsv2key"
+#define NVS_CONFIG_FALLBACK_STRATUM_SV2_KEY "fbstratumsv2key"
+#define NVS_CONFIG_POOL_2_SV2_KEY "pool2sv2key"
+#define NVS_CONFIG_POOL_3_SV2_KEY "pool3sv2key"
+// stratum+ssl instead of stratum+tcp
+#define NVS_CONFIG_STRATUM_TLS "stratumtls"
+#define NVS_CONFIG_FALLBACK_STRATUM_TLS "fbstratumtls"
+#define NVS_CONFIG_POOL_2_TLS "pool2tls"
+#define NVS_CONFIG_POOL_3_TLS "pool3tls"
+#define NVS_CONFIG_POOL_SPLIT "poolsplit"
+#define NVS_CONFIG_STRATUM_CONNECT_TIMEOUT "connecttimeout"
+#define NVS_CONFIG_STRATUM_DEAD_TIMEOUT "deadtimeout"
+#define NVS_CONFIG_STRATUM_CAPTURE_SIZE "capturesize"
+#define NVS_CONFIG_SHARES_PER_MINUTE "sharesperminute"
 #define NVS_CONFIG_ASIC_FREQ "asicfrequency"
 #define NVS_CONFIG_ASIC_VOLTAGE "asicvoltage"
 #define NVS_CONFIG_ASIC_MODEL "asicmodel"
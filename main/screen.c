@@ -414,7 +414,7 @@ static void screen_update_cb(lv_timer_t * timer)
 
     PowerManagementModule * power_management = &GLOBAL_STATE->POWER_MANAGEMENT_MODULE;
 
-    char *pool_url = module->is_using_fallback ? module->fallback_pool_url : module->pool_url;
+    char *pool_url = module->pools[module->active_pool].url;
     if (strcmp(lv_label_get_text(mining_url_scr_urls_label), pool_url) != 0) {
         lv_label_set_text(mining_url_scr_urls_label, pool_url);
     }
@@ -345,34 +345,36 @@ void self_test(void * pvParameters)
         tests_done(GLOBAL_STATE, TESTS_FAILED);
     }
 
-    GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs = malloc(sizeof(bm_job *) * 128);
-    GLOBAL_STATE->valid_jobs = malloc(sizeof(uint8_t) * 128);
+    GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs = malloc(sizeof(*GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs) * MAX_ACTIVE_JOBS);
 
-    for (int i = 0; i < 128; i++) {
-        GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[i] = NULL;
-        GLOBAL_STATE->valid_jobs[i] = 0;
+    for (int i = 0; i < MAX_ACTIVE_JOBS; i++) {
+        atomic_init(&GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[i], NULL);
     }
 
     vTaskDelay(1000 / portTICK_PERIOD_MS);
 
     mining_notify notify_message;
     notify_message.job_id = 0;
-    notify_message.prev_block_hash = "0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000";
+    swap_endian_words("0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000", notify_message.prev_block_hash);
     notify_message.version = 0x20000004;
     notify_message.version_mask = 0x1fffe000;
     notify_message.target = 0x1705ae3a;
     notify_message.ntime = 0x647025b5;
-    notify_message.difficulty = 1000000;
-
-    const char * coinbase_tx = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b0389130cfab"
-                               "e6d6d5cbab26a2599e92916edec"
-                               "5657a94a0708ddb970f5c45b5d12905085617eff8e010000000000000031650707758de07b010000000000001cfd703"
-                               "8212f736c7573682f0000000003"
-                               "79ad0c2a000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c29525"
-                               "34b424c4f434b3ae725d3994b81"
-                               "1572c1f345deb98b56b465ef8e153ecbbd27fa37bf1b005161380000000000000000266a24aa21a9ed63b06a7946b19"
-                               "0a3fda1d76165b25c9b883bcc66"
-                               "21b040773050ee2a1bb18f1800000000";
+    mining_notify_set_difficulty(&notify_message, 1000000);
+    notify_message.generation = atomic_load(&GLOBAL_STATE->sessions[0].work_generation);
+    notify_message.session = 0;
+
+    const char coinbase_tx_hex[] = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b0389130cfab"
+                                   "e6d6d5cbab26a2599e92916edec"
+                                   "5657a94a0708ddb970f5c45b5d12905085617eff8e010000000000000031650707758de07b010000000000001cfd703"
+                                   "8212f736c7573682f0000000003"
+                                   "79ad0c2a000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c29525"
+                                   "34b424c4f434b3ae725d3994b81"
+                                   "1572c1f345deb98b56b465ef8e153ecbbd27fa37bf1b005161380000000000000000266a24aa21a9ed63b06a7946b19"
+                                   "0a3fda1d76165b25c9b883bcc66"
+                                   "21b040773050ee2a1bb18f1800000000";
+    uint8_t coinbase_tx[sizeof(coinbase_tx_hex) / 2];
+    hex2bin(coinbase_tx_hex, coinbase_tx, sizeof(coinbase_tx));
     uint8_t merkles[13][32];
     int num_merkles = 13;
 
@@ -390,9 +392,20 @@ void self_test(void * pvParameters)
     hex2bin("c4f5ab01913fc186d550c1a28f3f3e9ffaca2016b961a6a751f8cca0089df924", merkles[11], 32);
     hex2bin("cff737e1d00176dd6bbfa73071adbb370f227cfb5fba186562e4060fcec877e1", merkles[12], 32);
 
-    char * merkle_root = calculate_merkle_root_hash(coinbase_tx, merkles, num_merkles);
+    uint8_t merkle_root[32];
+    calculate_merkle_root_hash(coinbase_tx, sizeof(coinbase_tx), merkles, num_merkles, merkle_root);
 
-    bm_job job = construct_bm_job(&notify_message, merkle_root, 0x1fffe000);
+    // the active job slots take a reference, so the job has to come from the pool
+    bm_job * job = NULL;
+    if (bm_job_pool_init(1, ASIC_get_job_packet_len(GLOBAL_STATE))) {
+        job = alloc_bm_job();
+    }
+    if (job == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate job");
+        tests_done(GLOBAL_STATE, TESTS_FAILED);
+    }
+    *job = construct_bm_job(&notify_message, merkle_root, 0x1fffe000);
+    ASIC_serialize_job(GLOBAL_STATE, job);
 
     uint8_t difficulty_mask = 8;
 
@@ -402,7 +415,7 @@ void self_test(void * pvParameters)
     ESP_LOGI(TAG, "Sending work");
 
     //(*GLOBAL_STATE->ASIC_functions.send_work_fn)(GLOBAL_STATE, &job);
-    ASIC_send_work(GLOBAL_STATE, &job);
+    ASIC_send_work(GLOBAL_STATE, job);
     
     double start = esp_timer_get_time();
     double sum = 0;
@@ -414,7 +427,7 @@ void self_test(void * pvParameters)
         task_result * asic_result = ASIC_process_work(GLOBAL_STATE);
         if (asic_result != NULL) {
             // check the nonce difficulty
-            double nonce_diff = test_nonce_value(&job, asic_result->nonce, asic_result->rolled_version);
+            double nonce_diff = test_nonce_value(job, asic_result->nonce, asic_result->rolled_version);
             sum += difficulty_mask;
             
             hash_rate = (sum * 4294967296) / (duration * 1000000000);
@@ -436,8 +449,10 @@ void self_test(void * pvParameters)
         tests_done(GLOBAL_STATE, TESTS_FAILED);
     }
 
+    for (int i = 0; i < MAX_ACTIVE_JOBS; i++) {
+        ASIC_set_active_job(GLOBAL_STATE, i, NULL);
+    }
     free(GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs);
-    free(GLOBAL_STATE->valid_jobs);
 
     if (test_core_voltage(GLOBAL_STATE) != ESP_OK) {
         tests_done(GLOBAL_STATE, TESTS_FAILED);
@@ -37,9 +37,23 @@ static void _suffix_string(uint64_t, char *, size_t, int);
 //local function prototypes
 static esp_err_t ensure_overheat_mode_config();
 
-static void _check_for_best_diff(GlobalState * GLOBAL_STATE, double diff, uint8_t job_id);
+static void _check_for_best_diff(GlobalState * GLOBAL_STATE, double diff, uint32_t nbits, bool found_block);
 static void _suffix_string(uint64_t val, char * buf, size_t bufsiz, int sigdigits);
 
+const PoolNvsConfig SYSTEM_POOL_NVS_CONFIG[MAX_POOLS] = {
+    {NVS_CONFIG_STRATUM_URL, NVS_CONFIG_STRATUM_PORT, NVS_CONFIG_STRATUM_USER, NVS_CONFIG_STRATUM_PASS,
+     NVS_CONFIG_STRATUM_WEIGHT, NVS_CONFIG_STRATUM_SV2_KEY, NVS_CONFIG_STRATUM_TLS, CONFIG_STRATUM_URL, CONFIG_STRATUM_PORT,
+     CONFIG_STRATUM_USER, CONFIG_STRATUM_PW},
+    {NVS_CONFIG_FALLBACK_STRATUM_URL, NVS_CONFIG_FALLBACK_STRATUM_PORT, NVS_CONFIG_FALLBACK_STRATUM_USER,
+     NVS_CONFIG_FALLBACK_STRATUM_PASS, NVS_CONFIG_FALLBACK_STRATUM_WEIGHT, NVS_CONFIG_FALLBACK_STRATUM_SV2_KEY,
+     NVS_CONFIG_FALLBACK_STRATUM_TLS, CONFIG_FALLBACK_STRATUM_URL, CONFIG_FALLBACK_STRATUM_PORT,
+     CONFIG_FALLBACK_STRATUM_USER, CONFIG_FALLBACK_STRATUM_PW},
+    {NVS_CONFIG_POOL_2_URL, NVS_CONFIG_POOL_2_PORT, NVS_CONFIG_POOL_2_USER, NVS_CONFIG_POOL_2_PASS,
+     NVS_CONFIG_POOL_2_WEIGHT, NVS_CONFIG_POOL_2_SV2_KEY, NVS_CONFIG_POOL_2_TLS, "", CONFIG_STRATUM_PORT, "", "x"},
+    {NVS_CONFIG_POOL_3_URL, NVS_CONFIG_POOL_3_PORT, NVS_CONFIG_POOL_3_USER, NVS_CONFIG_POOL_3_PASS,
+     NVS_CONFIG_POOL_3_WEIGHT, NVS_CONFIG_POOL_3_SV2_KEY, NVS_CONFIG_POOL_3_TLS, "", CONFIG_STRATUM_PORT, "", "x"},
+};
+
 void SYSTEM_init_system(GlobalState * GLOBAL_STATE)
 {
     SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
@@ -57,24 +71,26 @@ void SYSTEM_init_system(GlobalState * GLOBAL_STATE)
     module->lastClockSync = 0;
     module->FOUND_BLOCK = false;
     
-    // set the pool url
-    module->pool_url = nvs_config_get_string(NVS_CONFIG_STRATUM_URL, CONFIG_STRATUM_URL);
-    module->fallback_pool_url = nvs_config_get_string(NVS_CONFIG_FALLBACK_STRATUM_URL, CONFIG_FALLBACK_STRATUM_URL);
-
-    // set the pool port
-    module->pool_port = nvs_config_get_u16(NVS_CONFIG_STRATUM_PORT, CONFIG_STRATUM_PORT);
-    module->fallback_pool_port = nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_PORT, CONFIG_FALLBACK_STRATUM_PORT);
-
-    // set the pool user
-    module->pool_user = nvs_config_get_string(NVS_CONFIG_STRATUM_USER, CONFIG_STRATUM_USER);
-    module->fallback_pool_user = nvs_config_get_string(NVS_CONFIG_FALLBACK_STRATUM_USER, CONFIG_FALLBACK_STRATUM_USER);
-
-    // set the pool password
-    module->pool_pass = nvs_config_get_string(NVS_CONFIG_STRATUM_PASS, CONFIG_STRATUM_PW);
-    module->fallback_pool_pass = nvs_config_get_string(NVS_CONFIG_FALLBACK_STRATUM_PASS, CONFIG_FALLBACK_STRATUM_PW);
+    // set the pool table
+    for (int i = 0; i < MAX_POOLS; i++) {
+        const PoolNvsConfig * nvs = &SYSTEM_POOL_NVS_CONFIG[i];
+        module->pools[i].url = nvs_config_get_string(nvs->url_key, nvs->default_url);
+        module->pools[i].port = nvs_config_get_u16(nvs->port_key, nvs->default_port);
+        module->pools[i].user = nvs_config_get_string(nvs->user_key, nvs->default_user);
+        module->pools[i].pass = nvs_config_get_string(nvs->pass_key, nvs->default_pass);
+        module->pools[i].weight = nvs_config_get_u16(nvs->weight_key, 1);
+        module->pools[i].authority_key = nvs_config_get_string(nvs->authority_key_key, "");
+        module->pools[i].tls = nvs_config_get_u16(nvs->tls_key, 0) != 0;
+    }
+    module->pool_split = nvs_config_get_u16(NVS_CONFIG_POOL_SPLIT, 0) != 0;
 
-    // set fallback to false.
-    module->is_using_fallback = false;
+    // start on the primary pool
+    module->active_pool = 0;
+    module->fallback_hot_standby = nvs_config_get_u16(NVS_CONFIG_FALLBACK_HOT_STANDBY, 0) != 0;
+    module->connect_timeout_ms = nvs_config_get_u16(NVS_CONFIG_STRATUM_CONNECT_TIMEOUT, CONFIG_STRATUM_CONNECT_TIMEOUT);
+    module->dead_timeout_s = nvs_config_get_u16(NVS_CONFIG_STRATUM_DEAD_TIMEOUT, CONFIG_STRATUM_DEAD_TIMEOUT);
+    module->stratum_capture_kb = nvs_config_get_u16(NVS_CONFIG_STRATUM_CAPTURE_SIZE, CONFIG_STRATUM_CAPTURE_SIZE);
+    module->shares_per_minute = nvs_config_get_u16(NVS_CONFIG_SHARES_PER_MINUTE, CONFIG_STRATUM_SHARES_PER_MINUTE);
 
     // Initialize overheat_mode
     module->overheat_mode = nvs_config_get_u16(NVS_CONFIG_OVERHEAT_MODE, 0);
@@ -176,7 +192,7 @@ void SYSTEM_notify_new_ntime(GlobalState * GLOBAL_STATE, uint32_t ntime)
     settimeofday(&tv, NULL);
 }
 
-void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double found_diff, uint8_t job_id)
+void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double found_diff, uint32_t nbits, bool found_block)
 {
     SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
 
@@ -216,7 +232,7 @@ void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double found_diff, ui
     // logArrayContents(historical_hashrate, HISTORY_LENGTH);
     // logArrayContents(historical_hashrate_time_stamps, HISTORY_LENGTH);
 
-    _check_for_best_diff(GLOBAL_STATE, found_diff, job_id);
+    _check_for_best_diff(GLOBAL_STATE, found_diff, nbits, found_block);
 }
 
 static double _calculate_network_difficulty(uint32_t nBits)
@@ -231,7 +247,7 @@ static double _calculate_network_difficulty(uint32_t nBits)
     return difficulty;
 }
 
-static void _check_for_best_diff(GlobalState * GLOBAL_STATE, double diff, uint8_t job_id)
+static void _check_for_best_diff(GlobalState * GLOBAL_STATE, double diff, uint32_t nbits, bool found_block)
 {
     SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
 
@@ -240,10 +256,9 @@ static void _check_for_best_diff(GlobalState * GLOBAL_STATE, double diff, uint8_
         _suffix_string((uint64_t) diff, module->best_session_diff_string, DIFF_STRING_SIZE, 0);
     }
 
-    double network_diff = _calculate_network_difficulty(GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->target);
-    if (diff > network_diff) {
+    if (found_block) {
         module->FOUND_BLOCK = true;
-        ESP_LOGI(TAG, "FOUND BLOCK!!!!!!!!!!!!!!!!!!!!!! %f > %f", diff, network_diff);
+        ESP_LOGI(TAG, "FOUND BLOCK!!!!!!!!!!!!!!!!!!!!!! %f > %f", diff, _calculate_network_difficulty(nbits));
     }
 
     if ((uint64_t) diff <= module->best_nonce_diff) {
@@ -256,7 +271,7 @@ static void _check_for_best_diff(GlobalState * GLOBAL_STATE, double diff, uint8_
     // make the best_nonce_diff into a string
     _suffix_string((uint64_t) diff, module->best_diff_string, DIFF_STRING_SIZE, 0);
 
-    ESP_LOGI(TAG, "Network diff: %f", network_diff);
+    ESP_LOGI(TAG, "Network diff: %f", _calculate_network_difficulty(nbits));
 }
 
 /* Convert a uint64_t value into a truncated string for displaying with its
@@ -4,12 +4,30 @@
 #include "esp_err.h"
 #include "global_state.h"
 
+// NVS keys and defaults of an entry of the pool table
+typedef struct
+{
+    const char * url_key;
+    const char * port_key;
+    const char * user_key;
+    const char * pass_key;
+    const char * weight_key;
+    const char * authority_key_key;
+    const char * tls_key;
+    const char * default_url;
+    uint16_t default_port;
+    const char * default_user;
+    const char * default_pass;
+} PoolNvsConfig;
+
+extern const PoolNvsConfig SYSTEM_POOL_NVS_CONFIG[MAX_POOLS];
+
 void SYSTEM_init_system(GlobalState * GLOBAL_STATE);
 esp_err_t SYSTEM_init_peripherals(GlobalState * GLOBAL_STATE);
 
 void SYSTEM_notify_accepted_share(GlobalState * GLOBAL_STATE);
 void SYSTEM_notify_rejected_share(GlobalState * GLOBAL_STATE, char * error_msg);
-void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double found_diff, uint8_t job_id);
+void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double found_diff, uint32_t nbits, bool found_block);
 void SYSTEM_notify_mining_started(GlobalState * GLOBAL_STATE);
 void SYSTEM_notify_new_ntime(GlobalState * GLOBAL_STATE, uint32_t ntime);
 
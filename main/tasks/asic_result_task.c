@@ -5,6 +5,7 @@
 #include "serial.h"
 #include <string.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_config.h"
 #include "utils.h"
 #include "stratum_task.h"
@@ -12,9 +13,29 @@
 
 static const char *TAG = "asic_result";
 
+// A result together with the job it was found for. The queue holds a reference to the job so
+// it can't be replaced in its slot before the share task gets to it.
+typedef struct
+{
+    task_result result;
+    bm_job *job;
+} queued_result;
+
+bool ASIC_result_init(void *pvParameters)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    AsicResultModule *module = &GLOBAL_STATE->ASIC_RESULT_MODULE;
+
+    atomic_init(&module->dropped, 0);
+    atomic_init(&module->queue_high_water, 0);
+    module->results = xQueueCreate(ASIC_RESULT_QUEUE_SIZE, sizeof(queued_result));
+    return module->results != NULL;
+}
+
 void ASIC_result_task(void *pvParameters)
 {
     GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    AsicResultModule *module = &GLOBAL_STATE->ASIC_RESULT_MODULE;
 
     while (1)
     {
@@ -28,40 +49,122 @@ void ASIC_result_task(void *pvParameters)
 
         uint8_t job_id = asic_result->job_id;
 
-        if (GLOBAL_STATE->valid_jobs[job_id] == 0)
+        // one compare against the current work generation, results for jobs from before a clean_jobs notify are dropped
+        queued_result queued = {.result = *asic_result, .job = ASIC_get_active_job(GLOBAL_STATE, job_id)};
+        if (queued.job == NULL)
         {
             ESP_LOGW(TAG, "Invalid job nonce found, 0x%02X", job_id);
             continue;
         }
 
-        // check the nonce difficulty
-        double nonce_diff = test_nonce_value(
-            GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id],
-            asic_result->nonce,
-            asic_result->rolled_version);
-
-        //log the ASIC response
-        ESP_LOGI(TAG, "Ver: %08" PRIX32 " Nonce %08" PRIX32 " diff %.1f of %ld.", asic_result->rolled_version, asic_result->nonce, nonce_diff, GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->pool_diff);
+        // never wait for the share task, the UART RX buffer only holds a few hundred results
+        if (xQueueSendToBack(module->results, &queued, 0) != pdPASS)
+        {
+            uint32_t dropped = atomic_fetch_add(&module->dropped, 1) + 1;
+            ESP_LOGW(TAG, "Result queue full, dropped nonce %08" PRIX32 " (%" PRIu32 " dropped)", queued.result.nonce, dropped);
+            free_bm_job(queued.job);
+            continue;
+        }
 
-        if (nonce_diff >= GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->pool_diff)
+        // only this task raises the high water mark
+        uint32_t depth = uxQueueMessagesWaiting(module->results);
+        if (depth > atomic_load(&module->queue_high_water))
         {
-            char * user = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
-            int ret = STRATUM_V1_submit_share(
-                GLOBAL_STATE->sock,
-                GLOBAL_STATE->send_uid++,
+            atomic_store(&module->queue_high_water, depth);
+        }
+    }
+}
+
+static void submit_result(GlobalState *GLOBAL_STATE, const nonce_check *check)
+{
+    bm_job *active_job = check->job;
+    StratumSession *session = &GLOBAL_STATE->sessions[active_job->session];
+
+    // the share and block decisions compare the hash with the job's targets, the difficulty is for stats
+    double nonce_diff = hash_difficulty(check->hash);
+
+    //log the ASIC response
+    ESP_LOGI(TAG, "Ver: %08" PRIX32 " Nonce %08" PRIX32 " diff %.1f of %ld.", check->rolled_version, check->nonce, nonce_diff, active_job->pool_diff);
+
+    if (hash_meets_target(check->hash, &active_job->pool_target))
+    {
+        // submitted on the session the job came from
+        char * user = GLOBAL_STATE->SYSTEM_MODULE.pools[session->pool].user;
+        int send_uid = atomic_fetch_add(&session->send_uid, 1);
+        // tracked before it is queued, the response may arrive before STRATUM_V1_submit_share() returns
+        share_tracker_submit(&session->share_tracker, send_uid, active_job->jobid, nonce_diff,
+                             esp_timer_get_time() - active_job->notify_received_us);
+        int ret;
+        if (session->sv2_active) {
+            // the id is the sequence number of the channel, V2 takes the whole rolled version
+            ret = sv2_client_submit_share(session->sv2, send_uid, active_job->jobid, active_job->extranonce2,
+                                          active_job->ntime, check->nonce, check->rolled_version);
+        } else {
+            ret = STRATUM_V1_submit_share(
+                &session->tx,
+                send_uid,
                 user,
-                GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->jobid,
-                GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->extranonce2,
-                GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->ntime,
-                asic_result->nonce,
-                asic_result->rolled_version ^ GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->version);
-
-            if (ret < 0) {
-                ESP_LOGI(TAG, "Unable to write share to socket. Closing connection. Ret: %d (errno %d: %s)", ret, errno, strerror(errno));
-                stratum_close_connection(GLOBAL_STATE);
-            }
+                active_job->jobid,
+                active_job->extranonce2,
+                active_job->ntime,
+                check->nonce,
+                check->rolled_version ^ active_job->version);
         }
 
-        SYSTEM_notify_found_nonce(GLOBAL_STATE, nonce_diff, job_id);
+        // the stratum tx task closes the connection if the socket fails
+        if (ret < 0) {
+            ESP_LOGW(TAG, "Unable to queue share (errno %d: %s)", errno, strerror(errno));
+            share_tracker_cancel(&session->share_tracker, send_uid);
+        }
+    }
+
+    SYSTEM_notify_found_nonce(GLOBAL_STATE, nonce_diff, active_job->target,
+                              hash_meets_target(check->hash, &active_job->network_target));
+}
+
+void ASIC_share_task(void *pvParameters)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    QueueHandle_t results = GLOBAL_STATE->ASIC_RESULT_MODULE.results;
+    queued_result queued;
+    nonce_check checks[ASIC_SHARE_BATCH_SIZE];
+    // only this task verifies nonces, so the midstates are kept here without a lock
+    static nonce_midstate_cache midstate_cache;
+
+    while (1)
+    {
+        if (xQueueReceive(results, &queued, portMAX_DELAY) != pdPASS)
+        {
+            continue;
+        }
+
+        // results come in bursts with a low ticket mask, everything pending is hashed together
+        size_t count = 0;
+        do
+        {
+            bm_job *active_job = queued.job;
+            StratumSession *session = &GLOBAL_STATE->sessions[active_job->session];
+
+            // a clean_jobs notify may have arrived while the result was queued
+            if (active_job->generation != atomic_load(&session->work_generation))
+            {
+                ESP_LOGW(TAG, "Dropping stale nonce for job %s", active_job->jobid);
+                free_bm_job(active_job);
+                continue;
+            }
+
+            checks[count].job = active_job;
+            checks[count].nonce = queued.result.nonce;
+            checks[count].rolled_version = queued.result.rolled_version;
+            count++;
+        } while (count < ASIC_SHARE_BATCH_SIZE && xQueueReceive(results, &queued, 0) == pdPASS);
+
+        test_nonce_hashes(&midstate_cache, checks, count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            submit_result(GLOBAL_STATE, &checks[i]);
+            free_bm_job(checks[i].job);
+        }
     }
 }
@@ -1,6 +1,33 @@
 #ifndef ASIC_result_TASK_H_
 #define ASIC_result_TASK_H_
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+// results waiting for validation and share submission, each one holds a job from the pool
+#define ASIC_RESULT_QUEUE_SIZE 32
+// results the share task takes off the queue and hashes at once
+#define ASIC_SHARE_BATCH_SIZE 16
+
+typedef struct
+{
+    // task_result copies from the UART receive task to the share task
+    QueueHandle_t results;
+    // results received while the queue was full
+    _Atomic uint32_t dropped;
+    _Atomic uint32_t queue_high_water;
+} AsicResultModule;
+
+/// @brief Creates the result queue, call before starting the tasks.
+bool ASIC_result_init(void *pvParameters);
+
+/// @brief Drains the UART and hands the decoded results to ASIC_share_task without blocking.
 void ASIC_result_task(void *pvParameters);
 
-#endif
\ No newline at end of file
+/// @brief Validates the queued results and queues the shares on their session's stratum_tx ring,
+/// the session task writes them to the pool socket.
+void ASIC_share_task(void *pvParameters);
+
+#endif
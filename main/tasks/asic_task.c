@@ -3,6 +3,7 @@
 #include "serial.h"
 #include <string.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -20,12 +21,10 @@ void ASIC_task(void *pvParameters)
     //initialize the semaphore
     GLOBAL_STATE->ASIC_TASK_MODULE.semaphore = xSemaphoreCreateBinary();
 
-    GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs = malloc(sizeof(bm_job *) * 128);
-    GLOBAL_STATE->valid_jobs = malloc(sizeof(uint8_t) * 128);
-    for (int i = 0; i < 128; i++)
+    GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs = malloc(sizeof(*GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs) * MAX_ACTIVE_JOBS);
+    for (int i = 0; i < MAX_ACTIVE_JOBS; i++)
     {
-        GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[i] = NULL;
-        GLOBAL_STATE->valid_jobs[i] = 0;
+        atomic_init(&GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[i], NULL);
     }
 
     double asic_job_frequency_ms = ASIC_get_asic_job_frequency_ms(GLOBAL_STATE);
@@ -34,19 +33,34 @@ void ASIC_task(void *pvParameters)
     SYSTEM_notify_mining_started(GLOBAL_STATE);
     ESP_LOGI(TAG, "ASIC Ready!");
 
+    uint32_t sent_generation[MAX_POOLS];
+    for (int i = 0; i < MAX_POOLS; i++)
+    {
+        sent_generation[i] = atomic_load(&GLOBAL_STATE->sessions[i].work_generation);
+    }
+
     while (1)
     {
         bm_job *next_bm_job = (bm_job *)queue_dequeue(&GLOBAL_STATE->ASIC_jobs_queue);
+        StratumSession *session = &GLOBAL_STATE->sessions[next_bm_job->session];
 
-        if (next_bm_job->pool_diff != GLOBAL_STATE->stratum_difficulty)
+        // created just before a clean_jobs notify
+        if (next_bm_job->generation != atomic_load(&session->work_generation))
         {
-            ESP_LOGI(TAG, "New pool difficulty %lu", next_bm_job->pool_diff);
-            GLOBAL_STATE->stratum_difficulty = next_bm_job->pool_diff;
+            free_bm_job(next_bm_job);
+            continue;
         }
 
         //(*GLOBAL_STATE->ASIC_functions.send_work_fn)(GLOBAL_STATE, next_bm_job); // send the job to the ASIC
         ASIC_send_work(GLOBAL_STATE, next_bm_job);
 
+        if (next_bm_job->generation != sent_generation[next_bm_job->session])
+        {
+            sent_generation[next_bm_job->session] = next_bm_job->generation;
+            ESP_LOGI(TAG, "First job after clean jobs sent in %lld us",
+                     esp_timer_get_time() - session->work_generation_start_us);
+        }
+
         // Time to execute the above code is ~0.3ms
         // Delay for ASIC(s) to finish the job
         //vTaskDelay((asic_job_frequency_ms - 0.3) / portTICK_PERIOD_MS);
@@ -1,15 +1,26 @@
 #ifndef ASIC_TASK_H_
 #define ASIC_TASK_H_
 
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "mining.h"
+#include "work_queue.h"
+#include "asic_result_task.h"
+
+#define MAX_ACTIVE_JOBS 128
+
+// every job is either queued, being sent or waiting in active_jobs for its nonces, plus replaced
+// jobs still referenced by queued results, a batch in the share task and a lookup in the result task
+#define JOB_POOL_SIZE (QUEUE_SIZE + 1 + MAX_ACTIVE_JOBS + ASIC_RESULT_QUEUE_SIZE + ASIC_SHARE_BATCH_SIZE + 1)
+
 typedef struct
 {
     // ASIC may not return the nonce in the same order as the jobs were sent
     // it also may return a previous nonce under some circumstances
     // so we keep a list of jobs indexed by the job id
-    bm_job **active_jobs;
+    // each slot holds a reference to its job, use ASIC_get_active_job() / ASIC_set_active_job()
+    _Atomic(bm_job *) *active_jobs;
     //semaphone
     SemaphoreHandle_t semaphore;
 } AsicTaskModule;
@@ -5,7 +5,10 @@
 #include "global_state.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "mining.h"
+#include "stratum_work.h"
+#include "utils.h"
 #include "string.h"
 
 #include "asic.h"
@@ -15,104 +18,113 @@ static const char *TAG = "create_jobs_task";
 #define QUEUE_LOW_WATER_MARK 10 // Adjust based on your requirements
 
 static bool should_generate_more_work(GlobalState *GLOBAL_STATE);
-static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, uint32_t extranonce_2);
+static void accept_notify(GlobalState *GLOBAL_STATE, stratum_work *work, mining_notify *mining_notification);
+static stratum_work *next_session_work(GlobalState *GLOBAL_STATE, stratum_work *work, bool *ntime_limited);
+static void generate_work(GlobalState *GLOBAL_STATE, stratum_work *work);
+
+// The extranonce the session task last received, replaced in place by mining.set_extranonce
+static void read_extranonce(void *ctx, uint8_t session_index, stratum_work_extranonce *extranonce)
+{
+    StratumSession *session = &((GlobalState *)ctx)->sessions[session_index];
+    pthread_mutex_lock(&session->extranonce_lock);
+    extranonce->generation = atomic_load(&session->extranonce_generation);
+    extranonce->extranonce_len = hex2bin(session->extranonce_str, extranonce->extranonce, sizeof(extranonce->extranonce));
+    extranonce->extranonce_2_len = session->extranonce_2_len;
+    pthread_mutex_unlock(&session->extranonce_lock);
+}
 
 void create_jobs_task(void *pvParameters)
 {
     GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    stratum_work work[MAX_POOLS] = {0};
 
     while (1)
     {
-        mining_notify *mining_notification = (mining_notify *)queue_dequeue(&GLOBAL_STATE->stratum_queue);
-        if (mining_notification == NULL) {
-            ESP_LOGE(TAG, "Failed to dequeue mining notification");
-            vTaskDelay(100 / portTICK_PERIOD_MS); // Wait a bit before trying again
-            continue;
+        // the newest notify of a session replaces its work
+        while (queue_count(&GLOBAL_STATE->stratum_queue) > 0) {
+            mining_notify *mining_notification = (mining_notify *)queue_dequeue(&GLOBAL_STATE->stratum_queue);
+            accept_notify(GLOBAL_STATE, &work[mining_notification->session], mining_notification);
         }
 
-        ESP_LOGI(TAG, "New Work Dequeued %s", mining_notification->job_id);
-
-        if (GLOBAL_STATE->new_stratum_version_rolling_msg) {
-            ESP_LOGI(TAG, "Set chip version rolls %i", (int)(GLOBAL_STATE->version_mask >> 13));
-            //(GLOBAL_STATE->ASIC_functions.set_version_mask)(GLOBAL_STATE->version_mask);
-            ASIC_set_version_mask(GLOBAL_STATE, GLOBAL_STATE->version_mask);
-            GLOBAL_STATE->new_stratum_version_rolling_msg = false;
-        }
-
-        uint32_t extranonce_2 = 0;
-        while (GLOBAL_STATE->stratum_queue.count < 1 && GLOBAL_STATE->abandon_work == 0)
+        if (!should_generate_more_work(GLOBAL_STATE))
         {
-            if (should_generate_more_work(GLOBAL_STATE))
-            {
-                generate_work(GLOBAL_STATE, mining_notification, extranonce_2);
-
-                // Increase extranonce_2 for the next job.
-                extranonce_2++;
-            }
-            else
-            {
-                // If no more work needed, wait a bit before checking again.
-                vTaskDelay(100 / portTICK_PERIOD_MS);
-            }
+            // If no more work needed, wait a bit or until the next notify arrives.
+            queue_wait(&GLOBAL_STATE->stratum_queue, 100 / portTICK_PERIOD_MS);
+            continue;
         }
 
-        if (GLOBAL_STATE->abandon_work == 1)
-        {
-            GLOBAL_STATE->abandon_work = 0;
-            ASIC_jobs_queue_clear(&GLOBAL_STATE->ASIC_jobs_queue);
-            xSemaphoreGive(GLOBAL_STATE->ASIC_TASK_MODULE.semaphore);
+        bool ntime_limited = false;
+        stratum_work *next = next_session_work(GLOBAL_STATE, work, &ntime_limited);
+        if (next == NULL) {
+            // the chips roll the version of the last job until time allows the next ntime
+            queue_wait(&GLOBAL_STATE->stratum_queue, ntime_limited ? 1000 / portTICK_PERIOD_MS : portMAX_DELAY);
+            continue;
         }
 
-        STRATUM_V1_free_mining_notify(mining_notification);
+        generate_work(GLOBAL_STATE, next);
     }
 }
 
-static bool should_generate_more_work(GlobalState *GLOBAL_STATE)
+static void accept_notify(GlobalState *GLOBAL_STATE, stratum_work *work, mining_notify *mining_notification)
 {
-    return GLOBAL_STATE->ASIC_jobs_queue.count < QUEUE_LOW_WATER_MARK;
-}
+    StratumSession *session = &GLOBAL_STATE->sessions[mining_notification->session];
 
-static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, uint32_t extranonce_2)
-{
-    char *extranonce_2_str = extranonce_2_generate(extranonce_2, GLOBAL_STATE->extranonce_2_len);
-    if (extranonce_2_str == NULL) {
-        ESP_LOGE(TAG, "Failed to generate extranonce_2");
+    ESP_LOGI(TAG, "New Work Dequeued %s", mining_notification->job_id);
+
+    if (mining_notification->generation != atomic_load(&session->work_generation)) {
+        ESP_LOGI(TAG, "Skipping stale work %s", mining_notification->job_id);
+        STRATUM_V1_free_mining_notify(mining_notification);
         return;
     }
 
-    char *coinbase_tx = construct_coinbase_tx(notification->coinbase_1, notification->coinbase_2, GLOBAL_STATE->extranonce_str, extranonce_2_str);
-    if (coinbase_tx == NULL) {
-        ESP_LOGE(TAG, "Failed to construct coinbase_tx");
-        free(extranonce_2_str);
-        return;
+    if (GLOBAL_STATE->new_stratum_version_rolling_msg) {
+        ESP_LOGI(TAG, "Set chip version rolls %i", (int)(GLOBAL_STATE->version_mask >> 13));
+        //(GLOBAL_STATE->ASIC_functions.set_version_mask)(GLOBAL_STATE->version_mask);
+        ASIC_set_version_mask(GLOBAL_STATE, GLOBAL_STATE->version_mask);
+        GLOBAL_STATE->new_stratum_version_rolling_msg = false;
     }
 
-    char *merkle_root = calculate_merkle_root_hash(coinbase_tx, (uint8_t(*)[32])notification->merkle_branches, notification->n_merkle_branches);
-    if (merkle_root == NULL) {
-        ESP_LOGE(TAG, "Failed to calculate merkle_root");
-        free(extranonce_2_str);
-        free(coinbase_tx);
-        return;
+    if (!stratum_work_accept(work, mining_notification, read_extranonce, GLOBAL_STATE)) {
+        STRATUM_V1_free_mining_notify(mining_notification);
+    }
+}
+
+static stratum_work *next_session_work(GlobalState *GLOBAL_STATE, stratum_work *work, bool *ntime_limited)
+{
+    stratum_work_session sessions[MAX_POOLS];
+    for (int i = 0; i < GLOBAL_STATE->session_count; i++) {
+        StratumSession *session = &GLOBAL_STATE->sessions[i];
+        sessions[i].work_generation = atomic_load(&session->work_generation);
+        sessions[i].extranonce_generation = atomic_load(&session->extranonce_generation);
+        sessions[i].weight = session->weight;
+    }
+
+    bool rebuilt = false;
+    stratum_work *next = stratum_work_next(work, sessions, GLOBAL_STATE->session_count, read_extranonce, GLOBAL_STATE,
+                                           esp_timer_get_time(), &rebuilt, ntime_limited);
+    if (rebuilt) {
+        // jobs built with the old extranonce aren't sent anymore, the ones of other sessions are rebuilt right away
+        queue_clear(&GLOBAL_STATE->ASIC_jobs_queue);
     }
+    return next;
+}
 
-    bm_job next_job = construct_bm_job(notification, merkle_root, GLOBAL_STATE->version_mask);
+static bool should_generate_more_work(GlobalState *GLOBAL_STATE)
+{
+    return queue_count(&GLOBAL_STATE->ASIC_jobs_queue) < QUEUE_LOW_WATER_MARK;
+}
 
-    bm_job *queued_next_job = malloc(sizeof(bm_job));
+static void generate_work(GlobalState *GLOBAL_STATE, stratum_work *work)
+{
+    bm_job *queued_next_job = alloc_bm_job();
     if (queued_next_job == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for queued_next_job");
-        free(extranonce_2_str);
-        free(coinbase_tx);
-        free(merkle_root);
+        ESP_LOGE(TAG, "Job pool exhausted");
+        vTaskDelay(100 / portTICK_PERIOD_MS);
         return;
     }
 
-    memcpy(queued_next_job, &next_job, sizeof(bm_job));
-    queued_next_job->extranonce2 = extranonce_2_str; // Transfer ownership
-    queued_next_job->jobid = strdup(notification->job_id);
-    queued_next_job->version_mask = GLOBAL_STATE->version_mask;
+    stratum_work_next_job(work, GLOBAL_STATE->version_mask, queued_next_job);
+    ASIC_serialize_job(GLOBAL_STATE, queued_next_job);
 
     queue_enqueue(&GLOBAL_STATE->ASIC_jobs_queue, queued_next_job);
-
-    free(coinbase_tx);
-    free(merkle_root);
-}
\ No newline at end of file
+}
@@ -1,4 +1,5 @@
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "connect.h"
 #include "system.h"
 #include "global_state.h"
@@ -6,10 +7,16 @@
 #include <lwip/tcpip.h>
 #include "nvs_config.h"
 #include "stratum_task.h"
+#include "stratum_connect.h"
+#include "stratum_standby.h"
+#include "stratum_tls.h"
+#include "sv2_client.h"
 #include "work_queue.h"
 #include "esp_wifi.h"
 #include <esp_sntp.h>
+#include "esp_app_desc.h"
 #include <time.h>
+#include <pthread.h>
 
 #define PORT CONFIG_STRATUM_PORT
 #define STRATUM_URL CONFIG_STRATUM_URL
@@ -21,18 +28,41 @@
 #define FALLBACK_STRATUM_PW CONFIG_FALLBACK_STRATUM_PW
 #define STRATUM_DIFFICULTY CONFIG_STRATUM_DIFFICULTY
 
+#ifdef CONFIG_STRATUM_V2_EXTENDED_CHANNEL
+#define STRATUM_V2_EXTENDED_CHANNEL true
+#else
+#define STRATUM_V2_EXTENDED_CHANNEL false
+#endif
+
+// before this the clock hasn't been set by SNTP yet, 2024-01-01
+#define CLOCK_VALID_AFTER 1704067200
+
 #define MAX_RETRY_ATTEMPTS 3
 #define MAX_CRITICAL_RETRY_ATTEMPTS 5
 
+// How long after a disconnect the work of the subscription is kept for resuming it
+#define STRATUM_RESUME_WINDOW_MS 30000
+
 #define BUFFER_SIZE 1024
 
 static const char * TAG = "stratum_task";
 
-static StratumApiV1Message stratum_api_v1_message = {};
-static SystemTaskModule SYSTEM_TASK_MODULE = {.stratum_difficulty = 8192};
+// parameters of the tasks serving a session
+typedef struct
+{
+    GlobalState * GLOBAL_STATE;
+    StratumSession * session;
+} stratum_session_params;
+
+static stratum_session_params session_params[MAX_POOLS];
+
+// the session tasks take turns producing into the single-producer stratum queue
+static pthread_mutex_t notify_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static const char * primary_stratum_url;
-static uint16_t primary_stratum_port;
+static stratum_standby fallback_standby;
+static bool fallback_standby_enabled;
+
+static stratum_capture capture;
 
 struct timeval tcp_snd_timeout = {
     .tv_sec = 5,
@@ -44,6 +74,12 @@ struct timeval tcp_rcv_timeout = {
     .tv_usec = 0
 };
 
+// Stratum V1 receives wake up this often while the pool is quiet, to check on the connection
+struct timeval tcp_liveness_tick = {
+    .tv_sec = 1,
+    .tv_usec = 0
+};
+
 bool is_wifi_connected() {
     wifi_ap_record_t ap_info;
     if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
@@ -53,49 +89,457 @@ bool is_wifi_connected() {
     }
 }
 
-void cleanQueue(GlobalState * GLOBAL_STATE) {
-    ESP_LOGI(TAG, "Clean Jobs: clearing queue");
-    GLOBAL_STATE->abandon_work = 1;
-    queue_clear(&GLOBAL_STATE->stratum_queue);
+static bool pool_configured(SystemModule * module, int pool)
+{
+    return module->pools[pool].url != NULL && module->pools[pool].url[0] != '\0';
+}
+
+static bool pool_speaks_sv2(SystemModule * module, int pool)
+{
+    return pool_configured(module, pool) && module->pools[pool].authority_key[0] != '\0';
+}
+
+// Stratum V2 has its own encryption
+static bool pool_uses_tls(SystemModule * module, int pool)
+{
+    return pool_configured(module, pool) && module->pools[pool].tls && !pool_speaks_sv2(module, pool);
+}
+
+static const char * pool_scheme(SystemModule * module, int pool)
+{
+    if (pool_speaks_sv2(module, pool)) {
+        return "stratum2+tcp";
+    }
+    return pool_uses_tls(module, pool) ? "stratum+ssl" : "stratum+tcp";
+}
+
+// Next configured pool in priority order after the given one, wrapping around to the primary pool
+static int next_pool(SystemModule * module, int pool)
+{
+    for (int i = 1; i < MAX_POOLS; i++) {
+        int next = (pool + i) % MAX_POOLS;
+        if (pool_configured(module, next)) {
+            return next;
+        }
+    }
+    return pool;
+}
+
+bool stratum_init_sessions(GlobalState * GLOBAL_STATE)
+{
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
 
-    pthread_mutex_lock(&GLOBAL_STATE->valid_jobs_lock);
-    ASIC_jobs_queue_clear(&GLOBAL_STATE->ASIC_jobs_queue);
-    for (int i = 0; i < 128; i = i + 4) {
-        GLOBAL_STATE->valid_jobs[i] = 0;
+    int weighted_pools = 0;
+    for (int i = 0; i < MAX_POOLS; i++) {
+        if (pool_configured(module, i) && module->pools[i].weight > 0) {
+            weighted_pools++;
+        }
     }
-    pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
+    if (module->pool_split && weighted_pools < 2) {
+        ESP_LOGW(TAG, "Splitting needs at least two pools with a weight, using failover");
+        module->pool_split = false;
+    }
+
+    GLOBAL_STATE->session_count = 0;
+    for (int i = 0; i < MAX_POOLS; i++) {
+        if (module->pool_split ? !pool_configured(module, i) || module->pools[i].weight == 0 : i > 0) {
+            continue;
+        }
+
+        StratumSession * session = &GLOBAL_STATE->sessions[GLOBAL_STATE->session_count];
+        // failover mode has a single session, it follows SYSTEM_MODULE.active_pool
+        session->pool = module->pool_split ? i : module->active_pool;
+        session->weight = module->pool_split ? module->pools[i].weight : 1;
+        session->sock = -1;
+        atomic_store(&session->send_uid, 1);
+        session->stratum_difficulty = 8192;
+        session->subscribed_pool = -1;
+        stratum_vardiff_init(&session->vardiff, module->shares_per_minute, STRATUM_DIFFICULTY);
+        stratum_liveness_init(&session->liveness, module->dead_timeout_s * 1000);
+        pthread_mutex_init(&session->extranonce_lock, NULL);
+        if (!stratum_tx_init(&session->tx, STRATUM_TX_BUFFER_SIZE)) {
+            return false;
+        }
+        if (!line_buffer_init(&session->rx_buffer, STRATUM_LINE_BUFFER_SIZE)) {
+            return false;
+        }
+        share_tracker_init(&session->share_tracker);
+
+        // failover may take the session to any pool
+        bool sv2 = false;
+        for (int j = 0; j < MAX_POOLS; j++) {
+            sv2 |= (!module->pool_split || j == i) && pool_speaks_sv2(module, j);
+        }
+        session->sv2 = NULL;
+        session->sv2_active = false;
+        if (sv2) {
+            session->sv2 = malloc(sizeof(sv2_client));
+            if (session->sv2 == NULL || !sv2_client_init(session->sv2, &session->tx)) {
+                return false;
+            }
+        }
+        GLOBAL_STATE->session_count++;
+    }
+    return true;
 }
 
-void stratum_reset_uid(GlobalState * GLOBAL_STATE)
+void cleanQueue(GlobalState * GLOBAL_STATE, StratumSession * session) {
+    ESP_LOGI(TAG, "Clean Jobs: clearing queue");
+    // results for the session's jobs on the ASIC are rejected and its work still in flight is dropped from here on,
+    // queued notifies of other sessions stay valid
+    session->work_generation_start_us = esp_timer_get_time();
+    atomic_fetch_add(&session->work_generation, 1);
+    // jobs of other sessions are rebuilt from their current work right away
+    queue_clear(&GLOBAL_STATE->ASIC_jobs_queue);
+
+    // don't wait out the current job interval, the first new job is sent as soon as it is created
+    if (GLOBAL_STATE->ASIC_TASK_MODULE.semaphore != NULL) {
+        xSemaphoreGive(GLOBAL_STATE->ASIC_TASK_MODULE.semaphore);
+    }
+}
+
+void stratum_reset_uid(StratumSession * session)
 {
     ESP_LOGI(TAG, "Resetting stratum uid");
-    GLOBAL_STATE->send_uid = 1;
+    atomic_store(&session->send_uid, 1);
+}
+
+
+// Whether the session's next connection can resume its subscription and keep mining the current work
+static bool subscription_resumable(GlobalState * GLOBAL_STATE, StratumSession * session)
+{
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    int pool = module->pool_split ? session->pool : module->active_pool;
+    return session->subscription_id[0] != '\0' && session->subscribed_pool == pool &&
+           esp_timer_get_time() - session->disconnected_us < STRATUM_RESUME_WINDOW_MS * 1000;
 }
 
+static void drop_subscription(GlobalState * GLOBAL_STATE, StratumSession * session)
+{
+    session->subscription_id[0] = '\0';
+    cleanQueue(GLOBAL_STATE, session);
+}
+
+// Replaces the session's extranonce, the job creation rebuilds the coinbase of the current notify with it
+static bool set_extranonce(StratumSession * session, const char * extranonce_str, int extranonce_2_len)
+{
+    size_t len = strlen(extranonce_str);
+    if (len > STRATUM_MAX_EXTRANONCE_LEN * 2 || len % 2 != 0 || extranonce_2_len <= 0) {
+        ESP_LOGE(TAG, "Invalid extranonce %s with extranonce_2 length %d", extranonce_str, extranonce_2_len);
+        return false;
+    }
+
+    pthread_mutex_lock(&session->extranonce_lock);
+    strcpy(session->extranonce_str, extranonce_str);
+    session->extranonce_2_len = extranonce_2_len;
+    atomic_fetch_add(&session->extranonce_generation, 1);
+    pthread_mutex_unlock(&session->extranonce_lock);
+    return true;
+}
 
-void stratum_close_connection(GlobalState * GLOBAL_STATE)
+void stratum_close_connection(GlobalState * GLOBAL_STATE, StratumSession * session)
 {
-    if (GLOBAL_STATE->sock < 0) {
+    int sock = session->sock;
+    if (sock < 0) {
         ESP_LOGE(TAG, "Socket already shutdown, not shutting down again..");
         return;
     }
 
     ESP_LOGE(TAG, "Shutting down socket and restarting...");
-    shutdown(GLOBAL_STATE->sock, SHUT_RDWR);
-    close(GLOBAL_STATE->sock);
-    cleanQueue(GLOBAL_STATE);
+    session->sock = -1;
+    // a send() in progress finishes first, the socket number may be reused right after close()
+    stratum_tx_set_socket(&session->tx, -1);
+    stratum_socket_close(sock);
+    session->disconnected_us = esp_timer_get_time();
+    // the ASIC keeps working on the current jobs if the subscription may be resumed
+    if (!subscription_resumable(GLOBAL_STATE, session)) {
+        drop_subscription(GLOBAL_STATE, session);
+    }
     vTaskDelay(1000 / portTICK_PERIOD_MS);
 }
 
+// @return false if the response is not for a share
+static bool notify_share_result(GlobalState * GLOBAL_STATE, StratumSession * session, StratumApiV1Message * message)
+{
+    tracked_share share;
+    int64_t round_trip_us;
+    if (!share_tracker_complete(&session->share_tracker, message->message_id, message->response_success, &share,
+                                &round_trip_us)) {
+        return false;
+    }
+
+    if (message->response_success) {
+        ESP_LOGI(TAG, "Share accepted: job %s, diff %.1f, job age %lld ms, round trip %lld ms", share.jobid, share.nonce_diff,
+                 share.job_age_us / 1000, round_trip_us / 1000);
+        SYSTEM_notify_accepted_share(GLOBAL_STATE);
+    } else {
+        ESP_LOGW(TAG, "Share rejected: %s, job %s, diff %.1f, job age %lld ms, round trip %lld ms", message->error_str,
+                 share.jobid, share.nonce_diff, share.job_age_us / 1000, round_trip_us / 1000);
+        SYSTEM_notify_rejected_share(GLOBAL_STATE, message->error_str);
+    }
+    return true;
+}
+
+static void set_socket_timeouts(int sock, const struct timeval * rcv_timeout)
+{
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tcp_snd_timeout, sizeof(tcp_snd_timeout)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt SO_SNDTIMEO");
+    }
+
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO , rcv_timeout, sizeof(struct timeval)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO ");
+    }
+}
+
+// Keepalive probes from half the dead timeout on, so TCP gives up on an unreachable pool within it.
+// Also covers Stratum V2 connections, which aren't probed by the protocol.
+static void set_socket_keepalive(int sock, uint16_t dead_timeout_s)
+{
+    if (dead_timeout_s == 0) {
+        return;
+    }
+    int keepalive = 1;
+    int idle = dead_timeout_s / 2 > 0 ? dead_timeout_s / 2 : 1;
+    int interval = dead_timeout_s / 8 > 0 ? dead_timeout_s / 8 : 1;
+    int count = 4;
+    if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive)) != 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) != 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) != 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt keepalive");
+    }
+}
+
+// Probes a quiet pool between receive timeouts, false once the connection is considered dead
+static bool stratum_session_alive(StratumSession * session)
+{
+    stratum_liveness * liveness = &session->liveness;
+    int64_t now = esp_timer_get_time();
+    int64_t oldest_share_us = share_tracker_oldest_since(&session->share_tracker, liveness->last_rx_us);
+    stratum_liveness_action action = stratum_liveness_check(liveness, now, oldest_share_us);
+    if (action == STRATUM_LIVENESS_PROBE) {
+        ESP_LOGI(TAG, "Nothing from the pool for %lld s, probing the connection", (now - liveness->last_rx_us) / 1000000);
+        liveness->probe_uid = atomic_fetch_add(&session->send_uid, 1);
+        STRATUM_V1_ping(&session->tx, liveness->probe_uid);
+    } else if (action == STRATUM_LIVENESS_DEAD) {
+        ESP_LOGE(TAG, "Nothing from the pool for %lld s despite %s, the connection is dead",
+                 (now - liveness->last_rx_us) / 1000000, liveness->probe_sent_us != 0 ? "a probe" : "pending shares");
+        return false;
+    }
+    return true;
+}
+
+static void reset_share_stats(GlobalState * GLOBAL_STATE, StratumSession * session)
+{
+    for (int i = 0; i < GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count; i++) {
+        GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].count = 0;
+        GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].message[0] = '\0';
+    }
+    GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.shares_accepted = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.shares_rejected = 0;
+    share_tracker_clear_stats(&session->share_tracker);
+}
+
+// The ASIC rolls the same version bits for the jobs of every session, only those all connected pools allow
+static void update_version_mask(GlobalState * GLOBAL_STATE)
+{
+    uint32_t version_mask = 0xffffffff;
+    bool known = false;
+    for (int i = 0; i < GLOBAL_STATE->session_count; i++) {
+        if (GLOBAL_STATE->sessions[i].version_mask != 0) {
+            version_mask &= GLOBAL_STATE->sessions[i].version_mask;
+            known = true;
+        }
+    }
+    if (!known) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Set version mask: %08lx", version_mask);
+    GLOBAL_STATE->version_mask = version_mask;
+    GLOBAL_STATE->new_stratum_version_rolling_msg = true;
+}
+
+static void enqueue_mining_notify(GlobalState * GLOBAL_STATE, StratumSession * session, mining_notify * notify)
+{
+    pthread_mutex_lock(&notify_lock);
+    SYSTEM_notify_new_ntime(GLOBAL_STATE, notify->ntime);
+    if (queue_count(&GLOBAL_STATE->stratum_queue) == QUEUE_SIZE) {
+        // the job creation is far behind, the new notify supersedes everything queued
+        queue_clear(&GLOBAL_STATE->stratum_queue);
+    }
+    mining_notify_set_difficulty(notify, session->stratum_difficulty);
+    notify->generation = atomic_load(&session->work_generation);
+    notify->session = session - GLOBAL_STATE->sessions;
+    queue_enqueue(&GLOBAL_STATE->stratum_queue, notify);
+    pthread_mutex_unlock(&notify_lock);
+}
+
+static void receive_mining_notify(GlobalState * GLOBAL_STATE, StratumSession * session, StratumApiV1Message * message,
+                                  int64_t * connect_start_us)
+{
+    if (message->should_abandon_work) {
+        cleanQueue(GLOBAL_STATE, session);
+    }
+    message->mining_notification->received_us = esp_timer_get_time();
+    if (*connect_start_us != 0) {
+        ESP_LOGI(TAG, "First job %lld ms after connecting",
+                 (message->mining_notification->received_us - *connect_start_us) / 1000);
+        *connect_start_us = 0;
+    }
+    enqueue_mining_notify(GLOBAL_STATE, session, message->mining_notification);
+}
+
+static void set_difficulty(StratumSession * session, uint32_t difficulty)
+{
+    if (difficulty != session->stratum_difficulty) {
+        session->stratum_difficulty = difficulty;
+        ESP_LOGI(TAG, "Set stratum difficulty: %ld", session->stratum_difficulty);
+    }
+}
+
+// The measured hashrate in H/s, the nominal one for the ASIC frequency until there is a measurement
+static float nominal_hashrate(GlobalState * GLOBAL_STATE)
+{
+    // GH/s
+    double hashrate = GLOBAL_STATE->SYSTEM_MODULE.current_hashrate;
+    if (hashrate <= 0) {
+        hashrate = GLOBAL_STATE->POWER_MANAGEMENT_MODULE.frequency_value * GLOBAL_STATE->DEVICE_CONFIG.family.asic.small_core_count *
+                   GLOBAL_STATE->DEVICE_CONFIG.family.asic_count / 1000.0;
+    }
+    return hashrate * 1e9;
+}
+
+// The part of the hashrate that mines on the session's jobs, split mode hands them out by weight
+static double session_hashrate_ghs(GlobalState * GLOBAL_STATE, StratumSession * session)
+{
+    double hashrate = nominal_hashrate(GLOBAL_STATE) / 1e9;
+    if (!GLOBAL_STATE->SYSTEM_MODULE.pool_split) {
+        return hashrate;
+    }
+    uint32_t total_weight = 0;
+    for (int i = 0; i < GLOBAL_STATE->session_count; i++) {
+        total_weight += GLOBAL_STATE->sessions[i].weight;
+    }
+    return total_weight > 0 ? hashrate * session->weight / total_weight : hashrate;
+}
+
+// Suggests a difficulty for the session's hashrate on a new connection and whenever the hashrate
+// changed materially since, e.g. after a frequency change
+static void suggest_difficulty(GlobalState * GLOBAL_STATE, StratumSession * session)
+{
+    double hashrate = session_hashrate_ghs(GLOBAL_STATE, session);
+    uint32_t difficulty;
+    if (stratum_vardiff_update(&session->vardiff, hashrate, esp_timer_get_time(), &difficulty)) {
+        ESP_LOGI(TAG, "Suggesting difficulty %lu for %.1f GH/s", (unsigned long) difficulty, hashrate);
+        STRATUM_V1_suggest_difficulty(&session->tx, atomic_fetch_add(&session->send_uid, 1), difficulty);
+    }
+}
+
+// Continues on the standby connection to the fallback pool with the job it already received,
+// instead of reconnecting and waiting for the first mining.notify
+static bool stratum_adopt_standby(GlobalState * GLOBAL_STATE, StratumSession * session)
+{
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    stratum_standby_session standby;
+    if (!fallback_standby_enabled || module->active_pool != 0 ||
+        !stratum_standby_take(&fallback_standby, &standby, &session->rx_buffer)) {
+        return false;
+    }
+
+    ESP_LOGW(TAG, "Switching to the standby connection to %s:%d", module->pools[1].url, module->pools[1].port);
+    stratum_tx_set_socket(&session->tx, -1);
+    stratum_socket_close(session->sock);
+
+    module->active_pool = 1;
+    session->pool = 1;
+    reset_share_stats(GLOBAL_STATE, session);
+    share_tracker_reset(&session->share_tracker);
+
+    session->sock = standby.socket;
+    set_socket_timeouts(session->sock, &tcp_liveness_tick);
+    set_socket_keepalive(session->sock, module->dead_timeout_s);
+    stratum_liveness_reset(&session->liveness, esp_timer_get_time());
+    stratum_tx_set_socket(&session->tx, session->sock);
+    atomic_store(&session->send_uid, standby.send_uid);
+    set_extranonce(session, standby.extranonce_str, standby.extranonce_2_len);
+    free(standby.extranonce_str);
+    // the standby doesn't ask to resume, its subscription id is not known
+    session->subscription_id[0] = '\0';
+    session->subscribed_pool = 1;
+    session->version_mask = standby.version_mask;
+    update_version_mask(GLOBAL_STATE);
+    session->stratum_difficulty = standby.difficulty;
+    // the standby suggested for the hashrate at the time it connected
+    stratum_vardiff_reset(&session->vardiff);
+
+    cleanQueue(GLOBAL_STATE, session);
+    enqueue_mining_notify(GLOBAL_STATE, session, standby.latest_notify);
+    return true;
+}
+
+// Keeps the standby connection to the fallback pool up while mining on the primary pool
+void stratum_standby_task(void * pvParameters)
+{
+    GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+    PoolConfig * fallback = &GLOBAL_STATE->SYSTEM_MODULE.pools[1];
+
+    while (1) {
+        if (GLOBAL_STATE->SYSTEM_MODULE.active_pool != 0) {
+            // mining on a fallback pool already, the heartbeat takes care of switching back
+            stratum_standby_close(&fallback_standby);
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        if (stratum_standby_poll(&fallback_standby, 1000)) {
+            continue;
+        }
+
+        // not connected yet, dropped by the pool or just taken over by the stratum task
+        vTaskDelay(5000 / portTICK_PERIOD_MS);
+        if (GLOBAL_STATE->SYSTEM_MODULE.active_pool != 0 || !is_wifi_connected()) {
+            continue;
+        }
+
+        ESP_LOGI(TAG, "Opening standby connection to fallback pool: %s:%d", fallback->url, fallback->port);
+        if (!stratum_standby_connect(&fallback_standby, fallback->url, fallback->port,
+                                     pool_uses_tls(&GLOBAL_STATE->SYSTEM_MODULE, 1), fallback->user, fallback->pass,
+                                     GLOBAL_STATE->DEVICE_CONFIG.family.asic.name,
+                                     stratum_vardiff_difficulty(&GLOBAL_STATE->sessions[0].vardiff,
+                                                                nominal_hashrate(GLOBAL_STATE) / 1e9),
+                                     GLOBAL_STATE->SYSTEM_MODULE.connect_timeout_ms)) {
+            vTaskDelay(55000 / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+void stratum_tx_task(void * pvParameters)
+{
+    stratum_tx * tx = (stratum_tx *) pvParameters;
+
+    while (1) {
+        stratum_tx_wait(tx);
+        // a failed socket is shut down, the stratum task then sees the connection close and reconnects
+        stratum_tx_flush(tx);
+    }
+}
+
 void stratum_primary_heartbeat(void * pvParameters)
 {
     GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+    PoolConfig * primary = &GLOBAL_STATE->SYSTEM_MODULE.pools[0];
 
-    ESP_LOGI(TAG, "Starting heartbeat thread for primary pool: %s:%d", primary_stratum_url, primary_stratum_port);
-    vTaskDelay(10000 / portTICK_PERIOD_MS);
+    // the heartbeat sends on its own short-lived connection, without a writer task
+    static stratum_tx heartbeat_tx;
+    if (!stratum_tx_init(&heartbeat_tx, 1024)) {
+        ESP_LOGE(TAG, "Heartbeat. Failed to allocate TX buffer!");
+        vTaskDelete(NULL);
+    }
 
-    int addr_family = AF_INET;
-    int ip_protocol = IPPROTO_IP;
+    ESP_LOGI(TAG, "Starting heartbeat thread for primary pool: %s:%d", primary->url, primary->port);
+    vTaskDelay(10000 / portTICK_PERIOD_MS);
 
     struct timeval tcp_timeout = {
         .tv_sec = 5,
@@ -104,13 +548,13 @@ void stratum_primary_heartbeat(void * pvParameters)
 
     while (1)
     {
-        if (GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback == false) {
+        if (GLOBAL_STATE->SYSTEM_MODULE.active_pool == 0) {
             vTaskDelay(10000 / portTICK_PERIOD_MS);
             continue;
         }
 
-        char host_ip[INET_ADDRSTRLEN];
-        ESP_LOGD(TAG, "Running Heartbeat on: %s!", primary_stratum_url);
+        char host_ip[INET6_ADDRSTRLEN];
+        ESP_LOGD(TAG, "Running Heartbeat on: %s!", primary->url);
 
         if (!is_wifi_connected()) {
             ESP_LOGD(TAG, "Heartbeat. Failed WiFi check!");
@@ -118,32 +562,25 @@ void stratum_primary_heartbeat(void * pvParameters)
             continue;
         }
 
-        struct hostent *primary_dns_addr = gethostbyname(primary_stratum_url);
-        if (primary_dns_addr == NULL) {
-            ESP_LOGD(TAG, "Heartbeat. Failed DNS check for: %s!", primary_stratum_url);
+        int sock = stratum_connect(primary->url, primary->port, GLOBAL_STATE->SYSTEM_MODULE.connect_timeout_ms, host_ip,
+                                   sizeof(host_ip));
+        if (sock == STRATUM_CONNECT_ERR_DNS) {
+            ESP_LOGD(TAG, "Heartbeat. Failed DNS check for: %s!", primary->url);
             vTaskDelay(60000 / portTICK_PERIOD_MS);
             continue;
         }
-        inet_ntop(AF_INET, (void *)primary_dns_addr->h_addr_list[0], host_ip, sizeof(host_ip));
-
-        struct sockaddr_in dest_addr;
-        dest_addr.sin_addr.s_addr = inet_addr(host_ip);
-        dest_addr.sin_family = AF_INET;
-        dest_addr.sin_port = htons(primary_stratum_port);
-
-        int sock = socket(addr_family, SOCK_STREAM, ip_protocol);
         if (sock < 0) {
-            ESP_LOGD(TAG, "Heartbeat. Failed socket create check!");
+            ESP_LOGD(TAG, "Heartbeat. Failed connect check: %s:%d (errno %d: %s)", primary->url, primary->port, errno, strerror(errno));
             vTaskDelay(60000 / portTICK_PERIOD_MS);
             continue;
         }
 
-        int err = connect(sock, (struct sockaddr *)&dest_addr, sizeof(struct sockaddr_in6));
-        if (err != 0)
-        {
-            ESP_LOGD(TAG, "Heartbeat. Failed connect check: %s:%d (errno %d: %s)", host_ip, primary_stratum_port, errno, strerror(errno));
-            close(sock);
-            vTaskDelay(60000 / portTICK_PERIOD_MS);
+        // a Stratum V2 pool only answers after a whole handshake, reaching it has to do
+        if (pool_speaks_sv2(&GLOBAL_STATE->SYSTEM_MODULE, 0)) {
+            stratum_socket_close(sock);
+            ESP_LOGI(TAG, "Heartbeat successful and in fallback mode. Switching back to primary.");
+            GLOBAL_STATE->SYSTEM_MODULE.active_pool = 0;
+            stratum_close_connection(GLOBAL_STATE, &GLOBAL_STATE->sessions[0]);
             continue;
         }
 
@@ -151,16 +588,26 @@ void stratum_primary_heartbeat(void * pvParameters)
             ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO ");
         }
 
+        if (pool_uses_tls(&GLOBAL_STATE->SYSTEM_MODULE, 0) &&
+            !stratum_tls_start(sock, primary->url, primary->port, GLOBAL_STATE->SYSTEM_MODULE.connect_timeout_ms, NULL)) {
+            ESP_LOGD(TAG, "Heartbeat. Failed TLS handshake with %s:%d", primary->url, primary->port);
+            stratum_socket_close(sock);
+            vTaskDelay(60000 / portTICK_PERIOD_MS);
+            continue;
+        }
+
         int send_uid = 1;
-        STRATUM_V1_subscribe(sock, send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
-        STRATUM_V1_authenticate(sock, send_uid++, GLOBAL_STATE->SYSTEM_MODULE.pool_user, GLOBAL_STATE->SYSTEM_MODULE.pool_pass);
+        stratum_tx_set_socket(&heartbeat_tx, sock);
+        STRATUM_V1_subscribe(&heartbeat_tx, send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name, NULL);
+        STRATUM_V1_authenticate(&heartbeat_tx, send_uid++, primary->user, primary->pass);
+        stratum_tx_flush(&heartbeat_tx);
+        stratum_tx_set_socket(&heartbeat_tx, -1);
 
         char recv_buffer[BUFFER_SIZE];
         memset(recv_buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(sock, recv_buffer, BUFFER_SIZE - 1, 0);
+        int bytes_received = stratum_socket_recv(sock, recv_buffer, BUFFER_SIZE - 1, 0);
 
-        shutdown(sock, SHUT_RDWR);
-        close(sock);
+        stratum_socket_close(sock);
 
         if (bytes_received == -1)  {
             vTaskDelay(60000 / portTICK_PERIOD_MS);
@@ -169,8 +616,8 @@ void stratum_primary_heartbeat(void * pvParameters)
 
         if (strstr(recv_buffer, "mining.notify") != NULL) {
             ESP_LOGI(TAG, "Heartbeat successful and in fallback mode. Switching back to primary.");
-            GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = false;
-            stratum_close_connection(GLOBAL_STATE);
+            GLOBAL_STATE->SYSTEM_MODULE.active_pool = 0;
+            stratum_close_connection(GLOBAL_STATE, &GLOBAL_STATE->sessions[0]);
             continue;
         }
 
@@ -178,25 +625,105 @@ void stratum_primary_heartbeat(void * pvParameters)
     }
 }
 
-void stratum_task(void * pvParameters)
+// Runs a Stratum V2 connection on the connected socket until it fails or the pool sends the miner elsewhere.
+// The client hands out its messages like the V1 parser, the session is updated the same way.
+static void stratum_sv2_session(GlobalState * GLOBAL_STATE, StratumSession * session, PoolConfig * pool, int sock,
+                                int64_t connect_start_us, int * retry_attempts)
 {
-    GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+    sv2_client * client = session->sv2;
+    uint8_t authority_key[32];
+    if (client == NULL || !sv2_noise_decode_authority_key(pool->authority_key, authority_key)) {
+        ESP_LOGE(TAG, "Invalid Stratum V2 authority key for %s:%d", pool->url, pool->port);
+        (*retry_attempts)++;
+        stratum_socket_close(sock);
+        vTaskDelay(5000 / portTICK_PERIOD_MS);
+        return;
+    }
 
-    primary_stratum_url = GLOBAL_STATE->SYSTEM_MODULE.pool_url;
-    primary_stratum_port = GLOBAL_STATE->SYSTEM_MODULE.pool_port;
-    char * stratum_url = GLOBAL_STATE->SYSTEM_MODULE.pool_url;
-    uint16_t port = GLOBAL_STATE->SYSTEM_MODULE.pool_port;
+    time_t now = time(NULL);
+    sv2_client_config config = {
+        .authority_key = authority_key,
+        .host = pool->url,
+        .port = pool->port,
+        .user = pool->user,
+        .vendor = "bitaxe",
+        .hardware_version = GLOBAL_STATE->DEVICE_CONFIG.family.asic.name,
+        .firmware = esp_app_get_description()->version,
+        .nominal_hashrate = nominal_hashrate(GLOBAL_STATE),
+        .difficulty = STRATUM_DIFFICULTY,
+        .extended = STRATUM_V2_EXTENDED_CHANNEL,
+        // the certificate's validity period is only checked once SNTP has set the clock
+        .now = now > CLOCK_VALID_AFTER ? now : 0,
+    };
+    set_socket_timeouts(sock, &tcp_rcv_timeout);
+    set_socket_keepalive(sock, GLOBAL_STATE->SYSTEM_MODULE.dead_timeout_s);
+    // the frames aren't lines, there's nothing to capture
+    stratum_tx_set_capture(&session->tx, NULL, 0);
+    if (!sv2_client_connect(client, sock, &config)) {
+        ESP_LOGE(TAG, "Stratum V2 setup with %s:%d failed", pool->url, pool->port);
+        (*retry_attempts)++;
+        sv2_client_disconnect(client);
+        stratum_socket_close(sock);
+        vTaskDelay(5000 / portTICK_PERIOD_MS);
+        return;
+    }
+    *retry_attempts = 0;
+
+    session->sock = sock;
+    share_tracker_reset(&session->share_tracker);
+    // share sequence numbers of the channel
+    stratum_reset_uid(session);
+    session->version_mask = 0;
+    // there's nothing to resume, the channel is opened anew
+    session->subscription_id[0] = '\0';
+    session->subscribed_pool = session->pool;
+    session->sv2_active = true;
+    stratum_tx_set_socket(&session->tx, sock);
+    cleanQueue(GLOBAL_STATE, session);
+
+    StratumApiV1Message message = {};
+    while (sv2_client_receive(client, &message)) {
+        if (message.method == MINING_NOTIFY) {
+            receive_mining_notify(GLOBAL_STATE, session, &message, &connect_start_us);
+        } else if (message.method == MINING_SET_DIFFICULTY) {
+            set_difficulty(session, message.new_difficulty);
+        } else if (message.method == MINING_SET_VERSION_MASK) {
+            session->version_mask = message.version_mask;
+            update_version_mask(GLOBAL_STATE);
+        } else if (message.method == MINING_SET_EXTRANONCE) {
+            ESP_LOGI(TAG, "Set extranonce prefix: %s, extranonce_2 length %d", message.extranonce_str, message.extranonce_2_len);
+            set_extranonce(session, message.extranonce_str, message.extranonce_2_len);
+            free(message.extranonce_str);
+        } else if (message.method == STRATUM_RESULT) {
+            notify_share_result(GLOBAL_STATE, session, &message);
+        } else if (message.method == CLIENT_RECONNECT) {
+            ESP_LOGE(TAG, "Pool requested client reconnect...");
+            break;
+        }
+    }
 
-    STRATUM_V1_initialize_buffer();
-    char host_ip[20];
-    int addr_family = AF_INET;
-    int ip_protocol = IPPROTO_IP;
+    ESP_LOGE(TAG, "Stratum V2 connection to %s:%d ended, reconnecting...", pool->url, pool->port);
+    (*retry_attempts)++;
+    session->sv2_active = false;
+    stratum_close_connection(GLOBAL_STATE, session);
+    sv2_client_disconnect(client);
+}
+
+// Connection of one session. In failover mode it moves through the pool table on repeated failures,
+// in split mode it stays with its pool and the other sessions get its share of the jobs meanwhile.
+static void stratum_session_task(void * pvParameters)
+{
+    stratum_session_params * params = (stratum_session_params *) pvParameters;
+    GlobalState * GLOBAL_STATE = params->GLOBAL_STATE;
+    StratumSession * session = params->session;
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+
+    StratumApiV1Message stratum_api_v1_message = {};
+    char host_ip[INET6_ADDRSTRLEN];
     int retry_attempts = 0;
     int retry_critical_attempts = 0;
 
-    xTaskCreate(stratum_primary_heartbeat, "stratum primary heartbeat", 8192, pvParameters, 1, NULL);
-
-    ESP_LOGI(TAG, "Opening connection to pool: %s:%d", stratum_url, port);
+    ESP_LOGI(TAG, "Opening connection to pool: %s:%d", module->pools[session->pool].url, module->pools[session->pool].port);
     while (1) {
         if (!is_wifi_connected()) {
             ESP_LOGI(TAG, "WiFi disconnected, attempting to reconnect...");
@@ -204,50 +731,44 @@ void stratum_task(void * pvParameters)
             continue;
         }
 
-        if (retry_attempts >= MAX_RETRY_ATTEMPTS)
+        if (retry_attempts >= MAX_RETRY_ATTEMPTS && !module->pool_split)
         {
-            if (GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url == NULL || GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url[0] == '\0') {
+            int next = next_pool(module, module->active_pool);
+            if (next == module->active_pool) {
                 ESP_LOGI(TAG, "Unable to switch to fallback. No url configured. (retries: %d)...", retry_attempts);
-                GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = false;
                 retry_attempts = 0;
                 continue;
             }
 
-            GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = !GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback;
-            
+            module->active_pool = next;
+
             // Reset share stats at failover
-            for (int i = 0; i < GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count; i++) {
-                GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].count = 0;
-                GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].message[0] = '\0';
-            }
-            GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count = 0;
-            GLOBAL_STATE->SYSTEM_MODULE.shares_accepted = 0;
-            GLOBAL_STATE->SYSTEM_MODULE.shares_rejected = 0;
+            reset_share_stats(GLOBAL_STATE, session);
 
             ESP_LOGI(TAG, "Switching target due to too many failures (retries: %d)...", retry_attempts);
             retry_attempts = 0;
         }
 
-        stratum_url = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url : GLOBAL_STATE->SYSTEM_MODULE.pool_url;
-        port = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_port : GLOBAL_STATE->SYSTEM_MODULE.pool_port;
+        if (!module->pool_split) {
+            session->pool = module->active_pool;
+        }
+        PoolConfig * pool = &module->pools[session->pool];
 
-        struct hostent *dns_addr = gethostbyname(stratum_url);
-        if (dns_addr == NULL) {
+        bool resuming = subscription_resumable(GLOBAL_STATE, session);
+        if (!resuming && session->subscription_id[0] != '\0') {
+            ESP_LOGI(TAG, "Subscription %s can't be resumed anymore, dropping its work", session->subscription_id);
+            drop_subscription(GLOBAL_STATE, session);
+        }
+
+        ESP_LOGI(TAG, "Connecting to: %s://%s:%d", pool_scheme(module, session->pool), pool->url, pool->port);
+        int64_t connect_start_us = esp_timer_get_time();
+        int sock = stratum_connect(pool->url, pool->port, module->connect_timeout_ms, host_ip, sizeof(host_ip));
+        if (sock == STRATUM_CONNECT_ERR_DNS) {
             retry_attempts++;
             vTaskDelay(1000 / portTICK_PERIOD_MS);
             continue;
         }
-        inet_ntop(AF_INET, (void *)dns_addr->h_addr_list[0], host_ip, sizeof(host_ip));
-
-        ESP_LOGI(TAG, "Connecting to: stratum+tcp://%s:%d (%s)", stratum_url, port, host_ip);
-
-        struct sockaddr_in dest_addr;
-        dest_addr.sin_addr.s_addr = inet_addr(host_ip);
-        dest_addr.sin_family = AF_INET;
-        dest_addr.sin_port = htons(port);
-
-        GLOBAL_STATE->sock = socket(addr_family, SOCK_STREAM, ip_protocol);
-        if (GLOBAL_STATE->sock < 0) {
+        if (sock == STRATUM_CONNECT_ERR_SOCKET) {
             ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
             if (++retry_critical_attempts > MAX_CRITICAL_RETRY_ATTEMPTS) {
                 ESP_LOGE(TAG, "Max retry attempts reached, restarting...");
@@ -257,112 +778,208 @@ void stratum_task(void * pvParameters)
             continue;
         }
         retry_critical_attempts = 0;
-
-        ESP_LOGI(TAG, "Socket created, connecting to %s:%d", host_ip, port);
-        int err = connect(GLOBAL_STATE->sock, (struct sockaddr *)&dest_addr, sizeof(struct sockaddr_in6));
-        if (err != 0)
-        {
+        if (sock < 0) {
             retry_attempts++;
-            ESP_LOGE(TAG, "Socket unable to connect to %s:%d (errno %d: %s)", stratum_url, port, errno, strerror(errno));
-            // close the socket
-            shutdown(GLOBAL_STATE->sock, SHUT_RDWR);
-            close(GLOBAL_STATE->sock);
+            ESP_LOGE(TAG, "Socket unable to connect to %s:%d (errno %d: %s)", pool->url, pool->port, errno, strerror(errno));
             // instead of restarting, retry this every 5 seconds
             vTaskDelay(5000 / portTICK_PERIOD_MS);
             continue;
         }
+        ESP_LOGI(TAG, "Connected to %s:%d (%s) in %lld ms", pool->url, pool->port, host_ip,
+                 (esp_timer_get_time() - connect_start_us) / 1000);
 
-        if (setsockopt(GLOBAL_STATE->sock, SOL_SOCKET, SO_SNDTIMEO, &tcp_snd_timeout, sizeof(tcp_snd_timeout)) != 0) {
-            ESP_LOGE(TAG, "Fail to setsockopt SO_SNDTIMEO");
+        if (pool_speaks_sv2(module, session->pool)) {
+            stratum_sv2_session(GLOBAL_STATE, session, pool, sock, connect_start_us, &retry_attempts);
+            continue;
         }
-
-        if (setsockopt(GLOBAL_STATE->sock, SOL_SOCKET, SO_RCVTIMEO , &tcp_rcv_timeout, sizeof(tcp_rcv_timeout)) != 0) {
-            ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO ");
+        if (pool_uses_tls(module, session->pool) &&
+            !stratum_tls_start(sock, pool->url, pool->port, module->connect_timeout_ms, NULL)) {
+            retry_attempts++;
+            stratum_socket_close(sock);
+            vTaskDelay(5000 / portTICK_PERIOD_MS);
+            continue;
         }
 
-        stratum_reset_uid(GLOBAL_STATE);
-        cleanQueue(GLOBAL_STATE);
+        set_socket_timeouts(sock, &tcp_liveness_tick);
+        set_socket_keepalive(sock, module->dead_timeout_s);
+        session->sock = sock;
+        stratum_liveness_reset(&session->liveness, esp_timer_get_time());
+
+        line_buffer_reset(&session->rx_buffer);
+        stratum_tx_set_socket(&session->tx, sock);
+        stratum_tx_set_capture(&session->tx, GLOBAL_STATE->stratum_capture, session - GLOBAL_STATE->sessions);
+        share_tracker_reset(&session->share_tracker);
+        stratum_reset_uid(session);
+        session->version_mask = 0;
+        if (!resuming) {
+            cleanQueue(GLOBAL_STATE, session);
+        }
 
         ///// Start Stratum Action
         // mining.configure - ID: 1
-        STRATUM_V1_configure_version_rolling(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++, &GLOBAL_STATE->version_mask);
+        STRATUM_V1_configure_version_rolling(&session->tx, atomic_fetch_add(&session->send_uid, 1), &session->version_mask);
 
         // mining.subscribe - ID: 2
-        STRATUM_V1_subscribe(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
-
-        char * username = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
-        char * password = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_pass : GLOBAL_STATE->SYSTEM_MODULE.pool_pass;
+        STRATUM_V1_subscribe(&session->tx, atomic_fetch_add(&session->send_uid, 1), GLOBAL_STATE->DEVICE_CONFIG.family.asic.name,
+                             resuming ? session->subscription_id : NULL);
 
         //mining.authorize - ID: 3
-        STRATUM_V1_authenticate(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++, username, password);
+        STRATUM_V1_authenticate(&session->tx, atomic_fetch_add(&session->send_uid, 1), pool->user, pool->pass);
 
         //mining.suggest_difficulty - ID: 4
-        STRATUM_V1_suggest_difficulty(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++, STRATUM_DIFFICULTY);
+        stratum_vardiff_reset(&session->vardiff);
+        suggest_difficulty(GLOBAL_STATE, session);
 
-        // Everything is set up, lets make sure we don't abandon work unnecessarily.
-        GLOBAL_STATE->abandon_work = 0;
+        //mining.extranonce.subscribe - ID: 5
+        STRATUM_V1_extranonce_subscribe(&session->tx, atomic_fetch_add(&session->send_uid, 1));
 
         while (1) {
-            char * line = STRATUM_V1_receive_jsonrpc_line(GLOBAL_STATE->sock);
+            const char * line = STRATUM_V1_receive_jsonrpc_line(&session->rx_buffer, session->sock);
             if (!line) {
+                // a receive timeout only means the pool was quiet for a moment
+                if ((errno == EAGAIN || errno == EWOULDBLOCK) && stratum_session_alive(session)) {
+                    continue;
+                }
+                if (!module->pool_split && stratum_adopt_standby(GLOBAL_STATE, session)) {
+                    retry_attempts = 0;
+                    continue;
+                }
                 ESP_LOGE(TAG, "Failed to receive JSON-RPC line, reconnecting...");
                 retry_attempts++;
-                stratum_close_connection(GLOBAL_STATE);
+                stratum_close_connection(GLOBAL_STATE, session);
                 break;
             }
 
+            int64_t received_us = esp_timer_get_time();
+            if (GLOBAL_STATE->stratum_capture != NULL) {
+                stratum_capture_line(GLOBAL_STATE->stratum_capture, received_us, session - GLOBAL_STATE->sessions, false, line,
+                                     strlen(line));
+            }
             ESP_LOGI(TAG, "rx: %s", line); // debug incoming stratum messages
             STRATUM_V1_parse(&stratum_api_v1_message, line);
-            free(line);
+            stratum_liveness_received(&session->liveness, received_us, stratum_api_v1_message.method == MINING_NOTIFY);
 
             if (stratum_api_v1_message.method == MINING_NOTIFY) {
-                SYSTEM_notify_new_ntime(GLOBAL_STATE, stratum_api_v1_message.mining_notification->ntime);
-                if (stratum_api_v1_message.should_abandon_work &&
-                    (GLOBAL_STATE->stratum_queue.count > 0 || GLOBAL_STATE->ASIC_jobs_queue.count > 0)) {
-                    cleanQueue(GLOBAL_STATE);
-                }
-                if (GLOBAL_STATE->stratum_queue.count == QUEUE_SIZE) {
-                    mining_notify * next_notify_json_str = (mining_notify *) queue_dequeue(&GLOBAL_STATE->stratum_queue);
-                    STRATUM_V1_free_mining_notify(next_notify_json_str);
-                }
-                stratum_api_v1_message.mining_notification->difficulty = SYSTEM_TASK_MODULE.stratum_difficulty;
-                queue_enqueue(&GLOBAL_STATE->stratum_queue, stratum_api_v1_message.mining_notification);
+                receive_mining_notify(GLOBAL_STATE, session, &stratum_api_v1_message, &connect_start_us);
+                // notifies come at least every minute, often enough to follow the hashrate
+                suggest_difficulty(GLOBAL_STATE, session);
             } else if (stratum_api_v1_message.method == MINING_SET_DIFFICULTY) {
-                if (stratum_api_v1_message.new_difficulty != SYSTEM_TASK_MODULE.stratum_difficulty) {
-                    SYSTEM_TASK_MODULE.stratum_difficulty = stratum_api_v1_message.new_difficulty;
-                    ESP_LOGI(TAG, "Set stratum difficulty: %ld", SYSTEM_TASK_MODULE.stratum_difficulty);
-                }
+                set_difficulty(session, stratum_api_v1_message.new_difficulty);
             } else if (stratum_api_v1_message.method == MINING_SET_VERSION_MASK ||
                     stratum_api_v1_message.method == STRATUM_RESULT_VERSION_MASK) {
                 // 1fffe000
-                ESP_LOGI(TAG, "Set version mask: %08lx", stratum_api_v1_message.version_mask);
-                GLOBAL_STATE->version_mask = stratum_api_v1_message.version_mask;
-                GLOBAL_STATE->new_stratum_version_rolling_msg = true;
+                session->version_mask = stratum_api_v1_message.version_mask;
+                update_version_mask(GLOBAL_STATE);
             } else if (stratum_api_v1_message.method == STRATUM_RESULT_SUBSCRIBE) {
-                GLOBAL_STATE->extranonce_str = stratum_api_v1_message.extranonce_str;
-                GLOBAL_STATE->extranonce_2_len = stratum_api_v1_message.extranonce_2_len;
+                // a resumed subscription keeps its extranonce, the jobs on the ASIC stay valid
+                bool resumed = resuming && strcmp(stratum_api_v1_message.extranonce_str, session->extranonce_str) == 0 &&
+                               stratum_api_v1_message.extranonce_2_len == session->extranonce_2_len;
+                if (resumed) {
+                    ESP_LOGI(TAG, "Resumed subscription %s, continuing with the current work", session->subscription_id);
+                } else {
+                    set_extranonce(session, stratum_api_v1_message.extranonce_str, stratum_api_v1_message.extranonce_2_len);
+                    if (resuming) {
+                        ESP_LOGI(TAG, "Pool started a new subscription, dropping the work of %s", session->subscription_id);
+                        cleanQueue(GLOBAL_STATE, session);
+                    }
+                }
+                resuming = false;
+                free(stratum_api_v1_message.extranonce_str);
+                stratum_api_v1_message.extranonce_str = NULL;
+                strcpy(session->subscription_id, stratum_api_v1_message.subscription_id);
+                session->subscribed_pool = session->pool;
+            } else if (stratum_api_v1_message.method == MINING_SET_EXTRANONCE) {
+                ESP_LOGI(TAG, "Set extranonce: %s, extranonce_2 length %d", stratum_api_v1_message.extranonce_str,
+                         stratum_api_v1_message.extranonce_2_len);
+                set_extranonce(session, stratum_api_v1_message.extranonce_str, stratum_api_v1_message.extranonce_2_len);
+                free(stratum_api_v1_message.extranonce_str);
+                stratum_api_v1_message.extranonce_str = NULL;
             } else if (stratum_api_v1_message.method == CLIENT_RECONNECT) {
                 ESP_LOGE(TAG, "Pool requested client reconnect...");
-                stratum_close_connection(GLOBAL_STATE);
+                stratum_close_connection(GLOBAL_STATE, session);
                 break;
-            } else if (stratum_api_v1_message.method == STRATUM_RESULT) {
-                if (stratum_api_v1_message.response_success) {
+            } else if (stratum_api_v1_message.method == STRATUM_RESULT || stratum_api_v1_message.method == STRATUM_RESULT_SETUP) {
+                // any answer to a probe will do, pools without mining.ping reject it
+                if (session->liveness.probe_uid != 0 && stratum_api_v1_message.message_id == session->liveness.probe_uid) {
+                    ESP_LOGD(TAG, "Pool answered the connection probe");
+                    continue;
+                }
+                // shares are recognized by their id, the parser only guesses setup responses from its value
+                if (notify_share_result(GLOBAL_STATE, session, &stratum_api_v1_message)) {
+                    continue;
+                }
+                if (stratum_api_v1_message.method == STRATUM_RESULT_SETUP) {
+                    // Reset retry attempts after successfully receiving data.
+                    retry_attempts = 0;
+                    if (stratum_api_v1_message.response_success) {
+                        ESP_LOGI(TAG, "setup message accepted");
+                    } else {
+                        ESP_LOGE(TAG, "setup message rejected: %s", stratum_api_v1_message.error_str);
+                        if (resuming && stratum_api_v1_message.message_id == STRATUM_ID_SUBSCRIBE) {
+                            ESP_LOGW(TAG, "Pool refused to resume subscription %s, subscribing again", session->subscription_id);
+                            // closing drops the work of the subscription
+                            session->subscription_id[0] = '\0';
+                            stratum_close_connection(GLOBAL_STATE, session);
+                            break;
+                        }
+                    }
+                } else if (stratum_api_v1_message.response_success) {
                     ESP_LOGI(TAG, "message result accepted");
-                    SYSTEM_notify_accepted_share(GLOBAL_STATE);
                 } else {
                     ESP_LOGW(TAG, "message result rejected: %s", stratum_api_v1_message.error_str);
-                    SYSTEM_notify_rejected_share(GLOBAL_STATE, stratum_api_v1_message.error_str);
-                }
-            } else if (stratum_api_v1_message.method == STRATUM_RESULT_SETUP) {
-                // Reset retry attempts after successfully receiving data.
-                retry_attempts = 0;
-                if (stratum_api_v1_message.response_success) {
-                    ESP_LOGI(TAG, "setup message accepted");
-                } else {
-                    ESP_LOGE(TAG, "setup message rejected: %s", stratum_api_v1_message.error_str);
                 }
             }
         }
     }
     vTaskDelete(NULL);
 }
+
+void stratum_task(void * pvParameters)
+{
+    GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+
+    bool tls = false;
+    for (int i = 0; i < MAX_POOLS; i++) {
+        tls |= pool_uses_tls(module, i);
+    }
+    // the record buffers of every connection go to PSRAM if there is some
+    if (tls && !stratum_tls_init(NULL, GLOBAL_STATE->psram_is_available)) {
+        ESP_LOGE(TAG, "Failed to set up TLS, stratum+ssl pools won't connect");
+    }
+
+    if (module->stratum_capture_kb > 0) {
+        if (stratum_capture_init(&capture, module->stratum_capture_kb * 1024, GLOBAL_STATE->psram_is_available)) {
+            ESP_LOGI(TAG, "Capturing the stratum lines in %u KB", module->stratum_capture_kb);
+            GLOBAL_STATE->stratum_capture = &capture;
+        }
+    }
+
+    for (int i = 0; i < GLOBAL_STATE->session_count; i++) {
+        session_params[i].GLOBAL_STATE = GLOBAL_STATE;
+        session_params[i].session = &GLOBAL_STATE->sessions[i];
+        xTaskCreate(stratum_tx_task, "stratum tx", 4096, &GLOBAL_STATE->sessions[i].tx, 10, NULL);
+    }
+
+    if (module->pool_split) {
+        // the first session runs in this task
+        for (int i = 1; i < GLOBAL_STATE->session_count; i++) {
+            xTaskCreate(stratum_session_task, "stratum session", 8192, &session_params[i], 5, NULL);
+        }
+    } else {
+        xTaskCreate(stratum_primary_heartbeat, "stratum primary heartbeat", 8192, pvParameters, 1, NULL);
+
+        // the standby speaks Stratum V1 and is adopted by the V1 receive loop
+        if (module->fallback_hot_standby && pool_configured(module, 1) && !pool_speaks_sv2(module, 0) &&
+            !pool_speaks_sv2(module, 1)) {
+            if (stratum_standby_init(&fallback_standby)) {
+                fallback_standby_enabled = true;
+                xTaskCreate(stratum_standby_task, "stratum standby", 8192, pvParameters, 5, NULL);
+            } else {
+                ESP_LOGE(TAG, "Failed to allocate the standby connection");
+            }
+        }
+    }
+
+    stratum_session_task(&session_params[0]);
+}
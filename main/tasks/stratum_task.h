@@ -1,12 +1,12 @@
 #ifndef STRATUM_TASK_H_
 #define STRATUM_TASK_H_
 
-typedef struct
-{
-    uint32_t stratum_difficulty;
-} SystemTaskModule;
+// must be a power of two, holds a burst of shares with long worker names
+#define STRATUM_TX_BUFFER_SIZE 4096
 
+/// @brief Sets up one session per pool in split mode, a single failover session otherwise.
+bool stratum_init_sessions(GlobalState * GLOBAL_STATE);
 void stratum_task(void *pvParameters);
-void stratum_close_connection(GlobalState * GLOBAL_STATE);
+void stratum_close_connection(GlobalState * GLOBAL_STATE, StratumSession * session);
 
 #endif
\ No newline at end of file